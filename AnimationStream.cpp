@@ -0,0 +1,297 @@
+#include "AnimationStream.h"
+
+#include "PixelKernel.h"
+
+#include <stdexcept>
+
+namespace Render
+{
+    AnimationStream::AnimationStream()
+        : m_file()
+        , m_decoder()
+        , m_count(0)
+        , m_size()
+        , m_budget(0)
+        , m_decodeLock()
+        , m_canvas()
+        , m_lock()
+        , m_wake()
+        , m_ready()
+        , m_slots()
+        , m_current(0)
+        , m_stop(false)
+        , m_worker()
+    {
+
+    }
+
+    AnimationStream::~AnimationStream()
+    {
+        Stop();
+        Release();
+        m_canvas.Clean();
+    }
+
+    AnimationStream *AnimationStream::Create(std::vector<BYTE>& file, SIZE_T budget)
+    {
+        AnimationStream *stream = new AnimationStream();
+        stream->m_file.swap(file);
+
+        if (stream->m_file.empty() || !stream->m_decoder.Open(&stream->m_file[0], stream->m_file.size()))
+        {
+            stream->m_file.swap(file);
+            delete stream;
+            return NULL;
+        }
+
+        stream->m_count = stream->m_decoder.GetFrameCount();
+        stream->m_size = stream->m_decoder.GetCanvasSize();
+        stream->m_budget = budget;
+
+        if (!Image::Allocate(&stream->m_canvas, stream->m_size) || !stream->Allocate())
+        {
+            delete stream;
+            return NULL;
+        }
+
+        stream->Start();
+        return stream;
+    }
+
+    UINT AnimationStream::GetFrameDelay(UINT index) const
+    {
+        if (index >= m_count)
+            throw std::out_of_range("AnimationStream frame");
+
+        return max(1u, m_decoder.GetFrame(index).delay);
+    }
+
+    bool AnimationStream::Allocate()
+    {
+        //! the canvas counts against the budget too
+        SIZE_T frameBytes = (SIZE_T)m_size.cx * 4 * m_size.cy;
+        SIZE_T count = m_budget / frameBytes;
+        count = min(max(count, (SIZE_T)3) - 1, (SIZE_T)m_count);
+        count = max(count, (SIZE_T)min(2u, m_count));
+
+        m_slots.resize(count);
+        for (size_t i = 0; i != m_slots.size(); ++i)
+        {
+            Slot& slot = m_slots[i];
+            slot.frame = slot.pending = -1;
+            if (!Image::Allocate(&slot.image, m_size))
+            {
+                Release();
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void AnimationStream::Release()
+    {
+        for (size_t i = 0; i != m_slots.size(); ++i)
+            m_slots[i].image.Clean();
+        m_slots.clear();
+    }
+
+    void AnimationStream::Start()
+    {
+        m_stop = false;
+        m_worker = std::thread(&AnimationStream::WorkerLoop, this);
+    }
+
+    void AnimationStream::Stop()
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_stop = true;
+        }
+
+        m_wake.notify_all();
+        if (m_worker.joinable())
+            m_worker.join();
+    }
+
+    void AnimationStream::SetSize(const SIZE& size)
+    {
+        if (size.cx <= 0 || size.cy <= 0)
+            return;
+        if (size.cx == m_size.cx && size.cy == m_size.cy)
+            return;
+
+        Stop();
+
+        SIZE old = m_size;
+        Release();
+        m_size = size;
+        if (!Allocate())
+        {
+            m_size = old;
+            Allocate();
+        }
+
+        Start();
+    }
+
+    UINT AnimationStream::Distance(UINT frame) const
+    {
+        return (frame + m_count - m_current) % m_count;
+    }
+
+    INT AnimationStream::FindSlot(UINT frame) const
+    {
+        for (size_t i = 0; i != m_slots.size(); ++i)
+        {
+            if ((INT)frame == m_slots[i].frame)
+                return (INT)i;
+        }
+
+        return -1;
+    }
+
+    INT AnimationStream::PickSlot(bool outside) const
+    {
+        INT best = -1;
+        UINT bestDistance = 0;
+
+        for (size_t i = 0; i != m_slots.size(); ++i)
+        {
+            const Slot& slot = m_slots[i];
+            if (slot.pending >= 0)
+                continue;
+            if (slot.frame < 0)
+                return (INT)i;
+
+            UINT distance = Distance(slot.frame);
+            if (outside && distance < m_slots.size())
+                continue;
+
+            if (best < 0 || distance > bestDistance)
+            {
+                best = (INT)i;
+                bestDistance = distance;
+            }
+        }
+
+        return best;
+    }
+
+    void AnimationStream::DecodeSlot(UINT slot, UINT frame)
+    {
+        //! the canvas holds frame GetNextIndex() - 1, an earlier one replays from the start
+        if (m_decoder.GetNextIndex() > frame + 1)
+            m_decoder.Rewind();
+
+        while (m_decoder.GetNextIndex() <= frame)
+            m_decoder.Next(m_canvas.GetOffset(0, 0), m_canvas.GetStride());
+
+        Image& image = m_slots[slot].image;
+        if (image.GetWidth() == m_canvas.GetWidth() && image.GetHeight() == m_canvas.GetHeight())
+        {
+            Pixel::Copy(image.GetOffset(0, 0), image.GetStride(), m_canvas.GetOffset(0, 0), m_canvas.GetStride(),
+                m_canvas.GetWidth(), m_canvas.GetHeight());
+        }
+        else
+        {
+            RECT part = { 0, 0, image.GetWidth(), image.GetHeight() };
+            Pixel::Resample(Pixel::FilterBilinear, image.GetOffset(0, 0), image.GetStride(), part, image.GetWidth(), image.GetHeight(),
+                m_canvas.GetOffset(0, 0), m_canvas.GetStride(), m_canvas.GetWidth(), m_canvas.GetHeight());
+        }
+
+        image.SetAlphaMode(Image::AlphaPremultiplied);
+        image.Invalidate();
+    }
+
+    Image AnimationStream::GetFrame(UINT index)
+    {
+        if (index >= m_count)
+            throw std::out_of_range("AnimationStream frame");
+
+        std::unique_lock<std::mutex> lock(m_lock);
+
+        if (m_current != index)
+        {
+            m_current = index;
+            m_wake.notify_one();
+        }
+
+        for (;;)
+        {
+            INT found = FindSlot(index);
+            if (found >= 0)
+                return m_slots[found].image;
+
+            bool pending = false;
+            for (size_t i = 0; i != m_slots.size(); ++i)
+                pending |= (INT)index == m_slots[i].pending;
+
+            if (!pending)
+                break;
+
+            m_ready.wait(lock);
+        }
+
+        //! at most the worker's slot is busy and there are 2 at least
+        INT slot = PickSlot(false);
+        m_slots[slot].frame = -1;
+        m_slots[slot].pending = (INT)index;
+        lock.unlock();
+
+        {
+            std::lock_guard<std::mutex> guard(m_decodeLock);
+            DecodeSlot(slot, index);
+        }
+
+        lock.lock();
+        m_slots[slot].frame = (INT)index;
+        m_slots[slot].pending = -1;
+        m_ready.notify_all();
+        m_wake.notify_one();
+
+        return m_slots[slot].image;
+    }
+
+    void AnimationStream::WorkerLoop()
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+
+        while (!m_stop)
+        {
+            //! the nearest frame ahead without a slot, decoding forward keeps the replay short
+            INT frame = -1;
+            for (UINT d = 1; d < m_slots.size() && frame < 0; ++d)
+            {
+                UINT next = (m_current + d) % m_count;
+                bool pending = false;
+                for (size_t i = 0; i != m_slots.size(); ++i)
+                    pending |= (INT)next == m_slots[i].pending;
+
+                if (FindSlot(next) < 0 && !pending)
+                    frame = (INT)next;
+            }
+
+            INT slot = frame >= 0 ? PickSlot(true) : -1;
+            if (slot < 0)
+            {
+                m_wake.wait(lock);
+                continue;
+            }
+
+            m_slots[slot].frame = -1;
+            m_slots[slot].pending = frame;
+            lock.unlock();
+
+            {
+                std::lock_guard<std::mutex> guard(m_decodeLock);
+                DecodeSlot(slot, frame);
+            }
+
+            lock.lock();
+            m_slots[slot].frame = frame;
+            m_slots[slot].pending = -1;
+            m_ready.notify_all();
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Image.h"
+#include "ImageCodec.h"
+
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+namespace Render
+{
+    //! a GIF decoded a few frames at a time: a ring of slots follows the playback position
+    //! and a worker thread decodes the frames after it while the current one is shown
+    //! frames are composited in order, so going back replays from frame 0; looping plays on
+    class AnimationStream
+    {
+    private:
+        struct Slot
+        {
+            Image image;
+            INT frame;          //! decoded frame, -1 for none
+            INT pending;        //! frame being decoded into it, -1 for none
+        };
+
+    private:
+        std::vector<BYTE> m_file;
+        Codec::GifDecoder m_decoder;
+        UINT m_count;
+        SIZE m_size;                //! what the frames come out at
+        SIZE_T m_budget;
+
+        //! the decoder and the canvas it composites on, held for a whole decode
+        std::mutex m_decodeLock;
+        Image m_canvas;
+
+        //! the slots and the window
+        std::mutex m_lock;
+        std::condition_variable m_wake;
+        std::condition_variable m_ready;
+        std::vector<Slot> m_slots;
+        UINT m_current;
+        bool m_stop;
+        std::thread m_worker;
+
+    public:
+        //! takes the file's bytes, NULL when they are not a GIF
+        //! budget bounds the decoded frames kept, the ring holds 2 frames at least
+        static AnimationStream *Create(std::vector<BYTE>& file, SIZE_T budget);
+        ~AnimationStream();
+
+    public:
+        UINT GetFrameCount() const { return m_count; }
+        //! 1/100 s, 0 in the file reads as 1
+        UINT GetFrameDelay(UINT index) const;
+        SIZE GetSize() const { return m_size; }
+
+        //! the frame from its slot, decoded now when the worker has not got to it yet
+        //! stays valid until another frame is asked for, the slot is reused after that
+        Image GetFrame(UINT index);
+
+        //! frames come out at size from now on, the decoded ones are dropped
+        void SetSize(const SIZE& size);
+
+    private:
+        AnimationStream();
+
+        bool Allocate();
+        void Release();
+        void Start();
+        void Stop();
+
+        //! how far frame is after the current one, wrapping at the end
+        UINT Distance(UINT frame) const;
+        INT FindSlot(UINT frame) const;
+        //! an idle slot to decode into: empty, else the one furthest from the current frame
+        //! outside: only slots outside the window, the worker must not take the ones ahead
+        INT PickSlot(bool outside) const;
+        //! m_decodeLock held
+        void DecodeSlot(UINT slot, UINT frame);
+        void WorkerLoop();
+
+    private:
+        AnimationStream(const AnimationStream&);
+        AnimationStream& operator = (const AnimationStream&);
+    };
+}
\ No newline at end of file
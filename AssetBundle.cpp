@@ -0,0 +1,452 @@
+#include "AssetBundle.h"
+
+#include "Image.h"
+#include "ImageCodec.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Render
+{
+    //! little endian: header, assets, frames, names as utf-16, then every frame's rows at 64 byte boundaries
+    struct BundleHeader
+    {
+        char magic[8];
+        UINT version;
+        UINT assetCount;
+        UINT frameCount;
+        UINT namesLength;       //! utf-16 units
+        ULONGLONG fileSize;
+    };
+
+    static const char s_bundleMagic[8] = { 'S', 'C', 'B', 'U', 'N', 'D', 'L', 'E' };
+    enum { BundleVersion = 1, BundleAlign = 64 };
+
+    static_assert(sizeof(BundleHeader) == 32, "bundle header layout");
+    static_assert(sizeof(AssetBundle::Asset) == 24, "bundle asset layout");
+    static_assert(sizeof(AssetBundle::Frame) == 16, "bundle frame layout");
+
+    static ULONGLONG AlignBundle(ULONGLONG offset)
+    {
+        return (offset + BundleAlign - 1) & ~(ULONGLONG)(BundleAlign - 1);
+    }
+
+    static void SetBitmapInfo(BITMAPINFO *info, LONG width, LONG height)
+    {
+        ::memset(info, 0, sizeof(BITMAPINFO));
+
+        info->bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        info->bmiHeader.biWidth = width;
+        info->bmiHeader.biHeight = -height;
+        info->bmiHeader.biPlanes = 1;
+        info->bmiHeader.biBitCount = 32;
+        info->bmiHeader.biCompression = BI_RGB;
+    }
+
+    //! names are utf-16 in the file whatever wchar_t is
+    static void AppendUtf16(std::vector<WORD>& out, const String& text)
+    {
+        for (size_t i = 0; i != text.size(); ++i)
+        {
+            UINT c = (UINT)text[i];
+            if (c >= 0x10000)
+            {
+                c -= 0x10000;
+                out.push_back((WORD)(0xD800 | (c >> 10)));
+                out.push_back((WORD)(0xDC00 | (c & 0x3FF)));
+            }
+            else
+            {
+                out.push_back((WORD)c);
+            }
+        }
+    }
+
+    static String FromUtf16(const WORD *text, UINT length)
+    {
+        String out;
+        for (UINT i = 0; i != length; ++i)
+        {
+            UINT c = text[i];
+#if !defined(_WIN32)
+            //! wchar_t holds whole code points off Windows
+            if (c >= 0xD800 && c < 0xDC00 && i + 1 != length && text[i + 1] >= 0xDC00 && text[i + 1] < 0xE000)
+                c = 0x10000 + ((c - 0xD800) << 10) + (text[++i] - 0xDC00);
+#endif
+            out += (WCHAR)c;
+        }
+
+        return out;
+    }
+
+    AssetBundle::AssetBundle()
+        : m_base(NULL)
+        , m_size(0)
+        , m_assets(NULL)
+        , m_frames(NULL)
+        , m_index()
+#if defined(_WIN32)
+        , m_mapping(NULL)
+        , m_lock()
+        , m_bitmaps()
+#endif
+    {
+
+    }
+
+    AssetBundle::~AssetBundle()
+    {
+#if defined(_WIN32)
+        for (size_t i = 0; i != m_bitmaps.size(); ++i)
+        {
+            if (m_bitmaps[i])
+                ::DeleteObject(m_bitmaps[i]);
+        }
+
+        if (m_base)
+            ::UnmapViewOfFile(m_base);
+        if (m_mapping)
+            ::CloseHandle(m_mapping);
+#else
+        if (m_base)
+            ::munmap(m_base, (size_t)m_size);
+#endif
+    }
+
+    AssetBundle *AssetBundle::Open(const String& path)
+    {
+        AssetBundle *bundle = new AssetBundle();
+
+#if defined(_WIN32)
+        HANDLE file = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (INVALID_HANDLE_VALUE != file)
+        {
+            LARGE_INTEGER size;
+            if (::GetFileSizeEx(file, &size) && size.QuadPart > 0)
+            {
+                //! copy on write, an image written to gets its own pages
+                bundle->m_mapping = ::CreateFileMappingW(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+                if (bundle->m_mapping)
+                {
+                    bundle->m_base = (PBYTE)::MapViewOfFile(bundle->m_mapping, FILE_MAP_COPY, 0, 0, 0);
+                    bundle->m_size = (ULONGLONG)size.QuadPart;
+                }
+            }
+
+            ::CloseHandle(file);
+        }
+#else
+        int file = ::open(Codec::NarrowPath(path).c_str(), O_RDONLY);
+        if (file >= 0)
+        {
+            struct stat st;
+            if (0 == ::fstat(file, &st) && st.st_size > 0)
+            {
+                //! copy on write, an image written to gets its own pages
+                void *base = ::mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+                if (MAP_FAILED != base)
+                {
+                    bundle->m_base = (PBYTE)base;
+                    bundle->m_size = (ULONGLONG)st.st_size;
+                }
+            }
+
+            ::close(file);
+        }
+#endif
+
+        if (!bundle->m_base || !bundle->Index())
+        {
+            delete bundle;
+            return NULL;
+        }
+
+        return bundle;
+    }
+
+    bool AssetBundle::Index()
+    {
+        if (m_size < sizeof(BundleHeader))
+            return false;
+
+        const BundleHeader *header = (const BundleHeader *)m_base;
+        if (0 != ::memcmp(header->magic, s_bundleMagic, sizeof(s_bundleMagic)) || BundleVersion != header->version)
+            return false;
+        if (header->fileSize != m_size)
+            return false;
+
+        ULONGLONG frames = sizeof(BundleHeader) + (ULONGLONG)header->assetCount * sizeof(Asset);
+        ULONGLONG names = frames + (ULONGLONG)header->frameCount * sizeof(Frame);
+        if (names + (ULONGLONG)header->namesLength * sizeof(WORD) > m_size)
+            return false;
+
+        m_assets = (const Asset *)(m_base + sizeof(BundleHeader));
+        m_frames = (const Frame *)(m_base + frames);
+        const WORD *text = (const WORD *)(m_base + names);
+
+        //! a bundle is trusted no further than the decoders trust their files
+        for (UINT i = 0; i != header->assetCount; ++i)
+        {
+            const Asset& asset = m_assets[i];
+            if (asset.width <= 0 || asset.height <= 0 || asset.width > (1 << 24) || asset.height > (1 << 24))
+                return false;
+            if ((ULONGLONG)asset.nameOffset + asset.nameLength > header->namesLength)
+                return false;
+            if (!asset.frameCount || (ULONGLONG)asset.firstFrame + asset.frameCount > header->frameCount)
+                return false;
+
+            ULONGLONG bytes = (ULONGLONG)asset.width * 4 * asset.height;
+            for (UINT f = 0; f != asset.frameCount; ++f)
+            {
+                const Frame& frame = m_frames[asset.firstFrame + f];
+                if (frame.pixels % BundleAlign || frame.pixels > m_size || m_size - frame.pixels < bytes)
+                    return false;
+                if (frame.alphaMode > Image::AlphaPremultiplied)
+                    return false;
+            }
+
+            m_index[FromUtf16(text + asset.nameOffset, asset.nameLength)] = i;
+        }
+
+#if defined(_WIN32)
+        m_bitmaps.resize(header->frameCount, NULL);
+#endif
+
+        return true;
+    }
+
+    bool AssetBundle::Contains(const String& name) const
+    {
+        return m_index.end() != m_index.find(name);
+    }
+
+    bool AssetBundle::BorrowFrame(UINT index, LONG width, LONG height, Image *nullImage)
+    {
+        const Frame& frame = m_frames[index];
+        PBYTE pixels = m_base + frame.pixels;
+
+        BITMAPINFO info;
+        SetBitmapInfo(&info, width, height);
+
+#if defined(_WIN32)
+        HBITMAP bitmap = NULL;
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+
+            bitmap = m_bitmaps[index];
+            if (!bitmap)
+            {
+                //! a dib over the section shares the file's pages, when gdi turns it down a copy still works
+                PVOID bits = NULL;
+                if (frame.pixels <= 0xFFFFFFFF)
+                    bitmap = ::CreateDIBSection(NULL, &info, DIB_RGB_COLORS, &bits, m_mapping, (DWORD)frame.pixels);
+
+                if (!bitmap)
+                {
+                    bitmap = ::CreateDIBSection(NULL, &info, DIB_RGB_COLORS, &bits, NULL, 0);
+                    if (!bitmap)
+                        return false;
+
+                    ::memcpy(bits, pixels, (SIZE_T)width * 4 * height);
+                }
+
+                m_bitmaps[index] = bitmap;
+            }
+        }
+
+        DIBSECTION section;
+        if (!::GetObject(bitmap, sizeof(DIBSECTION), &section))
+            return false;
+        pixels = (PBYTE)section.dsBm.bmBits;
+#else
+        //! without gdi the handle is the pixel block itself
+        HBITMAP bitmap = (HBITMAP)pixels;
+#endif
+
+        if (!Image::Borrow(nullImage, pixels, bitmap, info))
+            return false;
+
+        nullImage->SetAlphaMode((Image::AlphaMode)frame.alphaMode, 0 != frame.opaque);
+        return true;
+    }
+
+    RefImageResource *AssetBundle::CreateImage(const String& name)
+    {
+        std::unordered_map<String, UINT>::const_iterator found = m_index.find(name);
+        if (m_index.end() == found)
+            return NULL;
+
+        const Asset& asset = m_assets[found->second];
+
+        RefImageResource *image = new RefImageResource();
+        if (!BorrowFrame(asset.firstFrame, asset.width, asset.height, image))
+        {
+            delete image;
+            return NULL;
+        }
+
+        return image;
+    }
+
+    AnimationImageSet *AssetBundle::CreateAnimation(const String& name)
+    {
+        std::unordered_map<String, UINT>::const_iterator found = m_index.find(name);
+        if (m_index.end() == found)
+            return NULL;
+
+        const Asset& asset = m_assets[found->second];
+
+        AnimationImageSet *set = new AnimationImageSet();
+        for (UINT i = 0; i != asset.frameCount; ++i)
+        {
+            AnimationImageSet::Frame frame = { Image(), max(1u, m_frames[asset.firstFrame + i].delay), { 0, 0, asset.width, asset.height }, false };
+            if (!BorrowFrame(asset.firstFrame + i, asset.width, asset.height, &frame.image))
+            {
+                delete set;
+                return NULL;
+            }
+
+            frame.opaque = frame.image.IsOpaque();
+
+            set->m_frames.push_back(frame);
+        }
+
+        return set;
+    }
+
+    AssetBundleWriter::AssetBundleWriter()
+        : m_entries()
+    {
+
+    }
+
+    AssetBundleWriter::~AssetBundleWriter()
+    {
+        for (size_t i = 0; i != m_entries.size(); ++i)
+            m_entries[i].frames->Release();
+    }
+
+    bool AssetBundleWriter::Add(const String& name, const String& path)
+    {
+        AnimationImageSet *frames = AnimationImageSet::Create(path);
+        if (!frames)
+            return false;
+
+        frames->AddRef();
+
+        for (size_t i = 0; i != m_entries.size(); ++i)
+        {
+            if (m_entries[i].name == name)
+            {
+                m_entries[i].frames->Release();
+                m_entries[i].frames = frames;
+                return true;
+            }
+        }
+
+        Entry entry = { name, frames };
+        m_entries.push_back(entry);
+        return true;
+    }
+
+    //! zeros from offset up to end
+    static bool PadFile(FILE *file, ULONGLONG offset, ULONGLONG end)
+    {
+        static const BYTE zeros[BundleAlign] = { 0 };
+        for (; offset < end; offset += min(end - offset, (ULONGLONG)BundleAlign))
+        {
+            if (1 != ::fwrite(zeros, (size_t)min(end - offset, (ULONGLONG)BundleAlign), 1, file))
+                return false;
+        }
+
+        return true;
+    }
+
+    bool AssetBundleWriter::Write(const String& path) const
+    {
+        std::vector<AssetBundle::Asset> assets;
+        std::vector<AssetBundle::Frame> frames;
+        std::vector<WORD> names;
+
+        for (size_t i = 0; i != m_entries.size(); ++i)
+        {
+            const AnimationImageSet *set = m_entries[i].frames;
+            SIZE size = set->GetFrameAt(0).GetSize();
+
+            AssetBundle::Asset asset = { (UINT)names.size(), 0, size.cx, size.cy, (UINT)frames.size(), (UINT)set->GetFramesCount() };
+            AppendUtf16(names, m_entries[i].name);
+            asset.nameLength = (UINT)names.size() - asset.nameOffset;
+            assets.push_back(asset);
+
+            for (INT f = 0; f != set->GetFramesCount(); ++f)
+            {
+                Image image = set->GetFrameAt(f);
+                if (image.GetWidth() != size.cx || image.GetHeight() != size.cy)
+                    return false;
+
+                AssetBundle::Frame frame = { 0, (UINT)set->GetFrameDelay(f), (BYTE)image.GetAlphaMode(), (BYTE)image.IsOpaque(), 0 };
+                frames.push_back(frame);
+            }
+        }
+
+        BundleHeader header;
+        ::memcpy(header.magic, s_bundleMagic, sizeof(s_bundleMagic));
+        header.version = BundleVersion;
+        header.assetCount = (UINT)assets.size();
+        header.frameCount = (UINT)frames.size();
+        header.namesLength = (UINT)names.size();
+
+        ULONGLONG index = sizeof(BundleHeader) + assets.size() * sizeof(AssetBundle::Asset)
+            + frames.size() * sizeof(AssetBundle::Frame) + names.size() * sizeof(WORD);
+        ULONGLONG offset = AlignBundle(index);
+
+        for (size_t i = 0; i != assets.size(); ++i)
+        {
+            ULONGLONG bytes = (ULONGLONG)assets[i].width * 4 * assets[i].height;
+            for (UINT f = 0; f != assets[i].frameCount; ++f)
+            {
+                frames[assets[i].firstFrame + f].pixels = offset;
+                offset = AlignBundle(offset + bytes);
+            }
+        }
+        header.fileSize = offset;
+
+#if defined(_WIN32)
+        FILE *file = ::_wfopen(path.c_str(), L"wb");
+#else
+        FILE *file = ::fopen(Codec::NarrowPath(path).c_str(), "wb");
+#endif
+        if (!file)
+            return false;
+
+        bool ok = 1 == ::fwrite(&header, sizeof(header), 1, file)
+            && (assets.empty() || 1 == ::fwrite(&assets[0], assets.size() * sizeof(AssetBundle::Asset), 1, file))
+            && (frames.empty() || 1 == ::fwrite(&frames[0], frames.size() * sizeof(AssetBundle::Frame), 1, file))
+            && (names.empty() || 1 == ::fwrite(&names[0], names.size() * sizeof(WORD), 1, file))
+            && PadFile(file, index, AlignBundle(index));
+
+        //! rows at DIB stride, which for 32 bpp is exactly the width
+        for (size_t i = 0; ok && i != m_entries.size(); ++i)
+        {
+            const AnimationImageSet *set = m_entries[i].frames;
+            for (INT f = 0; ok && f != set->GetFramesCount(); ++f)
+            {
+                Image image = set->GetFrameAt(f);
+                ULONGLONG bytes = (ULONGLONG)image.GetStride() * image.GetHeight();
+
+                ok = 1 == ::fwrite(image.GetOffset(0, 0), (size_t)bytes, 1, file)
+                    && PadFile(file, bytes, AlignBundle(bytes));
+            }
+        }
+
+        ok = 0 == ::fclose(file) && ok;
+        return ok;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Win32Compat.h"
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace Render
+{
+    class Image;
+    class RefImageResource;
+    class AnimationImageSet;
+
+    //! images decoded ahead of time into one file, mapped at startup so loading is page faults, not decoding
+    //! every frame is 32 bpp premultiplied or opaque BGRA at DIB stride, the images point straight into the mapping
+    //! pages stay shared between processes until an image is written to
+    class AssetBundle
+    {
+    public:
+        struct Asset
+        {
+            UINT nameOffset;        //! utf-16 units into the names
+            UINT nameLength;
+            LONG width;
+            LONG height;
+            UINT firstFrame;
+            UINT frameCount;
+        };
+
+        struct Frame
+        {
+            ULONGLONG pixels;       //! file offset, 64 byte aligned
+            UINT delay;             //! 1/100 s
+            BYTE alphaMode;         //! Image::AlphaMode
+            BYTE opaque;
+            WORD reserved;
+        };
+
+    private:
+        PBYTE m_base;
+        ULONGLONG m_size;
+
+        const Asset *m_assets;
+        const Frame *m_frames;
+        std::unordered_map<String, UINT> m_index;
+
+#if defined(_WIN32)
+        HANDLE m_mapping;
+
+        //! gdi draws from dib sections over the mapping, one per frame made on first use and lent to the images
+        std::mutex m_lock;
+        std::vector<HBITMAP> m_bitmaps;
+#endif
+
+    public:
+        //! maps path copy on write and checks the index, NULL for a missing or malformed bundle
+        static AssetBundle *Open(const String& path);
+        ~AssetBundle();
+
+    public:
+        bool Contains(const String& name) const;
+
+        //! the first frame over the mapped pixels, like RefImageResource::Create(path)
+        //! the bundle must outlive it; NULL for names it does not hold
+        RefImageResource *CreateImage(const String& name);
+        //! every frame with its delay, the bundle must outlive it as well
+        AnimationImageSet *CreateAnimation(const String& name);
+
+    private:
+        AssetBundle();
+        bool Index();
+        bool BorrowFrame(UINT index, LONG width, LONG height, Image *nullImage);
+
+    private:
+        AssetBundle(const AssetBundle&);
+        AssetBundle& operator = (const AssetBundle&);
+    };
+
+    //! the offline side: decodes files with the same codecs as the loaders and writes a bundle
+    class AssetBundleWriter
+    {
+    private:
+        struct Entry
+        {
+            String name;
+            AnimationImageSet *frames;
+        };
+
+        std::vector<Entry> m_entries;
+
+    public:
+        AssetBundleWriter();
+        ~AssetBundleWriter();
+
+    public:
+        //! path is decoded now, every frame of a GIF; a second entry of the same name replaces the first
+        bool Add(const String& name, const String& path);
+        bool Write(const String& path) const;
+
+    private:
+        AssetBundleWriter(const AssetBundleWriter&);
+        AssetBundleWriter& operator = (const AssetBundleWriter&);
+    };
+}
\ No newline at end of file
@@ -2,153 +2,504 @@
 
 #include "Image.h"
 #include "Surface.h"
+#include "PixelKernel.h"
+#include "GlyphCache.h"
+#include "DisplayList.h"
+#include "ScaledImageCache.h"
+
+#if defined(_WIN32)
 #include "wingdi.h"
 
 #pragma comment(lib, "Msimg32.lib")
+#endif
+
+#include <math.h>
+#include <vector>
 
 #if USE_CAIRO
 #include "cairo.h"
 
-#include <string>
-#include <codecvt>
-#include <locale>
+#include <wchar.h>
 #pragma comment(lib, "cairo.lib")
 #endif
 
-
-namespace DuiLibImport
+namespace Render
 {
-    static COLORREF PixelAlpha(COLORREF clrSrc, double src_darken, COLORREF clrDest, double dest_darken)
-    {
-        return RGB(GetRValue(clrSrc) * src_darken + GetRValue(clrDest) * dest_darken,
-            GetGValue(clrSrc) * src_darken + GetGValue(clrDest) * dest_darken,
-            GetBValue(clrSrc) * src_darken + GetBValue(clrDest) * dest_darken);
-    }
+    static void IntersectRegion(LPRECT outRegion, const SIZE& s1, const RECT& r2)
+    {
+        outRegion->left = max(0, r2.left);
+        outRegion->top = max(0, r2.top);
+
+        outRegion->right = min(s1.cx - outRegion->left, r2.left + r2.right - outRegion->left);
+        outRegion->bottom = min(s1.cy - outRegion->top, r2.top + r2.bottom - outRegion->top);
+    }
+
+    //! clip the image placed at pos against bounds (left, top, width, height), false when nothing is left
+    static bool ClipBlit(const RECT& bounds, const SIZE& srcSize, const POINT& pos, LPRECT outDst, LPPOINT outSrc)
+    {
+        LONG left = max(bounds.left, pos.x);
+        LONG top = max(bounds.top, pos.y);
+        LONG right = min(bounds.left + bounds.right, pos.x + srcSize.cx);
+        LONG bottom = min(bounds.top + bounds.bottom, pos.y + srcSize.cy);
+
+        if (right <= left || bottom <= top)
+            return false;
+
+        outDst->left = left;
+        outDst->top = top;
+        outDst->right = right - left;
+        outDst->bottom = bottom - top;
+
+        outSrc->x = left - pos.x;
+        outSrc->y = top - pos.y;
+
+        return true;
+    }
+
+    //! grows bounds (left, top, width, height) over part, an empty bounds becomes part and an empty part changes nothing
+    static inline void UniteBounds(LPRECT bounds, const RECT& part)
+    {
+        if (part.right <= 0 || part.bottom <= 0)
+            return;
+
+        if (bounds->right <= 0 || bounds->bottom <= 0)
+        {
+            *bounds = part;
+            return;
+        }
+
+        LONG left = min(bounds->left, part.left), top = min(bounds->top, part.top);
+        LONG right = max(bounds->left + bounds->right, part.left + part.right), bottom = max(bounds->top + bounds->bottom, part.top + part.bottom);
+
+        bounds->left = left;
+        bounds->top = top;
+        bounds->right = right - left;
+        bounds->bottom = bottom - top;
+    }
+
+    //! COLORREF to the 0x00RRGGBB layout of the surfaces
+    static inline DWORD PixelOf(COLORREF color)
+    {
+        return ((DWORD)GetRValue(color) << 16) | ((DWORD)GetGValue(color) << 8) | GetBValue(color);
+    }
+
+    //! opaque images only fade by the context opacity, the others by their own alpha as well
+    static inline Pixel::BlendMode BlendModeOf(const Image *image)
+    {
+        if (image->IsOpaque())
+            return Pixel::BlendConstAlpha;
+
+        return Image::AlphaPremultiplied == image->GetAlphaMode() ? Pixel::BlendPremultiplied : Pixel::BlendCombinedAlpha;
+    }
+
+    //! drawn below half its size, an image with mipmaps is read from the level just above the drawn size
+    //! nearest reads one pixel per output pixel whatever the source
+    static inline Image *ScaledSourceOf(Image *image, const RECT& region, Pixel::Filter filter)
+    {
+        if (Pixel::FilterNearest == filter)
+            return image;
+
+        SIZE scaledSize = { region.right, region.bottom };
+        return image->GetMipmap(scaledSize);
+    }
+
+    //! a clip rect trimmed to target, whatever size the clip was made for
+    static inline RECT TrimToTarget(const PixelBuffer& target, const RECT& r)
+    {
+        LONG left = max(0L, r.left), top = max(0L, r.top);
+        LONG right = min((LONG)target.width, r.left + r.right), bottom = min((LONG)target.height, r.top + r.bottom);
+
+        RECT trimmed = { 0 };
+        if (right > left && bottom > top)
+        {
+            RECT inside = { left, top, right - left, bottom - top };
+            trimmed = inside;
+        }
+
+        return trimmed;
+    }
 
-    static BOOL WINAPI AlphaBitBlt(HDC hDC, int nDestX, int nDestY, int dwWidth, int dwHeight, HDC hSrcDC, \
-        int nSrcX, int nSrcY, int wSrc, int hSrc, BLENDFUNCTION ftn)
+    //! src placed at pos and drawn over target with mode, inside every rect of clip; false when nothing is left
+    //! outRect is the box of what was drawn
+    static bool BlitClipped(const PixelBuffer& target, const BYTE *src, INT srcStride, const SIZE& srcSize, Pixel::BlendMode mode,
+        const POINT& pos, UINT opaque, const ClipRegion& clip, LPRECT outRect)
     {
-        HDC hTempDC = ::CreateCompatibleDC(hDC);
-        if (NULL == hTempDC)
-            return FALSE;
+        RECT drawn = { 0 };
 
-        //Creates Source DIB
-        LPBITMAPINFO lpbiSrc = NULL;
-        // Fill in the BITMAPINFOHEADER
-        lpbiSrc = (LPBITMAPINFO) new BYTE[sizeof(BITMAPINFOHEADER)];
-        if (lpbiSrc == NULL)
+        //! banded, nothing below the image is left once a rect starts under it
+        for (UINT i = 0; i != clip.GetCount() && clip.GetRect(i).top < pos.y + srcSize.cy; ++i)
         {
-            ::DeleteDC(hTempDC);
-            return FALSE;
+            RECT blitRect = { 0 };
+            POINT srcPos = { 0 };
+
+            if (!ClipBlit(TrimToTarget(target, clip.GetRect(i)), srcSize, pos, &blitRect, &srcPos))
+                continue;
+
+            PBYTE dst = target.data + blitRect.top * target.stride + blitRect.left * 4;
+            const BYTE *from = src + srcPos.y * srcStride + srcPos.x * 4;
+
+            if (255 == opaque && !target.coverage && Pixel::BlendConstAlpha == mode)
+                Pixel::Copy(dst, target.stride, from, srcStride, blitRect.right, blitRect.bottom);
+            else
+                Pixel::Blend(mode, dst, target.stride, from, srcStride, blitRect.right, blitRect.bottom, (BYTE)opaque);
+
+            UniteBounds(&drawn, blitRect);
+        }
+
+        *outRect = drawn;
+        return drawn.right > 0;
+    }
+
+    //! src resampled to region (left, top, width, height) and drawn over target with mode,
+    //! only the rows and columns inside clip are computed; false when nothing is left
+    static bool BlitScaled(const PixelBuffer& target, const BYTE *src, INT srcStride, const SIZE& srcSize, Pixel::BlendMode mode,
+        const RECT& region, Pixel::Filter filter, UINT opaque, FrameArena& arena, const ClipRegion& clip, LPRECT outRect)
+    {
+        SIZE scaledSize = { region.right, region.bottom };
+        POINT pos = { region.left, region.top };
+        RECT drawn = { 0 };
+
+        for (UINT i = 0; i != clip.GetCount() && clip.GetRect(i).top < region.top + region.bottom; ++i)
+        {
+            RECT blitRect = { 0 };
+            POINT srcPos = { 0 };
+
+            if (!ClipBlit(TrimToTarget(target, clip.GetRect(i)), scaledSize, pos, &blitRect, &srcPos))
+                continue;
+
+            //! a window of the scaled image comes out the same as the whole, clip rects meet without seams
+            RECT part = { srcPos.x, srcPos.y, blitRect.right, blitRect.bottom };
+            PBYTE dst = target.data + blitRect.top * target.stride + blitRect.left * 4;
+
+            if (255 == opaque && !target.coverage && Pixel::BlendConstAlpha == mode)
+            {
+                Pixel::Resample(filter, dst, target.stride, part, region.right, region.bottom, src, srcStride, srcSize.cx, srcSize.cy);
+            }
+            else
+            {
+                DWORD *scaled = arena.Allocate<DWORD>((SIZE_T)part.right * part.bottom);
+                Pixel::Resample(filter, (PBYTE)scaled, part.right * 4, part, region.right, region.bottom, src, srcStride, srcSize.cx, srcSize.cy);
+                Pixel::Blend(mode, dst, target.stride, (const BYTE *)scaled, part.right * 4, part.right, part.bottom, (BYTE)opaque);
+            }
+
+            UniteBounds(&drawn, blitRect);
         }
-        lpbiSrc->bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-        lpbiSrc->bmiHeader.biWidth = dwWidth;
-        lpbiSrc->bmiHeader.biHeight = dwHeight;
-        lpbiSrc->bmiHeader.biPlanes = 1;
-        lpbiSrc->bmiHeader.biBitCount = 32;
-        lpbiSrc->bmiHeader.biCompression = BI_RGB;
-        lpbiSrc->bmiHeader.biSizeImage = dwWidth * dwHeight;
-        lpbiSrc->bmiHeader.biXPelsPerMeter = 0;
-        lpbiSrc->bmiHeader.biYPelsPerMeter = 0;
-        lpbiSrc->bmiHeader.biClrUsed = 0;
-        lpbiSrc->bmiHeader.biClrImportant = 0;
 
-        COLORREF* pSrcBits = NULL;
-        HBITMAP hSrcDib = CreateDIBSection(
-            hSrcDC, lpbiSrc, DIB_RGB_COLORS, (void **)&pSrcBits,
-            NULL, NULL);
+        *outRect = drawn;
+        return drawn.right > 0;
+    }
+
+    static bool BlitScaled(const PixelBuffer& target, Image *image, const RECT& region, Pixel::Filter filter, UINT opaque,
+        FrameArena& arena, const ClipRegion& clip, LPRECT outRect)
+    {
+        return BlitScaled(target, image->GetOffset(0, 0), image->GetStride(), image->GetSize(), BlendModeOf(image),
+            region, filter, opaque, arena, clip, outRect);
+    }
+
+    //! where a KindScale matrix puts a size, offset rounded to whole pixels; right is width, bottom is height
+    //! the size comes from the factors alone, a draw is as wide wherever it lands
+    static RECT ScaledRegionOf(const AffineMaxtrix& matrix, const SIZE& size)
+    {
+        const XFORM& m = matrix.GetMatrix();
+
+        RECT region = { (LONG)::floor(m.eDx + 0.5), (LONG)::floor(m.eDy + 0.5),
+            (LONG)::floor((double)m.eM11 * size.cx + 0.5), (LONG)::floor((double)m.eM22 * size.cy + 0.5) };
+        return region;
+    }
+
+    //! the pixels a draw of size through matrix can touch, moved by -origin; right is width, bottom is height
+    //! the scaled edges are rounded on their own, they may reach a pixel past MapBounds
+    static RECT DrawnBoundsOf(const AffineMaxtrix& matrix, const SIZE& size, const POINT& origin)
+    {
+        RECT whole = { 0, 0, size.cx, size.cy };
+        RECT bounds = AffineMaxtrix::KindScale == matrix.GetKind() ? ScaledRegionOf(matrix, size) : matrix.MapBounds(whole);
+
+        bounds.left -= origin.x;
+        bounds.top -= origin.y;
+        return bounds;
+    }
+
+#if USE_GDI || USE_CAIRO
+    //! transform followed by the move to -origin, for the backends mapping a draw themselves
+    static AffineMaxtrix DeviceMatrixOf(const AffineMaxtrix& transform, const POINT& origin)
+    {
+        AffineMaxtrix matrix = transform;
+        if (origin.x || origin.y)
+            matrix.Multiply(AffineMaxtrix(1.f, 0.f, 0.f, 1.f, (float)-origin.x, (float)-origin.y));
+
+        return matrix;
+    }
+#endif
+
+    //! narrows [first, last) to the x where lo < p + x * d < hi, false when nothing is left
+    static bool NarrowSpan(double p, double d, double lo, double hi, double *first, double *last)
+    {
+        if (::fabs(d) < 1e-9)
+            return lo < p && p < hi && *first < *last;
 
-        if ((NULL == hSrcDib) || (NULL == pSrcBits))
+        double a = (lo - p) / d, b = (hi - p) / d;
+        if (a > b)
         {
-            delete[] lpbiSrc;
-            ::DeleteDC(hTempDC);
-            return FALSE;
+            double t = a;
+            a = b;
+            b = t;
         }
 
-        HBITMAP hOldTempBmp = (HBITMAP)::SelectObject(hTempDC, hSrcDib);
-        ::StretchBlt(hTempDC, 0, 0, dwWidth, dwHeight, hSrcDC, nSrcX, nSrcY, wSrc, hSrc, SRCCOPY);
-        ::SelectObject(hTempDC, hOldTempBmp);
+        *first = max(*first, a);
+        *last = min(*last, b);
 
-        //Creates Destination DIB
-        LPBITMAPINFO lpbiDest = NULL;
-        // Fill in the BITMAPINFOHEADER
-        lpbiDest = (LPBITMAPINFO) new BYTE[sizeof(BITMAPINFOHEADER)];
-        if (lpbiDest == NULL)
+        return *first < *last;
+    }
+
+    //! src put through matrix (source pixels to target pixels), moved by -origin whole pixels after rounding
+    //! and drawn over target with mode, inside clip
+    //! translate blits, scale resamples with filter, anything else is sampled bilinearly
+    //! over the target box the source lands in, row by row where the source actually is
+    static bool BlitTransformed(const PixelBuffer& target, const BYTE *src, INT srcStride, const SIZE& srcSize, Pixel::BlendMode mode,
+        const AffineMaxtrix& matrix, Pixel::Filter filter, UINT opaque, FrameArena& arena, const POINT& origin, const ClipRegion& clip, LPRECT outRect)
+    {
+        if (AffineMaxtrix::KindIdentity == matrix.GetKind() || AffineMaxtrix::KindTranslate == matrix.GetKind())
+        {
+            POINT pos = { matrix.GetOffset().x - origin.x, matrix.GetOffset().y - origin.y };
+            return BlitClipped(target, src, srcStride, srcSize, mode, pos, opaque, clip, outRect);
+        }
+
+        if (AffineMaxtrix::KindScale == matrix.GetKind())
         {
-            delete[] lpbiSrc;
-            ::DeleteObject(hSrcDib);
-            ::DeleteDC(hTempDC);
-            return FALSE;
+            RECT region = DrawnBoundsOf(matrix, srcSize, origin);
+            if (region.right <= 0 || region.bottom <= 0)
+                return false;
+
+            return BlitScaled(target, src, srcStride, srcSize, mode, region, filter, opaque, arena, clip, outRect);
         }
 
-        lpbiDest->bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-        lpbiDest->bmiHeader.biWidth = dwWidth;
-        lpbiDest->bmiHeader.biHeight = dwHeight;
-        lpbiDest->bmiHeader.biPlanes = 1;
-        lpbiDest->bmiHeader.biBitCount = 32;
-        lpbiDest->bmiHeader.biCompression = BI_RGB;
-        lpbiDest->bmiHeader.biSizeImage = dwWidth * dwHeight;
-        lpbiDest->bmiHeader.biXPelsPerMeter = 0;
-        lpbiDest->bmiHeader.biYPelsPerMeter = 0;
-        lpbiDest->bmiHeader.biClrUsed = 0;
-        lpbiDest->bmiHeader.biClrImportant = 0;
+        AffineMaxtrix inverse = matrix;
+        if (!inverse.Invert())
+            return false;
+
+        RECT box = DrawnBoundsOf(matrix, srcSize, origin);
+        SIZE boxSize = { box.right, box.bottom };
+        POINT boxPos = { box.left, box.top };
 
-        COLORREF* pDestBits = NULL;
-        HBITMAP hDestDib = CreateDIBSection(
-            hDC, lpbiDest, DIB_RGB_COLORS, (void **)&pDestBits,
-            NULL, NULL);
+        if (!clip.Intersects(box))
+            return false;
 
-        if ((NULL == hDestDib) || (NULL == pDestBits))
+        //! the sampler reads premultiplied pixels, straight ones are converted once
+        DWORD alphaOr = 0;
+        if (Pixel::BlendConstAlpha == mode)
         {
-            delete[] lpbiSrc;
-            ::DeleteObject(hSrcDib);
-            ::DeleteDC(hTempDC);
-            return FALSE;
+            alphaOr = 0xFF000000;
         }
+        else if (Pixel::BlendPremultiplied != mode)
+        {
+            PBYTE premultiplied = (PBYTE)arena.Allocate<DWORD>((SIZE_T)srcSize.cx * srcSize.cy);
+            Pixel::Premultiply(premultiplied, srcSize.cx * 4, src, srcStride, srcSize.cx, srcSize.cy);
 
-        ::SelectObject(hTempDC, hDestDib);
-        ::BitBlt(hTempDC, 0, 0, dwWidth, dwHeight, hDC, nDestX, nDestY, SRCCOPY);
-        ::SelectObject(hTempDC, hOldTempBmp);
+            src = premultiplied;
+            srcStride = srcSize.cx * 4;
+        }
 
-        double src_darken;
-        BYTE nAlpha;
+        const Pixel::Kernels& kernels = Pixel::GetKernels();
+        const XFORM& step = inverse.GetMatrix();
+        INT stepU = (INT)::floor(step.eM11 * 65536.0 + 0.5), stepV = (INT)::floor(step.eM12 * 65536.0 + 0.5);
+        DWORD *row = arena.Allocate<DWORD>(min(box.right, clip.GetBounds().right));
+        RECT drawn = { 0 };
 
-        for (int pixel = 0; pixel < dwWidth * dwHeight; pixel++, pSrcBits++, pDestBits++)
+        for (UINT i = 0; i != clip.GetCount() && clip.GetRect(i).top < box.top + box.bottom; ++i)
         {
-            nAlpha = LOBYTE(*pSrcBits >> 24);
-            src_darken = (double)(nAlpha * ftn.SourceConstantAlpha) / 255.0 / 255.0;
-            if (src_darken < 0.0) src_darken = 0.0;
-            *pDestBits = PixelAlpha(*pSrcBits, src_darken, *pDestBits, 1.0 - src_darken);
-        } //for
+            RECT part = { 0 };
+            POINT srcPos = { 0 };
 
-        ::SelectObject(hTempDC, hDestDib);
-        ::BitBlt(hDC, nDestX, nDestY, dwWidth, dwHeight, hTempDC, 0, 0, SRCCOPY);
-        ::SelectObject(hTempDC, hOldTempBmp);
+            if (!ClipBlit(TrimToTarget(target, clip.GetRect(i)), boxSize, boxPos, &part, &srcPos))
+                continue;
 
-        delete[] lpbiDest;
-        ::DeleteObject(hDestDib);
+            for (LONG y = part.top; y != part.top + part.bottom; ++y)
+            {
+                //! the row's first box pixel centre back in the source, relative to its pixel centres;
+                //! a pixel's sample depends on where it is, not on the clip rect or tile its row starts in
+                double u = 0.0, v = 0.0;
+                inverse.Map(box.left + origin.x + 0.5, y + origin.y + 0.5, &u, &v);
+                u -= 0.5;
+                v -= 0.5;
+
+                //! only where the 2 x 2 footprint still touches the source, columns from the box's left
+                LONG from = part.left - box.left, to = from + part.right;
+                double first = from, last = to;
+                if (!NarrowSpan(u, stepU / 65536.0, -1.0, srcSize.cx, &first, &last) || !NarrowSpan(v, stepV / 65536.0, -1.0, srcSize.cy, &first, &last))
+                    continue;
+
+                LONG begin = max(from, (LONG)::floor(first));
+                LONG end = min(to, (LONG)::ceil(last));
+                if (end <= begin)
+                    continue;
+
+                LONGLONG startU = (LONGLONG)::floor(u * 65536.0 + 0.5) + (LONGLONG)begin * stepU;
+                LONGLONG startV = (LONGLONG)::floor(v * 65536.0 + 0.5) + (LONGLONG)begin * stepV;
+
+                kernels.sampleBilinear(row, end - begin, (const DWORD *)src, srcStride, srcSize.cx, srcSize.cy,
+                    (INT)startU, (INT)startV, stepU, stepV, alphaOr);
+                kernels.blend[Pixel::BlendPremultiplied]((DWORD *)(target.data + y * target.stride) + box.left + begin,
+                    row, end - begin, (BYTE)opaque);
+            }
 
-        delete[] lpbiSrc;
-        ::DeleteObject(hSrcDib);
+            UniteBounds(&drawn, part);
+        }
 
-        ::DeleteDC(hTempDC);
-        return TRUE;
+        *outRect = drawn;
+        return drawn.right > 0;
     }
-}
 
-namespace Render
-{
-    static void IntersectRegion(LPRECT outRegion, const SIZE& s1, const RECT& r2)
+    //! the source rect of image drawn over dest (left, top, width, height, user space) through transform, inside clip
+    //! a whole image is read from the mip level matching its footprint and, once a scaled size repeats, from ScaledImageCache
+    static bool BlitTransformed(const PixelBuffer& target, Image *image, const RECT& source, const RECT& dest, const AffineMaxtrix& transform,
+        Pixel::Filter filter, UINT opaque, FrameArena& arena, const POINT& origin, const ClipRegion& clip, LPRECT outRect)
     {
-        outRegion->left = max(0, r2.left);
-        outRegion->top = max(0, r2.top);
+        if (source.right <= 0 || source.bottom <= 0 || dest.right <= 0 || dest.bottom <= 0)
+            return false;
 
-        outRegion->right = min(s1.cx - outRegion->left, r2.left + r2.right - outRegion->left);
-        outRegion->bottom = min(s1.cy - outRegion->top, r2.top + r2.bottom - outRegion->top);
+        AffineMaxtrix matrix = transform;
+        matrix.Translate((float)dest.left, (float)dest.top);
+        matrix.Scale((float)dest.right / source.right, (float)dest.bottom / source.bottom);
+
+        //! nothing of it inside the clip, no cache lookup or mip level either;
+        //! a pixel of margin, a mip level's factors may round an edge the other way
+        SIZE sourceSize = { source.right, source.bottom };
+        RECT reach = DrawnBoundsOf(matrix, sourceSize, origin);
+        RECT margin = { reach.left - 1, reach.top - 1, reach.right + 2, reach.bottom + 2 };
+        if (!clip.Intersects(margin))
+            return false;
+
+        const BYTE *src = image->GetOffset(source.left, source.top);
+        INT srcStride = image->GetStride();
+        Pixel::BlendMode mode = BlendModeOf(image);
+
+        bool whole = 0 == source.left && 0 == source.top && image->GetWidth() == source.right && image->GetHeight() == source.bottom;
+
+        if (whole && AffineMaxtrix::KindScale == matrix.GetKind())
+        {
+            RECT region = ScaledRegionOf(matrix, sourceSize);
+            SIZE scaledSize = { region.right, region.bottom };
+
+            RefImageResource *scaled = ScaledImageCache::Instance().Acquire(image, scaledSize, filter);
+            if (scaled)
+            {
+                AffineMaxtrix offset(1.f, 0.f, 0.f, 1.f, (float)region.left, (float)region.top);
+                bool drawn = BlitTransformed(target, scaled->GetOffset(0, 0), scaled->GetStride(), scaledSize, mode, offset, filter, opaque, arena, origin, clip, outRect);
+
+                scaled->Release();
+                return drawn;
+            }
+        }
+
+        if (whole && Pixel::FilterNearest != filter)
+        {
+            const XFORM& m = matrix.GetMatrix();
+            SIZE footprint = { (LONG)::ceil(::sqrt(m.eM11 * m.eM11 + m.eM12 * m.eM12) * source.right),
+                (LONG)::ceil(::sqrt(m.eM21 * m.eM21 + m.eM22 * m.eM22) * source.bottom) };
+
+            Image *level = image->GetMipmap(footprint);
+            if (level != image)
+            {
+                matrix.Scale((float)source.right / level->GetWidth(), (float)source.bottom / level->GetHeight());
+
+                sourceSize = level->GetSize();
+                src = level->GetOffset(0, 0);
+                srcStride = level->GetStride();
+            }
+        }
+
+        return BlitTransformed(target, src, srcStride, sourceSize, mode, matrix, filter, opaque, arena, origin, clip, outRect);
+    }
+
+    //! the text as DrawTextAt lays it out, brush box first, drawn at where inside every rect of clip; false when nothing is left
+    //! glyphs are blended whole pixels, each clip rect gets a view of target of its own
+    //! one locked layout into arena, the blending runs alongside other threads' text
+    static bool BlitText(const PixelBuffer& target, const Font& font, const Brush& brush, DWORD color, BYTE alpha,
+        const POINT& where, const String& text, FrameArena& arena, const ClipRegion& clip, LPRECT outRect)
+    {
+        TextLayout layout = GlyphCache::Instance().Layout(font, text, arena);
+        RECT ink = layout.bounds;
+        ink.left += where.x;
+        ink.top += where.y;
+
+        SIZE size = brush.IsNull() ? SIZE() : layout.size;
+        RECT fill = { where.x, where.y, size.cx, size.cy };
+
+        RECT box = ink;
+        UniteBounds(&box, fill);
+        if (!clip.Intersects(box))
+            return false;
+
+        RECT drawn = { 0 };
+        SIZE inkSize = { ink.right, ink.bottom };
+        POINT inkPos = { ink.left, ink.top };
+
+        for (UINT i = 0; i != clip.GetCount() && clip.GetRect(i).top < box.top + box.bottom; ++i)
+        {
+            RECT r = TrimToTarget(target, clip.GetRect(i));
+            RECT part = { 0 };
+            POINT srcPos = { 0 };
+
+            if (!brush.IsNull() && ClipBlit(r, size, where, &part, &srcPos))
+            {
+                Pixel::Fill(target.data + part.top * target.stride + part.left * 4, target.stride,
+                    part.right, part.bottom, 0xFF000000 | PixelOf(brush.GetColor()));
+                UniteBounds(&drawn, part);
+            }
+
+            if (!ClipBlit(r, inkSize, inkPos, &part, &srcPos))
+                continue;
+
+            PixelBuffer view = { target.data + r.top * target.stride + r.left * 4, target.stride, r.right, r.bottom, target.coverage };
+            POINT at = { where.x - r.left, where.y - r.top };
+
+            GlyphCache::DrawLayout(view, layout, at, color, alpha);
+            UniteBounds(&drawn, part);
+        }
+
+        *outRect = drawn;
+        return drawn.right > 0;
+    }
+
+    //! the text as DrawTextAt lays it out, brush box included, drawn into a premultiplied buffer and put through transform
+    static bool BlitTextTransformed(const PixelBuffer& target, const Font& font, const Brush& brush, COLORREF color, UINT opaque,
+        const POINT& where, const String& text, const AffineMaxtrix& transform, FrameArena& arena, const POINT& origin, const ClipRegion& clip, LPRECT outRect)
+    {
+        TextLayout layout = GlyphCache::Instance().Layout(font, text, arena);
+        RECT bounds = layout.bounds;
+        SIZE size = brush.IsNull() ? SIZE() : layout.size;
+
+        LONG left = min(bounds.left, 0L), top = min(bounds.top, 0L);
+        LONG right = max(bounds.left + bounds.right, size.cx), bottom = max(bounds.top + bounds.bottom, size.cy);
+        if (right <= left || bottom <= top)
+            return false;
+
+        AffineMaxtrix matrix = transform;
+        matrix.Translate((float)(where.x + left), (float)(where.y + top));
+
+        //! nothing of it inside the clip, nothing to draw offscreen either
+        SIZE bufferSize = { right - left, bottom - top };
+        if (!clip.Intersects(DrawnBoundsOf(matrix, bufferSize, origin)))
+            return false;
+
+        PixelBuffer buffer = { (PBYTE)arena.Allocate<DWORD>((SIZE_T)(right - left) * (bottom - top)), (right - left) * 4, right - left, bottom - top, false };
+        Pixel::Fill(buffer.data, buffer.stride, buffer.width, buffer.height, 0);
+
+        if (!brush.IsNull())
+            Pixel::Fill(buffer.data - top * buffer.stride - left * 4, buffer.stride, size.cx, size.cy, 0xFF000000 | PixelOf(brush.GetColor()));
+
+        //! glyphs tinted over transparent black come out premultiplied, their coverage in alpha
+        POINT at = { -left, -top };
+        BYTE alpha = (BYTE)Pixel::Div255(opaque * GetAValue(color));
+        GlyphCache::DrawLayout(buffer, layout, at, PixelOf(color), alpha);
+
+        return BlitTransformed(target, buffer.data, buffer.stride, bufferSize, Pixel::BlendPremultiplied, matrix, Pixel::FilterBilinear, 255, arena, origin, clip, outRect);
     }
 
+#if defined(_WIN32)
     typedef BOOL(WINAPI *LPALPHABLEND)(HDC, int, int, int, int, HDC, int, int, int, int, BLENDFUNCTION);
     static LPALPHABLEND lpAlphaBlend = AlphaBlend;/*(LPALPHABLEND) ::GetProcAddress(::GetModuleHandle(_T("msimg32.dll")), "AlphaBlend");*/
+#endif
 
     Font::Font()
         : m_font()
@@ -160,7 +511,7 @@ namespace Render
         : m_font()
     {
         ::memset(&m_font, 0, sizeof(LOGFONTW));
-        ::memcpy(m_font.lfFaceName, family.c_str(), min(LF_FACESIZE, family.length()) *sizeof(WCHAR));
+        ::memcpy(m_font.lfFaceName, family.c_str(), min((size_t)LF_FACESIZE, family.length()) *sizeof(WCHAR));
         m_font.lfWidth = px;
     }
 
@@ -168,7 +519,7 @@ namespace Render
         : m_font()
     {
         ::memset(&m_font, 0, sizeof(LOGFONTW));
-        ::memcpy(m_font.lfFaceName, family.c_str(), min(LF_FACESIZE, family.length()) *sizeof(WCHAR));
+        ::memcpy(m_font.lfFaceName, family.c_str(), min((size_t)LF_FACESIZE, family.length()) *sizeof(WCHAR));
         m_font.lfWidth = px;
         m_font.lfWeight = weight;
         m_font.lfItalic = italic;
@@ -176,7 +527,7 @@ namespace Render
 
     void Font::SetFamily(const String& family)
     {
-        ::memcpy(m_font.lfFaceName, family.c_str(), min(LF_FACESIZE, family.length()) *sizeof(WCHAR));
+        ::memcpy(m_font.lfFaceName, family.c_str(), min((size_t)LF_FACESIZE, family.length()) *sizeof(WCHAR));
     }
 
     void Font::SetPixelSize(int px)
@@ -217,29 +568,6 @@ namespace Render
 
     }
 
-#if USE_GDI
-
-    AffineMaxtrix::AffineMaxtrix()
-        : m_maxtrix()
-    {}
-
-    AffineMaxtrix::AffineMaxtrix(float m11, float m12,
-        float m21, float m22,
-        float dx, float dy)
-        : m_maxtrix()
-    {
-
-    }
-
-    void Rotate(float degrees)
-    {}
-    void Scale(float xFactor, float yFactor)
-    {}
-    void Sheer(float xFactor, float yFactor)
-    {}
-    void Translate(float dx, float dy)
-    {}
-
     TextMetric::TextMetric()
         : m_font()
     {
@@ -256,208 +584,1660 @@ namespace Render
 
     SIZE TextMetric::GetMeasureSize(const String& text) const
     {
-        HDC memDC = ::CreateCompatibleDC(NULL);
-        RECT textBoundingRect = { 0 };
-        HFONT hFont = CreateFontIndirect(&m_font.m_font);
-
-        ::SelectObject(memDC, hFont);
-        ::DrawText(memDC, text.c_str(), text.length(), &textBoundingRect, DT_CALCRECT);
-
-        ::DeleteObject(hFont);
-        ::DeleteObject(memDC);
-
-		SIZE tmp = { textBoundingRect.right - textBoundingRect.left, textBoundingRect.bottom - textBoundingRect.top };
+        return GlyphCache::Instance().Measure(m_font, text);
+    }
 
-        return tmp;
+    //! first then second, as CombineTransform does
+    static XFORM CombineXform(const XFORM& first, const XFORM& second)
+    {
+        XFORM out = {
+            first.eM11 * second.eM11 + first.eM12 * second.eM21,
+            first.eM11 * second.eM12 + first.eM12 * second.eM22,
+            first.eM21 * second.eM11 + first.eM22 * second.eM21,
+            first.eM21 * second.eM12 + first.eM22 * second.eM22,
+            first.eDx * second.eM11 + first.eDy * second.eM21 + second.eDx,
+            first.eDx * second.eM12 + first.eDy * second.eM22 + second.eDy,
+        };
+
+        return out;
     }
 
-    Context::Context()
-        : m_DC(NULL)
-        , m_surface(NULL)
+    AffineMaxtrix::AffineMaxtrix()
+        : m_maxtrix()
+        , m_kind(KindIdentity)
     {
-        
+        m_maxtrix.eM11 = 1.f;
+        m_maxtrix.eM22 = 1.f;
     }
 
-    Context::~Context()
+    AffineMaxtrix::AffineMaxtrix(float m11, float m12,
+        float m21, float m22,
+        float dx, float dy)
+        : m_maxtrix()
+        , m_kind(KindIdentity)
     {
-        if (m_DC)
-            ::DeleteObject(m_DC);
+        XFORM m = { m11, m12, m21, m22, dx, dy };
+        m_maxtrix = m;
+
+        Classify();
     }
 
-    void Context::Reset()
+    void AffineMaxtrix::Rotate(float degrees)
     {
-        if (m_surface)
+        float c = 1.f, s = 0.f;
+
+        //! quarter turns exactly, cos(90) in float is not 0
+        double quarters = degrees / 90.0;
+        if (::floor(quarters) == quarters)
         {
-            if (m_DC)
-                ::DeleteObject(m_DC);
+            static const float cosines[4] = { 1.f, 0.f, -1.f, 0.f };
+            INT quarter = (INT)::fmod(quarters, 4.0);
+            quarter = quarter < 0 ? quarter + 4 : quarter;
 
-            m_surface->InitContext(*this);
+            c = cosines[quarter];
+            s = cosines[(quarter + 3) & 3];
+        }
+        else
+        {
+            double radians = degrees * (3.14159265358979323846 / 180.0);
+            c = (float)::cos(radians);
+            s = (float)::sin(radians);
         }
+
+        XFORM rotation = { c, s, -s, c, 0.f, 0.f };
+        m_maxtrix = CombineXform(rotation, m_maxtrix);
+        Classify();
     }
 
-    void Context::SetFont(const Font& f)
+    void AffineMaxtrix::Scale(float xFactor, float yFactor)
     {
-        m_status.top().font = f;
+        XFORM scale = { xFactor, 0.f, 0.f, yFactor, 0.f, 0.f };
+        m_maxtrix = CombineXform(scale, m_maxtrix);
+        Classify();
     }
 
-    void Context::SetPen(const Pen& p)
+    void AffineMaxtrix::Sheer(float xFactor, float yFactor)
     {
-        m_status.top().pen = p;
+        XFORM shear = { 1.f, yFactor, xFactor, 1.f, 0.f, 0.f };
+        m_maxtrix = CombineXform(shear, m_maxtrix);
+        Classify();
     }
 
-    void Context::SetBrush(const Brush& b)
+    void AffineMaxtrix::Translate(float dx, float dy)
     {
-        m_status.top().brush = b;
-
-        if (m_DC)
-            ::SetBkMode(m_DC, m_status.top().brush.IsNull() ? TRANSPARENT : OPAQUE);
+        XFORM translation = { 1.f, 0.f, 0.f, 1.f, dx, dy };
+        m_maxtrix = CombineXform(translation, m_maxtrix);
+        Classify();
     }
 
-    void Context::SetTransform(const AffineMaxtrix& matrix)
+    void AffineMaxtrix::Multiply(const AffineMaxtrix& other)
     {
-        m_status.top().transform = matrix;
+        m_maxtrix = CombineXform(m_maxtrix, other.m_maxtrix);
+        Classify();
     }
 
-    void Context::SetOpaque(BYTE opaque)
+    bool AffineMaxtrix::Invert()
     {
-        m_status.top().opaque = opaque;
+        const XFORM& m = m_maxtrix;
+        double det = (double)m.eM11 * m.eM22 - (double)m.eM12 * m.eM21;
+        if (::fabs(det) < 1e-12)
+            return false;
+
+        double m11 = m.eM22 / det, m12 = -m.eM12 / det;
+        double m21 = -m.eM21 / det, m22 = m.eM11 / det;
+
+        XFORM inverse = { (float)m11, (float)m12, (float)m21, (float)m22,
+            (float)-(m.eDx * m11 + m.eDy * m21), (float)-(m.eDx * m12 + m.eDy * m22) };
+        m_maxtrix = inverse;
+
+        Classify();
+        return true;
     }
 
-    void Context::DrawImage(Image *image)
+    POINT AffineMaxtrix::GetOffset() const
     {
-        POINT zero = { 0, 0 };
-        DrawImageAt(image, zero);
+        POINT offset = { (LONG)::floor(m_maxtrix.eDx + 0.5f), (LONG)::floor(m_maxtrix.eDy + 0.5f) };
+        return offset;
     }
 
-    void Context::DrawImageAt(Image *image, const POINT& pos)
+    void AffineMaxtrix::Map(double x, double y, double *outX, double *outY) const
     {
-        UINT opaque = m_status.top().opaque;
+        *outX = x * m_maxtrix.eM11 + y * m_maxtrix.eM21 + m_maxtrix.eDx;
+        *outY = x * m_maxtrix.eM12 + y * m_maxtrix.eM22 + m_maxtrix.eDy;
+    }
 
-        if (opaque && m_surface && m_DC && !image->IsNull())
+    RECT AffineMaxtrix::MapBounds(const RECT& rect) const
+    {
+        double xs[4] = { 0 }, ys[4] = { 0 };
+        Map(rect.left, rect.top, &xs[0], &ys[0]);
+        Map(rect.left + rect.right, rect.top, &xs[1], &ys[1]);
+        Map(rect.left, rect.top + rect.bottom, &xs[2], &ys[2]);
+        Map(rect.left + rect.right, rect.top + rect.bottom, &xs[3], &ys[3]);
+
+        double left = xs[0], top = ys[0], right = xs[0], bottom = ys[0];
+        for (int i = 1; i != 4; ++i)
         {
-            RECT desRect = { 0 };
-            m_surface->GetSurfaceRect(&desRect);
-
-            if (pos.x > desRect.right || pos.y > desRect.bottom)
-                return;
+            left = min(left, xs[i]);
+            top = min(top, ys[i]);
+            right = max(right, xs[i]);
+            bottom = max(bottom, ys[i]);
+        }
 
-            HDC srcDC = ::CreateCompatibleDC(NULL);
+        RECT bounds = { (LONG)::floor(left), (LONG)::floor(top), 0, 0 };
+        bounds.right = (LONG)::ceil(right) - bounds.left;
+        bounds.bottom = (LONG)::ceil(bottom) - bounds.top;
 
-            ::SelectObject(srcDC, image->m_bitmap);
+        return bounds;
+    }
 
-            if (255 != opaque)
-            {
-                BLENDFUNCTION bf = { AC_SRC_OVER, 0, opaque, 0 };
-                lpAlphaBlend(m_DC, pos.x, pos.y, desRect.right, desRect.bottom,
-                    srcDC, 0, 0, image->GetWidth(), image->GetHeight(), bf);
-            }
-            else
-            {
-                ::BitBlt(m_DC, pos.x, pos.y, desRect.right, desRect.bottom, srcDC, 0, 0, SRCCOPY);
-            }
+    void AffineMaxtrix::Classify()
+    {
+        //! float matrices built from steps do not land exactly on 1 or 0
+        const float epsilon = 1e-4f;
+        const XFORM& m = m_maxtrix;
 
-            ::DeleteObject(srcDC);
+        if (::fabs(m.eM12) > epsilon || ::fabs(m.eM21) > epsilon || m.eM11 <= epsilon || m.eM22 <= epsilon)
+        {
+            m_kind = KindGeneral;
+            return;
         }
-    }
 
-    void Context::DrawClippedImage(Image *image, const RECT& region)
-    {
-        if (region.right <= 0 || region.bottom <= 0)
+        if (::fabs(m.eM11 - 1.f) > epsilon || ::fabs(m.eM22 - 1.f) > epsilon)
+        {
+            m_kind = KindScale;
             return;
+        }
 
-        if (m_surface && m_DC && !image->IsNull())
+        POINT offset = GetOffset();
+        if (::fabs(m.eDx - offset.x) > epsilon || ::fabs(m.eDy - offset.y) > epsilon)
         {
-            RECT desRect = { 0 };
-            m_surface->GetSurfaceRect(&desRect);
+            //! half a pixel off is a resampling, not a blit
+            m_kind = KindGeneral;
+            return;
+        }
 
-            HDC srcDC = ::CreateCompatibleDC(NULL);
+        m_kind = offset.x || offset.y ? KindTranslate : KindIdentity;
+    }
 
-            ::SelectObject(srcDC, image->m_bitmap);
-         
-            ::BitBlt(m_DC, desRect.left, desRect.top, region.right, region.bottom, srcDC, region.left, region.top, SRCCOPY);
+    void Context::BeginRecording(DisplayList *list)
+    {
+        m_recording = list;
+    }
 
-            ::DeleteObject(srcDC);
+    void Context::EndRecording()
+    {
+        m_recording = NULL;
+    }
+
+    FrameArena& Context::GetArena()
+    {
+        if (m_surface && m_surface->GetFlushCount() != m_arenaFrame)
+        {
+            m_arenaFrame = m_surface->GetFlushCount();
+            m_arena.Reset();
         }
+
+        return m_arena;
     }
 
-    void Context::DrawClippedImageAt(Image *image, const RECT& region, const POINT& pos)
+    void Context::AddDamage(LONG x, LONG y, LONG width, LONG height)
     {
-        if (region.right <= 0 || region.bottom <= 0)
+        if (!m_surface)
             return;
 
+        //! the clip is inside the surface, nothing outside its bounds was touched
+        const RECT& bounds = m_status.Top().clip.GetBounds();
+
+        LONG left = max(x, bounds.left);
+        LONG top = max(y, bounds.top);
+        LONG right = min(x + width, bounds.left + bounds.right);
+        LONG bottom = min(y + height, bounds.top + bounds.bottom);
+
+        if (right > left && bottom > top)
+        {
+            RECT r = { left, top, right - left, bottom - top };
+            m_damage.Add(r);
+        }
+    }
+
+#if USE_GDI
+
+    //! AlphaBlend reads per pixel alpha only premultiplied, straight images are drawn opaque
+    static inline bool HasAlpha(const Image *image)
+    {
+        return !image->IsOpaque() && Image::AlphaPremultiplied == image->GetAlphaMode();
+    }
+
+    static inline BYTE AlphaFormatOf(const Image *image)
+    {
+        return HasAlpha(image) ? AC_SRC_ALPHA : 0;
+    }
+
+    Context::Context()
+        : m_DC(NULL)
+        , m_surface(NULL)
+        , m_origin()
+        , m_dirty(0)
+        , m_recording(NULL)
+        , m_arena()
+        , m_arenaFrame(0)
+    {
+        
+    }
+
+    Context::~Context()
+    {
+        if (m_DC)
+            ::DeleteObject(m_DC);
+    }
+
+    void Context::Reset()
+    {
+        if (m_surface)
+        {
+            if (m_DC)
+                ::DeleteObject(m_DC);
+
+            m_surface->InitContext(*this);
+        }
+    }
+
+    void Context::SetFont(const Font& f)
+    {
+        if (m_recording)
+        {
+            m_recording->SetFont(f);
+            return;
+        }
+
+        m_status.Top().font = f;
+        m_status.Top().changed |= StatusFont;
+    }
+
+    void Context::SetPen(const Pen& p)
+    {
+        if (m_recording)
+        {
+            m_recording->SetPen(p);
+            return;
+        }
+
+        m_status.Top().pen = p;
+        m_status.Top().changed |= StatusPen;
+        m_dirty |= StatusPen;
+    }
+
+    void Context::SetBrush(const Brush& b)
+    {
+        if (m_recording)
+        {
+            m_recording->SetBrush(b);
+            return;
+        }
+
+        m_status.Top().brush = b;
+        m_status.Top().changed |= StatusBrush;
+        m_dirty |= StatusBrush;
+    }
+
+    void Context::SetTransform(const AffineMaxtrix& matrix)
+    {
+        if (m_recording)
+        {
+            m_recording->SetTransform(matrix);
+            return;
+        }
+
+        m_status.Top().transform = matrix;
+        m_status.Top().changed |= StatusTransform;
+    }
+
+    void Context::SetOpaque(BYTE opaque)
+    {
+        if (m_recording)
+        {
+            m_recording->SetOpaque(opaque);
+            return;
+        }
+
+        m_status.Top().opaque = opaque;
+        m_status.Top().changed |= StatusOpaque;
+    }
+
+    void Context::ClipRect(const RECT& rect)
+    {
+        Clip(ClipReplace, rect);
+    }
+
+    void Context::IntersectClip(const RECT& rect)
+    {
+        Clip(ClipIntersect, rect);
+    }
+
+    void Context::UnionClip(const RECT& rect)
+    {
+        Clip(ClipUnion, rect);
+    }
+
+    void Context::ExcludeClip(const RECT& rect)
+    {
+        Clip(ClipExclude, rect);
+    }
+
+    void Context::Clip(ClipOp op, const RECT& rect)
+    {
+        if (m_recording)
+        {
+            m_recording->Clip(op, rect);
+            return;
+        }
+
+        RECT moved = { rect.left - m_origin.x, rect.top - m_origin.y, rect.right, rect.bottom };
+        ContextStatus& status = m_status.Top();
+        status.clip.Combine(op, moved);
+
+        //! the mirror dib paths write every rect as it is, none may reach past the surface
+        if (ClipReplace == op || ClipUnion == op)
+            status.clip.Intersect(GetBoundingRegion());
+
+        status.changed |= StatusClip;
+        m_dirty |= StatusClip;
+    }
+
+    void Context::DrawImage(Image *image)
+    {
+        POINT zero = { 0, 0 };
+        DrawImageAt(image, zero);
+    }
+
+    void Context::DrawImageAt(Image *image, const POINT& pos)
+    {
+        if (m_recording)
+        {
+            m_recording->DrawImageAt(image, pos);
+            return;
+        }
+
+        if (AffineMaxtrix::KindIdentity != m_status.Top().transform.GetKind())
+        {
+            RECT whole = { 0, 0, image->GetWidth(), image->GetHeight() };
+            RECT dest = { pos.x, pos.y, whole.right, whole.bottom };
+            DrawTransformed(image, whole, dest, Pixel::FilterBilinear);
+            return;
+        }
+
+        const ContextStatus& currentStatus = m_status.Top();
+        UINT opaque = currentStatus.opaque;
+
+        if (opaque && m_surface && m_DC && !image->IsNull())
+        {
+            //! only the part of the image inside the clip's bounds is blitted, not the surface's size from pos
+            POINT at = { pos.x - m_origin.x, pos.y - m_origin.y };
+            RECT blitRect = { 0 };
+            POINT srcPos = { 0 };
+
+            if (!ClipBlit(currentStatus.clip.GetBounds(), image->GetSize(), at, &blitRect, &srcPos) || !currentStatus.clip.Intersects(blitRect))
+                return;
+
+            if (255 != opaque || !image->IsOpaque())
+            {
+                //! blend straight into the mirror dib, no dc round-trip
+                DIBSECTION dib = { 0 };
+                HGDIOBJ target = ::GetCurrentObject(m_DC, OBJ_BITMAP);
+
+                if (target && sizeof(DIBSECTION) == ::GetObject(target, sizeof(DIBSECTION), &dib) && dib.dsBm.bmBits)
+                {
+                    ::GdiFlush();
+
+                    PixelBuffer buffer = { (PBYTE)dib.dsBm.bmBits, dib.dsBm.bmWidthBytes, dib.dsBm.bmWidth, dib.dsBm.bmHeight, false };
+
+                    if (BlitClipped(buffer, image->GetOffset(0, 0), image->GetStride(), image->GetSize(), BlendModeOf(image),
+                        at, opaque, currentStatus.clip, &blitRect))
+                    {
+                        AddDamage(blitRect.left, blitRect.top, blitRect.right, blitRect.bottom);
+                    }
+
+                    return;
+                }
+            }
+
+            //! the dc's clip region trims the blit to the clip's rects
+            ApplyState(StatusClip);
+
+            HDC srcDC = ::CreateCompatibleDC(NULL);
+
+            ::SelectObject(srcDC, image->m_bitmap);
+
+            if (255 != opaque || HasAlpha(image))
+            {
+                BLENDFUNCTION bf = { AC_SRC_OVER, 0, opaque, AlphaFormatOf(image) };
+                lpAlphaBlend(m_DC, blitRect.left, blitRect.top, blitRect.right, blitRect.bottom,
+                    srcDC, srcPos.x, srcPos.y, blitRect.right, blitRect.bottom, bf);
+            }
+            else
+            {
+                ::BitBlt(m_DC, blitRect.left, blitRect.top, blitRect.right, blitRect.bottom, srcDC, srcPos.x, srcPos.y, SRCCOPY);
+            }
+
+            ::DeleteObject(srcDC);
+
+            AddDamage(blitRect.left, blitRect.top, blitRect.right, blitRect.bottom);
+        }
+    }
+
+    void Context::DrawClippedImage(Image *image, const RECT& region)
+    {
+        POINT pos = { 0, 0 };
+        DrawClippedImageAt(image, region, pos);
+    }
+
+    void Context::DrawClippedImageAt(Image *image, const RECT& region, const POINT& pos)
+    {
+        if (m_recording)
+        {
+            m_recording->DrawClippedImageAt(image, region, pos);
+            return;
+        }
+
+        if (region.right <= 0 || region.bottom <= 0)
+            return;
+
+        if (AffineMaxtrix::KindIdentity != m_status.Top().transform.GetKind())
+        {
+            //! keep the clipped pixels where they would have been
+            RECT clipRegion = { 0 };
+            IntersectRegion(&clipRegion, image->GetSize(), region);
+
+            RECT dest = { pos.x + clipRegion.left - region.left, pos.y + clipRegion.top - region.top, clipRegion.right, clipRegion.bottom };
+            DrawTransformed(image, clipRegion, dest, Pixel::FilterBilinear);
+            return;
+        }
+
+        const ClipRegion& clip = m_status.Top().clip;
+
         if (m_surface && m_DC && !image->IsNull())
         {
-            RECT desRect = { 0 };
-            m_surface->GetSurfaceRect(&desRect);
+            RECT clipRegion = { 0 };
 
-            if (pos.x > desRect.right || pos.y > desRect.bottom)
+            IntersectRegion(&clipRegion, image->GetSize(), region);
+            if (clipRegion.right <= 0 || clipRegion.bottom <= 0)
+                return;
+
+            //! the clipped pixels stay where they would have been, and only what the clip's bounds keep is blitted
+            SIZE clipSize = { clipRegion.right, clipRegion.bottom };
+            POINT at = { pos.x + clipRegion.left - region.left - m_origin.x, pos.y + clipRegion.top - region.top - m_origin.y };
+            RECT blitRect = { 0 };
+            POINT srcPos = { 0 };
+
+            if (!ClipBlit(clip.GetBounds(), clipSize, at, &blitRect, &srcPos) || !clip.Intersects(blitRect))
                 return;
 
+            ApplyState(StatusClip);
+
             HDC srcDC = ::CreateCompatibleDC(NULL);
 
             ::SelectObject(srcDC, image->m_bitmap);
 
-            ::BitBlt(m_DC, pos.x, pos.y, region.right, region.bottom, srcDC, region.left, region.top, SRCCOPY);
+            if (HasAlpha(image))
+            {
+                BLENDFUNCTION bf = { AC_SRC_OVER, 0, 255, AC_SRC_ALPHA };
+                lpAlphaBlend(m_DC, blitRect.left, blitRect.top, blitRect.right, blitRect.bottom,
+                    srcDC, clipRegion.left + srcPos.x, clipRegion.top + srcPos.y, blitRect.right, blitRect.bottom, bf);
+            }
+            else
+            {
+                ::BitBlt(m_DC, blitRect.left, blitRect.top, blitRect.right, blitRect.bottom,
+                    srcDC, clipRegion.left + srcPos.x, clipRegion.top + srcPos.y, SRCCOPY);
+            }
+
+            ::DeleteObject(srcDC);
+
+            AddDamage(blitRect.left, blitRect.top, blitRect.right, blitRect.bottom);
+        }
+    }
+
+    void Context::DrawScaledImage(Image *image, const RECT& region, Pixel::Filter filter)
+    {
+        if (m_recording)
+        {
+            m_recording->DrawScaledImage(image, region, filter);
+            return;
+        }
+
+        UINT opaque = m_status.Top().opaque;
+
+        if (region.right <= 0 || region.bottom <= 0)
+            return;
+
+        if (AffineMaxtrix::KindIdentity != m_status.Top().transform.GetKind())
+        {
+            RECT whole = { 0, 0, image->GetWidth(), image->GetHeight() };
+            DrawTransformed(image, whole, region, filter);
+            return;
+        }
+
+        const ClipRegion& clip = m_status.Top().clip;
+        RECT moved = { region.left - m_origin.x, region.top - m_origin.y, region.right, region.bottom };
+
+        //! outside the clip, not even a cache lookup
+        if (opaque && m_surface && m_DC && !image->IsNull() && clip.Intersects(moved))
+        {
+            SIZE scaledSize = { region.right, region.bottom };
+            RefImageResource *scaled = ScaledImageCache::Instance().Acquire(image, scaledSize, filter);
+            if (scaled)
+            {
+                //! drawn at this size before, it is a plain blit now
+                POINT pos = { region.left, region.top };
+                DrawImageAt(scaled, pos);
+                scaled->Release();
+                return;
+            }
+
+            image = ScaledSourceOf(image, region, filter);
+
+            //! resample straight into the mirror dib, as DrawImageAt blends
+            DIBSECTION dib = { 0 };
+            HGDIOBJ target = ::GetCurrentObject(m_DC, OBJ_BITMAP);
+
+            if (target && sizeof(DIBSECTION) == ::GetObject(target, sizeof(DIBSECTION), &dib) && dib.dsBm.bmBits)
+            {
+                ::GdiFlush();
+
+                PixelBuffer buffer = { (PBYTE)dib.dsBm.bmBits, dib.dsBm.bmWidthBytes, dib.dsBm.bmWidth, dib.dsBm.bmHeight, false };
+
+                RECT blitRect = { 0 };
+                if (BlitScaled(buffer, image, moved, filter, opaque, GetArena(), clip, &blitRect))
+                    AddDamage(blitRect.left, blitRect.top, blitRect.right, blitRect.bottom);
+
+                return;
+            }
+
+            //! stretched whole so the sampling stays the same, the dc's clip region trims it
+            ApplyState(StatusClip);
+
+            HDC srcDC = ::CreateCompatibleDC(NULL);
+            ::SelectObject(srcDC, image->m_bitmap);
+
+            if (255 != opaque || HasAlpha(image))
+            {
+                BLENDFUNCTION bf = { AC_SRC_OVER, 0, opaque, AlphaFormatOf(image) };
+                lpAlphaBlend(m_DC, moved.left, moved.top, moved.right, moved.bottom,
+                    srcDC, 0, 0, image->GetWidth(), image->GetHeight(), bf);
+            }
+            else
+            {
+                ::SetStretchBltMode(m_DC, Pixel::FilterNearest == filter ? COLORONCOLOR : HALFTONE);
+                ::StretchBlt(m_DC, moved.left, moved.top, moved.right, moved.bottom,
+                    srcDC, 0, 0, image->GetWidth(), image->GetHeight(), SRCCOPY);
+            }
 
             ::DeleteObject(srcDC);
+
+            AddDamage(moved.left, moved.top, moved.right, moved.bottom);
+        }
+    }
+
+    void Context::DrawText(const String& text)
+    {
+        POINT topLeft = { 0, 0 };
+        DrawTextAt(topLeft, text);
+    }
+
+    void Context::DrawTextAt(POINT where, const String& text)
+    {
+        if (m_recording)
+        {
+            m_recording->DrawTextAt(where, text);
+            return;
+        }
+
+        //! whole pixel offsets keep the glyphs on the grid, anything else draws them offscreen first
+        const AffineMaxtrix& transform = m_status.Top().transform;
+        if (AffineMaxtrix::KindTranslate == transform.GetKind())
+        {
+            where.x += transform.GetOffset().x;
+            where.y += transform.GetOffset().y;
+        }
+        else if (AffineMaxtrix::KindIdentity != transform.GetKind())
+        {
+            DrawTextTransformed(where, text);
+            return;
+        }
+
+        where.x -= m_origin.x;
+        where.y -= m_origin.y;
+
+        RECT pos = { where.x, where.y, 0, 0 };
+        const ContextStatus& currentStatus = m_status.Top();
+
+        if (!text.empty() && !currentStatus.clip.IsEmpty() && m_surface && m_DC)
+        {
+            //! cached glyphs blended into the mirror dib, no hfont per call
+            DIBSECTION dib = { 0 };
+            HGDIOBJ target = ::GetCurrentObject(m_DC, OBJ_BITMAP);
+
+            if (target && sizeof(DIBSECTION) == ::GetObject(target, sizeof(DIBSECTION), &dib) && dib.dsBm.bmBits)
+            {
+                PixelBuffer buffer = { (PBYTE)dib.dsBm.bmBits, dib.dsBm.bmWidthBytes, dib.dsBm.bmWidth, dib.dsBm.bmHeight, false };
+
+                ::GdiFlush();
+
+                RECT bounds = { 0 };
+                if (BlitText(buffer, currentStatus.font, currentStatus.brush, PixelOf(currentStatus.pen.GetColor()), (BYTE)currentStatus.opaque,
+                    where, text, GetArena(), currentStatus.clip, &bounds))
+                {
+                    AddDamage(bounds.left, bounds.top, bounds.right, bounds.bottom);
+                }
+
+                return;
+            }
+
+            const Font& currentFont = currentStatus.font;
+            ApplyState(StatusPen | StatusBrush | StatusClip);
+
+            HFONT fObj = ::CreateFontIndirect(&currentFont.m_font);
+            HGDIOBJ fPre = ::SelectObject(m_DC, fObj);
+
+            ::DrawText(m_DC, text.c_str(), text.length(), &pos, DT_LEFT | DT_TOP | DT_NOCLIP);
+
+            //! DT_NOCLIP leaves pos untouched, measure for the damage
+            RECT bounds = { where.x, where.y, where.x, where.y };
+            ::DrawText(m_DC, text.c_str(), text.length(), &bounds, DT_LEFT | DT_TOP | DT_NOCLIP | DT_CALCRECT);
+            AddDamage(bounds.left, bounds.top, bounds.right - bounds.left, bounds.bottom - bounds.top);
+
+            ::SelectObject(m_DC, fPre);
+            ::DeleteObject(fObj);
+        }
+    }
+
+    void Context::DrawTransformed(Image *image, const RECT& source, const RECT& dest, Pixel::Filter filter)
+    {
+        UINT opaque = m_status.Top().opaque;
+        const ClipRegion& clip = m_status.Top().clip;
+
+        if (!opaque || clip.IsEmpty() || !m_surface || !m_DC || image->IsNull())
+            return;
+
+        const AffineMaxtrix& transform = m_status.Top().transform;
+
+        //! sampled straight into the mirror dib, as DrawImageAt blends
+        DIBSECTION dib = { 0 };
+        HGDIOBJ target = ::GetCurrentObject(m_DC, OBJ_BITMAP);
+
+        if (target && sizeof(DIBSECTION) == ::GetObject(target, sizeof(DIBSECTION), &dib) && dib.dsBm.bmBits)
+        {
+            ::GdiFlush();
+
+            PixelBuffer buffer = { (PBYTE)dib.dsBm.bmBits, dib.dsBm.bmWidthBytes, dib.dsBm.bmWidth, dib.dsBm.bmHeight, false };
+
+            RECT blitRect = { 0 };
+            if (BlitTransformed(buffer, image, source, dest, transform, filter, opaque, GetArena(), m_origin, clip, &blitRect))
+                AddDamage(blitRect.left, blitRect.top, blitRect.right, blitRect.bottom);
+
+            return;
+        }
+
+        AffineMaxtrix device = DeviceMatrixOf(transform, m_origin);
+        RECT bounds = device.MapBounds(dest);
+        if (!clip.Intersects(bounds))
+            return;
+
+        //! no bits to reach, the dc maps the blit itself; the clip region is in device pixels, the world transform leaves it be
+        ApplyState(StatusClip);
+
+        int graphicsMode = ::SetGraphicsMode(m_DC, GM_ADVANCED);
+        ::SetWorldTransform(m_DC, &device.GetMatrix());
+
+        HDC srcDC = ::CreateCompatibleDC(NULL);
+        ::SelectObject(srcDC, image->m_bitmap);
+
+        if (255 != opaque || HasAlpha(image))
+        {
+            BLENDFUNCTION bf = { AC_SRC_OVER, 0, (BYTE)opaque, AlphaFormatOf(image) };
+            lpAlphaBlend(m_DC, dest.left, dest.top, dest.right, dest.bottom,
+                srcDC, source.left, source.top, source.right, source.bottom, bf);
+        }
+        else
+        {
+            ::SetStretchBltMode(m_DC, Pixel::FilterNearest == filter ? COLORONCOLOR : HALFTONE);
+            ::StretchBlt(m_DC, dest.left, dest.top, dest.right, dest.bottom,
+                srcDC, source.left, source.top, source.right, source.bottom, SRCCOPY);
+        }
+
+        ::DeleteObject(srcDC);
+
+        ::ModifyWorldTransform(m_DC, NULL, MWT_IDENTITY);
+        ::SetGraphicsMode(m_DC, graphicsMode);
+
+        AddDamage(bounds.left, bounds.top, bounds.right, bounds.bottom);
+    }
+
+    void Context::DrawTextTransformed(const POINT& where, const String& text)
+    {
+        const ContextStatus& currentStatus = m_status.Top();
+
+        if (text.empty() || currentStatus.clip.IsEmpty() || !m_surface || !m_DC)
+            return;
+
+        DIBSECTION dib = { 0 };
+        HGDIOBJ target = ::GetCurrentObject(m_DC, OBJ_BITMAP);
+
+        if (target && sizeof(DIBSECTION) == ::GetObject(target, sizeof(DIBSECTION), &dib) && dib.dsBm.bmBits)
+        {
+            ::GdiFlush();
+
+            PixelBuffer buffer = { (PBYTE)dib.dsBm.bmBits, dib.dsBm.bmWidthBytes, dib.dsBm.bmWidth, dib.dsBm.bmHeight, false };
+
+            //! gdi colours carry no alpha, the opacity alone fades the text as DrawTextAt does
+            RECT bounds = { 0 };
+            if (BlitTextTransformed(buffer, currentStatus.font, currentStatus.brush, currentStatus.pen.GetColor() | 0xFF000000, currentStatus.opaque,
+                where, text, currentStatus.transform, GetArena(), m_origin, currentStatus.clip, &bounds))
+            {
+                AddDamage(bounds.left, bounds.top, bounds.right, bounds.bottom);
+            }
+
+            return;
+        }
+
+        ApplyState(StatusPen | StatusBrush | StatusClip);
+
+        AffineMaxtrix device = DeviceMatrixOf(currentStatus.transform, m_origin);
+        int graphicsMode = ::SetGraphicsMode(m_DC, GM_ADVANCED);
+        ::SetWorldTransform(m_DC, &device.GetMatrix());
+
+        HFONT fObj = ::CreateFontIndirect(&currentStatus.font.m_font);
+        HGDIOBJ fPre = ::SelectObject(m_DC, fObj);
+
+        RECT pos = { where.x, where.y, 0, 0 };
+        ::DrawText(m_DC, text.c_str(), text.length(), &pos, DT_LEFT | DT_TOP | DT_NOCLIP);
+
+        RECT bounds = { where.x, where.y, where.x, where.y };
+        ::DrawText(m_DC, text.c_str(), text.length(), &bounds, DT_LEFT | DT_TOP | DT_NOCLIP | DT_CALCRECT);
+
+        ::SelectObject(m_DC, fPre);
+        ::DeleteObject(fObj);
+
+        ::ModifyWorldTransform(m_DC, NULL, MWT_IDENTITY);
+        ::SetGraphicsMode(m_DC, graphicsMode);
+
+        RECT measured = { bounds.left, bounds.top, bounds.right - bounds.left, bounds.bottom - bounds.top };
+        bounds = device.MapBounds(measured);
+        AddDamage(bounds.left, bounds.top, bounds.right, bounds.bottom);
+    }
+
+    TextMetric Context::GetTextMetric() const
+    {
+        return TextMetric(m_status.Top().font);
+    }
+
+    RECT Context::GetBoundingRegion() const
+    {
+        RECT rect = { 0 };
+        if (m_surface)
+        {
+            m_surface->GetSurfaceRect(&rect);
+        }
+
+        return rect;
+    }
+
+    void Context::Save()
+    {
+        if (m_recording)
+        {
+            m_recording->Save();
+            return;
+        }
+
+        if (m_DC)
+        {
+            //! by index, pushing may move the levels that spilled; the same clip, the dc's stays right
+            m_status.Push().Reset();
+            m_status.Top().clip = m_status[m_status.GetSize() - 2].clip;
+            m_dirty |= StatusPen | StatusBrush;
+        }
+    }
+
+    void Context::Restore()
+    {
+        if (m_recording)
+        {
+            m_recording->Restore();
+            return;
+        }
+
+        if (m_status.GetSize() > 1)
+        {
+            if (m_status.Top().changed & StatusClip)
+                m_dirty |= StatusClip;
+
+            m_status.Pop();
+            m_dirty |= StatusPen | StatusBrush;
+        }
+    }
+
+    void Context::ApplyState(UINT fields)
+    {
+        UINT dirty = m_dirty & fields;
+        if (!dirty || !m_DC)
+            return;
+
+        const ContextStatus& status = m_status.Top();
+
+        if (dirty & StatusPen)
+            ::SetTextColor(m_DC, status.pen.GetColor());
+
+        if (dirty & StatusBrush)
+        {
+            ::SetBkMode(m_DC, status.brush.IsNull() ? TRANSPARENT : OPAQUE);
+            if (!status.brush.IsNull())
+                ::SetBkColor(m_DC, status.brush.GetColor());
+        }
+
+        if (dirty & StatusClip)
+        {
+            //! device pixels, selected as a copy so the region is ours to free
+            HRGN region = ::CreateRectRgn(0, 0, 0, 0);
+            for (UINT i = 0; i != status.clip.GetCount(); ++i)
+            {
+                const RECT& r = status.clip.GetRect(i);
+                HRGN part = ::CreateRectRgn(r.left, r.top, r.left + r.right, r.top + r.bottom);
+
+                ::CombineRgn(region, region, part, RGN_OR);
+                ::DeleteObject(part);
+            }
+
+            ::SelectClipRgn(m_DC, region);
+            ::DeleteObject(region);
+        }
+
+        m_dirty &= ~dirty;
+    }
+
+    void Context::OnAttached(HDC dc, Surface *surface)
+    {
+        m_DC = dc;
+        m_surface = surface;
+        m_origin.x = m_origin.y = 0;
+
+        m_status.Clear();
+        m_status.Push().Reset();
+        m_status.Top().clip.SetRect(GetBoundingRegion());
+
+        //! a fresh attach starts a frame, e.g. tile contexts whose surfaces never flush
+        m_arena.Reset();
+        m_arenaFrame = surface->GetFlushCount();
+
+        //! a new dc, nothing of it is known yet
+        m_dirty = StatusPen | StatusBrush | StatusClip;
+    }
+
+#elif USE_CAIRO
+
+    //! nul terminated utf-8 copy in the frame arena, WCHAR is utf-16 on windows and utf-32 elsewhere
+    static const char *ToUtf8(FrameArena& arena, const WCHAR *text, size_t length)
+    {
+        char *out = arena.Allocate<char>(length * 4 + 1);
+        char *p = out;
+
+        for (size_t i = 0; i != length; ++i)
+        {
+            DWORD c = (DWORD)text[i];
+
+            if (c >= 0xD800 && c < 0xDC00 && i + 1 != length && (DWORD)text[i + 1] >= 0xDC00 && (DWORD)text[i + 1] < 0xE000)
+            {
+                c = 0x10000 + ((c - 0xD800) << 10) + ((DWORD)text[i + 1] - 0xDC00);
+                ++i;
+            }
+
+            if (c < 0x80)
+            {
+                *p++ = (char)c;
+            }
+            else if (c < 0x800)
+            {
+                *p++ = (char)(0xC0 | (c >> 6));
+                *p++ = (char)(0x80 | (c & 0x3F));
+            }
+            else if (c < 0x10000)
+            {
+                *p++ = (char)(0xE0 | (c >> 12));
+                *p++ = (char)(0x80 | ((c >> 6) & 0x3F));
+                *p++ = (char)(0x80 | (c & 0x3F));
+            }
+            else
+            {
+                *p++ = (char)(0xF0 | (c >> 18));
+                *p++ = (char)(0x80 | ((c >> 12) & 0x3F));
+                *p++ = (char)(0x80 | ((c >> 6) & 0x3F));
+                *p++ = (char)(0x80 | (c & 0x3F));
+            }
+        }
+
+        *p = 0;
+        return out;
+    }
+
+    //! cairo takes premultiplied alpha only, straight data is drawn opaque
+    static inline cairo_format_t FormatOf(const Image *image)
+    {
+        if (!image->IsOpaque() && Image::AlphaPremultiplied == image->GetAlphaMode())
+            return CAIRO_FORMAT_ARGB32;
+
+        return CAIRO_FORMAT_RGB24;
+    }
+
+    //! for targets the kernels cannot reach, cairo has no box or lanczos and takes its best
+    static inline cairo_filter_t FilterOf(Pixel::Filter filter)
+    {
+        switch (filter)
+        {
+        case Pixel::FilterNearest: return CAIRO_FILTER_NEAREST;
+        case Pixel::FilterBilinear: return CAIRO_FILTER_BILINEAR;
+        default: return CAIRO_FILTER_BEST;
+        }
+    }
+
+    Context::Context()
+        : m_status()
+        , m_surface(NULL)
+        , m_origin()
+        , m_DC(NULL)
+        , m_target(NULL)
+        , m_recording(NULL)
+        , m_arena()
+        , m_arenaFrame(0)
+    {
+
+    }
+
+    Context::~Context()
+    {
+        if (m_DC)
+            ::cairo_destroy(m_DC);
+    }
+
+    void Context::Reset()
+    {
+        if (m_surface)
+        {
+            if (m_DC)
+                ::cairo_destroy(m_DC);
+
+            m_surface->InitContext(*this);
+        }
+    }
+
+    void Context::SetFont(const Font& f)
+    {
+        if (m_recording)
+        {
+            m_recording->SetFont(f);
+            return;
+        }
+
+        if (m_DC)
+        {
+            m_status.Top().font = f;
+            m_status.Top().changed |= StatusFont;
+            m_status.Top().dirty |= StatusFont;
+        }
+    }
+
+    void Context::SetPen(const Pen& p)
+    {
+        if (m_recording)
+        {
+            m_recording->SetPen(p);
+            return;
+        }
+
+        if (m_DC)
+        {
+            m_status.Top().pen = p;
+            m_status.Top().changed |= StatusPen;
+            m_status.Top().dirty |= StatusPen;
+        }
+    }
+
+    void Context::SetBrush(const Brush& b)
+    {
+        if (m_recording)
+        {
+            m_recording->SetBrush(b);
+            return;
+        }
+
+        if (m_DC)
+        {
+            m_status.Top().brush = b;
+            m_status.Top().changed |= StatusBrush;
+        }
+    }
+
+    void Context::SetTransform(const AffineMaxtrix& matrix)
+    {
+        if (m_recording)
+        {
+            m_recording->SetTransform(matrix);
+            return;
+        }
+
+        if (m_DC)
+        {
+            //! draws read it themselves, only the fallbacks hand it to cairo, inside their own save
+            m_status.Top().transform = matrix;
+            m_status.Top().changed |= StatusTransform;
+        }
+    }
+
+    void Context::SetOpaque(BYTE opaque)
+    {
+        if (m_recording)
+        {
+            m_recording->SetOpaque(opaque);
+            return;
+        }
+
+        if (m_DC)
+        {
+            m_status.Top().opaque = opaque;
+            m_status.Top().changed |= StatusOpaque;
+            m_status.Top().dirty |= StatusOpaque;
+        }
+    }
+
+    void Context::ClipRect(const RECT& rect)
+    {
+        Clip(ClipReplace, rect);
+    }
+
+    void Context::IntersectClip(const RECT& rect)
+    {
+        Clip(ClipIntersect, rect);
+    }
+
+    void Context::UnionClip(const RECT& rect)
+    {
+        Clip(ClipUnion, rect);
+    }
+
+    void Context::ExcludeClip(const RECT& rect)
+    {
+        Clip(ClipExclude, rect);
+    }
+
+    void Context::Clip(ClipOp op, const RECT& rect)
+    {
+        if (m_recording)
+        {
+            m_recording->Clip(op, rect);
+            return;
+        }
+
+        FollowTarget();
+
+        if (m_DC)
+        {
+            ContextStatus& status = m_status.Top();
+            RECT moved = { rect.left - m_origin.x, rect.top - m_origin.y, rect.right, rect.bottom };
+            status.clip.Combine(op, moved);
+
+            //! the image surface paths write every rect as it is, none may reach past the surface
+            if (ClipReplace == op || ClipUnion == op)
+                status.clip.Intersect(GetBoundingRegion());
+
+            status.changed |= StatusClip;
+            status.dirty |= StatusClip;
+        }
+    }
+
+    void Context::DrawImage(Image *image)
+    {
+        POINT pos = { 0, 0 };
+        DrawImageAt(image, pos);
+    }
+
+    void Context::DrawImageAt(Image *image, const POINT& pos)
+    {
+        if (m_recording)
+        {
+            m_recording->DrawImageAt(image, pos);
+            return;
+        }
+
+        FollowTarget();
+
+        if (AffineMaxtrix::KindIdentity != m_status.Top().transform.GetKind())
+        {
+            RECT whole = { 0, 0, image->GetWidth(), image->GetHeight() };
+            RECT dest = { pos.x, pos.y, whole.right, whole.bottom };
+            DrawTransformed(image, whole, dest, Pixel::FilterBilinear);
+            return;
+        }
+
+        POINT at = { pos.x - m_origin.x, pos.y - m_origin.y };
+        UINT opaque = m_status.Top().opaque;
+        const ClipRegion& clip = m_status.Top().clip;
+
+        if (opaque && !clip.IsEmpty() && m_surface && m_DC && !image->IsNull())
+        {
+            cairo_surface_t *target = ::cairo_get_target(m_DC);
+
+            if (CAIRO_SURFACE_TYPE_IMAGE == ::cairo_surface_get_type(target))
+            {
+                //! blend straight into the target buffer, an opaque image at 255 is the same copy cairo_paint does
+                PixelBuffer buffer = { ::cairo_image_surface_get_data(target), ::cairo_image_surface_get_stride(target),
+                    ::cairo_image_surface_get_width(target), ::cairo_image_surface_get_height(target), false };
+                RECT blitRect = { 0 };
+
+                ::cairo_surface_flush(target);
+
+                if (BlitClipped(buffer, image->GetOffset(0, 0), image->GetStride(), image->GetSize(), BlendModeOf(image),
+                    at, opaque, clip, &blitRect))
+                {
+                    ::cairo_surface_mark_dirty_rectangle(target, blitRect.left, blitRect.top, blitRect.right, blitRect.bottom);
+
+                    AddDamage(blitRect.left, blitRect.top, blitRect.right, blitRect.bottom);
+                }
+
+                return;
+            }
+
+            //! cairo's clip trims the paint to the clip's rects
+            ApplyState(StatusClip);
+
+            cairo_surface_t *srcSurface = cairo_image_surface_create_for_data(image->GetOffset(0, 0), FormatOf(image), image->GetWidth(), image->GetHeight(), image->GetStride());
+            ::cairo_set_source_surface(m_DC, srcSurface, at.x, at.y);
+
+            if (255 == opaque)
+            {
+                ::cairo_paint(m_DC);
+            }
+            else
+            {
+                ::cairo_paint_with_alpha(m_DC, opaque / 255.);
+            }
+
+            ::cairo_surface_destroy(srcSurface);
+
+            //! the image replaced the pen's source
+            m_status.Top().dirty |= StatusPen;
+
+            AddDamage(at.x, at.y, image->GetWidth(), image->GetHeight());
+        }
+    }
+
+    void Context::DrawClippedImage(Image *image, const RECT& region)
+    {
+        POINT pos = { 0, 0 };
+        DrawClippedImageAt(image, region, pos);
+    }
+
+    void Context::DrawClippedImageAt(Image *image, const RECT& region, const POINT& pos)
+    {
+        if (m_recording)
+        {
+            m_recording->DrawClippedImageAt(image, region, pos);
+            return;
+        }
+
+        FollowTarget();
+
+        if (AffineMaxtrix::KindIdentity != m_status.Top().transform.GetKind())
+        {
+            //! keep the clipped pixels where they would have been
+            RECT clipRegion = { 0 };
+            IntersectRegion(&clipRegion, image->GetSize(), region);
+
+            RECT dest = { pos.x + clipRegion.left - region.left, pos.y + clipRegion.top - region.top, clipRegion.right, clipRegion.bottom };
+            DrawTransformed(image, clipRegion, dest, Pixel::FilterBilinear);
+            return;
+        }
+
+        POINT at = { pos.x - m_origin.x, pos.y - m_origin.y };
+        UINT opaque = m_status.Top().opaque;
+        const ClipRegion& clip = m_status.Top().clip;
+
+        if (opaque && !clip.IsEmpty() && m_surface && m_DC && !image->IsNull())
+        {
+            RECT clipRegion = { 0 };
+
+            IntersectRegion(&clipRegion, image->GetSize(), region);
+            if (clipRegion.right <= 0 || clipRegion.bottom <= 0)
+                return;
+
+            cairo_surface_t *target = ::cairo_get_target(m_DC);
+
+            if (CAIRO_SURFACE_TYPE_IMAGE == ::cairo_surface_get_type(target))
+            {
+                //! no wrapper surface per call, see DrawImageAt
+                PixelBuffer buffer = { ::cairo_image_surface_get_data(target), ::cairo_image_surface_get_stride(target),
+                    ::cairo_image_surface_get_width(target), ::cairo_image_surface_get_height(target), false };
+                SIZE clipSize = { clipRegion.right, clipRegion.bottom };
+                RECT blitRect = { 0 };
+
+                ::cairo_surface_flush(target);
+
+                if (BlitClipped(buffer, image->GetOffset(clipRegion.left, clipRegion.top), image->GetStride(), clipSize, BlendModeOf(image),
+                    at, opaque, clip, &blitRect))
+                {
+                    ::cairo_surface_mark_dirty_rectangle(target, blitRect.left, blitRect.top, blitRect.right, blitRect.bottom);
+
+                    AddDamage(blitRect.left, blitRect.top, blitRect.right, blitRect.bottom);
+                }
+
+                return;
+            }
+
+            ApplyState(StatusClip);
+
+            cairo_surface_t *srcSurface = cairo_image_surface_create_for_data(image->GetOffset(clipRegion.left, clipRegion.top), FormatOf(image), clipRegion.right, clipRegion.bottom, image->GetStride());
+            ::cairo_set_source_surface(m_DC, srcSurface, at.x, at.y);
+
+            if (255 == opaque)
+            {
+                ::cairo_paint(m_DC);
+            }
+            else
+            {
+                ::cairo_paint_with_alpha(m_DC, opaque / 255.);
+            }
+
+            ::cairo_surface_destroy(srcSurface);
+
+            //! the image replaced the pen's source
+            m_status.Top().dirty |= StatusPen;
+
+            AddDamage(at.x, at.y, clipRegion.right, clipRegion.bottom);
+        }
+    }
+
+    void Context::DrawScaledImage(Image *image, const RECT& region, Pixel::Filter filter)
+    {
+        if (m_recording)
+        {
+            m_recording->DrawScaledImage(image, region, filter);
+            return;
+        }
+
+        FollowTarget();
+
+        UINT opaque = m_status.Top().opaque;
+
+        if (region.right <= 0 || region.bottom <= 0)
+            return;
+
+        if (AffineMaxtrix::KindIdentity != m_status.Top().transform.GetKind())
+        {
+            RECT whole = { 0, 0, image->GetWidth(), image->GetHeight() };
+            DrawTransformed(image, whole, region, filter);
+            return;
+        }
+
+        const ClipRegion& clip = m_status.Top().clip;
+        RECT moved = { region.left - m_origin.x, region.top - m_origin.y, region.right, region.bottom };
+
+        //! outside the clip, not even a cache lookup
+        if (opaque && m_surface && m_DC && !image->IsNull() && clip.Intersects(moved))
+        {
+            SIZE scaledSize = { region.right, region.bottom };
+            RefImageResource *scaled = ScaledImageCache::Instance().Acquire(image, scaledSize, filter);
+            if (scaled)
+            {
+                //! drawn at this size before, it is a plain blit now
+                POINT pos = { region.left, region.top };
+                DrawImageAt(scaled, pos);
+                scaled->Release();
+                return;
+            }
+
+            image = ScaledSourceOf(image, region, filter);
+
+            cairo_surface_t *target = ::cairo_get_target(m_DC);
+
+            if (CAIRO_SURFACE_TYPE_IMAGE == ::cairo_surface_get_type(target))
+            {
+                //! resample straight into the target buffer, as DrawImageAt blends
+                PixelBuffer buffer = { ::cairo_image_surface_get_data(target), ::cairo_image_surface_get_stride(target),
+                    ::cairo_image_surface_get_width(target), ::cairo_image_surface_get_height(target), false };
+                RECT blitRect = { 0 };
+
+                ::cairo_surface_flush(target);
+
+                if (BlitScaled(buffer, image, moved, filter, opaque, GetArena(), clip, &blitRect))
+                {
+                    ::cairo_surface_mark_dirty_rectangle(target, blitRect.left, blitRect.top, blitRect.right, blitRect.bottom);
+
+                    AddDamage(blitRect.left, blitRect.top, blitRect.right, blitRect.bottom);
+                }
+
+                return;
+            }
+
+            //! before the save, so the clip set stays this level's
+            ApplyState(StatusClip);
+
+            cairo_surface_t *srcSurface = cairo_image_surface_create_for_data(image->GetOffset(0, 0), FormatOf(image), image->GetWidth(), image->GetHeight(), image->GetStride());
+
+            ::cairo_save(m_DC);
+            ::cairo_translate(m_DC, moved.left, moved.top);
+            ::cairo_scale(m_DC, (double)region.right / image->GetWidth(), (double)region.bottom / image->GetHeight());
+            ::cairo_set_source_surface(m_DC, srcSurface, 0, 0);
+            ::cairo_pattern_set_filter(::cairo_get_source(m_DC), FilterOf(filter));
+
+            if (255 == opaque)
+            {
+                ::cairo_paint(m_DC);
+            }
+            else
+            {
+                ::cairo_paint_with_alpha(m_DC, opaque / 255.);
+            }
+
+            ::cairo_restore(m_DC);
+            ::cairo_surface_destroy(srcSurface);
+
+            AddDamage(moved.left, moved.top, moved.right, moved.bottom);
+        }
+    }
+
+    void Context::DrawText(const String& text)
+    {
+        POINT pos = { 0, 0 };
+        DrawTextAt(pos, text);
+    }
+
+    void Context::DrawTextAt(const POINT& where, const String& text)
+    {
+        if (m_recording)
+        {
+            m_recording->DrawTextAt(where, text);
+            return;
+        }
+
+        FollowTarget();
+
+        if (text.empty())
+            return;
+
+        const auto& currentStatus = m_status.Top();
+
+        //! whole pixel offsets keep the glyphs on the grid, anything else draws them offscreen first
+        POINT at = where;
+        if (AffineMaxtrix::KindTranslate == currentStatus.transform.GetKind())
+        {
+            at.x += currentStatus.transform.GetOffset().x;
+            at.y += currentStatus.transform.GetOffset().y;
+        }
+        else if (AffineMaxtrix::KindIdentity != currentStatus.transform.GetKind())
+        {
+            DrawTextTransformed(where, text);
+            return;
+        }
+
+        at.x -= m_origin.x;
+        at.y -= m_origin.y;
+
+        if (currentStatus.opaque && !currentStatus.clip.IsEmpty() && m_surface && m_DC)
+        {
+            auto textColor = currentStatus.pen.GetColor();
+            cairo_surface_t *target = ::cairo_get_target(m_DC);
+
+            if (CAIRO_SURFACE_TYPE_IMAGE == ::cairo_surface_get_type(target))
+            {
+                //! cached glyphs blended into the target buffer, no utf-8 round trip or extents call
+                PixelBuffer buffer = { ::cairo_image_surface_get_data(target), ::cairo_image_surface_get_stride(target),
+                    ::cairo_image_surface_get_width(target), ::cairo_image_surface_get_height(target), false };
+                BYTE alpha = (BYTE)Pixel::Div255(currentStatus.opaque * GetAValue(textColor));
+
+                ::cairo_surface_flush(target);
+
+                //! no brush box, cairo text never fills one
+                RECT bounds = { 0 };
+                if (BlitText(buffer, currentStatus.font, Brush(), PixelOf(textColor), alpha, at, text, GetArena(), currentStatus.clip, &bounds))
+                {
+                    ::cairo_surface_mark_dirty_rectangle(target, bounds.left, bounds.top, bounds.right, bounds.bottom);
+
+                    AddDamage(bounds.left, bounds.top, bounds.right, bounds.bottom);
+                }
+
+                return;
+            }
+
+            ApplyState(StatusFont | StatusPen | StatusOpaque | StatusClip);
+
+            const char *utf8Text = ToUtf8(GetArena(), text.c_str(), text.length());
+
+            cairo_text_extents_t extends = { 0 };
+            ::cairo_text_extents(m_DC, utf8Text, &extends);
+
+            ::cairo_move_to(m_DC, at.x, at.y - extends.y_bearing);
+            ::cairo_show_text(m_DC, utf8Text);
+
+            //! ink box, rounded outwards, plus a pixel for antialiasing
+            AddDamage(at.x + (LONG)extends.x_bearing - 1, at.y - 1,
+                (LONG)(extends.width + 0.999) + 2, (LONG)(extends.height + 0.999) + 2);
+        }
+    }
+
+    void Context::DrawTransformed(Image *image, const RECT& source, const RECT& dest, Pixel::Filter filter)
+    {
+        UINT opaque = m_status.Top().opaque;
+        const ClipRegion& clip = m_status.Top().clip;
+
+        if (!opaque || clip.IsEmpty() || !m_surface || !m_DC || image->IsNull())
+            return;
+
+        const AffineMaxtrix& transform = m_status.Top().transform;
+        cairo_surface_t *target = ::cairo_get_target(m_DC);
+
+        if (CAIRO_SURFACE_TYPE_IMAGE == ::cairo_surface_get_type(target))
+        {
+            //! sampled straight into the target buffer, as DrawImageAt blends
+            PixelBuffer buffer = { ::cairo_image_surface_get_data(target), ::cairo_image_surface_get_stride(target),
+                ::cairo_image_surface_get_width(target), ::cairo_image_surface_get_height(target), false };
+            RECT blitRect = { 0 };
+
+            ::cairo_surface_flush(target);
+
+            if (BlitTransformed(buffer, image, source, dest, transform, filter, opaque, GetArena(), m_origin, clip, &blitRect))
+            {
+                ::cairo_surface_mark_dirty_rectangle(target, blitRect.left, blitRect.top, blitRect.right, blitRect.bottom);
+
+                AddDamage(blitRect.left, blitRect.top, blitRect.right, blitRect.bottom);
+            }
+
+            return;
+        }
+
+        AffineMaxtrix device = DeviceMatrixOf(transform, m_origin);
+        RECT bounds = device.MapBounds(dest);
+        if (!clip.Intersects(bounds))
+            return;
+
+        //! device pixels, set before the save and the transform
+        ApplyState(StatusClip);
+
+        const XFORM& m = device.GetMatrix();
+        cairo_matrix_t matrix;
+        ::cairo_matrix_init(&matrix, m.eM11, m.eM12, m.eM21, m.eM22, m.eDx, m.eDy);
+
+        cairo_surface_t *srcSurface = cairo_image_surface_create_for_data(image->GetOffset(source.left, source.top), FormatOf(image), source.right, source.bottom, image->GetStride());
+
+        ::cairo_save(m_DC);
+        ::cairo_transform(m_DC, &matrix);
+        ::cairo_translate(m_DC, dest.left, dest.top);
+        ::cairo_scale(m_DC, (double)dest.right / source.right, (double)dest.bottom / source.bottom);
+        ::cairo_set_source_surface(m_DC, srcSurface, 0, 0);
+        ::cairo_pattern_set_filter(::cairo_get_source(m_DC), FilterOf(filter));
+
+        if (255 == opaque)
+        {
+            ::cairo_paint(m_DC);
+        }
+        else
+        {
+            ::cairo_paint_with_alpha(m_DC, opaque / 255.);
+        }
+
+        ::cairo_restore(m_DC);
+        ::cairo_surface_destroy(srcSurface);
+
+        AddDamage(bounds.left, bounds.top, bounds.right, bounds.bottom);
+    }
+
+    void Context::DrawTextTransformed(const POINT& where, const String& text)
+    {
+        const ContextStatus& currentStatus = m_status.Top();
+
+        if (text.empty() || !currentStatus.opaque || currentStatus.clip.IsEmpty() || !m_surface || !m_DC)
+            return;
+
+        cairo_surface_t *target = ::cairo_get_target(m_DC);
+
+        if (CAIRO_SURFACE_TYPE_IMAGE == ::cairo_surface_get_type(target))
+        {
+            PixelBuffer buffer = { ::cairo_image_surface_get_data(target), ::cairo_image_surface_get_stride(target),
+                ::cairo_image_surface_get_width(target), ::cairo_image_surface_get_height(target), false };
+            RECT bounds = { 0 };
+
+            ::cairo_surface_flush(target);
+
+            //! no brush box, as DrawTextAt draws none here
+            if (BlitTextTransformed(buffer, currentStatus.font, Brush(), currentStatus.pen.GetColor(), currentStatus.opaque,
+                where, text, currentStatus.transform, GetArena(), m_origin, currentStatus.clip, &bounds))
+            {
+                ::cairo_surface_mark_dirty_rectangle(target, bounds.left, bounds.top, bounds.right, bounds.bottom);
+
+                AddDamage(bounds.left, bounds.top, bounds.right, bounds.bottom);
+            }
+
+            return;
+        }
+
+        ApplyState(StatusClip);
+
+        AffineMaxtrix device = DeviceMatrixOf(currentStatus.transform, m_origin);
+        const XFORM& m = device.GetMatrix();
+        cairo_matrix_t matrix;
+        ::cairo_matrix_init(&matrix, m.eM11, m.eM12, m.eM21, m.eM22, m.eDx, m.eDy);
+
+        ::cairo_save(m_DC);
+        ::cairo_transform(m_DC, &matrix);
+
+        //! set inside the save, so the restore below takes them away again
+        m_status.Top().dirty |= StatusFont | StatusPen | StatusOpaque;
+        ApplyState(StatusFont | StatusPen | StatusOpaque);
+
+        const char *utf8Text = ToUtf8(GetArena(), text.c_str(), text.length());
+
+        cairo_text_extents_t extends = { 0 };
+        ::cairo_text_extents(m_DC, utf8Text, &extends);
+
+        ::cairo_move_to(m_DC, where.x, where.y - extends.y_bearing);
+        ::cairo_show_text(m_DC, utf8Text);
+
+        ::cairo_restore(m_DC);
+        m_status.Top().dirty |= StatusFont | StatusPen | StatusOpaque;
+
+        RECT ink = { where.x + (LONG)extends.x_bearing - 1, where.y - 1, (LONG)(extends.width + 0.999) + 2, (LONG)(extends.height + 0.999) + 2 };
+        RECT bounds = device.MapBounds(ink);
+        AddDamage(bounds.left, bounds.top, bounds.right, bounds.bottom);
+    }
+
+    void Context::Save()
+    {
+        if (m_recording)
+        {
+            m_recording->Save();
+            return;
+        }
+
+        if (m_DC)
+        {
+            FollowTarget();
+
+            //! the new level starts from the defaults while cairo keeps the parent's gstate,
+            //! the clip alone carries over, as cairo's does; by index, pushing may move the levels that spilled
+            ContextStatus& status = m_status.Push();
+            const ContextStatus& parent = m_status[m_status.GetSize() - 2];
+            status.Reset();
+            status.clip = parent.clip;
+            status.dirty = StatusFont | StatusPen | StatusOpaque | (parent.dirty & StatusClip);
+            ::cairo_save(m_DC);
         }
     }
 
-    void Context::DrawScaledImage(Image *image, const RECT& region)
+    void Context::Restore()
     {
-        if (region.right <= 0 || region.bottom <= 0)
+        if (m_recording)
+        {
+            m_recording->Restore();
             return;
+        }
 
-        if (m_surface && m_DC && !image->IsNull())
+        if (m_DC)
         {
-            RECT desRect = { 0 };
-            m_surface->GetSurfaceRect(&desRect);
-
-            HDC srcDC = ::CreateCompatibleDC(NULL);
-            ::SelectObject(srcDC, image->m_bitmap);
-
-            ::SetStretchBltMode(m_DC, HALFTONE);
-            ::StretchBlt(m_DC, desRect.left, desRect.top, desRect.right, desRect.bottom,
-                srcDC, 0, 0, image->GetWidth(), image->GetHeight(), SRCCOPY);
-
-            ::DeleteObject(srcDC);
+            if (m_status.GetSize() > 1)
+            {
+                m_status.Pop();
+            }
+            ::cairo_restore(m_DC);
         }
     }
 
-    void Context::DrawText(const String& text)
+    void Context::ApplyState(UINT fields)
     {
-        POINT topLeft = { 0, 0 };
-        DrawTextAt(topLeft, text);
-    }
+        ContextStatus& status = m_status.Top();
+        UINT dirty = status.dirty & fields;
+        if (!dirty || !m_DC)
+            return;
 
-    void Context::DrawTextAt(POINT where, const String& text)
-    {
-        RECT pos = { where.x, where.y, 0, 0 };
+        if (dirty & StatusFont)
+        {
+            const WCHAR *family = status.font.m_font.lfFaceName;
+            const char *face = ToUtf8(GetArena(), family, ::wcsnlen(family, LF_FACESIZE));
+            ::cairo_select_font_face(m_DC, face, CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+        }
 
-        if (!text.empty() && m_surface && m_DC)
+        if (dirty & (StatusPen | StatusOpaque))
         {
-            auto currentStatus = m_status.top();
+            //! the source colour carries the opacity, one set covers both
+            dirty |= StatusPen | StatusOpaque;
+            COLORREF color = status.pen.GetColor();
 
-            const Font& currentFont = currentStatus.font;
-            ::SetTextColor(m_DC, currentStatus.pen.GetColor());
+            if (255 == status.opaque && 255 == GetAValue(color))
+            {
+                ::cairo_set_source_rgb(m_DC, GetRValue(color) / 255., GetGValue(color) / 255., GetBValue(color) / 255.);
+            }
+            else
+            {
+                ::cairo_set_source_rgba(m_DC, GetRValue(color) / 255., GetGValue(color) / 255., GetBValue(color) / 255.,
+                    (status.opaque / 255.) * (GetAValue(color) / 255.));
+            }
 
-            HFONT fObj = ::CreateFontIndirect(&currentFont.m_font);
-            HGDIOBJ fPre = ::SelectObject(m_DC, fObj);
+            ::cairo_set_line_width(m_DC, status.pen.GetWidth());
+        }
 
-            if (!currentStatus.brush.IsNull())
+        if (dirty & StatusClip)
+        {
+            //! identity ctm here, the rects land on device pixels
+            ::cairo_reset_clip(m_DC);
+            for (UINT i = 0; i != status.clip.GetCount(); ++i)
             {
-                SetBkColor(m_DC, currentStatus.brush.GetColor());
+                const RECT& r = status.clip.GetRect(i);
+                ::cairo_rectangle(m_DC, r.left, r.top, r.right, r.bottom);
             }
-            ::DrawText(m_DC, text.c_str(), text.length(), &pos, DT_LEFT | DT_TOP | DT_NOCLIP);
-
-            ::SelectObject(m_DC, fPre);
-            ::DeleteObject(fObj);
+            ::cairo_clip(m_DC);
         }
+
+        status.dirty &= ~dirty;
     }
 
     TextMetric Context::GetTextMetric() const
     {
-        return TextMetric(m_status.top().font);
+        return TextMetric(m_status.Top().font);
     }
 
     RECT Context::GetBoundingRegion() const
@@ -471,129 +2251,201 @@ namespace Render
         return rect;
     }
 
-    void Context::Save()
-    {
-        if (m_DC)
-        {
-            m_status.push(ContextStatus());
-            ::SetBkMode(m_DC, TRANSPARENT);
-        }
-    }
-
-    void Context::Restore()
-    {
-        if (m_status.size() > 1)
-        {
-            m_status.pop();
-
-            if (m_DC)
-                ::SetBkMode(m_DC, m_status.top().brush.IsNull() ? TRANSPARENT : OPAQUE);
-        }
-    }
-
-    void Context::OnAttached(HDC dc, Surface *surface)
+    void Context::OnAttached(struct _cairo *dc, struct _cairo_surface *const *target, Surface *surface)
     {
         m_DC = dc;
+        m_target = target;
         m_surface = surface;
+        m_origin.x = m_origin.y = 0;
 
-        m_status = ContextStatusStack();
-        m_status.push(ContextStatus());
-
-        ::SetBkMode(m_DC, TRANSPARENT);
-    }
-
-#elif USE_CAIRO
-
-    TextMetric::TextMetric()
-        : m_boundDC(NULL)
-    {
+        m_status.Clear();
+        m_status.Push().Reset();
+        m_status.Top().clip.SetRect(GetBoundingRegion());
+        m_status.Top().dirty = StatusFont | StatusPen | StatusOpaque;
 
+        //! a fresh attach starts a frame, e.g. tile contexts whose surfaces never flush
+        m_arena.Reset();
+        m_arenaFrame = surface->GetFlushCount();
     }
 
-    TextMetric::TextMetric(struct _cairo *boundDC)
-        : m_boundDC(boundDC)
+    void Context::FollowTarget()
     {
+        if (!m_DC || !m_target || ::cairo_get_target(m_DC) == *m_target)
+            return;
 
-    }
+        //! m_DC still holds a reference, the old surface is alive until it is destroyed
+        cairo_surface_t *previousTarget = ::cairo_get_target(m_DC);
+        RECT previous = { 0, 0, ::cairo_image_surface_get_width(previousTarget), ::cairo_image_surface_get_height(previousTarget) };
+        RECT bounds = { 0, 0, ::cairo_image_surface_get_width(*m_target), ::cairo_image_surface_get_height(*m_target) };
 
-    TextMetric::~TextMetric()
-    {
+        ::cairo_destroy(m_DC);
+        m_DC = ::cairo_create(*m_target);
 
-    }
+        //! the clips as the software context follows a Bind; the new gstates are cairo's defaults,
+        //! so every level pushes its state again and gets the cairo_save its Save made
+        for (UINT i = 0; i != m_status.GetSize(); ++i)
+        {
+            ClipRegion& clip = m_status[i].clip;
+            const RECT& r = clip.GetBounds();
 
-    SIZE TextMetric::GetMeasureSize(const String& text) const
-    {
-        SIZE size = { 0 };
+            if (clip.IsRect() && r.left == previous.left && r.top == previous.top && r.right == previous.right && r.bottom == previous.bottom)
+                clip.SetRect(bounds);
+            else
+                clip.Intersect(bounds);
 
-        if (m_boundDC)
-        {
-            std::wstring_convert<std::codecvt_utf8<wchar_t>> utf8_conv;
-            std::string utf8_text = utf8_conv.to_bytes(text);
+            m_status[i].dirty |= StatusFont | StatusPen | StatusOpaque | StatusClip;
 
-            cairo_text_extents_t extends = { 0 };
-            ::cairo_text_extents(m_boundDC, utf8_text.c_str(), &extends);
+            if (i)
+                ::cairo_save(m_DC);
         }
-        
-        return size;
     }
 
+#elif USE_SOFTWARE
+
     Context::Context()
         : m_status()
+        , m_target(NULL)
         , m_surface(NULL)
-        , m_DC(NULL)
+        , m_origin()
+        , m_targetSize()
+        , m_recording(NULL)
+        , m_arena()
+        , m_arenaFrame(0)
     {
 
     }
 
     Context::~Context()
     {
-        if (m_DC)
-            ::cairo_destroy(m_DC);
+
     }
 
     void Context::Reset()
     {
         if (m_surface)
         {
-            if (m_DC)
-                ::cairo_destroy(m_DC);
-
             m_surface->InitContext(*this);
         }
     }
 
     void Context::SetFont(const Font& f)
     {
-        if (m_DC)
+        if (m_recording)
         {
-            std::wstring_convert<std::codecvt_utf8<wchar_t>> utf8_conv;
-            std::string face = utf8_conv.to_bytes(f.m_font.lfFaceName);
-            ::cairo_select_font_face(m_DC, face.c_str(), CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+            m_recording->SetFont(f);
+            return;
         }
+
+        m_status.Top().font = f;
+        m_status.Top().changed |= StatusFont;
     }
 
     void Context::SetPen(const Pen& p)
     {
-        if (m_DC)
+        if (m_recording)
         {
-            ::cairo_set_line_width(m_DC, p.GetWidth());
-            m_status.top().pen = p;
+            m_recording->SetPen(p);
+            return;
         }
+
+        m_status.Top().pen = p;
+        m_status.Top().changed |= StatusPen;
     }
 
     void Context::SetBrush(const Brush& b)
     {
-        if (m_DC)
+        if (m_recording)
+        {
+            m_recording->SetBrush(b);
+            return;
+        }
+
+        m_status.Top().brush = b;
+        m_status.Top().changed |= StatusBrush;
+    }
+
+    void Context::SetTransform(const AffineMaxtrix& matrix)
+    {
+        if (m_recording)
         {
-            m_status.top().brush = b;
+            m_recording->SetTransform(matrix);
+            return;
         }
+
+        m_status.Top().transform = matrix;
+        m_status.Top().changed |= StatusTransform;
     }
 
     void Context::SetOpaque(BYTE opaque)
     {
-        if (m_DC)
+        if (m_recording)
+        {
+            m_recording->SetOpaque(opaque);
+            return;
+        }
+
+        m_status.Top().opaque = opaque;
+        m_status.Top().changed |= StatusOpaque;
+    }
+
+    void Context::ClipRect(const RECT& rect)
+    {
+        Clip(ClipReplace, rect);
+    }
+
+    void Context::IntersectClip(const RECT& rect)
+    {
+        Clip(ClipIntersect, rect);
+    }
+
+    void Context::UnionClip(const RECT& rect)
+    {
+        Clip(ClipUnion, rect);
+    }
+
+    void Context::ExcludeClip(const RECT& rect)
+    {
+        Clip(ClipExclude, rect);
+    }
+
+    void Context::Clip(ClipOp op, const RECT& rect)
+    {
+        if (m_recording)
+        {
+            m_recording->Clip(op, rect);
+            return;
+        }
+
+        FollowTarget();
+
+        RECT moved = { rect.left - m_origin.x, rect.top - m_origin.y, rect.right, rect.bottom };
+        ContextStatus& status = m_status.Top();
+        status.clip.Combine(op, moved);
+
+        //! the draws write every rect as it is, none may reach past the surface
+        if (ClipReplace == op || ClipUnion == op)
+            status.clip.Intersect(GetBoundingRegion());
+
+        status.changed |= StatusClip;
+    }
+
+    void Context::BlitImage(Image *image, const RECT& srcRegion, const POINT& pos)
+    {
+        FollowTarget();
+
+        const ContextStatus& currentStatus = m_status.Top();
+
+        if (!currentStatus.opaque || currentStatus.clip.IsEmpty() || !IsValid() || image->IsNull())
+            return;
+
+        SIZE srcSize = { srcRegion.right, srcRegion.bottom };
+        POINT at = { pos.x - m_origin.x, pos.y - m_origin.y };
+        RECT blitRect = { 0 };
+
+        if (BlitClipped(*m_target, image->GetOffset(srcRegion.left, srcRegion.top), image->GetStride(), srcSize, BlendModeOf(image),
+            at, currentStatus.opaque, currentStatus.clip, &blitRect))
         {
-            m_status.top().opaque = opaque;
+            AddDamage(blitRect.left, blitRect.top, blitRect.right, blitRect.bottom);
         }
     }
 
@@ -605,24 +2457,22 @@ namespace Render
 
     void Context::DrawImageAt(Image *image, const POINT& pos)
     {
-        UINT opaque = m_status.top().opaque;
-
-        if (opaque && m_surface && m_DC && !image->IsNull())
+        if (m_recording)
         {
-            cairo_surface_t *srcSurface = cairo_image_surface_create_for_data(image->GetOffset(0, 0), CAIRO_FORMAT_RGB24, image->GetWidth(), image->GetHeight(), image->GetStride());
-            ::cairo_set_source_surface(m_DC, srcSurface, pos.x, pos.y);
+            m_recording->DrawImageAt(image, pos);
+            return;
+        }
 
-            if (255 == opaque)
-            {
-                ::cairo_paint(m_DC);
-            }
-            else
-            {
-                ::cairo_paint_with_alpha(m_DC, opaque / 255.);
-            }
+        RECT whole = { 0, 0, image->GetWidth(), image->GetHeight() };
 
-            ::cairo_surface_destroy(srcSurface);
+        if (AffineMaxtrix::KindIdentity != m_status.Top().transform.GetKind())
+        {
+            RECT dest = { pos.x, pos.y, whole.right, whole.bottom };
+            DrawTransformed(image, whole, dest, Pixel::FilterBilinear);
+            return;
         }
+
+        BlitImage(image, whole, pos);
     }
 
     void Context::DrawClippedImage(Image *image, const RECT& region)
@@ -633,36 +2483,81 @@ namespace Render
 
     void Context::DrawClippedImageAt(Image *image, const RECT& region, const POINT& pos)
     {
-        UINT opaque = m_status.top().opaque;
+        if (m_recording)
+        {
+            m_recording->DrawClippedImageAt(image, region, pos);
+            return;
+        }
 
-        if (opaque && m_surface && m_DC && !image->IsNull())
+        if (region.right <= 0 || region.bottom <= 0 || image->IsNull())
+            return;
+
+        RECT clipRegion = { 0 };
+
+        IntersectRegion(&clipRegion, image->GetSize(), region);
+        if (clipRegion.right <= 0 || clipRegion.bottom <= 0)
+            return;
+
+        //! keep the clipped pixels where they would have been
+        POINT at = { pos.x + clipRegion.left - region.left, pos.y + clipRegion.top - region.top };
+
+        if (AffineMaxtrix::KindIdentity != m_status.Top().transform.GetKind())
         {
-            RECT desRect = { 0 };
-            m_surface->GetSurfaceRect(&desRect);
+            RECT dest = { at.x, at.y, clipRegion.right, clipRegion.bottom };
+            DrawTransformed(image, clipRegion, dest, Pixel::FilterBilinear);
+            return;
+        }
 
-            if (pos.x > desRect.right || pos.y > desRect.bottom)
-                return;
+        BlitImage(image, clipRegion, at);
+    }
 
-            RECT clipRegion = { 0 };
+    void Context::DrawScaledImage(Image *image, const RECT& region, Pixel::Filter filter)
+    {
+        if (m_recording)
+        {
+            m_recording->DrawScaledImage(image, region, filter);
+            return;
+        }
 
-            IntersectRegion(&clipRegion, image->GetSize(), region);
-            if (clipRegion.right <= 0 || clipRegion.bottom <= 0)
-                return;
+        UINT opaque = m_status.Top().opaque;
 
-            cairo_surface_t *srcSurface = cairo_image_surface_create_for_data(image->GetOffset(clipRegion.left, clipRegion.top), CAIRO_FORMAT_RGB24, clipRegion.right, clipRegion.bottom, image->GetStride());
-            ::cairo_set_source_surface(m_DC, srcSurface, pos.x, pos.y);
+        if (region.right <= 0 || region.bottom <= 0)
+            return;
 
-            if (255 == opaque)
-            {
-                ::cairo_paint(m_DC);
-            }
-            else
-            {
-                ::cairo_paint_with_alpha(m_DC, opaque / 255.);
-            }
+        if (!opaque || !IsValid() || image->IsNull())
+            return;
 
-            ::cairo_surface_destroy(srcSurface);
+        if (AffineMaxtrix::KindIdentity != m_status.Top().transform.GetKind())
+        {
+            RECT whole = { 0, 0, image->GetWidth(), image->GetHeight() };
+            DrawTransformed(image, whole, region, filter);
+            return;
+        }
+
+        //! outside the clip, not even a cache lookup
+        FollowTarget();
+
+        const ClipRegion& clip = m_status.Top().clip;
+        RECT moved = { region.left - m_origin.x, region.top - m_origin.y, region.right, region.bottom };
+        if (!clip.Intersects(moved))
+            return;
+
+        SIZE scaledSize = { region.right, region.bottom };
+        RefImageResource *scaled = ScaledImageCache::Instance().Acquire(image, scaledSize, filter);
+        if (scaled)
+        {
+            //! drawn at this size before, it is a plain blit now
+            POINT pos = { region.left, region.top };
+            DrawImageAt(scaled, pos);
+            scaled->Release();
+            return;
         }
+
+        image = ScaledSourceOf(image, region, filter);
+
+        RECT blitRect = { 0 };
+        if (BlitScaled(*m_target, image, moved, filter, opaque, GetArena(), clip, &blitRect))
+            AddDamage(blitRect.left, blitRect.top, blitRect.right, blitRect.bottom);
     }
 
     void Context::DrawText(const String& text)
@@ -673,59 +2568,105 @@ namespace Render
 
     void Context::DrawTextAt(const POINT& where, const String& text)
     {
-        if (text.empty())
+        if (m_recording)
+        {
+            m_recording->DrawTextAt(where, text);
             return;
+        }
+
+        FollowTarget();
+
+        const ContextStatus& currentStatus = m_status.Top();
 
-        const auto& currentStatus = m_status.top();
+        if (text.empty() || !currentStatus.opaque || currentStatus.clip.IsEmpty() || !IsValid())
+            return;
 
-        if (currentStatus.opaque && m_surface && m_DC)
+        //! whole pixel offsets keep the glyphs on the grid, anything else draws them offscreen first
+        POINT at = where;
+        if (AffineMaxtrix::KindTranslate == currentStatus.transform.GetKind())
         {
-            auto textColor = currentStatus.pen.GetColor();
-            if (255 == currentStatus.opaque && 255 == GetAValue(textColor))
-            {
-                ::cairo_set_source_rgb(m_DC, GetRValue(textColor) / 255., GetGValue(textColor) / 255., GetBValue(textColor) / 255.);
-            }
-            else
-            {
-                ::cairo_set_source_rgba(m_DC, GetRValue(textColor) / 255., GetGValue(textColor) / 255., GetBValue(textColor) / 255.,
-                    (currentStatus.opaque / 255.) * (GetAValue(textColor) / 255.));
-            }
+            at.x += currentStatus.transform.GetOffset().x;
+            at.y += currentStatus.transform.GetOffset().y;
+        }
+        else if (AffineMaxtrix::KindIdentity != currentStatus.transform.GetKind())
+        {
+            DrawTextTransformed(where, text);
+            return;
+        }
 
-            std::wstring_convert<std::codecvt_utf8<wchar_t>> utf8_conv;
-            std::string utf8_text = utf8_conv.to_bytes(text);
+        at.x -= m_origin.x;
+        at.y -= m_origin.y;
 
-            cairo_text_extents_t extends = { 0 };
-            ::cairo_text_extents(m_DC, utf8_text.c_str(), &extends);
+        //! glyphs come from GlyphCache, headless builds install a rasterizer there
+        COLORREF textColor = currentStatus.pen.GetColor();
+        BYTE alpha = (BYTE)Pixel::Div255(currentStatus.opaque * GetAValue(textColor));
+
+        RECT bounds = { 0 };
+        if (BlitText(*m_target, currentStatus.font, currentStatus.brush, PixelOf(textColor), alpha, at, text, GetArena(), currentStatus.clip, &bounds))
+            AddDamage(bounds.left, bounds.top, bounds.right, bounds.bottom);
+    }
+
+    void Context::DrawTransformed(Image *image, const RECT& source, const RECT& dest, Pixel::Filter filter)
+    {
+        FollowTarget();
+
+        UINT opaque = m_status.Top().opaque;
+
+        if (!opaque || m_status.Top().clip.IsEmpty() || !IsValid() || image->IsNull())
+            return;
+
+        RECT blitRect = { 0 };
+        if (BlitTransformed(*m_target, image, source, dest, m_status.Top().transform, filter, opaque, GetArena(), m_origin, m_status.Top().clip, &blitRect))
+            AddDamage(blitRect.left, blitRect.top, blitRect.right, blitRect.bottom);
+    }
+
+    void Context::DrawTextTransformed(const POINT& where, const String& text)
+    {
+        const ContextStatus& currentStatus = m_status.Top();
 
-            ::cairo_move_to(m_DC, where.x, where.y - extends.y_bearing);
-            ::cairo_show_text(m_DC, utf8_text.c_str());
+        RECT bounds = { 0 };
+        if (BlitTextTransformed(*m_target, currentStatus.font, currentStatus.brush, currentStatus.pen.GetColor(), currentStatus.opaque,
+            where, text, currentStatus.transform, GetArena(), m_origin, currentStatus.clip, &bounds))
+        {
+            AddDamage(bounds.left, bounds.top, bounds.right, bounds.bottom);
         }
     }
 
     void Context::Save()
     {
-        if (m_DC)
+        if (m_recording)
         {
-            m_status.push(ContextStatus());
-            ::cairo_save(m_DC);
+            m_recording->Save();
+            return;
+        }
+
+        if (IsValid())
+        {
+            FollowTarget();
+
+            //! by index, pushing may move the levels that spilled
+            m_status.Push().Reset();
+            m_status.Top().clip = m_status[m_status.GetSize() - 2].clip;
         }
     }
 
     void Context::Restore()
     {
-        if (m_DC)
+        if (m_recording)
         {
-            if (m_status.size() > 1)
-            {
-                m_status.pop();
-            }
-            ::cairo_restore(m_DC);
+            m_recording->Restore();
+            return;
+        }
+
+        if (m_status.GetSize() > 1)
+        {
+            m_status.Pop();
         }
     }
 
     TextMetric Context::GetTextMetric() const
     {
-        return TextMetric(m_DC);
+        return TextMetric(m_status.Top().font);
     }
 
     RECT Context::GetBoundingRegion() const
@@ -739,13 +2680,45 @@ namespace Render
         return rect;
     }
 
-    void Context::OnAttached(struct _cairo *dc, Surface *surface)
+    void Context::OnAttached(const PixelBuffer *target, Surface *surface)
     {
-        m_DC = dc;
+        m_target = target;
         m_surface = surface;
+        m_origin.x = m_origin.y = 0;
+
+        m_status.Clear();
+        m_status.Push().Reset();
+        m_status.Top().clip.SetRect(GetBoundingRegion());
+        m_targetSize.cx = target->width;
+        m_targetSize.cy = target->height;
+
+        //! a fresh attach starts a frame, e.g. tile contexts whose surfaces never flush
+        m_arena.Reset();
+        m_arenaFrame = surface->GetFlushCount();
+    }
+
+    void Context::FollowTarget()
+    {
+        if (!m_target || (m_target->width == m_targetSize.cx && m_target->height == m_targetSize.cy))
+            return;
+
+        RECT previous = { 0, 0, m_targetSize.cx, m_targetSize.cy };
+        RECT bounds = { 0, 0, m_target->width, m_target->height };
+
+        //! the whole surface stays the whole surface, a clip of the caller's only loses what fell off
+        for (UINT i = 0; i != m_status.GetSize(); ++i)
+        {
+            ClipRegion& clip = m_status[i].clip;
+            const RECT& r = clip.GetBounds();
+
+            if (clip.IsRect() && r.left == previous.left && r.top == previous.top && r.right == previous.right && r.bottom == previous.bottom)
+                clip.SetRect(bounds);
+            else
+                clip.Intersect(bounds);
+        }
 
-        m_status = ContextStatusStack();
-        m_status.push(ContextStatus());
+        m_targetSize.cx = m_target->width;
+        m_targetSize.cy = m_target->height;
     }
 
 #endif
@@ -1,9 +1,15 @@
 #pragma once
 
-#include <stack>
+#include "Win32Compat.h"
+#include "Region.h"
+#include "FrameArena.h"
+#include "SmallStack.h"
+
+#include "PixelKernel.h"
 
 #if USE_CAIRO
 struct _cairo;
+struct _cairo_surface;
 #endif
 
 #define RGBA(r,g,b,a) ((COLORREF)(((BYTE)(r)|((WORD)((BYTE)(g))<<8))|(((DWORD)(BYTE)(b))<<16)|(((DWORD)(BYTE)(a))<<24)))
@@ -14,6 +20,7 @@ namespace Render
 {
     class Surface;
     class Image;
+    class DisplayList;
 
     class Font
     {
@@ -86,8 +93,7 @@ namespace Render
         bool IsNull() const { return m_style == Null; }
     };
 
-#if USE_GDI
-
+    //! measured through GlyphCache, the same laid out run DrawTextAt draws
     class TextMetric
     {
     private:
@@ -103,10 +109,29 @@ namespace Render
         SIZE GetMeasureSize(const String& text) const;
     };
 
+    //! fields of a ContextStatus, as bits
+    enum StatusField
+    {
+        StatusFont = 1, StatusPen = 2, StatusBrush = 4, StatusOpaque = 8, StatusTransform = 16, StatusClip = 32,
+    };
+
+    //! user space to surface pixels, laid out as XFORM: x' = x * eM11 + y * eM21 + eDx, y' = x * eM12 + y * eM22 + eDy
+    //! Rotate / Scale / Sheer / Translate act on user space, before what the matrix already does, as cairo's do
     class AffineMaxtrix
     {
     public:
+        //! how the draws go through it, found again after every change
+        enum Kind
+        {
+            KindIdentity = 0,
+            KindTranslate,      //! unit axes, whole pixel offset: an offset blit
+            KindScale,          //! axis-aligned, positive factors: the resampler, edges rounded to whole pixels
+            KindGeneral,        //! rotation, shear, mirroring or a fractional offset: bilinear over the destination box
+        };
+
+    private:
         XFORM m_maxtrix;
+        Kind m_kind;
 
     public:
         AffineMaxtrix();
@@ -115,12 +140,33 @@ namespace Render
             float dx, float dy);
 
     public:
+        //! clockwise on screen, y grows downwards
         void Rotate(float degrees);
         void Scale(float xFactor, float yFactor);
         void Sheer(float xFactor, float yFactor);
         void Translate(float dx, float dy);
+
+        //! other applied after this one
+        void Multiply(const AffineMaxtrix& other);
+        //! false when it maps everything onto a line, the matrix is left as it was
+        bool Invert();
+
+    public:
+        const XFORM& GetMatrix() const { return m_maxtrix; }
+        Kind GetKind() const { return m_kind; }
+        //! the whole pixel offset of a KindTranslate or KindIdentity matrix
+        POINT GetOffset() const;
+
+        void Map(double x, double y, double *outX, double *outY) const;
+        //! box of the mapped rect, rounded outwards; in and out, right is width, bottom is height
+        RECT MapBounds(const RECT& rect) const;
+
+    private:
+        void Classify();
     };
 
+#if USE_GDI
+
     class Context
     {
         friend class RenderSurface;
@@ -132,18 +178,49 @@ namespace Render
             Pen pen;
             Brush brush;
             AffineMaxtrix transform;
+            ClipRegion clip;     //! surface pixels, inside the surface; a Save starts from the parent's
             UINT opaque;         //! max 255
+            UINT changed;        //! StatusField bits set since Reset
 
         public:
-            ContextStatus() : opaque(255) {}
+            ContextStatus() : opaque(255), changed(0) {}
+
+            //! back to the defaults, only the fields that were set are touched
+            void Reset()
+            {
+                if (changed & StatusFont)
+                    font = Font();
+                if (changed & StatusPen)
+                    pen = Pen();
+                if (changed & StatusBrush)
+                    brush = Brush();
+                if (changed & StatusTransform)
+                    transform = AffineMaxtrix();
+                opaque = 255;
+                changed = 0;
+            }
         };
 
     private:
-        typedef std::stack<ContextStatus> ContextStatusStack;
+        //! reused slots, Save only resets the fields the previous occupant set
+        typedef SmallStack<ContextStatus, 8> ContextStatusStack;
         ContextStatusStack m_status;
 
         HDC m_DC;
         Surface *m_surface;
+        POINT m_origin;
+
+        //! StatusField bits whose dc state (bk mode, colours) is stale, applied by the next draw needing it
+        UINT m_dirty;
+
+        DamageRegion m_damage;
+
+        //! not owned, set between BeginRecording and EndRecording
+        DisplayList *m_recording;
+
+        //! transient buffers of the draw calls, rewound after the surface flushed
+        FrameArena m_arena;
+        ULONG m_arenaFrame;
 
     public:
         Context();
@@ -159,6 +236,22 @@ namespace Render
         void SetTransform(const AffineMaxtrix& matrix);
         void SetOpaque(BYTE opaque);
 
+        //! where the surface's top left is in the drawing, e.g. a tile's; every draw and clip rect moves by -origin,
+        //! a transformed draw after its edges are rounded to pixels, so it lands the same wherever the drawing is cut
+        //! not part of Save / Restore nor recorded, attaching sets it back to 0, 0
+        void SetOrigin(const POINT& origin) { m_origin = origin; }
+        const POINT& GetOrigin() const { return m_origin; }
+
+    public:
+        //! rects are pixels whatever the transform, moved by -origin onto the surface; right is width, bottom is height
+        //! draws are trimmed to the clip before any pixel is touched, an empty clip rejects them
+        void ClipRect(const RECT& rect);
+        void IntersectClip(const RECT& rect);
+        void UnionClip(const RECT& rect);
+        void ExcludeClip(const RECT& rect);
+        void Clip(ClipOp op, const RECT& rect);
+        const ClipRegion& GetClip() const { return m_status.Top().clip; }
+
     public:
         void DrawImage(Image *);
         void DrawImageAt(Image *, const POINT& pos);
@@ -166,7 +259,7 @@ namespace Render
         void DrawClippedImage(Image *, const RECT& region);
         void DrawClippedImageAt(Image *, const RECT& region, const POINT& pos);
 
-        void DrawScaledImage(Image *, const RECT& region);
+        void DrawScaledImage(Image *, const RECT& region, Pixel::Filter filter = Pixel::FilterBilinear);
 
         void DrawText(const String& text);
         void DrawTextAt(POINT where, const String& text);
@@ -175,61 +268,252 @@ namespace Render
         void Save();
         void Restore();
 
+    public:
+        //! until EndRecording the draw calls, state setters and Save / Restore append to list instead
+        void BeginRecording(DisplayList *list);
+        void EndRecording();
+        bool IsRecording() const { return NULL != m_recording; }
+
+    public:
+        //! scratch memory valid until the surface's next Flush
+        FrameArena& GetArena();
+
     public:
         TextMetric GetTextMetric() const;
 
         //! right is width, bottom is height
         RECT GetBoundingRegion() const;
 
+        //! everything drawn since the last ResetDamage, clipped to the surface and the clip's bounds
+        const DamageRegion& GetDamage() const { return m_damage; }
+        void ResetDamage() { m_damage.Clear(); }
+
     public:
         bool IsValid() const { return NULL != m_DC; }
 
     protected:
         void OnAttached(HDC dc, Surface *surface);
 
+    private:
+        //! the image's source rect drawn over dest (left, top, width, height, user space) through a non identity transform
+        void DrawTransformed(Image *image, const RECT& source, const RECT& dest, Pixel::Filter filter);
+        void DrawTextTransformed(const POINT& where, const String& text);
+        void AddDamage(LONG x, LONG y, LONG width, LONG height);
+        //! pushes the dirty ones among fields to the backend
+        void ApplyState(UINT fields);
+
     private:
         Context(const Context&);
         Context& operator = (const Context&);
     };
 
 #elif USE_CAIRO
-    
-    class TextMetric
+
+    class Context
     {
+        friend class RenderSurface;
+
+        class ContextStatus
+        {
+        public:
+            UINT opaque;         //! max 255
+            Font font;
+            Pen pen;
+            Brush brush;
+            AffineMaxtrix transform;
+            ClipRegion clip;     //! surface pixels, inside the surface; a Save starts from the parent's
+            UINT changed;        //! StatusField bits set since Reset
+            //! StatusField bits not yet pushed to the cairo gstate of this level,
+            //! cairo_restore brings back the parent's gstate so each level tracks its own
+            UINT dirty;
+
+        public:
+            ContextStatus() : opaque(255), changed(0), dirty(0) {}
+
+            //! back to the defaults, only the fields that were set are touched
+            void Reset()
+            {
+                if (changed & StatusFont)
+                    font = Font();
+                if (changed & StatusPen)
+                    pen = Pen();
+                if (changed & StatusBrush)
+                    brush = Brush();
+                if (changed & StatusTransform)
+                    transform = AffineMaxtrix();
+                opaque = 255;
+                changed = 0;
+                dirty = 0;
+            }
+        };
+
     private:
-        struct _cairo *m_boundDC;
+        //! reused slots, Save only resets the fields the previous occupant set
+        typedef SmallStack<ContextStatus, 8> ContextStatusStack;
+        ContextStatusStack m_status;
+
+        Surface *m_surface;
+        POINT m_origin;
+        struct _cairo *m_DC;
+
+        //! the surface's cairo surface slot, a Bind to another buffer replaces what it holds under m_DC
+        struct _cairo_surface *const *m_target;
+
+        DamageRegion m_damage;
+
+        //! not owned, set between BeginRecording and EndRecording
+        DisplayList *m_recording;
+
+        //! transient buffers of the draw calls, rewound after the surface flushed
+        FrameArena m_arena;
+        ULONG m_arenaFrame;
 
     public:
-        TextMetric();
-        explicit TextMetric(struct _cairo *boundDC);
-        ~TextMetric();
+        Context();
+        ~Context();
 
     public:
-        //! bounding size
-        SIZE GetMeasureSize(const String& text) const;
+        void Reset();
+
+    public:
+        void SetFont(const Font& f);
+        void SetPen(const Pen& p);
+        void SetBrush(const Brush& b);
+        void SetTransform(const AffineMaxtrix& matrix);
+        void SetOpaque(BYTE opaque);
+
+        //! where the surface's top left is in the drawing, e.g. a tile's; every draw and clip rect moves by -origin,
+        //! a transformed draw after its edges are rounded to pixels, so it lands the same wherever the drawing is cut
+        //! not part of Save / Restore nor recorded, attaching sets it back to 0, 0
+        void SetOrigin(const POINT& origin) { m_origin = origin; }
+        const POINT& GetOrigin() const { return m_origin; }
+
+    public:
+        //! rects are pixels whatever the transform, moved by -origin onto the surface; right is width, bottom is height
+        //! draws are trimmed to the clip before any pixel is touched, an empty clip rejects them
+        void ClipRect(const RECT& rect);
+        void IntersectClip(const RECT& rect);
+        void UnionClip(const RECT& rect);
+        void ExcludeClip(const RECT& rect);
+        void Clip(ClipOp op, const RECT& rect);
+        const ClipRegion& GetClip() const { return m_status.Top().clip; }
+
+    public:
+        void DrawImage(Image *);
+        void DrawImageAt(Image *, const POINT& pos);
+        //! 
+        void DrawClippedImage(Image *, const RECT& region);
+        void DrawClippedImageAt(Image *, const RECT& region, const POINT& pos);
+
+        void DrawScaledImage(Image *, const RECT& region, Pixel::Filter filter = Pixel::FilterBilinear);
+
+        void DrawText(const String& text);
+        void DrawTextAt(const POINT& where, const String& text);
+
+    public:
+        void Save();
+        void Restore();
+
+    public:
+        //! until EndRecording the draw calls, state setters and Save / Restore append to list instead
+        void BeginRecording(DisplayList *list);
+        void EndRecording();
+        bool IsRecording() const { return NULL != m_recording; }
+
+    public:
+        //! scratch memory valid until the surface's next Flush
+        FrameArena& GetArena();
+
+    public:
+        TextMetric GetTextMetric() const;
+
+        //! right is width, bottom is height
+        RECT GetBoundingRegion() const;
+
+        //! everything drawn since the last ResetDamage, clipped to the surface and the clip's bounds
+        const DamageRegion& GetDamage() const { return m_damage; }
+        void ResetDamage() { m_damage.Clear(); }
+
+    public:
+        bool IsValid() const { return NULL != m_DC; }
+
+    protected:
+        void OnAttached(struct _cairo *dc, struct _cairo_surface *const *target, Surface *surface);
+
+    private:
+        //! the image's source rect drawn over dest (left, top, width, height, user space) through a non identity transform
+        void DrawTransformed(Image *image, const RECT& source, const RECT& dest, Pixel::Filter filter);
+        void DrawTextTransformed(const POINT& where, const String& text);
+        void AddDamage(LONG x, LONG y, LONG width, LONG height);
+        //! pushes the dirty ones among fields to the backend
+        void ApplyState(UINT fields);
+        //! m_DC recreated on the surface's current cairo surface after a Bind replaced it
+        void FollowTarget();
+
+    private:
+        Context(const Context&);
+        Context& operator = (const Context&);
     };
 
+#elif USE_SOFTWARE
+
+    //! rasterizes straight into the surface buffer with the pixel kernels
     class Context
     {
         friend class RenderSurface;
+        friend class YuvSurface;
 
         class ContextStatus
         {
         public:
-            UINT opaque;         //! max 255
+            Font font;
             Pen pen;
             Brush brush;
+            AffineMaxtrix transform;
+            ClipRegion clip;     //! surface pixels, inside the surface; a Save starts from the parent's
+            UINT opaque;         //! max 255
+            UINT changed;        //! StatusField bits set since Reset
 
         public:
-            ContextStatus() : opaque(255) {}
+            ContextStatus() : opaque(255), changed(0) {}
+
+            //! back to the defaults, only the fields that were set are touched
+            void Reset()
+            {
+                if (changed & StatusFont)
+                    font = Font();
+                if (changed & StatusPen)
+                    pen = Pen();
+                if (changed & StatusBrush)
+                    brush = Brush();
+                if (changed & StatusTransform)
+                    transform = AffineMaxtrix();
+                opaque = 255;
+                changed = 0;
+            }
         };
 
     private:
-        typedef std::stack<ContextStatus> ContextStatusStack;
+        //! reused slots, Save only resets the fields the previous occupant set
+        typedef SmallStack<ContextStatus, 8> ContextStatusStack;
         ContextStatusStack m_status;
 
+        //! owned by the surface, follows SetSource without re-attaching
+        const PixelBuffer *m_target;
         Surface *m_surface;
-        struct _cairo *m_DC;
+        POINT m_origin;
+
+        //! the target's size the clips were made for, a Bind may change it under the context
+        SIZE m_targetSize;
+
+        DamageRegion m_damage;
+
+        //! not owned, set between BeginRecording and EndRecording
+        DisplayList *m_recording;
+
+        //! transient buffers of the draw calls, rewound after the surface flushed
+        FrameArena m_arena;
+        ULONG m_arenaFrame;
 
     public:
         Context();
@@ -242,9 +526,25 @@ namespace Render
         void SetFont(const Font& f);
         void SetPen(const Pen& p);
         void SetBrush(const Brush& b);
-        // void SetTransform(const AffineMaxtrix& matrix);
+        void SetTransform(const AffineMaxtrix& matrix);
         void SetOpaque(BYTE opaque);
 
+        //! where the surface's top left is in the drawing, e.g. a tile's; every draw and clip rect moves by -origin,
+        //! a transformed draw after its edges are rounded to pixels, so it lands the same wherever the drawing is cut
+        //! not part of Save / Restore nor recorded, attaching sets it back to 0, 0
+        void SetOrigin(const POINT& origin) { m_origin = origin; }
+        const POINT& GetOrigin() const { return m_origin; }
+
+    public:
+        //! rects are pixels whatever the transform, moved by -origin onto the surface; right is width, bottom is height
+        //! draws are trimmed to the clip before any pixel is touched, an empty clip rejects them
+        void ClipRect(const RECT& rect);
+        void IntersectClip(const RECT& rect);
+        void UnionClip(const RECT& rect);
+        void ExcludeClip(const RECT& rect);
+        void Clip(ClipOp op, const RECT& rect);
+        const ClipRegion& GetClip() const { return m_status.Top().clip; }
+
     public:
         void DrawImage(Image *);
         void DrawImageAt(Image *, const POINT& pos);
@@ -252,6 +552,8 @@ namespace Render
         void DrawClippedImage(Image *, const RECT& region);
         void DrawClippedImageAt(Image *, const RECT& region, const POINT& pos);
 
+        void DrawScaledImage(Image *, const RECT& region, Pixel::Filter filter = Pixel::FilterBilinear);
+
         void DrawText(const String& text);
         void DrawTextAt(const POINT& where, const String& text);
 
@@ -259,17 +561,40 @@ namespace Render
         void Save();
         void Restore();
 
+    public:
+        //! until EndRecording the draw calls, state setters and Save / Restore append to list instead
+        void BeginRecording(DisplayList *list);
+        void EndRecording();
+        bool IsRecording() const { return NULL != m_recording; }
+
+    public:
+        //! scratch memory valid until the surface's next Flush
+        FrameArena& GetArena();
+
     public:
         TextMetric GetTextMetric() const;
 
         //! right is width, bottom is height
         RECT GetBoundingRegion() const;
 
+        //! everything drawn since the last ResetDamage, clipped to the surface and the clip's bounds
+        const DamageRegion& GetDamage() const { return m_damage; }
+        void ResetDamage() { m_damage.Clear(); }
+
     public:
-        bool IsValid() const { return NULL != m_DC; }
+        bool IsValid() const { return m_target && m_target->data; }
 
     protected:
-        void OnAttached(struct _cairo *dc, Surface *surface);
+        void OnAttached(const PixelBuffer *target, Surface *surface);
+
+    private:
+        void BlitImage(Image *image, const RECT& srcRegion, const POINT& pos);
+        //! the image's source rect drawn over dest (left, top, width, height, user space) through a non identity transform
+        void DrawTransformed(Image *image, const RECT& source, const RECT& dest, Pixel::Filter filter);
+        void DrawTextTransformed(const POINT& where, const String& text);
+        void AddDamage(LONG x, LONG y, LONG width, LONG height);
+        //! the clips brought to the target's size after a Bind changed it
+        void FollowTarget();
 
     private:
         Context(const Context&);
@@ -0,0 +1,291 @@
+#include "DisplayList.h"
+
+#include "Image.h"
+#include "GlyphCache.h"
+
+namespace Render
+{
+    //! wider than any surface, the clip before the first clip command
+    static const RECT Unclipped = { -0x40000000, -0x40000000, 0x7FFFFFFF, 0x7FFFFFFF };
+
+    //! right is width, bottom is height; zero sized when they do not meet
+    static RECT IntersectBounds(const RECT& a, const RECT& b)
+    {
+        LONG left = max(a.left, b.left), top = max(a.top, b.top);
+        LONG right = min(a.left + a.right, b.left + b.right), bottom = min(a.top + a.bottom, b.top + b.bottom);
+
+        RECT r = { 0 };
+        if (right > left && bottom > top)
+        {
+            RECT both = { left, top, right - left, bottom - top };
+            r = both;
+        }
+
+        return r;
+    }
+
+    DisplayList::DisplayList()
+        : m_commands()
+        , m_fonts()
+        , m_pens()
+        , m_brushes()
+        , m_transforms()
+        , m_strings()
+        , m_stringCount(0)
+        , m_fontStack()
+        , m_transformStack()
+        , m_clipStack()
+    {
+        m_fontStack.push_back(Font());
+        m_transformStack.push_back(AffineMaxtrix());
+        m_clipStack.push_back(Unclipped);
+    }
+
+    DisplayList::~DisplayList()
+    {
+
+    }
+
+    void DisplayList::Reset()
+    {
+        m_commands.clear();
+        m_fonts.clear();
+        m_pens.clear();
+        m_brushes.clear();
+        m_transforms.clear();
+        m_stringCount = 0;
+
+        m_fontStack.resize(1);
+        m_fontStack[0] = Font();
+        m_transformStack.resize(1);
+        m_transformStack[0] = AffineMaxtrix();
+        m_clipStack.resize(1);
+        m_clipStack[0] = Unclipped;
+    }
+
+    DisplayList::Command& DisplayList::Append(Op op)
+    {
+        Command command = { op, 0, NULL, { 0 }, { 0 }, { 0 } };
+        m_commands.push_back(command);
+
+        return m_commands.back();
+    }
+
+    void DisplayList::Place(Command& command, const RECT& bounds)
+    {
+        const AffineMaxtrix& transform = m_transformStack.back();
+
+        RECT reach = bounds;
+        if (AffineMaxtrix::KindIdentity != transform.GetKind())
+        {
+            //! a pixel of margin, scaled edges are rounded on their own and may land past the mapped box
+            RECT mapped = transform.MapBounds(bounds);
+            RECT margin = { mapped.left - 1, mapped.top - 1, mapped.right + 2, mapped.bottom + 2 };
+            reach = margin;
+        }
+
+        command.bounds = IntersectBounds(reach, m_clipStack.back());
+    }
+
+    void DisplayList::Save()
+    {
+        //! Save starts from a default status in every backend
+        Append(OpSave);
+        m_fontStack.push_back(Font());
+        m_transformStack.push_back(AffineMaxtrix());
+
+        //! except the clip, which carries over
+        RECT clip = m_clipStack.back();
+        m_clipStack.push_back(clip);
+    }
+
+    void DisplayList::Restore()
+    {
+        Append(OpRestore);
+        if (m_fontStack.size() > 1)
+        {
+            m_fontStack.pop_back();
+            m_transformStack.pop_back();
+            m_clipStack.pop_back();
+        }
+    }
+
+    void DisplayList::SetFont(const Font& f)
+    {
+        Append(OpSetFont).index = (UINT)m_fonts.size();
+        m_fonts.push_back(f);
+        m_fontStack.back() = f;
+    }
+
+    void DisplayList::SetPen(const Pen& p)
+    {
+        Append(OpSetPen).index = (UINT)m_pens.size();
+        m_pens.push_back(p);
+    }
+
+    void DisplayList::SetBrush(const Brush& b)
+    {
+        Append(OpSetBrush).index = (UINT)m_brushes.size();
+        m_brushes.push_back(b);
+    }
+
+    void DisplayList::SetTransform(const AffineMaxtrix& matrix)
+    {
+        Append(OpSetTransform).index = (UINT)m_transforms.size();
+        m_transforms.push_back(matrix);
+        m_transformStack.back() = matrix;
+    }
+
+    void DisplayList::SetOpaque(BYTE opaque)
+    {
+        Append(OpSetOpaque).index = opaque;
+    }
+
+    void DisplayList::Clip(ClipOp op, const RECT& rect)
+    {
+        Command& command = Append(OpClip);
+        command.index = op;
+        command.region = rect;
+
+        //! a replay's clip is never wider than this, its surface only narrows it
+        RECT& clip = m_clipStack.back();
+        switch (op)
+        {
+        case ClipReplace:
+            clip = IntersectBounds(rect, Unclipped);
+            break;
+        case ClipIntersect:
+            clip = IntersectBounds(clip, rect);
+            break;
+        case ClipUnion:
+            if (rect.right > 0 && rect.bottom > 0)
+            {
+                if (clip.right <= 0 || clip.bottom <= 0)
+                {
+                    clip = rect;
+                    break;
+                }
+
+                LONG left = min(clip.left, rect.left), top = min(clip.top, rect.top);
+                LONG right = max(clip.left + clip.right, rect.left + rect.right), bottom = max(clip.top + clip.bottom, rect.top + rect.bottom);
+
+                RECT both = { left, top, right - left, bottom - top };
+                clip = IntersectBounds(both, Unclipped);
+            }
+            break;
+        case ClipExclude:
+            break;
+        }
+    }
+
+    void DisplayList::DrawImageAt(Image *image, const POINT& pos)
+    {
+        Command& command = Append(OpDrawImageAt);
+        command.image = image;
+        command.pos = pos;
+
+        RECT bounds = { pos.x, pos.y, image->GetWidth(), image->GetHeight() };
+        Place(command, bounds);
+    }
+
+    void DisplayList::DrawClippedImageAt(Image *image, const RECT& region, const POINT& pos)
+    {
+        Command& command = Append(OpDrawClippedImageAt);
+        command.image = image;
+        command.region = region;
+        command.pos = pos;
+
+        RECT bounds = { pos.x, pos.y, region.right, region.bottom };
+        Place(command, bounds);
+    }
+
+    void DisplayList::DrawScaledImage(Image *image, const RECT& region, Pixel::Filter filter)
+    {
+        Command& command = Append(OpDrawScaledImage);
+        command.index = filter;
+        command.image = image;
+        command.region = region;
+        Place(command, region);
+    }
+
+    void DisplayList::DrawTextAt(const POINT& where, const String& text)
+    {
+        Command& command = Append(OpDrawTextAt);
+        command.index = m_stringCount;
+        command.pos = where;
+
+        RECT bounds = GlyphCache::Instance().GetTextBounds(m_fontStack.back(), text);
+        bounds.left += where.x;
+        bounds.top += where.y;
+        Place(command, bounds);
+
+        if (m_stringCount == m_strings.size())
+            m_strings.push_back(String());
+        m_strings[m_stringCount++].assign(text);
+    }
+
+    void DisplayList::Replay(Context& context) const
+    {
+        for (size_t i = 0; i != m_commands.size(); ++i)
+        {
+            Execute(context, m_commands[i]);
+        }
+    }
+
+    void DisplayList::Replay(Context& context, const POINT& origin, const std::vector<UINT>& commands) const
+    {
+        //! the context moves every draw after rounding it, a draw cut by tiles lands as it does whole
+        POINT previous = context.GetOrigin();
+        context.SetOrigin(origin);
+
+        for (size_t i = 0; i != commands.size(); ++i)
+        {
+            Execute(context, m_commands[commands[i]]);
+        }
+
+        context.SetOrigin(previous);
+    }
+
+    void DisplayList::Execute(Context& context, const Command& command) const
+    {
+        switch (command.op)
+        {
+        case OpSave:
+            context.Save();
+            break;
+        case OpRestore:
+            context.Restore();
+            break;
+        case OpSetFont:
+            context.SetFont(m_fonts[command.index]);
+            break;
+        case OpSetPen:
+            context.SetPen(m_pens[command.index]);
+            break;
+        case OpSetBrush:
+            context.SetBrush(m_brushes[command.index]);
+            break;
+        case OpSetOpaque:
+            context.SetOpaque((BYTE)command.index);
+            break;
+        case OpClip:
+            context.Clip((ClipOp)command.index, command.region);
+            break;
+        case OpSetTransform:
+            context.SetTransform(m_transforms[command.index]);
+            break;
+        case OpDrawImageAt:
+            context.DrawImageAt(command.image, command.pos);
+            break;
+        case OpDrawClippedImageAt:
+            context.DrawClippedImageAt(command.image, command.region, command.pos);
+            break;
+        case OpDrawScaledImage:
+            context.DrawScaledImage(command.image, command.region, (Pixel::Filter)command.index);
+            break;
+        case OpDrawTextAt:
+            context.DrawTextAt(command.pos, m_strings[command.index]);
+            break;
+        }
+    }
+}
\ No newline at end of file
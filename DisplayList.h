@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Context.h"
+
+#include <vector>
+
+namespace Render
+{
+    class Image;
+
+    //! recorded Context calls, replayed into any Context later
+    //! Reset keeps the storage, so recording the same frame again allocates nothing
+    //! images are kept as raw pointers and must outlive the replay
+    //! replay does not modify the list, several threads may replay it at once
+    class DisplayList
+    {
+    public:
+        enum Op
+        {
+            OpSave = 0, OpRestore,
+            OpSetFont, OpSetPen, OpSetBrush, OpSetOpaque, OpSetTransform, OpClip,
+            OpDrawImageAt, OpDrawClippedImageAt, OpDrawScaledImage, OpDrawTextAt,
+        };
+
+        //! fixed size, fonts / pens / brushes / text live in side pools referenced by index
+        struct Command
+        {
+            Op op;
+            UINT index;         //! pool index, opaque, filter or ClipOp
+            Image *image;
+            RECT region;        //! right is width, bottom is height; a clip's rect as it was given
+            POINT pos;
+            RECT bounds;        //! draws only, surface pixels it may touch, right is width, bottom is height
+        };
+
+        static bool IsDraw(Op op) { return op >= OpDrawImageAt; }
+
+    private:
+        std::vector<Command> m_commands;
+        std::vector<Font> m_fonts;
+        std::vector<Pen> m_pens;
+        std::vector<Brush> m_brushes;
+        std::vector<AffineMaxtrix> m_transforms;
+        //! strings past m_stringCount are spare, reassigning them reuses their capacity
+        std::vector<String> m_strings;
+        UINT m_stringCount;
+
+        //! the font each text command will draw with, a fresh context's state at the start
+        std::vector<Font> m_fontStack;
+        //! the transform each draw goes through, for its bounds
+        std::vector<AffineMaxtrix> m_transformStack;
+        //! what the clip can at most let through, draws' bounds are trimmed to it so tiles outside skip them
+        std::vector<RECT> m_clipStack;
+
+    public:
+        DisplayList();
+        ~DisplayList();
+
+    public:
+        //! drops the commands, keeps every buffer's capacity
+        void Reset();
+        void Replay(Context& context) const;
+        //! only the listed commands, drawn with the context's origin at origin, e.g. into a tile's context
+        void Replay(Context& context, const POINT& origin, const std::vector<UINT>& commands) const;
+
+    public:
+        void Save();
+        void Restore();
+
+        void SetFont(const Font& f);
+        void SetPen(const Pen& p);
+        void SetBrush(const Brush& b);
+        void SetTransform(const AffineMaxtrix& matrix);
+        void SetOpaque(BYTE opaque);
+        void Clip(ClipOp op, const RECT& rect);
+
+        void DrawImageAt(Image *image, const POINT& pos);
+        void DrawClippedImageAt(Image *image, const RECT& region, const POINT& pos);
+        void DrawScaledImage(Image *image, const RECT& region, Pixel::Filter filter = Pixel::FilterBilinear);
+        void DrawTextAt(const POINT& where, const String& text);
+
+    public:
+        bool IsEmpty() const { return m_commands.empty(); }
+        UINT GetCount() const { return (UINT)m_commands.size(); }
+        const Command& GetCommand(UINT index) const { return m_commands[index]; }
+
+    private:
+        Command& Append(Op op);
+        //! bounds in user space through the current transform, trimmed to the clip
+        void Place(Command& command, const RECT& bounds);
+        void Execute(Context& context, const Command& command) const;
+
+    private:
+        DisplayList(const DisplayList&);
+        DisplayList& operator = (const DisplayList&);
+    };
+}
\ No newline at end of file
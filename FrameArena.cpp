@@ -0,0 +1,88 @@
+#include "FrameArena.h"
+
+#include <stdlib.h>
+
+namespace Render
+{
+    FrameArena::FrameArena()
+        : m_blocks()
+        , m_offset(0)
+        , m_used(0)
+    {
+
+    }
+
+    FrameArena::~FrameArena()
+    {
+        for (size_t i = 0; i != m_blocks.size(); ++i)
+        {
+            ::free(m_blocks[i].data);
+        }
+    }
+
+    void *FrameArena::Allocate(SIZE_T bytes, SIZE_T align)
+    {
+        if (!bytes)
+            return NULL;
+
+        if (!m_blocks.empty())
+        {
+            Block& block = m_blocks.back();
+            SIZE_T start = (m_offset + align - 1) & ~(align - 1);
+
+            if (start + bytes <= block.size)
+            {
+                m_used += start + bytes - m_offset;
+                m_offset = start + bytes;
+                return block.data + start;
+            }
+        }
+
+        //! malloc aligns to 16 on every platform we build for
+        SIZE_T size = max(bytes, (SIZE_T)DefaultBlockSize);
+        if (!m_blocks.empty())
+            size = max(size, m_blocks.back().size * 2);
+
+        Block block = { (BYTE *)::malloc(size), size };
+        if (!block.data)
+            throw 0;
+
+        m_blocks.push_back(block);
+        m_offset = bytes;
+        m_used += bytes;
+
+        return block.data;
+    }
+
+    void FrameArena::Reset()
+    {
+        if (m_blocks.size() > 1)
+        {
+            SIZE_T total = GetCapacity();
+
+            for (size_t i = 0; i != m_blocks.size(); ++i)
+            {
+                ::free(m_blocks[i].data);
+            }
+            m_blocks.clear();
+
+            Block block = { (BYTE *)::malloc(total), total };
+            if (block.data)
+                m_blocks.push_back(block);
+        }
+
+        m_offset = 0;
+        m_used = 0;
+    }
+
+    SIZE_T FrameArena::GetCapacity() const
+    {
+        SIZE_T capacity = 0;
+        for (size_t i = 0; i != m_blocks.size(); ++i)
+        {
+            capacity += m_blocks[i].size;
+        }
+
+        return capacity;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Win32Compat.h"
+
+#include <vector>
+
+namespace Render
+{
+    //! bump allocator for memory that only lives until the end of the frame
+    //! Reset rewinds it; a frame that needed several blocks leaves one block of the
+    //! combined size behind, so the next frame of the same shape allocates nothing
+    class FrameArena
+    {
+    public:
+        enum { DefaultBlockSize = 64 * 1024 };
+
+    private:
+        struct Block
+        {
+            BYTE *data;
+            SIZE_T size;
+        };
+
+    private:
+        std::vector<Block> m_blocks;
+        SIZE_T m_offset;        //! into the last block
+        SIZE_T m_used;
+
+    public:
+        FrameArena();
+        ~FrameArena();
+
+    public:
+        //! never NULL for bytes > 0, freed by Reset or the destructor
+        void *Allocate(SIZE_T bytes, SIZE_T align = 16);
+
+        template<class T>
+        T *Allocate(SIZE_T count)
+        {
+            return (T *)Allocate(count * sizeof(T), sizeof(T) < 16 ? sizeof(T) : 16);
+        }
+
+        void Reset();
+
+    public:
+        SIZE_T GetUsed() const { return m_used; }
+        SIZE_T GetCapacity() const;
+
+    private:
+        FrameArena(const FrameArena&);
+        FrameArena& operator = (const FrameArena&);
+    };
+}
\ No newline at end of file
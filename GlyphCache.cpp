@@ -0,0 +1,727 @@
+#include "GlyphCache.h"
+
+#include "Context.h"
+#include "FrameArena.h"
+
+#include <string.h>
+
+#if USE_CAIRO
+#include "cairo.h"
+
+#include <math.h>
+#include <string>
+#include <codecvt>
+#include <locale>
+#endif
+
+namespace Render
+{
+#if USE_CAIRO
+
+    //! same faces the toy api picks, through a cached scaled font
+    class CairoGlyphRasterizer : public GlyphRasterizer
+    {
+    private:
+        cairo_scaled_font_t *m_font;
+        LOGFONTW m_current;
+
+    public:
+        CairoGlyphRasterizer()
+            : m_font(NULL)
+            , m_current()
+        {}
+
+        ~CairoGlyphRasterizer()
+        {
+            if (m_font)
+                ::cairo_scaled_font_destroy(m_font);
+        }
+
+    public:
+        bool GetLineMetrics(const Font& font, LONG *ascent, LONG *height)
+        {
+            if (!Select(font))
+                return false;
+
+            cairo_font_extents_t extents = { 0 };
+            ::cairo_scaled_font_extents(m_font, &extents);
+
+            *ascent = (LONG)ceil(extents.ascent);
+            *height = (LONG)ceil(extents.height);
+            return true;
+        }
+
+        UINT MapCharacter(const Font& font, WCHAR ch)
+        {
+            if (!Select(font))
+                return 0;
+
+            std::wstring_convert<std::codecvt_utf8<wchar_t>> utf8_conv;
+            std::string utf8 = utf8_conv.to_bytes(ch);
+
+            cairo_glyph_t *glyphs = NULL;
+            int count = 0;
+            UINT index = 0;
+
+            if (CAIRO_STATUS_SUCCESS == ::cairo_scaled_font_text_to_glyphs(m_font, 0, 0, utf8.c_str(), (int)utf8.length(),
+                &glyphs, &count, NULL, NULL, NULL) && count)
+            {
+                index = (UINT)glyphs[0].index;
+            }
+
+            ::cairo_glyph_free(glyphs);
+            return index;
+        }
+
+        bool Rasterize(const Font& font, UINT glyph, GlyphMetrics *metrics, std::vector<BYTE> *coverage)
+        {
+            if (!Select(font))
+                return false;
+
+            cairo_glyph_t g = { glyph, 0, 0 };
+            cairo_text_extents_t extents = { 0 };
+            ::cairo_scaled_font_glyph_extents(m_font, &g, 1, &extents);
+
+            ::memset(metrics, 0, sizeof(GlyphMetrics));
+            metrics->advance = (LONG)floor(extents.x_advance + 0.5);
+
+            if (extents.width <= 0 || extents.height <= 0)
+                return true;
+
+            metrics->left = (LONG)floor(extents.x_bearing);
+            metrics->top = (LONG)floor(extents.y_bearing);
+            metrics->width = (LONG)ceil(extents.x_bearing + extents.width) - metrics->left;
+            metrics->height = (LONG)ceil(extents.y_bearing + extents.height) - metrics->top;
+
+            cairo_surface_t *mask = ::cairo_image_surface_create(CAIRO_FORMAT_A8, metrics->width, metrics->height);
+            cairo_t *cr = ::cairo_create(mask);
+
+            g.x = -metrics->left;
+            g.y = -metrics->top;
+            ::cairo_set_scaled_font(cr, m_font);
+            ::cairo_show_glyphs(cr, &g, 1);
+            ::cairo_destroy(cr);
+            ::cairo_surface_flush(mask);
+
+            const BYTE *bits = ::cairo_image_surface_get_data(mask);
+            int stride = ::cairo_image_surface_get_stride(mask);
+
+            coverage->resize(metrics->width * metrics->height);
+            for (LONG y = 0; y != metrics->height; ++y)
+            {
+                ::memcpy(&(*coverage)[y * metrics->width], bits + y * stride, metrics->width);
+            }
+
+            ::cairo_surface_destroy(mask);
+            return true;
+        }
+
+    private:
+        bool Select(const Font& font)
+        {
+            if (m_font && 0 == ::memcmp(&m_current, &font.m_font, sizeof(LOGFONTW)))
+                return true;
+
+            std::wstring_convert<std::codecvt_utf8<wchar_t>> utf8_conv;
+            std::string family = utf8_conv.to_bytes(font.m_font.lfFaceName);
+
+            cairo_font_face_t *face = ::cairo_toy_font_face_create(family.c_str(),
+                font.m_font.lfItalic ? CAIRO_FONT_SLANT_ITALIC : CAIRO_FONT_SLANT_NORMAL,
+                font.m_font.lfWeight >= 600 ? CAIRO_FONT_WEIGHT_BOLD : CAIRO_FONT_WEIGHT_NORMAL);
+
+            cairo_matrix_t size, ctm;
+            ::cairo_matrix_init_scale(&size, font.GetPixelSize(), font.GetPixelSize());
+            ::cairo_matrix_init_identity(&ctm);
+
+            cairo_font_options_t *options = ::cairo_font_options_create();
+            ::cairo_font_options_set_antialias(options, CAIRO_ANTIALIAS_GRAY);
+
+            cairo_scaled_font_t *scaled = ::cairo_scaled_font_create(face, &size, &ctm, options);
+
+            ::cairo_font_options_destroy(options);
+            ::cairo_font_face_destroy(face);
+
+            if (CAIRO_STATUS_SUCCESS != ::cairo_scaled_font_status(scaled))
+            {
+                ::cairo_scaled_font_destroy(scaled);
+                return false;
+            }
+
+            if (m_font)
+                ::cairo_scaled_font_destroy(m_font);
+
+            m_font = scaled;
+            m_current = font.m_font;
+            return true;
+        }
+    };
+
+    static GlyphRasterizer *CreateDefaultRasterizer()
+    {
+        return new CairoGlyphRasterizer();
+    }
+
+#elif defined(_WIN32)
+
+    //! one memory dc, the hfont is only recreated when the font changes
+    class GdiGlyphRasterizer : public GlyphRasterizer
+    {
+    private:
+        HDC m_DC;
+        HFONT m_font;
+        LOGFONTW m_current;
+
+    public:
+        GdiGlyphRasterizer()
+            : m_DC(::CreateCompatibleDC(NULL))
+            , m_font(NULL)
+            , m_current()
+        {}
+
+        ~GdiGlyphRasterizer()
+        {
+            if (m_DC)
+                ::DeleteDC(m_DC);
+            if (m_font)
+                ::DeleteObject(m_font);
+        }
+
+    public:
+        bool GetLineMetrics(const Font& font, LONG *ascent, LONG *height)
+        {
+            TEXTMETRICW tm = { 0 };
+            if (!Select(font) || !::GetTextMetricsW(m_DC, &tm))
+                return false;
+
+            *ascent = tm.tmAscent;
+            *height = tm.tmHeight;
+            return true;
+        }
+
+        UINT MapCharacter(const Font& font, WCHAR ch)
+        {
+            WORD index = 0;
+            if (!Select(font) || GDI_ERROR == ::GetGlyphIndicesW(m_DC, &ch, 1, &index, 0))
+                return 0;
+
+            return index;
+        }
+
+        bool Rasterize(const Font& font, UINT glyph, GlyphMetrics *metrics, std::vector<BYTE> *coverage)
+        {
+            if (!Select(font))
+                return false;
+
+            const MAT2 identity = { { 0, 1 }, { 0, 0 }, { 0, 0 }, { 0, 1 } };
+            GLYPHMETRICS gm = { 0 };
+            UINT format = GGO_GLYPH_INDEX | GGO_GRAY8_BITMAP;
+
+            DWORD size = ::GetGlyphOutlineW(m_DC, glyph, format, &gm, 0, NULL, &identity);
+            if (GDI_ERROR == size)
+                return false;
+
+            ::memset(metrics, 0, sizeof(GlyphMetrics));
+            metrics->advance = gm.gmCellIncX;
+
+            //! blanks report a 1x1 black box but no bits
+            if (0 == size)
+                return true;
+
+            std::vector<BYTE> bits(size);
+            if (GDI_ERROR == ::GetGlyphOutlineW(m_DC, glyph, format, &gm, size, &bits[0], &identity))
+                return false;
+
+            metrics->left = gm.gmptGlyphOrigin.x;
+            metrics->top = -gm.gmptGlyphOrigin.y;
+            metrics->width = gm.gmBlackBoxX;
+            metrics->height = gm.gmBlackBoxY;
+
+            //! GGO_GRAY8 rows are dword aligned with 65 levels
+            LONG pitch = (metrics->width + 3) & ~3;
+            coverage->resize(metrics->width * metrics->height);
+            for (LONG y = 0; y != metrics->height; ++y)
+            {
+                for (LONG x = 0; x != metrics->width; ++x)
+                {
+                    UINT level = bits[y * pitch + x];
+                    (*coverage)[y * metrics->width + x] = (BYTE)(level >= 64 ? 255 : (level * 255 + 32) / 64);
+                }
+            }
+
+            return true;
+        }
+
+    private:
+        bool Select(const Font& font)
+        {
+            if (!m_DC)
+                return false;
+
+            if (m_font && 0 == ::memcmp(&m_current, &font.m_font, sizeof(LOGFONTW)))
+                return true;
+
+            HFONT hFont = ::CreateFontIndirectW(&font.m_font);
+            if (!hFont)
+                return false;
+
+            ::SelectObject(m_DC, hFont);
+            if (m_font)
+                ::DeleteObject(m_font);
+
+            m_font = hFont;
+            m_current = font.m_font;
+            return true;
+        }
+    };
+
+    static GlyphRasterizer *CreateDefaultRasterizer()
+    {
+        return new GdiGlyphRasterizer();
+    }
+
+#else
+
+    //! no platform font engine, install one with SetRasterizer
+    static GlyphRasterizer *CreateDefaultRasterizer()
+    {
+        return NULL;
+    }
+
+#endif
+
+    GlyphCache::FontKey::FontKey(const Font& font)
+    {
+        //! padding included, so memcmp and the hash see the same bytes
+        ::memset(this, 0, sizeof(FontKey));
+        ::memcpy(face, font.m_font.lfFaceName, sizeof(face));
+        px = font.GetPixelSize();
+        weight = font.m_font.lfWeight;
+        italic = font.m_font.lfItalic;
+    }
+
+    bool GlyphCache::FontKey::operator == (const FontKey& other) const
+    {
+        return 0 == ::memcmp(this, &other, sizeof(FontKey));
+    }
+
+    size_t GlyphCache::FontKeyHash::operator () (const FontKey& key) const
+    {
+        //! FNV-1a
+        const BYTE *bytes = (const BYTE *)&key;
+        size_t hash = 2166136261u;
+        for (size_t i = 0; i != sizeof(FontKey); ++i)
+        {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+
+        return hash;
+    }
+
+    GlyphCache& GlyphCache::Instance()
+    {
+        static GlyphCache cache;
+        return cache;
+    }
+
+    GlyphCache::GlyphCache()
+        : m_lock()
+        , m_rasterizer(CreateDefaultRasterizer())
+        , m_fonts()
+        , m_pages()
+        , m_pageSize(DefaultPageSize)
+        , m_maxPages(DefaultMaxPages)
+        , m_scratch()
+        , m_runs()
+        , m_runIndex()
+        , m_runBytes(0)
+        , m_runBudget(DefaultRunBudget)
+        , m_runHits(0)
+        , m_runMisses(0)
+    {
+
+    }
+
+    GlyphCache::~GlyphCache()
+    {
+        delete m_rasterizer;
+    }
+
+    void GlyphCache::SetRasterizer(GlyphRasterizer *rasterizer)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        delete m_rasterizer;
+        m_rasterizer = rasterizer;
+
+        m_fonts.clear();
+        m_pages.clear();
+        ClearRuns();
+    }
+
+    void GlyphCache::SetBudget(LONG pageSize, UINT maxPages)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        m_pageSize = max(pageSize, 64);
+        m_maxPages = max(maxPages, 1u);
+
+        //! coverage pointers assume the old pitch
+        for (FontMap::iterator it = m_fonts.begin(); it != m_fonts.end(); ++it)
+        {
+            it->second.glyphs.clear();
+        }
+        m_pages.clear();
+    }
+
+    void GlyphCache::SetRunBudget(SIZE_T bytes)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        m_runBudget = bytes;
+        TrimRuns(m_runBudget);
+    }
+
+    void GlyphCache::Clear()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        m_fonts.clear();
+        m_pages.clear();
+        ClearRuns();
+    }
+
+    TextRunStats GlyphCache::GetRunStats()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        TextRunStats stats = { m_runHits, m_runMisses, m_runBytes, (UINT)m_runs.size() };
+        return stats;
+    }
+
+    GlyphCache::FontEntry *GlyphCache::FindFont(const Font& font)
+    {
+        if (!m_rasterizer)
+            return NULL;
+
+        FontKey key(font);
+        FontMap::iterator it = m_fonts.find(key);
+
+        if (it == m_fonts.end())
+        {
+            it = m_fonts.insert(std::make_pair(key, FontEntry())).first;
+
+            FontEntry& entry = it->second;
+            entry.ascent = entry.height = 0;
+            entry.valid = m_rasterizer->GetLineMetrics(font, &entry.ascent, &entry.height);
+        }
+
+        //! failed fonts stay cached, so a missing face is not retried per call
+        return it->second.valid ? &it->second : NULL;
+    }
+
+    UINT GlyphCache::MapCharacter(FontEntry& entry, const Font& font, WCHAR ch)
+    {
+        std::unordered_map<WCHAR, UINT>::const_iterator mapped = entry.chars.find(ch);
+        if (mapped != entry.chars.end())
+            return mapped->second;
+
+        UINT index = m_rasterizer->MapCharacter(font, ch);
+        entry.chars[ch] = index;
+        return index;
+    }
+
+    const GlyphCache::Glyph *GlyphCache::FindGlyph(FontEntry& entry, const Font& font, UINT index)
+    {
+        std::unordered_map<UINT, Glyph>::const_iterator cached = entry.glyphs.find(index);
+        if (cached != entry.glyphs.end())
+            return &cached->second;
+
+        Glyph glyph = { { 0 }, NULL };
+        if (!m_rasterizer->Rasterize(font, index, &glyph.metrics, &m_scratch))
+            return NULL;
+
+        if (glyph.metrics.width > 0 && glyph.metrics.height > 0)
+        {
+            glyph.coverage = Pack(&m_scratch[0], glyph.metrics.width, glyph.metrics.height);
+
+            if (!glyph.coverage && glyph.metrics.width <= m_pageSize && glyph.metrics.height <= m_pageSize)
+            {
+                //! atlas full, start over; font entries stay so callers' pointers remain valid
+                for (FontMap::iterator it = m_fonts.begin(); it != m_fonts.end(); ++it)
+                {
+                    it->second.glyphs.clear();
+                }
+                m_pages.resize(1);
+                m_pages[0].shelfTop = m_pages[0].shelfHeight = m_pages[0].cursor = 0;
+
+                glyph.coverage = Pack(&m_scratch[0], glyph.metrics.width, glyph.metrics.height);
+            }
+        }
+
+        return &(entry.glyphs[index] = glyph);
+    }
+
+    const BYTE *GlyphCache::Pack(const BYTE *coverage, LONG width, LONG height)
+    {
+        if (width > m_pageSize || height > m_pageSize)
+            return NULL;
+
+        for (;;)
+        {
+            if (!m_pages.empty())
+            {
+                Page& page = m_pages.back();
+
+                if (page.cursor + width > m_pageSize)
+                {
+                    page.shelfTop += page.shelfHeight;
+                    page.shelfHeight = 0;
+                    page.cursor = 0;
+                }
+
+                if (page.shelfTop + height <= m_pageSize)
+                {
+                    BYTE *dst = &page.pixels[page.shelfTop * m_pageSize + page.cursor];
+                    for (LONG y = 0; y != height; ++y)
+                    {
+                        ::memcpy(dst + y * m_pageSize, coverage + y * width, width);
+                    }
+
+                    page.cursor += width;
+                    page.shelfHeight = max(page.shelfHeight, height);
+                    return dst;
+                }
+            }
+
+            if (m_pages.size() >= m_maxPages)
+                return NULL;
+
+            m_pages.push_back(Page());
+            Page& page = m_pages.back();
+            page.pixels.resize(m_pageSize * m_pageSize);
+            page.shelfTop = page.shelfHeight = page.cursor = 0;
+        }
+    }
+
+    static size_t HashText(size_t hash, const String& text)
+    {
+        //! FNV-1a continued over the characters
+        for (size_t i = 0; i != text.length(); ++i)
+        {
+            hash = (hash ^ (size_t)text[i]) * 16777619u;
+        }
+
+        return hash;
+    }
+
+    const GlyphCache::TextRun *GlyphCache::FindRun(FontEntry& entry, const Font& font, const String& text)
+    {
+        FontKey key(font);
+        size_t hash = HashText(FontKeyHash()(key), text);
+
+        std::pair<RunIndex::iterator, RunIndex::iterator> range = m_runIndex.equal_range(hash);
+        for (RunIndex::iterator it = range.first; it != range.second; ++it)
+        {
+            RunList::iterator run = it->second;
+            if (run->font == key && run->text == text)
+            {
+                ++m_runHits;
+                m_runs.splice(m_runs.begin(), m_runs, run);
+                return &*run;
+            }
+        }
+
+        ++m_runMisses;
+
+        m_runs.push_front(TextRun(font));
+        TextRun& run = m_runs.front();
+        run.text = text;
+        run.hash = hash;
+        LayoutRun(entry, font, &run);
+
+        run.bytes = sizeof(TextRun) + run.text.capacity() * sizeof(WCHAR) + run.glyphs.capacity() * sizeof(RunGlyph);
+        m_runBytes += run.bytes;
+        m_runIndex.insert(std::make_pair(hash, m_runs.begin()));
+
+        TrimRuns(m_runBudget);
+        return &run;
+    }
+
+    void GlyphCache::LayoutRun(FontEntry& entry, const Font& font, TextRun *run)
+    {
+        const String& text = run->text;
+        LONG penX = 0, lineTop = 0;
+        LONG left = 0, top = 0, right = 0, bottom = 0;
+
+        run->glyphs.reserve(text.length());
+        run->size.cx = 0;
+        run->size.cy = text.empty() ? 0 : entry.height;
+
+        for (size_t i = 0; i != text.length(); ++i)
+        {
+            WCHAR ch = text[i];
+            if ('\r' == ch)
+                continue;
+
+            if ('\n' == ch)
+            {
+                penX = 0;
+                lineTop += entry.height;
+                run->size.cy = lineTop + entry.height;
+                continue;
+            }
+
+            UINT index = MapCharacter(entry, font, ch);
+            const Glyph *glyph = FindGlyph(entry, font, index);
+            if (!glyph)
+                continue;
+
+            RunGlyph placed = { index, penX, lineTop };
+            run->glyphs.push_back(placed);
+
+            const GlyphMetrics& m = glyph->metrics;
+            if (m.width > 0 && m.height > 0)
+            {
+                left = min(left, penX + m.left);
+                top = min(top, lineTop + entry.ascent + m.top);
+                right = max(right, penX + m.left + m.width);
+                bottom = max(bottom, lineTop + entry.ascent + m.top + m.height);
+            }
+
+            penX += m.advance;
+            run->size.cx = max(run->size.cx, penX);
+        }
+
+        right = max(right, run->size.cx);
+        bottom = max(bottom, run->size.cy);
+
+        run->bounds.left = left;
+        run->bounds.top = top;
+        run->bounds.right = right - left;
+        run->bounds.bottom = bottom - top;
+
+        run->glyphs.shrink_to_fit();
+    }
+
+    void GlyphCache::TrimRuns(SIZE_T budget)
+    {
+        //! the newest run stays, the caller is about to use it
+        while (m_runBytes > budget && m_runs.size() > 1)
+        {
+            TextRun& oldest = m_runs.back();
+
+            std::pair<RunIndex::iterator, RunIndex::iterator> range = m_runIndex.equal_range(oldest.hash);
+            for (RunIndex::iterator it = range.first; it != range.second; ++it)
+            {
+                if (&*it->second == &oldest)
+                {
+                    m_runIndex.erase(it);
+                    break;
+                }
+            }
+
+            m_runBytes -= oldest.bytes;
+            m_runs.pop_back();
+        }
+    }
+
+    void GlyphCache::ClearRuns()
+    {
+        m_runs.clear();
+        m_runIndex.clear();
+        m_runBytes = 0;
+    }
+
+    TextLayout GlyphCache::Layout(const Font& font, const String& text, FrameArena& arena)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        TextLayout layout = { { 0 }, { 0 }, NULL, 0 };
+        FontEntry *entry = FindFont(font);
+        if (!entry || text.empty())
+            return layout;
+
+        const TextRun *run = FindRun(*entry, font, text);
+        layout.size = run->size;
+        layout.bounds = run->bounds;
+
+        PlacedGlyph *placed = arena.Allocate<PlacedGlyph>(run->glyphs.size());
+        for (size_t i = 0; i != run->glyphs.size(); ++i)
+        {
+            const RunGlyph& pen = run->glyphs[i];
+
+            //! copied right away, a later miss may start the atlas over
+            const Glyph *glyph = FindGlyph(*entry, font, pen.glyph);
+            if (!glyph || !glyph->coverage)
+                continue;
+
+            const GlyphMetrics& m = glyph->metrics;
+            BYTE *coverage = arena.Allocate<BYTE>((SIZE_T)m.width * m.height);
+            for (LONG y = 0; y != m.height; ++y)
+            {
+                ::memcpy(coverage + y * m.width, glyph->coverage + y * m_pageSize, m.width);
+            }
+
+            PlacedGlyph copy = { pen.x + m.left, pen.y + entry->ascent + m.top, m.width, m.height, coverage };
+            placed[layout.count++] = copy;
+        }
+
+        layout.glyphs = placed;
+        return layout;
+    }
+
+    RECT GlyphCache::DrawLayout(const PixelBuffer& target, const TextLayout& layout, const POINT& where, DWORD color, BYTE alpha)
+    {
+        LONG left = where.x, top = where.y;
+        LONG right = where.x + layout.size.cx, bottom = where.y + layout.size.cy;
+
+        for (UINT i = 0; i != layout.count; ++i)
+        {
+            const PlacedGlyph& glyph = layout.glyphs[i];
+            LONG x = where.x + glyph.x;
+            LONG y = where.y + glyph.y;
+
+            LONG x0 = max(x, 0), y0 = max(y, 0);
+            LONG x1 = min(x + glyph.width, target.width), y1 = min(y + glyph.height, target.height);
+
+            if (x1 > x0 && y1 > y0)
+            {
+                Pixel::BlendMask(target.data + y0 * target.stride + x0 * 4, target.stride,
+                    glyph.coverage + (y0 - y) * glyph.width + (x0 - x), glyph.width, x1 - x0, y1 - y0, color, alpha);
+            }
+
+            //! ink can overhang the cell, italics and negative bearings
+            left = min(left, x);
+            top = min(top, y);
+            right = max(right, x + glyph.width);
+            bottom = max(bottom, y + glyph.height);
+        }
+
+        RECT box = { left, top, right - left, bottom - top };
+        return box;
+    }
+
+    SIZE GlyphCache::Measure(const Font& font, const String& text)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        SIZE size = { 0 };
+        FontEntry *entry = FindFont(font);
+        if (!entry || text.empty())
+            return size;
+
+        return FindRun(*entry, font, text)->size;
+    }
+
+    RECT GlyphCache::GetTextBounds(const Font& font, const String& text)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        RECT bounds = { 0 };
+        FontEntry *entry = FindFont(font);
+        if (!entry || text.empty())
+            return bounds;
+
+        return FindRun(*entry, font, text)->bounds;
+    }
+}
\ No newline at end of file
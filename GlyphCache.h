@@ -0,0 +1,205 @@
+#pragma once
+
+#include "Win32Compat.h"
+#include "PixelKernel.h"
+
+#include <list>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+
+namespace Render
+{
+    class Font;
+    class FrameArena;
+
+    //! coverage box of one glyph, relative to the pen on the baseline
+    struct GlyphMetrics
+    {
+        LONG left;          //! pen to the first column
+        LONG top;           //! baseline to the first row, negative above it
+        LONG width;
+        LONG height;
+        LONG advance;
+    };
+
+    //! platform glyph source, only asked on a cache miss
+    class GlyphRasterizer
+    {
+    public:
+        virtual ~GlyphRasterizer() {}
+
+    public:
+        //! ascent and line height in pixels
+        virtual bool GetLineMetrics(const Font& font, LONG *ascent, LONG *height) = 0;
+        virtual UINT MapCharacter(const Font& font, WCHAR ch) = 0;
+        //! A8 coverage, width bytes per row
+        virtual bool Rasterize(const Font& font, UINT glyph, GlyphMetrics *metrics, std::vector<BYTE> *coverage) = 0;
+    };
+
+    //! one inked glyph of a laid out run, relative to where the run is drawn; coverage is width bytes a row
+    struct PlacedGlyph
+    {
+        LONG x;
+        LONG y;
+        LONG width;
+        LONG height;
+        const BYTE *coverage;
+    };
+
+    //! a run as GlyphCache lays it out, copied out of the cache so it is blended without the lock
+    struct TextLayout
+    {
+        SIZE size;                  //! cell box, what Measure returns
+        RECT bounds;                //! every pixel DrawLayout may touch, what GetTextBounds returns
+        const PlacedGlyph *glyphs;  //! in the arena, blanks left out
+        UINT count;
+    };
+
+    struct TextRunStats
+    {
+        ULONGLONG hits;
+        ULONGLONG misses;
+        SIZE_T bytes;
+        UINT count;
+    };
+
+    //! rasterized glyphs shelf-packed into A8 atlas pages, shared by every context
+    //! keyed by (face, pixel size, weight, italic, glyph id)
+    //! laid out runs are kept in an LRU keyed by (font, string), so measure then draw lays out once
+    class GlyphCache
+    {
+    public:
+        enum { DefaultPageSize = 512, DefaultMaxPages = 8 };
+        enum { DefaultRunBudget = 1024 * 1024 };
+
+    private:
+        struct FontKey
+        {
+            WCHAR face[LF_FACESIZE];
+            LONG px;
+            LONG weight;
+            LONG italic;
+
+            explicit FontKey(const Font& font);
+            bool operator == (const FontKey& other) const;
+        };
+
+        struct FontKeyHash
+        {
+            size_t operator () (const FontKey& key) const;
+        };
+
+        struct Glyph
+        {
+            GlyphMetrics metrics;
+            const BYTE *coverage;   //! inside a page, NULL for blanks, pitch is the page size
+        };
+
+        struct FontEntry
+        {
+            bool valid;
+            LONG ascent;
+            LONG height;
+            std::unordered_map<WCHAR, UINT> chars;
+            std::unordered_map<UINT, Glyph> glyphs;
+        };
+
+        //! pen position of one glyph, relative to the run origin and its line top
+        struct RunGlyph
+        {
+            UINT glyph;
+            LONG x;
+            LONG y;
+        };
+
+        struct TextRun
+        {
+            FontKey font;
+            String text;
+            size_t hash;
+            std::vector<RunGlyph> glyphs;
+            SIZE size;              //! cell box, what DT_CALCRECT reports
+            RECT bounds;            //! cell box plus ink overhang, from the origin, right is width, bottom is height
+            SIZE_T bytes;
+
+            explicit TextRun(const Font& f) : font(f), text(), hash(0), glyphs(), size(), bounds(), bytes(0) {}
+        };
+
+        struct Page
+        {
+            std::vector<BYTE> pixels;
+            LONG shelfTop;
+            LONG shelfHeight;
+            LONG cursor;
+        };
+
+        typedef std::unordered_map<FontKey, FontEntry, FontKeyHash> FontMap;
+        //! front is the most recent, the index is keyed by hash so a hit copies no string
+        typedef std::list<TextRun> RunList;
+        typedef std::unordered_multimap<size_t, RunList::iterator> RunIndex;
+
+    private:
+        std::mutex m_lock;
+        GlyphRasterizer *m_rasterizer;
+
+        FontMap m_fonts;
+        std::vector<Page> m_pages;
+        LONG m_pageSize;
+        UINT m_maxPages;
+
+        std::vector<BYTE> m_scratch;
+
+        RunList m_runs;
+        RunIndex m_runIndex;
+        SIZE_T m_runBytes;
+        SIZE_T m_runBudget;
+        ULONGLONG m_runHits;
+        ULONGLONG m_runMisses;
+
+    public:
+        static GlyphCache& Instance();
+
+    public:
+        GlyphCache();
+        ~GlyphCache();
+
+    public:
+        //! takes ownership, NULL disables text; drops every cached glyph
+        void SetRasterizer(GlyphRasterizer *rasterizer);
+        //! pages are square A8, once all are full the atlas starts over
+        void SetBudget(LONG pageSize, UINT maxPages);
+        //! approximate bytes of laid out runs kept, the latest run always stays
+        void SetRunBudget(SIZE_T bytes);
+        void Clear();
+
+        TextRunStats GetRunStats();
+
+    public:
+        //! lays out like DrawText(DT_LEFT | DT_TOP | DT_NOCLIP), '\n' starts a new line
+        //! size, bounds and glyphs in one locked lookup; the glyphs' coverage is copied into arena,
+        //! so drawing it needs no lock and a later atlas reset frees nothing being read
+        TextLayout Layout(const Font& font, const String& text, FrameArena& arena);
+        //! color is 0x00RRGGBB, alpha scales the coverage; any thread, touches nothing of the cache
+        //! returns the box touched, right is width, bottom is height
+        static RECT DrawLayout(const PixelBuffer& target, const TextLayout& layout, const POINT& where, DWORD color, BYTE alpha);
+
+        SIZE Measure(const Font& font, const String& text);
+        //! every pixel DrawLayout may touch, relative to where, right is width, bottom is height
+        RECT GetTextBounds(const Font& font, const String& text);
+
+    private:
+        FontEntry *FindFont(const Font& font);
+        UINT MapCharacter(FontEntry& entry, const Font& font, WCHAR ch);
+        const Glyph *FindGlyph(FontEntry& entry, const Font& font, UINT index);
+        const TextRun *FindRun(FontEntry& entry, const Font& font, const String& text);
+        void LayoutRun(FontEntry& entry, const Font& font, TextRun *run);
+        void TrimRuns(SIZE_T budget);
+        void ClearRuns();
+        const BYTE *Pack(const BYTE *coverage, LONG width, LONG height);
+
+    private:
+        GlyphCache(const GlyphCache&);
+        GlyphCache& operator = (const GlyphCache&);
+    };
+}
\ No newline at end of file
@@ -1,13 +1,27 @@
 #include "Image.h"
 
+#include "PixelKernel.h"
+#include "ImageCodec.h"
+#include "AnimationStream.h"
+#include "ThreadPool.h"
+#include "ScaledImageCache.h"
+
+#include <algorithm>
+#include <mutex>
+#include <atomic>
+
+#if defined(_WIN32)
 #include <Amvideo.h>
 #include <gdiplus.h>
+#else
+#include <stdlib.h>
+#endif
 
 #define BITMAP_BITCOUNT 32
 
 namespace Render
 {
-    static HBITMAP CreateBitmap(const SIZE& s, LPVOID *ppData, BITMAPINFO *bitmapInfo)
+    static HBITMAP CreateBitmap(const SIZE& s, void **ppData, BITMAPINFO *bitmapInfo)
     {
         memset(bitmapInfo, 0, sizeof(BITMAPINFO));
 
@@ -18,7 +32,28 @@ namespace Render
         bitmapInfo->bmiHeader.biHeight = -s.cy;
         bitmapInfo->bmiHeader.biPlanes = 1;
 
+#if defined(_WIN32)
         return CreateDIBSection(NULL, bitmapInfo, DIB_RGB_COLORS, ppData, NULL, 0);
+#else
+        //! without gdi the handle is the pixel block itself
+        *ppData = ::calloc(DIBWIDTHBYTES(bitmapInfo->bmiHeader), s.cy);
+        return (HBITMAP)*ppData;
+#endif
+    }
+
+    static ULONGLONG NextImageId()
+    {
+        static std::atomic<ULONGLONG> next(0);
+        return ++next;
+    }
+
+    static void DeleteBitmap(HBITMAP bitmap)
+    {
+#if defined(_WIN32)
+        ::DeleteObject(bitmap);
+#else
+        ::free(bitmap);
+#endif
     }
 
     bool Image::Allocate(Image *nullImage, const SIZE& size)
@@ -32,13 +67,14 @@ namespace Render
         BITMAPINFO desBitmapInfo;
         PBYTE pDesData = NULL;
 
-        HBITMAP bitmap = CreateBitmap(size, (LPVOID *)&pDesData, &desBitmapInfo);
+        HBITMAP bitmap = CreateBitmap(size, (void **)&pDesData, &desBitmapInfo);
 
         if (bitmap)
         {
             ::memcpy(&nullImage->m_bitmapInfo, &desBitmapInfo, sizeof(BITMAPINFO));
             nullImage->m_pData = pDesData;
             nullImage->m_bitmap = bitmap;
+            nullImage->m_id = NextImageId();
 
             return true;
         }
@@ -67,25 +103,46 @@ namespace Render
 
         nullImage->m_pData = pData;
         nullImage->m_bitmap = bitmap;
+        nullImage->m_id = NextImageId();
 
         ::memcpy(&nullImage->m_bitmapInfo, &bitmapInfo, sizeof(BITMAPINFO));
 
         return true;
     }
 
-    static HBITMAP CreateBitmapFrom(Gdiplus::Image *srcBitmap, LPVOID *ppData, BITMAPINFO *bitmapInfo)
+    bool Image::Borrow(Image *nullImage, PBYTE pData, HBITMAP bitmap, const BITMAPINFO& bitmapInfo)
+    {
+        if (!Initialize(nullImage, pData, bitmap, bitmapInfo))
+            return false;
+
+        nullImage->m_borrowed = true;
+        return true;
+    }
+
+#if defined(_WIN32)
+
+    //! gdi+ converts the decoded frame to premultiplied BGRA straight into the dib
+    static HBITMAP CreateBitmapFrom(Gdiplus::Bitmap *srcBitmap, LPVOID *ppData, BITMAPINFO *bitmapInfo)
     {
         SIZE imageSize = { srcBitmap->GetWidth(), srcBitmap->GetHeight() };
         HBITMAP desBitmap = CreateBitmap(imageSize, ppData, bitmapInfo);
 
         if (desBitmap)
         {
-            //! draw the bitmap
-            HDC desDC = ::CreateCompatibleDC(NULL);
-            ::SelectObject(desDC, desBitmap);
-
-            Gdiplus::Graphics g(desDC);
-            if (Gdiplus::Ok != g.DrawImage(srcBitmap, 0, 0))
+            Gdiplus::Rect rect(0, 0, imageSize.cx, imageSize.cy);
+            Gdiplus::BitmapData data;
+            data.Width = imageSize.cx;
+            data.Height = imageSize.cy;
+            data.Stride = DIBWIDTHBYTES(bitmapInfo->bmiHeader);
+            data.PixelFormat = PixelFormat32bppPARGB;
+            data.Scan0 = *ppData;
+            data.Reserved = 0;
+
+            if (Gdiplus::Ok == srcBitmap->LockBits(&rect, Gdiplus::ImageLockModeRead | Gdiplus::ImageLockModeUserInputBuf, PixelFormat32bppPARGB, &data))
+            {
+                srcBitmap->UnlockBits(&data);
+            }
+            else
             {
                 //! when failed, delete the bitmap
                 ::DeleteObject(desBitmap);
@@ -93,17 +150,32 @@ namespace Render
                 desBitmap = NULL;
                 *ppData = NULL;
             }
-
-            ::DeleteObject(desDC);
         }
 
         return desBitmap;
     }
 
+#endif
+
+    struct Image::MipChain
+    {
+        enum { MaxLevels = 16 };
+
+        Image levels[MaxLevels];    //! level i is half of level i - 1, the image before level 0
+        UINT count;                 //! built so far
+    };
+
     Image::Image()
         : m_pData(NULL)
-        , m_bitmap(NULL)
         , m_bitmapInfo()
+        , m_alphaMode(AlphaIgnored)
+        , m_opaque(true)
+        , m_borrowed(false)
+        , m_mips(NULL)
+        , m_id(0)
+        , m_generation(0)
+        , m_scaleCached(false)
+        , m_bitmap(NULL)
     {
 
     }
@@ -115,12 +187,142 @@ namespace Render
 
     void Image::Clean()
     {
+        //! a copy drawn scaled set its own flag, not this one's, so the pixels' sizes go by id
+        if (m_id)
+        {
+            m_scaleCached = false;
+            ScaledImageCache::Instance().Drop(m_id);
+        }
+
+        Invalidate();
+        delete m_mips;
+        m_mips = NULL;
+        m_id = 0;
+
         if (m_bitmap)
         {
-            ::DeleteObject(m_bitmap);
+            if (!m_borrowed)
+                DeleteBitmap(m_bitmap);
             m_bitmap = NULL;
             m_pData = NULL;
         }
+
+        m_alphaMode = AlphaIgnored;
+        m_opaque = true;
+        m_borrowed = false;
+    }
+
+    //! guards building and dropping levels, held only for that
+    static std::mutex& GetMipLock()
+    {
+        static std::mutex lock;
+        return lock;
+    }
+
+    void Image::EnableMipmaps()
+    {
+        if (!m_mips && m_bitmap)
+        {
+            m_mips = new MipChain();
+            m_mips->count = 0;
+        }
+    }
+
+    Image *Image::GetMipmap(const SIZE& size)
+    {
+        if (!m_mips || !m_bitmap || size.cx <= 0 || size.cy <= 0)
+            return this;
+
+        if (size.cx * 2 > GetWidth() || size.cy * 2 > GetHeight())
+            return this;
+
+        std::lock_guard<std::mutex> guard(GetMipLock());
+
+        Image *level = this;
+        for (UINT i = 0; i != MipChain::MaxLevels; ++i)
+        {
+            SIZE half = { max(1, level->GetWidth() / 2), max(1, level->GetHeight() / 2) };
+            if (half.cx < size.cx || half.cy < size.cy)
+                break;
+
+            Image& next = m_mips->levels[i];
+            if (i >= m_mips->count)
+            {
+                if (!Allocate(&next, half))
+                    break;
+
+                RECT whole = { 0, 0, half.cx, half.cy };
+                Pixel::Resample(Pixel::FilterBox, next.m_pData, next.GetStride(), whole, half.cx, half.cy,
+                    level->m_pData, level->GetStride(), level->GetWidth(), level->GetHeight());
+                next.SetAlphaMode(level->m_alphaMode, level->m_opaque);
+
+                m_mips->count = i + 1;
+            }
+
+            level = &next;
+        }
+
+        return level;
+    }
+
+    void Image::Invalidate()
+    {
+        ++m_generation;
+
+        if (m_scaleCached)
+        {
+            m_scaleCached = false;
+            ScaledImageCache::Instance().Drop(m_id);
+        }
+
+        if (!m_mips)
+            return;
+
+        std::lock_guard<std::mutex> guard(GetMipLock());
+
+        for (UINT i = 0; i != m_mips->count; ++i)
+            m_mips->levels[i].Clean();
+        m_mips->count = 0;
+    }
+
+    void Image::SetAlphaMode(AlphaMode mode)
+    {
+        m_alphaMode = mode;
+        m_opaque = true;
+
+        if (AlphaIgnored == mode || !m_pData)
+            return;
+
+        INT width = GetWidth(), height = GetHeight(), stride = GetStride();
+        for (INT y = 0; y != height && m_opaque; ++y)
+        {
+            const DWORD *row = (const DWORD *)(m_pData + y * stride);
+            for (INT x = 0; x != width; ++x)
+            {
+                if (0xFF000000 != (row[x] & 0xFF000000))
+                {
+                    m_opaque = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    void Image::SetAlphaMode(AlphaMode mode, bool opaque)
+    {
+        m_alphaMode = mode;
+        m_opaque = AlphaIgnored == mode || opaque;
+    }
+
+    void Image::Premultiply()
+    {
+        if (AlphaStraight != m_alphaMode || !m_pData)
+            return;
+
+        m_opaque = Pixel::Premultiply(m_pData, GetStride(), m_pData, GetStride(), GetWidth(), GetHeight());
+        m_alphaMode = AlphaPremultiplied;
+
+        Invalidate();
     }
 
     PBYTE Image::GetOffset(UINT w, UINT h)
@@ -165,7 +367,14 @@ namespace Render
         return DIBWIDTHBYTES(m_bitmapInfo.bmiHeader);
     }
 
-    void Image::Scale(const SIZE& size)
+    //! shared by every Image::Scale big enough to be worth splitting
+    static ThreadPool *GetScalePool()
+    {
+        static ThreadPool pool;
+        return &pool;
+    }
+
+    void Image::Scale(const SIZE& size, Pixel::Filter filter)
     {
         if (!m_bitmap)
             return;
@@ -176,40 +385,45 @@ namespace Render
         if (size.cx == m_bitmapInfo.bmiHeader.biWidth && size.cy == -m_bitmapInfo.bmiHeader.biHeight)
             return;
 
-        HDC srcDC = ::CreateCompatibleDC(NULL);
-        HDC desDC = ::CreateCompatibleDC(NULL);
-        
-        //! src
-        HBITMAP srcBitmap = m_bitmap;
-        BITMAPINFO srcBitmapInfo;
-        ::memcpy(&srcBitmapInfo, &m_bitmapInfo, sizeof(BITMAPINFO));
-
-        //! des
         BITMAPINFO desBitmapInfo;
         PBYTE pDesData = NULL;
-        HBITMAP desBitmap = CreateBitmap(size, (PVOID *)&pDesData, &desBitmapInfo);
+        HBITMAP desBitmap = CreateBitmap(size, (void **)&pDesData, &desBitmapInfo);
 
         if (desBitmap)
         {
-            ::SelectObject(srcDC, srcBitmap);
-            ::SelectObject(desDC, desBitmap);
-
-            ::SetStretchBltMode(desDC, HALFTONE);
-            ::StretchBlt(desDC, 0, 0, size.cx, size.cy,
-                srcDC, 0, 0, srcBitmapInfo.bmiHeader.biWidth, -srcBitmapInfo.bmiHeader.biHeight, SRCCOPY);
-
-            ::DeleteObject(srcBitmap);
+#if defined(_WIN32)
+            //! GDI may still be drawing into the source section
+            ::GdiFlush();
+#endif
+            //! below about 512 x 512 handing out the rows costs more than it saves
+            ThreadPool *pool = (ULONGLONG)size.cx * size.cy >= 512 * 512 ? GetScalePool() : NULL;
+            RECT part = { 0, 0, size.cx, size.cy };
+            Pixel::Resample(filter, pDesData, DIBWIDTHBYTES(desBitmapInfo.bmiHeader), part, size.cx, size.cy,
+                m_pData, GetStride(), GetWidth(), GetHeight(), pool);
+
+            if (!m_borrowed)
+            {
+#if defined(_WIN32)
+                ::DeleteObject(m_bitmap);
+#else
+                DeleteBitmap(m_bitmap);
+#endif
+            }
+            m_borrowed = false;
 
             //! update 
             ::memcpy(&m_bitmapInfo, &desBitmapInfo, sizeof(BITMAPINFO));
             m_pData = pDesData;
             m_bitmap = desBitmap;
-        }
 
-        ::DeleteObject(desDC);
-        ::DeleteObject(srcDC);
+            //! entries of the old pixels go by the old id
+            Invalidate();
+            m_id = NextImageId();
+        }
     }
 
+#if defined(_WIN32)
+
     class GIDPlusContext
     {
     private:
@@ -238,11 +452,20 @@ namespace Render
         }
     };
 
+    //! started by the first file the portable decoders turn down, shut down at exit
+    static bool StartGdiPlus()
+    {
+        static GIDPlusContext context;
+        return context.TestOK();
+    }
+
+#endif
+
     template<typename _Pointer_Type>
     class ScopedPointer
     {
-        typedef typename _Pointer_Type _Given_Pointer_Type;
-        typedef typename ScopedPointer<_Pointer_Type> _Self_Type;
+        typedef _Pointer_Type _Given_Pointer_Type;
+        typedef ScopedPointer<_Pointer_Type> _Self_Type;
 
     public:
         ScopedPointer(_Given_Pointer_Type *_raw_ptr)
@@ -295,11 +518,24 @@ namespace Render
 
     RefImageResource *RefImageResource::Create(const String& path)
     {
+        std::vector<BYTE> file;
+        if (!Codec::ReadFile(path, file))
+            return NULL;
+
         ScopedPointer<RefImageResource> d = new RefImageResource();
+        if (Codec::Decode(&file[0], file.size(), d.GetRaw()))
+        {
+            RefImageResource *ret = d.GetRaw();
+            d.Dismiss();
+
+            return ret;
+        }
+
+#if defined(_WIN32)
+        //! what the portable decoders turn down: TIFF, ICO, arithmetic coded JPEG ...
         if (d)
         {
-            GIDPlusContext context;
-            if (context.TestOK())
+            if (StartGdiPlus())
             {
                 Gdiplus::Bitmap srcBitmap(path.c_str());
                 if (Gdiplus::Ok == srcBitmap.GetLastStatus())
@@ -311,6 +547,7 @@ namespace Render
 
                     RefImageResource *ret = d.GetRaw();
                     Image::Initialize(ret, pDesData, bitmap, desBitmapInfo);
+                    ret->SetAlphaMode(AlphaPremultiplied);
 
                     d.Dismiss();
 
@@ -318,6 +555,7 @@ namespace Render
                 }
             }
         }
+#endif
 
         return NULL;
     }
@@ -351,15 +589,138 @@ namespace Render
     }
 
 
+    //! bounding box of the pixels that differ between two images of one size, empty when none do
+    static RECT DiffRect(const Image& a, const Image& b)
+    {
+        RECT rect = { 0, 0, 0, 0 };
+        INT width = a.GetWidth(), height = a.GetHeight();
+
+        INT top = 0;
+        while (top != height && 0 == ::memcmp(a.GetOffset(0, top), b.GetOffset(0, top), width * 4))
+            ++top;
+        if (top == height)
+            return rect;
+
+        INT bottom = height;
+        while (0 == ::memcmp(a.GetOffset(0, bottom - 1), b.GetOffset(0, bottom - 1), width * 4))
+            --bottom;
+
+        INT left = width, right = 0;
+        for (INT y = top; y != bottom; ++y)
+        {
+            const DWORD *pa = (const DWORD *)a.GetOffset(0, y);
+            const DWORD *pb = (const DWORD *)b.GetOffset(0, y);
+
+            INT x = 0;
+            while (x < left && pa[x] == pb[x])
+                ++x;
+            left = x;
+
+            x = width;
+            while (x > right && pa[x - 1] == pb[x - 1])
+                --x;
+            right = x;
+        }
+
+        rect.left = left;
+        rect.top = top;
+        rect.right = right;
+        rect.bottom = bottom;
+        return rect;
+    }
+
+    //! rect on a canvas of size from, mapped onto one of size to and grown by what the bilinear
+    //! filter spreads a source pixel over: a pixel shrinking, to / from pixels enlarging, plus one for rounding
+    static RECT ScaleRect(const RECT& rect, const SIZE& from, const SIZE& to)
+    {
+        RECT scaled = { 0, 0, 0, 0 };
+        if (rect.right <= rect.left || rect.bottom <= rect.top || from.cx <= 0 || from.cy <= 0)
+            return scaled;
+
+        LONG growX = 1 + max((LONG)1, (LONG)((to.cx + from.cx - 1) / from.cx));
+        LONG growY = 1 + max((LONG)1, (LONG)((to.cy + from.cy - 1) / from.cy));
+
+        scaled.left = max((LONG)0, (LONG)((ULONGLONG)rect.left * to.cx / from.cx) - growX);
+        scaled.top = max((LONG)0, (LONG)((ULONGLONG)rect.top * to.cy / from.cy) - growY);
+        scaled.right = min(to.cx, (LONG)(((ULONGLONG)rect.right * to.cx + from.cx - 1) / from.cx) + growX);
+        scaled.bottom = min(to.cy, (LONG)(((ULONGLONG)rect.bottom * to.cy + from.cy - 1) / from.cy) + growY);
+        return scaled;
+    }
+
     AnimationImageSet *AnimationImageSet::Create(const String& filePath)
     {
+        std::vector<BYTE> file;
+        if (!Codec::ReadFile(filePath, file))
+            return NULL;
+
         ScopedPointer<AnimationImageSet> d = new AnimationImageSet;
+
+        Codec::GifDecoder decoder;
+        if (decoder.Open(&file[0], file.size()))
+        {
+            //! each frame is composited over the one before, only the rect that changed is kept
+            SIZE size = decoder.GetCanvasSize();
+            Image canvas, previous;
+            if (Image::Allocate(&canvas, size) && Image::Allocate(&previous, size))
+            {
+                for (UINT i = 0; i != decoder.GetFrameCount(); ++i)
+                {
+                    if (i)
+                        Pixel::Copy(previous.GetOffset(0, 0), previous.GetStride(), canvas.GetOffset(0, 0), canvas.GetStride(), size.cx, size.cy);
+
+                    decoder.Next(canvas.GetOffset(0, 0), canvas.GetStride());
+                    canvas.SetAlphaMode(Image::AlphaPremultiplied);
+
+                    RECT whole = { 0, 0, size.cx, size.cy };
+                    RECT rect = i ? DiffRect(previous, canvas) : whole;
+
+                    //! past 3/4 of the canvas a delta saves little, and a key frame ends the replay when seeking
+                    RECT from = rect;
+                    if (!i || (ULONGLONG)(rect.right - rect.left) * (rect.bottom - rect.top) * 4 > (ULONGLONG)size.cx * size.cy * 3)
+                        from = whole;
+
+                    Frame frame = { Image(), max(1u, decoder.GetFrame(i).delay), rect, canvas.IsOpaque() };
+                    SIZE extent = { from.right - from.left, from.bottom - from.top };
+                    if (extent.cx && extent.cy)
+                    {
+                        if (!Image::Allocate(&frame.image, extent))
+                            break;
+
+                        Pixel::Copy(frame.image.GetOffset(0, 0), frame.image.GetStride(), canvas.GetOffset(from.left, from.top), canvas.GetStride(), extent.cx, extent.cy);
+                        frame.image.SetAlphaMode(Image::AlphaPremultiplied);
+                    }
+
+                    d->m_frames.push_back(frame);
+                }
+            }
+
+            canvas.Clean();
+            previous.Clean();
+        }
+        else
+        {
+            Image image;
+            if (Codec::Decode(&file[0], file.size(), &image))
+            {
+                Frame frame = { image, 1, { 0, 0, image.GetWidth(), image.GetHeight() }, image.IsOpaque() };
+                d->m_frames.push_back(frame);
+            }
+        }
+
+        if (!d->m_frames.empty())
+        {
+            AnimationImageSet *ret = d.GetRaw();
+            d.Dismiss();
+
+            return ret;
+        }
+
+#if defined(_WIN32)
         if (d)
         {
-            GIDPlusContext context;
-            if (context.TestOK())
+            if (StartGdiPlus())
             {
-                Gdiplus::Image srcImage(filePath.c_str());
+                Gdiplus::Bitmap srcImage(filePath.c_str());
                 if (Gdiplus::Ok == srcImage.GetLastStatus())
                 {
                     GUID dimensionID;
@@ -388,7 +749,8 @@ namespace Render
                             {
                                 Image loImage;
                                 Image::Initialize(&loImage, pDesData, bitmap, bitmapInfo);
-								Frame loFrame = {loImage,ldwPause};
+                                loImage.SetAlphaMode(Image::AlphaPremultiplied);
+								Frame loFrame = {loImage,ldwPause,{0,0,loImage.GetWidth(),loImage.GetHeight()},loImage.IsOpaque()};
 
 								d->m_frames.push_back(loFrame);
                             }
@@ -404,21 +766,51 @@ namespace Render
                 }
             }
         }
+#endif
 
         return NULL;
     }
 
+    AnimationImageSet *AnimationImageSet::CreateStreaming(const String& filePath, SIZE_T budget)
+    {
+        std::vector<BYTE> file;
+        if (!Codec::ReadFile(filePath, file))
+            return NULL;
+
+        AnimationStream *stream = AnimationStream::Create(file, budget);
+        if (!stream)
+            return Create(filePath);
+
+        AnimationImageSet *d = new AnimationImageSet;
+        d->m_stream = stream;
+
+        return d;
+    }
+
     AnimationImageSet::AnimationImageSet()
         : m_frames()
+        , m_composed()
+        , m_composedIndex(-1)
+        , m_tracks()
+        , m_track(NULL)
+        , m_stream(NULL)
+        , m_RefCount(0)
     {
     }
 
     AnimationImageSet::~AnimationImageSet()
     {
+        delete m_stream;
+
+        while (!m_tracks.empty())
+            DropTrack(m_tracks.back());
+
         for (auto it = m_frames.begin(); it != m_frames.end(); ++it)
         {
-            ::DeleteObject(it->image.m_bitmap);
+            it->image.Clean();
         }
+
+        m_composed.Clean();
     }
 
     void AnimationImageSet::AddRef()
@@ -437,27 +829,254 @@ namespace Render
         return FALSE;
     }
 
-    void AnimationImageSet::Scale(const SIZE& size)
+    struct AnimationImageSet::ScaleJob
     {
-        for (auto it = m_frames.begin(); it != m_frames.end(); ++it)
+        const AnimationImageSet *set;
+        Track *track;
+        UINT chunks;
+    };
+
+    void AnimationImageSet::Scale(const SIZE& size, ThreadPool *pool)
+    {
+        if (m_stream)
+            m_stream->SetSize(size);
+
+        if (m_frames.empty() || size.cx <= 0 || size.cy <= 0)
+            return;
+
+        SIZE canvas = GetCanvasSize();
+        if (size.cx == canvas.cx && size.cy == canvas.cy)
+        {
+            m_track = NULL;
+            return;
+        }
+
+        Track *track = NULL;
+        for (auto it = m_tracks.begin(); it != m_tracks.end(); ++it)
+        {
+            if ((*it)->size.cx == size.cx && (*it)->size.cy == size.cy)
+            {
+                track = *it;
+                m_tracks.erase(it);
+                break;
+            }
+        }
+
+        if (!track)
+            track = CreateTrack(size);
+
+        m_tracks.insert(m_tracks.begin(), track);
+        if (m_tracks.size() > ScaledSizes)
+            DropTrack(m_tracks.back());
+
+        m_track = track;
+
+        if (pool)
         {
-            it->image.Scale(size);
+            //! runs of frames in order, each replaying the deltas onto a canvas of its own
+            ScaleJob job = { this, track, min(pool->GetConcurrency(), (UINT)m_frames.size()) };
+            pool->Run(job.chunks, ScaleChunk, &job);
         }
     }
 
     INT AnimationImageSet::GetFramesCount() const
     {
+        if (m_stream)
+            return m_stream->GetFrameCount();
+
         return m_frames.size();
     }
 
     INT AnimationImageSet::GetFrameDelay(INT frameIndex) const
     {
+        if (m_stream)
+            return m_stream->GetFrameDelay(frameIndex);
+
         return m_frames.at(frameIndex).delay;
     }
 
+    RECT AnimationImageSet::GetFrameRect(INT frameIndex) const
+    {
+        if (m_stream)
+        {
+            RECT rect = { 0, 0, m_stream->GetSize().cx, m_stream->GetSize().cy };
+            return rect;
+        }
+
+        if (m_track)
+            return m_track->frames.at(frameIndex).rect;
+
+        return m_frames.at(frameIndex).rect;
+    }
+
     Image AnimationImageSet::GetFrameAt(INT frameIndex) const
     {
-        return m_frames.at(frameIndex).image;
+        if (m_stream)
+            return m_stream->GetFrame(frameIndex);
+
+        m_frames.at(frameIndex);
+
+        SIZE canvas = GetCanvasSize();
+        if (!m_track)
+            return Compose(m_frames, canvas, m_composed, m_composedIndex, frameIndex);
+
+        //! a delta is scaled along with every frame from the key frame before it
+        INT key = frameIndex;
+        while (key > 0 && !IsKeyFrame(m_frames[key], canvas))
+            --key;
+
+        for (INT i = key; i <= frameIndex; ++i)
+        {
+            if (!m_track->scaled[i])
+                ScaleFrame(m_track, i, Compose(m_frames, canvas, m_composed, m_composedIndex, i));
+        }
+
+        return Compose(m_track->frames, m_track->size, m_track->composed, m_track->composedIndex, frameIndex);
+    }
+
+    bool AnimationImageSet::IsKeyFrame(const Frame& frame, const SIZE& canvas)
+    {
+        return frame.image.GetWidth() == canvas.cx && frame.image.GetHeight() == canvas.cy;
+    }
+
+    Image AnimationImageSet::Compose(const Frames& frames, const SIZE& canvas, Image& composed, INT& composedIndex, INT frameIndex)
+    {
+        const Frame& target = frames[frameIndex];
+        if (IsKeyFrame(target, canvas))
+            return target.image;
+
+        if (composed.IsNull() && !Image::Allocate(&composed, canvas))
+            return Image();
+
+        //! frame 0 is always a key frame
+        INT from = frameIndex;
+        while (from > 0 && !IsKeyFrame(frames[from], canvas))
+            --from;
+
+        if (composedIndex >= from && composedIndex <= frameIndex)
+            from = composedIndex + 1;
+
+        for (INT i = from; i <= frameIndex; ++i)
+        {
+            const Frame& frame = frames[i];
+            if (frame.image.IsNull())
+                continue;
+
+            POINT at = { 0, 0 };
+            if (!IsKeyFrame(frame, canvas))
+            {
+                at.x = frame.rect.left;
+                at.y = frame.rect.top;
+            }
+
+            Pixel::Copy(composed.GetOffset(at.x, at.y), composed.GetStride(), frame.image.GetOffset(0, 0), frame.image.GetStride(),
+                frame.image.GetWidth(), frame.image.GetHeight());
+        }
+
+        composed.SetAlphaMode(Image::AlphaPremultiplied, target.opaque);
+        if (composedIndex != frameIndex)
+            composed.Invalidate();
+        composedIndex = frameIndex;
+
+        return composed;
+    }
+
+    SIZE AnimationImageSet::GetCanvasSize() const
+    {
+        return m_frames[0].image.GetSize();
+    }
+
+    AnimationImageSet::Track *AnimationImageSet::CreateTrack(const SIZE& size)
+    {
+        SIZE canvas = GetCanvasSize();
+
+        Track *track = new Track;
+        track->size = size;
+        track->frames.resize(m_frames.size());
+        track->scaled.assign(m_frames.size(), 0);
+        track->composedIndex = -1;
+
+        //! the rects are known before any pixel is scaled
+        for (size_t i = 0; i != m_frames.size(); ++i)
+        {
+            Frame& frame = track->frames[i];
+            frame.delay = m_frames[i].delay;
+            frame.rect = ScaleRect(m_frames[i].rect, canvas, size);
+            frame.opaque = m_frames[i].opaque;
+        }
+
+        return track;
     }
-}
 
+    void AnimationImageSet::DropTrack(Track *track)
+    {
+        for (auto it = track->frames.begin(); it != track->frames.end(); ++it)
+        {
+            it->image.Clean();
+        }
+
+        track->composed.Clean();
+
+        m_tracks.erase(std::find(m_tracks.begin(), m_tracks.end(), track));
+        if (m_track == track)
+            m_track = NULL;
+
+        delete track;
+    }
+
+    void AnimationImageSet::ScaleFrame(Track *track, INT frameIndex, const Image& source) const
+    {
+        //! the composed frame is scaled whole, then a delta is cut back to its rect grown by what the filter reads
+        SIZE canvas = GetCanvasSize();
+        Frame& next = track->frames[frameIndex];
+
+        Image whole;
+        if (!source.IsNull() && Image::Allocate(&whole, canvas))
+        {
+            Pixel::Copy(whole.GetOffset(0, 0), whole.GetStride(), source.GetOffset(0, 0), source.GetStride(), canvas.cx, canvas.cy);
+            whole.SetAlphaMode(Image::AlphaPremultiplied, next.opaque);
+            whole.Scale(track->size);
+
+            SIZE extent = { next.rect.right - next.rect.left, next.rect.bottom - next.rect.top };
+            if (IsKeyFrame(m_frames[frameIndex], canvas))
+            {
+                next.image = whole;
+            }
+            else
+            {
+                if (extent.cx && extent.cy && Image::Allocate(&next.image, extent))
+                {
+                    Pixel::Copy(next.image.GetOffset(0, 0), next.image.GetStride(),
+                        whole.GetOffset(next.rect.left, next.rect.top), whole.GetStride(), extent.cx, extent.cy);
+                    next.image.SetAlphaMode(Image::AlphaPremultiplied);
+                }
+
+                whole.Clean();
+            }
+        }
+
+        track->scaled[frameIndex] = 1;
+    }
+
+    void AnimationImageSet::ScaleChunk(void *param, UINT index)
+    {
+        ScaleJob *job = (ScaleJob *)param;
+        const AnimationImageSet *set = job->set;
+
+        UINT count = (UINT)set->m_frames.size();
+        INT begin = (INT)((ULONGLONG)count * index / job->chunks);
+        INT end = (INT)((ULONGLONG)count * (index + 1) / job->chunks);
+
+        SIZE canvas = set->GetCanvasSize();
+        Image composed;
+        INT composedIndex = -1;
+
+        for (INT i = begin; i != end; ++i)
+        {
+            if (!job->track->scaled[i])
+                set->ScaleFrame(job->track, i, Compose(set->m_frames, canvas, composed, composedIndex, i));
+        }
+
+        composed.Clean();
+    }
+}
@@ -1,19 +1,46 @@
 #pragma once
 
+#include "Win32Compat.h"
+#include "PixelKernel.h"
+
 #include <vector>
 
 namespace Render
 {
     class Image
     {
+        friend class ScaledImageCache;
+
+    public:
+        //! how the alpha byte of the pixels is read
+        enum AlphaMode
+        {
+            AlphaIgnored = 0,       //! padding, every pixel is drawn opaque
+            AlphaStraight,          //! colours not multiplied by alpha yet
+            AlphaPremultiplied,     //! colours multiplied by alpha, what the blend kernels and cairo take
+        };
+
     public:
         static bool Allocate(Image *nullImage, const SIZE& size);
         static bool ReAllocate(Image *image, const SIZE& size) throw();
         static bool Initialize(Image *image, PBYTE pData, HBITMAP bitmap, const BITMAPINFO& bitmapInfo);
+        //! pixels owned elsewhere that outlive the image, such as a mapped AssetBundle; Clean and Scale leave them alone
+        static bool Borrow(Image *image, PBYTE pData, HBITMAP bitmap, const BITMAPINFO& bitmapInfo);
 
     private:
         PBYTE m_pData;
         BITMAPINFO m_bitmapInfo;
+        AlphaMode m_alphaMode;
+        bool m_opaque;          //! every alpha 255, or ignored
+        bool m_borrowed;        //! m_bitmap is not ours to delete
+
+        //! halves kept for drawing scaled down, NULL until EnableMipmaps; shared by copies like m_bitmap
+        struct MipChain;
+        MipChain *m_mips;
+
+        ULONGLONG m_id;         //! of the pixel block, never reused, 0 without pixels
+        UINT m_generation;      //! counts Invalidate calls
+        bool m_scaleCached;     //! ScaledImageCache has sizes of it through this copy, Invalidate drops them; Clean drops any copy's
 
     public:
         HBITMAP m_bitmap;
@@ -23,9 +50,37 @@ namespace Render
         virtual~Image();
 
     public:
-        void Scale(const SIZE& size);
+        //! resampled in place, large images split across a shared ThreadPool
+        void Scale(const SIZE& size, Pixel::Filter filter = Pixel::FilterBilinear);
         void Clean();
 
+    public:
+        //! keep box-filtered halves of the pixels for draws scaled below half their size,
+        //! built level by level on the first draw that needs them; Clean frees them and turns this off
+        void EnableMipmaps();
+        //! the smallest of the image and its halves that still covers size, the image itself when not enabled
+        //! safe from several drawing threads at once
+        Image *GetMipmap(const SIZE& size);
+        //! the pixels were written through GetOffset, what was derived from them is dropped
+        //! and the generation moves on; not while other threads draw the image
+        void Invalidate();
+
+        //! (id, generation) names the current pixels; copies share both until one of them changes
+        ULONGLONG GetId() const { return m_id; }
+        UINT GetGeneration() const { return m_generation; }
+
+    public:
+        //! tells how the current data is to be read, the opaque flag is taken from the alphas
+        void SetAlphaMode(AlphaMode mode);
+        //! the caller already knows whether every alpha is 255
+        void SetAlphaMode(AlphaMode mode, bool opaque);
+        //! straight data to premultiplied in place, a no-op in the other modes
+        void Premultiply();
+
+        AlphaMode GetAlphaMode() const { return m_alphaMode; }
+        //! nothing shows through, a plain copy draws it
+        bool IsOpaque() const { return m_opaque; }
+
     public:
         PBYTE GetOffset(UINT w, UINT h);
         const PBYTE GetOffset(UINT w, UINT h) const;
@@ -57,23 +112,60 @@ namespace Render
     public:
         void AddRef();
         BOOL Release();
+        //! exact only while nobody else can take a reference, as under ImageCache's lock
+        SIZE_T GetRefCount() const { return m_RefCount; }
     };
 
+    class AnimationStream;
+    class ThreadPool;
+
     class AnimationImageSet
     {
+        friend class AssetBundle;
+
+    public:
+        enum
+        {
+            ScaledSizes = 4,    //! sizes kept scaled besides the source, the one picked least recently goes first
+        };
+
     private:
         struct Frame
         {
-            Image image;
+            Image image;        //! the whole canvas for a key frame, else only what changed
             UINT delay;
+            RECT rect;          //! what changed over the frame before, where a delta's pixels go
+            bool opaque;        //! the composed canvas, a delta alone does not tell
         };
         typedef std::vector<Frame> Frames;
         Frames m_frames;
 
+        //! deltas are copied over the frame before, from the last key frame on or past m_composedIndex
+        mutable Image m_composed;
+        mutable INT m_composedIndex;
+
+        //! m_frames at another size, each frame scaled from the source when first asked for
+        struct Track
+        {
+            SIZE size;
+            Frames frames;
+            std::vector<BYTE> scaled;   //! not bool, pool threads set neighbouring entries
+            Image composed;
+            INT composedIndex;
+        };
+        std::vector<Track *> m_tracks;      //! most recently picked first
+        Track *m_track;                     //! what GetFrameAt reads, NULL for the source
+
+        //! set when the frames are decoded on demand instead of held in m_frames
+        AnimationStream *m_stream;
+
         SIZE_T m_RefCount;
 
     public:
         static AnimationImageSet *Create(const String& filePath);
+        //! a GIF keeps only about budget bytes of frames around the one last asked for
+        //! and decodes the next ones in the background; anything else loads as Create does
+        static AnimationImageSet *CreateStreaming(const String& filePath, SIZE_T budget);
 
     protected:
         AnimationImageSet();
@@ -86,14 +178,33 @@ namespace Render
         BOOL Release();
 
     public:
-        void Scale(const SIZE& size);
+        //! frames come out at size from now on, scaled from the untouched source frames
+        //! lazily as they are asked for, or all of them now across pool's threads
+        void Scale(const SIZE& size, ThreadPool *pool = NULL);
 
     public:
         INT GetFramesCount() const;
         INT GetFrameDelay(INT frameIndex) const;
+        //! what frameIndex changed over the frame before, the whole canvas for frame 0 or when not known
+        //! redrawing only it over the last frame drawn is enough, see Context::DrawClippedImageAt
+        RECT GetFrameRect(INT frameIndex) const;
 
         //! NOT RECOMMANDED save the return image, unless u know what ur doing
-        //! when scale or destory, the return image will be invalid
+        //! when destory, or scale and its size dropped from the cache, the return image will be invalid
+        //! streamed or composed from a delta, it is also invalid once another frame is asked for
         Image GetFrameAt(INT frameIndex) const;
+
+    private:
+        static bool IsKeyFrame(const Frame& frame, const SIZE& canvas);
+        //! frameIndex whole: a key frame as it is, else the deltas copied onto composed
+        static Image Compose(const Frames& frames, const SIZE& canvas, Image& composed, INT& composedIndex, INT frameIndex);
+
+        SIZE GetCanvasSize() const;
+        Track *CreateTrack(const SIZE& size);
+        void DropTrack(Track *track);
+        //! source is frameIndex composed at the source size
+        void ScaleFrame(Track *track, INT frameIndex, const Image& source) const;
+        struct ScaleJob;
+        static void ScaleChunk(void *param, UINT index);
     };
 }
\ No newline at end of file
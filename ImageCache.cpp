@@ -0,0 +1,205 @@
+#include "ImageCache.h"
+
+#include "Image.h"
+#include "ImageCodec.h"
+
+#if defined(_WIN32)
+#include <wctype.h>
+#include <vector>
+#else
+#include <stdlib.h>
+#include <sys/stat.h>
+#endif
+
+namespace Render
+{
+    //! the path with every link and relative part resolved, and when the file was last written
+    static bool GetFileKey(const String& path, String *key, ULONGLONG *mtime)
+    {
+#if defined(_WIN32)
+        DWORD length = ::GetFullPathNameW(path.c_str(), 0, NULL, NULL);
+        if (!length)
+            return false;
+
+        std::vector<WCHAR> full(length);
+        length = ::GetFullPathNameW(path.c_str(), length, &full[0], NULL);
+
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if (!length || !::GetFileAttributesExW(&full[0], GetFileExInfoStandard, &data))
+            return false;
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            return false;
+
+        //! ntfs names compare without case
+        key->assign(&full[0], length);
+        for (size_t i = 0; i != key->size(); ++i)
+            (*key)[i] = (WCHAR)::towlower((*key)[i]);
+
+        *mtime = ((ULONGLONG)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+        return true;
+#else
+        char *resolved = ::realpath(Codec::NarrowPath(path).c_str(), NULL);
+        if (!resolved)
+            return false;
+
+        struct stat st;
+        bool ok = 0 == ::stat(resolved, &st) && S_ISREG(st.st_mode);
+        if (ok)
+        {
+            //! the resolved bytes as they are, the key is only compared
+            key->clear();
+            for (const char *p = resolved; *p; ++p)
+                *key += (WCHAR)(BYTE)*p;
+
+#if defined(__APPLE__)
+            *mtime = (ULONGLONG)st.st_mtimespec.tv_sec * 1000000000u + st.st_mtimespec.tv_nsec;
+#else
+            *mtime = (ULONGLONG)st.st_mtim.tv_sec * 1000000000u + st.st_mtim.tv_nsec;
+#endif
+        }
+
+        ::free(resolved);
+        return ok;
+#endif
+    }
+
+    ImageCache& ImageCache::Instance()
+    {
+        static ImageCache cache;
+        return cache;
+    }
+
+    ImageCache::ImageCache()
+        : m_lock()
+        , m_entries()
+        , m_index()
+        , m_bytes(0)
+        , m_budget(DefaultBudget)
+        , m_hits(0)
+        , m_misses(0)
+        , m_evictions(0)
+    {
+
+    }
+
+    ImageCache::~ImageCache()
+    {
+        Clear();
+    }
+
+    RefImageResource *ImageCache::Load(const String& path)
+    {
+        String key;
+        ULONGLONG mtime = 0;
+        if (!GetFileKey(path, &key, &mtime))
+            return NULL;
+
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+
+            EntryIndex::iterator found = m_index.find(key);
+            if (found != m_index.end())
+            {
+                EntryList::iterator entry = found->second;
+                if (entry->mtime == mtime)
+                {
+                    ++m_hits;
+                    m_entries.splice(m_entries.begin(), m_entries, entry);
+
+                    entry->image->AddRef();
+                    return entry->image;
+                }
+
+                //! the file changed, whoever holds the old image keeps it
+                Drop(entry);
+            }
+
+            ++m_misses;
+        }
+
+        //! decoded outside the lock, loads of other files go on meanwhile
+        RefImageResource *image = RefImageResource::Create(path);
+        if (!image)
+            return NULL;
+
+        image->AddRef();
+
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        EntryIndex::iterator found = m_index.find(key);
+        if (found != m_index.end())
+        {
+            EntryList::iterator entry = found->second;
+            if (entry->mtime == mtime)
+            {
+                //! another thread decoded the same file first
+                m_entries.splice(m_entries.begin(), m_entries, entry);
+                entry->image->AddRef();
+                image->Release();
+
+                return entry->image;
+            }
+
+            Drop(entry);
+        }
+
+        Entry entry = { key, mtime, image, (SIZE_T)image->GetStride() * image->GetHeight() };
+        m_entries.push_front(entry);
+        m_index[key] = m_entries.begin();
+        m_bytes += entry.bytes;
+
+        //! the caller's reference, the first one is the cache's
+        image->AddRef();
+        Trim(m_budget);
+
+        return image;
+    }
+
+    void ImageCache::SetBudget(SIZE_T bytes)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        m_budget = bytes;
+        Trim(m_budget);
+    }
+
+    void ImageCache::Clear()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        while (!m_entries.empty())
+            Drop(m_entries.begin());
+    }
+
+    ImageCacheStats ImageCache::GetStats()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        ImageCacheStats stats = { m_hits, m_misses, m_evictions, m_bytes, (UINT)m_entries.size() };
+        return stats;
+    }
+
+    void ImageCache::Trim(SIZE_T budget)
+    {
+        //! oldest first, an image referenced elsewhere would not free anything
+        for (EntryList::iterator it = m_entries.end(); it != m_entries.begin() && m_bytes > budget;)
+        {
+            --it;
+            if (1 != it->image->GetRefCount())
+                continue;
+
+            EntryList::iterator victim = it++;
+            Drop(victim);
+            ++m_evictions;
+        }
+    }
+
+    void ImageCache::Drop(EntryList::iterator entry)
+    {
+        m_index.erase(entry->key);
+        m_bytes -= entry->bytes;
+
+        entry->image->Release();
+        m_entries.erase(entry);
+    }
+}
\ No newline at end of file
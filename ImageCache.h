@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Win32Compat.h"
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace Render
+{
+    class RefImageResource;
+
+    struct ImageCacheStats
+    {
+        ULONGLONG hits;
+        ULONGLONG misses;
+        ULONGLONG evictions;
+        SIZE_T bytes;
+        UINT count;
+    };
+
+    //! decoded images shared by every context, keyed by canonical path and last write time
+    //! over the budget, images only the cache still references go, least recently used first
+    class ImageCache
+    {
+    public:
+        enum { DefaultBudget = 64 * 1024 * 1024 };
+
+    private:
+        struct Entry
+        {
+            String key;
+            ULONGLONG mtime;
+            RefImageResource *image;    //! one reference is the cache's
+            SIZE_T bytes;
+        };
+
+        //! front is the most recent
+        typedef std::list<Entry> EntryList;
+        typedef std::unordered_map<String, EntryList::iterator> EntryIndex;
+
+    private:
+        std::mutex m_lock;
+
+        EntryList m_entries;
+        EntryIndex m_index;
+        SIZE_T m_bytes;
+        SIZE_T m_budget;
+
+        ULONGLONG m_hits;
+        ULONGLONG m_misses;
+        ULONGLONG m_evictions;
+
+    public:
+        static ImageCache& Instance();
+
+    public:
+        ImageCache();
+        ~ImageCache();
+
+    public:
+        //! the image decoded from path, shared until the file changes
+        //! one reference is the caller's to Release, NULL when the file is missing or does not decode
+        RefImageResource *Load(const String& path);
+
+        //! bytes of pixels kept, images still referenced elsewhere stay even over it
+        void SetBudget(SIZE_T bytes);
+        //! drops the cache's references, images in use live on until released
+        void Clear();
+
+        ImageCacheStats GetStats();
+
+    private:
+        void Trim(SIZE_T budget);
+        void Drop(EntryList::iterator entry);
+
+    private:
+        ImageCache(const ImageCache&);
+        ImageCache& operator = (const ImageCache&);
+    };
+}
\ No newline at end of file
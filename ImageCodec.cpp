@@ -0,0 +1,378 @@
+#include "ImageCodecFormats.h"
+
+#include <stdio.h>
+
+namespace Render
+{
+    namespace Codec
+    {
+        Format Sniff(const BYTE *data, SIZE_T size)
+        {
+            static const BYTE png[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+
+            if (size >= 8 && 0 == ::memcmp(data, png, 8))
+                return FormatPNG;
+            if (size >= 3 && 0xFF == data[0] && 0xD8 == data[1] && 0xFF == data[2])
+                return FormatJPEG;
+            if (size >= 6 && (0 == ::memcmp(data, "GIF87a", 6) || 0 == ::memcmp(data, "GIF89a", 6)))
+                return FormatGIF;
+            if (size >= 2 && 'B' == data[0] && 'M' == data[1])
+                return FormatBMP;
+
+            return FormatUnknown;
+        }
+
+#if !defined(_WIN32)
+        std::string NarrowPath(const String& path)
+        {
+            std::string narrow;
+            for (size_t i = 0; i != path.size(); ++i)
+            {
+                UINT c = (UINT)path[i];
+                if (c < 0x80)
+                {
+                    narrow += (char)c;
+                }
+                else if (c < 0x800)
+                {
+                    narrow += (char)(0xC0 | (c >> 6));
+                    narrow += (char)(0x80 | (c & 0x3F));
+                }
+                else if (c < 0x10000)
+                {
+                    narrow += (char)(0xE0 | (c >> 12));
+                    narrow += (char)(0x80 | ((c >> 6) & 0x3F));
+                    narrow += (char)(0x80 | (c & 0x3F));
+                }
+                else
+                {
+                    narrow += (char)(0xF0 | (c >> 18));
+                    narrow += (char)(0x80 | ((c >> 12) & 0x3F));
+                    narrow += (char)(0x80 | ((c >> 6) & 0x3F));
+                    narrow += (char)(0x80 | (c & 0x3F));
+                }
+            }
+
+            return narrow;
+        }
+#endif
+
+        bool ReadFile(const String& path, std::vector<BYTE>& out)
+        {
+#if defined(_WIN32)
+            FILE *file = ::_wfopen(path.c_str(), L"rb");
+#else
+            FILE *file = ::fopen(NarrowPath(path).c_str(), "rb");
+#endif
+            if (!file)
+                return false;
+
+            bool ok = false;
+            if (0 == ::fseek(file, 0, SEEK_END))
+            {
+                long size = ::ftell(file);
+                if (size > 0 && 0 == ::fseek(file, 0, SEEK_SET))
+                {
+                    out.resize((size_t)size);
+                    ok = (size_t)size == ::fread(&out[0], 1, (size_t)size, file);
+                }
+            }
+
+            ::fclose(file);
+            return ok;
+        }
+
+        bool Decode(const BYTE *data, SIZE_T size, Image *nullImage)
+        {
+            if (!data || !nullImage->IsNull())
+                return false;
+
+            bool ok = false;
+            switch (Sniff(data, size))
+            {
+            case FormatPNG: ok = DecodePNG(data, size, nullImage); break;
+            case FormatJPEG: ok = DecodeJPEG(data, size, nullImage); break;
+            case FormatBMP: ok = DecodeBMP(data, size, nullImage); break;
+            case FormatGIF: ok = DecodeGIF(data, size, nullImage); break;
+            default: break;
+            }
+
+            //! a decoder failing half way leaves its allocation behind
+            if (!ok && !nullImage->IsNull())
+                nullImage->Clean();
+
+            return ok;
+        }
+
+        bool AllocateImage(Image *nullImage, LONG width, LONG height)
+        {
+            //! 1 GB of pixels at most, so no row or plane size overflows
+            if (width <= 0 || height <= 0 || width > (1 << 24) || height > (1 << 24))
+                return false;
+            if ((ULONGLONG)width * height > (1u << 28))
+                return false;
+
+            SIZE size = { width, height };
+            return Image::Allocate(nullImage, size);
+        }
+
+        RowWriter::RowWriter(Image *image, bool alpha)
+            : m_image(image)
+            , m_kernels(Pixel::GetKernels())
+            , m_width(image->GetWidth())
+            , m_alpha(alpha)
+            , m_opaque(0xFF)
+        {
+
+        }
+
+        void RowWriter::Commit(INT y)
+        {
+            if (m_alpha)
+            {
+                DWORD *row = GetRow(y);
+                m_opaque &= m_kernels.premultiply(row, row, m_width);
+            }
+        }
+
+        void RowWriter::Finish()
+        {
+            if (m_alpha)
+            {
+                m_image->SetAlphaMode(Image::AlphaPremultiplied, 0xFF == m_opaque);
+            }
+            else
+            {
+                m_image->SetAlphaMode(Image::AlphaIgnored);
+            }
+        }
+
+        //! BMP: 1 / 4 / 8 bit palettes, 16 / 32 bit bit fields, 24 and 32 bit BGR; no RLE
+
+        //! where a bit field mask sits and how to widen it to 8 bits
+        struct BitField
+        {
+            UINT mask;
+            UINT shift;
+            UINT max;
+
+            explicit BitField(UINT m)
+                : mask(m)
+                , shift(0)
+                , max(0)
+            {
+                if (m)
+                {
+                    while (!(m & 1))
+                    {
+                        m >>= 1;
+                        ++shift;
+                    }
+                    max = m;
+                }
+            }
+
+            UINT Get(UINT pixel) const
+            {
+                if (!max)
+                    return 0;
+                return (((pixel & mask) >> shift) * 255 + max / 2) / max;
+            }
+        };
+
+        bool DecodeBMP(const BYTE *data, SIZE_T size, Image *nullImage)
+        {
+            if (size < 14 + 12)
+                return false;
+
+            UINT offBits = Read32LE(data + 10);
+            UINT headerSize = Read32LE(data + 14);
+            const BYTE *header = data + 14;
+
+            if (headerSize < 12 || 14 + (SIZE_T)headerSize > size)
+                return false;
+
+            LONG width = 0, height = 0;
+            UINT bitCount = 0, compression = 0, colors = 0;
+            UINT masks[4] = { 0, 0, 0, 0 };
+            const BYTE *palette = NULL;
+            UINT paletteEntry = 4;
+
+            if (12 == headerSize)
+            {
+                //! BITMAPCOREHEADER, rgb triples
+                width = (LONG)Read16LE(header + 4);
+                height = (LONG)Read16LE(header + 6);
+                bitCount = Read16LE(header + 10);
+                paletteEntry = 3;
+            }
+            else
+            {
+                if (headerSize < 40)
+                    return false;
+
+                width = (LONG)Read32LE(header + 4);
+                height = (LONG)Read32LE(header + 8);
+                bitCount = Read16LE(header + 14);
+                compression = Read32LE(header + 16);
+                colors = Read32LE(header + 32);
+            }
+
+            //! the masks follow a plain info header, v2 and later headers carry them
+            SIZE_T paletteOffset = 14 + headerSize;
+            if (3 == compression || 6 == compression)
+            {
+                UINT count = 6 == compression || headerSize >= 56 ? 4 : 3;
+                const BYTE *m = header + 40;
+                if (40 == headerSize)
+                    paletteOffset += count * 4;
+
+                if ((SIZE_T)(m - data) + count * 4 > size)
+                    return false;
+
+                for (UINT i = 0; i != count; ++i)
+                    masks[i] = Read32LE(m + i * 4);
+            }
+            else if (0 != compression)
+            {
+                return false;
+            }
+            else if (16 == bitCount)
+            {
+                masks[0] = 0x7C00;
+                masks[1] = 0x03E0;
+                masks[2] = 0x001F;
+            }
+            else if (32 == bitCount)
+            {
+                masks[0] = 0x00FF0000;
+                masks[1] = 0x0000FF00;
+                masks[2] = 0x000000FF;
+            }
+
+            bool topDown = height < 0;
+            if (topDown)
+                height = -height;
+
+            if (bitCount <= 8)
+            {
+                if (1 != bitCount && 4 != bitCount && 8 != bitCount)
+                    return false;
+
+                if (!colors || colors > (1u << bitCount))
+                    colors = 1u << bitCount;
+
+                if (paletteOffset + (SIZE_T)colors * paletteEntry > size)
+                    return false;
+
+                palette = data + paletteOffset;
+            }
+            else if (16 != bitCount && 24 != bitCount && 32 != bitCount)
+            {
+                return false;
+            }
+
+            if (width <= 0 || height <= 0 || width > (1 << 24))
+                return false;
+
+            SIZE_T stride = (((SIZE_T)width * bitCount + 31) / 32) * 4;
+            if (offBits >= size || (size - offBits) / stride < (SIZE_T)height)
+                return false;
+
+            if (!AllocateImage(nullImage, width, height))
+                return false;
+
+            //! indices past the palette come out black
+            DWORD lut[256];
+            for (UINT i = 0; i != 256; ++i)
+            {
+                lut[i] = 0xFF000000;
+                if (palette && i < colors)
+                {
+                    const BYTE *p = palette + i * paletteEntry;
+                    lut[i] |= (p[2] << 16) | (p[1] << 8) | p[0];
+                }
+            }
+
+            //! 32 bit BI_RGB leaves the 4th byte undefined, it counts as alpha unless every one is 0
+            bool guessAlpha = 32 == bitCount && 0 == compression;
+            if (guessAlpha)
+                masks[3] = 0xFF000000;
+
+            BitField r(masks[0]), g(masks[1]), b(masks[2]), a(masks[3]);
+            bool plain32 = 32 == bitCount && 0x00FF0000 == masks[0] && 0x0000FF00 == masks[1] && 0x000000FF == masks[2];
+
+            RowWriter writer(nullImage, masks[3] && !guessAlpha);
+            DWORD alphaSeen = 0;
+
+            for (LONG y = 0; y != height; ++y)
+            {
+                const BYTE *src = data + offBits + (topDown ? y : height - 1 - y) * stride;
+                DWORD *dst = writer.GetRow(y);
+
+                switch (bitCount)
+                {
+                case 1:
+                case 4:
+                case 8:
+                    {
+                        UINT perByte = 8 / bitCount, mask = (1u << bitCount) - 1;
+                        for (LONG x = 0; x != width; ++x)
+                        {
+                            UINT shift = 8 - bitCount * (1 + x % perByte);
+                            dst[x] = lut[(src[x / perByte] >> shift) & mask];
+                        }
+                    }
+                    break;
+                case 24:
+                    for (LONG x = 0; x != width; ++x, src += 3)
+                        dst[x] = 0xFF000000 | (src[2] << 16) | (src[1] << 8) | src[0];
+                    break;
+                default:
+                    for (LONG x = 0; x != width; ++x)
+                    {
+                        UINT p = 16 == bitCount ? Read16LE(src + x * 2) : Read32LE(src + x * 4);
+                        if (plain32)
+                        {
+                            dst[x] = masks[3] ? p : p | 0xFF000000;
+                        }
+                        else
+                        {
+                            UINT alpha = masks[3] ? a.Get(p) : 255;
+                            dst[x] = (alpha << 24) | (r.Get(p) << 16) | (g.Get(p) << 8) | b.Get(p);
+                        }
+                        alphaSeen |= dst[x];
+                    }
+                    break;
+                }
+
+                writer.Commit(y);
+            }
+
+            if (guessAlpha)
+            {
+                INT imageStride = nullImage->GetStride();
+                if (alphaSeen >> 24)
+                {
+                    bool opaque = Pixel::Premultiply(nullImage->GetOffset(0, 0), imageStride, nullImage->GetOffset(0, 0), imageStride, width, height);
+                    nullImage->SetAlphaMode(Image::AlphaPremultiplied, opaque);
+                }
+                else
+                {
+                    for (LONG y = 0; y != height; ++y)
+                    {
+                        DWORD *row = writer.GetRow(y);
+                        for (LONG x = 0; x != width; ++x)
+                            row[x] |= 0xFF000000;
+                    }
+                    nullImage->SetAlphaMode(Image::AlphaIgnored);
+                }
+
+                return true;
+            }
+
+            writer.Finish();
+            return true;
+        }
+    }
+}
\ No newline at end of file
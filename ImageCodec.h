@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Win32Compat.h"
+
+#include <string>
+#include <vector>
+
+namespace Render
+{
+    class Image;
+
+    //! portable PNG / JPEG / BMP / GIF decoding, no GDI+ and no library startup per load
+    //! rows are decoded straight into the Image's bitmap and end up premultiplied BGRA
+    namespace Codec
+    {
+        enum Format
+        {
+            FormatUnknown = 0, FormatPNG, FormatJPEG, FormatBMP, FormatGIF,
+        };
+
+        //! from the leading magic bytes
+        Format Sniff(const BYTE *data, SIZE_T size);
+
+#if !defined(_WIN32)
+        //! utf-8, what the file system calls take off Windows
+        std::string NarrowPath(const String& path);
+#endif
+
+        //! the whole file, false when it is missing or empty
+        bool ReadFile(const String& path, std::vector<BYTE>& out);
+
+        //! allocates nullImage and decodes into it, the first frame of a GIF
+        //! alpha ends up premultiplied, or ignored for formats without it
+        bool Decode(const BYTE *data, SIZE_T size, Image *nullImage);
+
+        //! GIF frames in file order, the data must outlive the decoder
+        class GifDecoder
+        {
+        public:
+            //! what happens to the frame's rect before the next frame is drawn
+            enum Disposal
+            {
+                DisposeNone = 0,        //! unspecified, left in place
+                DisposeKeep,            //! left in place
+                DisposeBackground,      //! cleared to transparent
+                DisposePrevious,        //! restored to what was there before the frame
+            };
+
+            struct Frame
+            {
+                RECT rect;              //! right is width, bottom is height, may reach past the canvas
+                UINT delay;             //! 1/100 s, as stored in the file
+                Disposal disposal;
+                INT transparent;        //! palette index, -1 for none
+                bool interlaced;
+                const BYTE *palette;    //! rgb triples
+                UINT paletteSize;
+                const BYTE *lzw;        //! minimum code size, then the sub-blocks
+            };
+
+        private:
+            const BYTE *m_data;
+            const BYTE *m_end;
+            SIZE m_canvas;
+            std::vector<Frame> m_frames;
+
+            //! Next: the frame to draw and what the one before left behind
+            UINT m_next;
+            std::vector<DWORD> m_saved;     //! canvas under the last DisposePrevious frame
+            std::vector<DWORD> m_pixels;
+            std::vector<BYTE> m_indices;
+
+        public:
+            GifDecoder();
+            ~GifDecoder();
+
+        public:
+            //! parses the frame table, no pixel is decoded
+            bool Open(const BYTE *data, SIZE_T size);
+
+            SIZE GetCanvasSize() const { return m_canvas; }
+            UINT GetFrameCount() const { return (UINT)m_frames.size(); }
+            const Frame& GetFrame(UINT index) const { return m_frames[index]; }
+
+            //! the frame's own rect as BGRA, transparent pixels 0, dst holds rect.right x rect.bottom pixels
+            bool DecodeFrame(UINT index, PBYTE dst, INT dstStride, std::vector<BYTE>& indices) const;
+
+            //! disposes the previous frame on canvas and draws the next one over it
+            //! canvas is the full canvas size and holds what Next drew last, false after the last frame
+            bool Next(PBYTE canvas, INT canvasStride);
+            //! the next Next draws frame 0 onto a cleared canvas
+            void Rewind();
+            UINT GetNextIndex() const { return m_next; }
+
+        private:
+            GifDecoder(const GifDecoder&);
+            GifDecoder& operator = (const GifDecoder&);
+        };
+    }
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+
+//! private to the ImageCodec*.cpp units
+
+#include "ImageCodec.h"
+#include "Image.h"
+#include "PixelKernel.h"
+
+namespace Render
+{
+    namespace Codec
+    {
+        //! little and big endian reads, the caller checked the bounds
+        inline UINT Read16LE(const BYTE *p) { return p[0] | (p[1] << 8); }
+        inline UINT Read32LE(const BYTE *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((UINT)p[3] << 24); }
+        inline UINT Read16BE(const BYTE *p) { return (p[0] << 8) | p[1]; }
+        inline UINT Read32BE(const BYTE *p) { return ((UINT)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+
+        //! allocates nullImage, false for sizes no decoder should accept
+        bool AllocateImage(Image *nullImage, LONG width, LONG height);
+
+        //! hands out the rows of the destination image and finishes each one as it is committed
+        class RowWriter
+        {
+        private:
+            Image *m_image;
+            const Pixel::Kernels& m_kernels;
+            INT m_width;
+            bool m_alpha;
+            BYTE m_opaque;
+
+        public:
+            //! alpha: the rows come with straight alpha, otherwise every pixel is written opaque
+            RowWriter(Image *image, bool alpha);
+
+        public:
+            DWORD *GetRow(INT y) const { return (DWORD *)m_image->GetOffset(0, y); }
+            //! row y holds straight BGRA, premultiplied in place while it is still in cache
+            void Commit(INT y);
+            //! every row committed, sets the image's alpha mode
+            void Finish();
+        };
+
+        //! each allocates nullImage only once the header checked out
+        bool DecodePNG(const BYTE *data, SIZE_T size, Image *nullImage);
+        bool DecodeJPEG(const BYTE *data, SIZE_T size, Image *nullImage);
+        bool DecodeBMP(const BYTE *data, SIZE_T size, Image *nullImage);
+        bool DecodeGIF(const BYTE *data, SIZE_T size, Image *nullImage);
+    }
+}
\ No newline at end of file
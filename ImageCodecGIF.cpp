@@ -0,0 +1,389 @@
+#include "ImageCodecFormats.h"
+
+#include <string.h>
+
+namespace Render
+{
+    namespace Codec
+    {
+        //! skips a chain of sub-blocks, NULL when it runs past the end
+        static const BYTE *SkipBlocks(const BYTE *p, const BYTE *end)
+        {
+            while (p < end)
+            {
+                UINT length = *p++;
+                if (!length)
+                    return p;
+                if ((SIZE_T)(end - p) < length)
+                    return NULL;
+                p += length;
+            }
+
+            return NULL;
+        }
+
+        //! LZW codes of a frame into count palette indices, a short stream leaves the rest 0
+        static bool DecodeLzw(const BYTE *p, const BYTE *end, PBYTE out, SIZE_T count)
+        {
+            enum { MaxCodes = 4096 };
+
+            ::memset(out, 0, count);
+            if (p >= end)
+                return false;
+
+            UINT minSize = *p++;
+            if (minSize < 1 || minSize > 8)
+                return false;
+
+            WORD prefix[MaxCodes];
+            BYTE suffix[MaxCodes];
+            BYTE first[MaxCodes];
+            WORD length[MaxCodes];
+
+            UINT clear = 1u << minSize, eoi = clear + 1;
+            for (UINT i = 0; i != clear; ++i)
+            {
+                prefix[i] = 0;
+                suffix[i] = first[i] = (BYTE)i;
+                length[i] = 1;
+            }
+
+            UINT codeSize = minSize + 1, next = clear + 2;
+            INT old = -1;
+
+            UINT bits = 0, bitCount = 0, block = 0;
+            SIZE_T pos = 0;
+
+            for (;;)
+            {
+                //! lsb first across the sub-blocks
+                while (bitCount < codeSize)
+                {
+                    if (!block)
+                    {
+                        if (p >= end || !(block = *p++))
+                            return true;
+                    }
+                    if (p >= end)
+                        return true;
+
+                    bits |= (UINT)*p++ << bitCount;
+                    bitCount += 8;
+                    --block;
+                }
+
+                UINT code = bits & ((1u << codeSize) - 1);
+                bits >>= codeSize;
+                bitCount -= codeSize;
+
+                if (code == clear)
+                {
+                    codeSize = minSize + 1;
+                    next = clear + 2;
+                    old = -1;
+                    continue;
+                }
+
+                if (code == eoi)
+                    return true;
+
+                if (old < 0)
+                {
+                    if (code >= clear)
+                        return false;
+                    if (pos < count)
+                        out[pos++] = (BYTE)code;
+                    old = code;
+                    continue;
+                }
+
+                UINT emit = code;
+                if (code > next || (code == next && next >= MaxCodes))
+                    return false;
+
+                //! a full table keeps the old entries until the next clear code
+                if (next < MaxCodes)
+                {
+                    prefix[next] = (WORD)old;
+                    first[next] = first[old];
+                    suffix[next] = code == next ? first[old] : first[code];
+                    length[next] = (WORD)(length[old] + 1);
+                    ++next;
+
+                    if (next == (1u << codeSize) && codeSize < 12)
+                        ++codeSize;
+                }
+
+                //! the string is written back to front along the prefix chain
+                UINT n = length[emit];
+                for (UINT c = emit, i = n; i; c = prefix[c])
+                {
+                    --i;
+                    if (pos + i < count)
+                        out[pos + i] = suffix[c];
+                }
+                pos += n;
+                if (pos >= count)
+                    return true;
+
+                old = code;
+            }
+        }
+
+        GifDecoder::GifDecoder()
+            : m_data(NULL)
+            , m_end(NULL)
+            , m_canvas()
+            , m_frames()
+            , m_next(0)
+            , m_saved()
+            , m_pixels()
+            , m_indices()
+        {
+
+        }
+
+        GifDecoder::~GifDecoder()
+        {
+
+        }
+
+        bool GifDecoder::Open(const BYTE *data, SIZE_T size)
+        {
+            m_frames.clear();
+            m_next = 0;
+
+            if (FormatGIF != Sniff(data, size) || size < 13)
+                return false;
+
+            m_data = data;
+            m_end = data + size;
+            m_canvas.cx = Read16LE(data + 6);
+            m_canvas.cy = Read16LE(data + 8);
+
+            const BYTE *global = NULL;
+            UINT globalSize = 0;
+            const BYTE *p = data + 13;
+            if (data[10] & 0x80)
+            {
+                global = p;
+                globalSize = 2u << (data[10] & 7);
+                if ((SIZE_T)(m_end - p) < globalSize * 3)
+                    return false;
+                p += globalSize * 3;
+            }
+
+            //! the graphic control extension applies to the next image only
+            Frame control;
+            ::memset(&control, 0, sizeof(control));
+            control.transparent = -1;
+
+            while (p && p < m_end)
+            {
+                BYTE introducer = *p++;
+
+                if (0x3B == introducer)
+                    break;
+
+                if (0x21 == introducer)
+                {
+                    if (p >= m_end)
+                        break;
+
+                    BYTE label = *p++;
+                    if (0xF9 == label && m_end - p >= 6 && 4 == p[0])
+                    {
+                        UINT disposal = (p[1] >> 2) & 7;
+                        control.disposal = disposal <= DisposePrevious ? (Disposal)disposal : DisposeNone;
+                        control.delay = Read16LE(p + 2);
+                        control.transparent = (p[1] & 1) ? p[4] : -1;
+                    }
+                    p = SkipBlocks(p, m_end);
+                    continue;
+                }
+
+                if (0x2C != introducer || m_end - p < 9)
+                    break;
+
+                Frame frame = control;
+                frame.rect.left = Read16LE(p);
+                frame.rect.top = Read16LE(p + 2);
+                frame.rect.right = Read16LE(p + 4);
+                frame.rect.bottom = Read16LE(p + 6);
+                frame.interlaced = 0 != (p[8] & 0x40);
+                frame.palette = global;
+                frame.paletteSize = globalSize;
+
+                BYTE flags = p[8];
+                p += 9;
+                if (flags & 0x80)
+                {
+                    frame.palette = p;
+                    frame.paletteSize = 2u << (flags & 7);
+                    if ((SIZE_T)(m_end - p) < frame.paletteSize * 3)
+                        break;
+                    p += frame.paletteSize * 3;
+                }
+
+                if (p >= m_end)
+                    break;
+
+                frame.lzw = p;
+                p = SkipBlocks(p + 1, m_end);
+
+                //! a truncated last frame still shows what arrived, an empty one is dropped
+                if (frame.rect.right > 0 && frame.rect.bottom > 0)
+                    m_frames.push_back(frame);
+
+                ::memset(&control, 0, sizeof(control));
+                control.transparent = -1;
+            }
+
+            //! some encoders leave the screen size 0, the first frame sets it then
+            if ((m_canvas.cx <= 0 || m_canvas.cy <= 0) && !m_frames.empty())
+            {
+                m_canvas.cx = m_frames[0].rect.left + m_frames[0].rect.right;
+                m_canvas.cy = m_frames[0].rect.top + m_frames[0].rect.bottom;
+            }
+
+            return !m_frames.empty() && m_canvas.cx > 0 && m_canvas.cy > 0;
+        }
+
+        bool GifDecoder::DecodeFrame(UINT index, PBYTE dst, INT dstStride, std::vector<BYTE>& indices) const
+        {
+            if (index >= m_frames.size())
+                return false;
+
+            const Frame& frame = m_frames[index];
+            UINT width = frame.rect.right, height = frame.rect.bottom;
+
+            indices.resize((SIZE_T)width * height);
+            if (!DecodeLzw(frame.lzw, m_end, &indices[0], indices.size()))
+                return false;
+
+            //! straight and premultiplied agree, every entry is opaque or clear
+            DWORD palette[256];
+            for (UINT i = 0; i != 256; ++i)
+            {
+                palette[i] = 0xFF000000;
+                if (frame.palette && i < frame.paletteSize)
+                {
+                    const BYTE *c = frame.palette + i * 3;
+                    palette[i] |= (c[0] << 16) | (c[1] << 8) | c[2];
+                }
+            }
+            if (frame.transparent >= 0)
+                palette[frame.transparent] = 0;
+
+            //! interlaced rows come as every 8th from 0, every 8th from 4, every 4th from 2, every 2nd from 1
+            static const BYTE starts[4] = { 0, 4, 2, 1 };
+            static const BYTE steps[4] = { 8, 8, 4, 2 };
+            UINT pass = 0, y = 0;
+
+            for (UINT row = 0; row != height; ++row)
+            {
+                if (frame.interlaced)
+                {
+                    while (y >= height)
+                    {
+                        ++pass;
+                        y = starts[pass];
+                    }
+                }
+                else
+                {
+                    y = row;
+                }
+
+                const BYTE *src = &indices[(SIZE_T)row * width];
+                DWORD *out = (DWORD *)(dst + y * dstStride);
+                for (UINT x = 0; x != width; ++x)
+                    out[x] = palette[src[x]];
+
+                if (frame.interlaced)
+                    y += steps[pass];
+            }
+
+            return true;
+        }
+
+        bool GifDecoder::Next(PBYTE canvas, INT canvasStride)
+        {
+            if (m_next >= m_frames.size())
+                return false;
+
+            const Pixel::Kernels& kernels = Pixel::GetKernels();
+
+            if (0 == m_next)
+            {
+                Pixel::Fill(canvas, canvasStride, m_canvas.cx, m_canvas.cy, 0);
+            }
+            else
+            {
+                const Frame& last = m_frames[m_next - 1];
+                RECT r = last.rect;
+                LONG right = min(m_canvas.cx, r.left + r.right), bottom = min(m_canvas.cy, r.top + r.bottom);
+
+                if (r.left < right && r.top < bottom)
+                {
+                    if (DisposeBackground == last.disposal)
+                    {
+                        Pixel::Fill(canvas + r.top * canvasStride + r.left * 4, canvasStride, right - r.left, bottom - r.top, 0);
+                    }
+                    else if (DisposePrevious == last.disposal && !m_saved.empty())
+                    {
+                        Pixel::Copy(canvas + r.top * canvasStride + r.left * 4, canvasStride,
+                            (const BYTE *)&m_saved[0], (right - r.left) * 4, right - r.left, bottom - r.top);
+                    }
+                }
+            }
+
+            const Frame& frame = m_frames[m_next++];
+            LONG left = frame.rect.left, top = frame.rect.top;
+            LONG right = min(m_canvas.cx, left + frame.rect.right), bottom = min(m_canvas.cy, top + frame.rect.bottom);
+
+            if (left >= right || top >= bottom)
+                return true;
+
+            if (DisposePrevious == frame.disposal)
+            {
+                m_saved.resize((SIZE_T)(right - left) * (bottom - top));
+                Pixel::Copy((PBYTE)&m_saved[0], (right - left) * 4,
+                    canvas + top * canvasStride + left * 4, canvasStride, right - left, bottom - top);
+            }
+
+            //! a broken frame draws whatever decoded, as browsers do
+            m_pixels.resize((SIZE_T)frame.rect.right * frame.rect.bottom);
+            DecodeFrame(m_next - 1, (PBYTE)&m_pixels[0], frame.rect.right * 4, m_indices);
+
+            //! clear pixels keep the canvas, opaque ones replace it
+            for (LONG y = top; y != bottom; ++y)
+            {
+                kernels.blend[Pixel::BlendPremultiplied]((DWORD *)(canvas + y * canvasStride) + left,
+                    &m_pixels[(SIZE_T)(y - top) * frame.rect.right], right - left, 255);
+            }
+
+            return true;
+        }
+
+        void GifDecoder::Rewind()
+        {
+            m_next = 0;
+        }
+
+        bool DecodeGIF(const BYTE *data, SIZE_T size, Image *nullImage)
+        {
+            GifDecoder decoder;
+            if (!decoder.Open(data, size))
+                return false;
+
+            SIZE canvas = decoder.GetCanvasSize();
+            if (!AllocateImage(nullImage, canvas.cx, canvas.cy))
+                return false;
+
+            decoder.Next(nullImage->GetOffset(0, 0), nullImage->GetStride());
+            nullImage->SetAlphaMode(Image::AlphaPremultiplied);
+            return true;
+        }
+    }
+}
\ No newline at end of file
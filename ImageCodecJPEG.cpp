@@ -0,0 +1,1144 @@
+#include "ImageCodecFormats.h"
+
+#include <string.h>
+
+namespace Render
+{
+    namespace Codec
+    {
+        //! JPEG: baseline and progressive huffman, 8 bit precision, gray / YCbCr / RGB / CMYK / YCCK
+        //! no arithmetic coding, lossless or hierarchical frames
+
+        //! zig-zag position to natural order, padded so a corrupt run cannot index past the end
+        static const BYTE s_dezigzag[64 + 15] =
+        {
+            0, 1, 8, 16, 9, 2, 3, 10,
+            17, 24, 32, 25, 18, 11, 4, 5,
+            12, 19, 26, 33, 40, 48, 41, 34,
+            27, 20, 13, 6, 7, 14, 21, 28,
+            35, 42, 49, 56, 57, 50, 43, 36,
+            29, 22, 15, 23, 30, 37, 44, 51,
+            58, 59, 52, 45, 38, 31, 39, 46,
+            53, 60, 61, 54, 47, 55, 62, 63,
+            63, 63, 63, 63, 63, 63, 63, 63,
+            63, 63, 63, 63, 63, 63, 63,
+        };
+
+        //! canonical huffman code of a DHT segment, 9 bit lookup with a per-length walk for the rest
+        class JpegHuffman
+        {
+        public:
+            enum { FastBits = 9, FastSize = 1 << FastBits };
+
+            BYTE fast[FastSize];        //! symbol index, 255 when the code is longer
+            WORD code[256];
+            BYTE values[256];
+            BYTE size[257];
+            UINT maxCode[18];           //! first code of the next length, left aligned to 16 bits
+            INT delta[17];              //! symbol index minus code, per length
+
+        public:
+            bool Build(const BYTE *counts)
+            {
+                UINT k = 0;
+                for (UINT i = 0; i != 16; ++i)
+                {
+                    for (UINT j = 0; j != counts[i]; ++j)
+                        size[k++] = (BYTE)(i + 1);
+                }
+                size[k] = 0;
+
+                UINT c = 0;
+                k = 0;
+                for (UINT j = 1; j <= 16; ++j)
+                {
+                    delta[j] = (INT)k - (INT)c;
+                    while (size[k] == j)
+                        code[k++] = (WORD)c++;
+                    if (c > (1u << j))
+                        return false;
+
+                    maxCode[j] = c << (16 - j);
+                    c <<= 1;
+                }
+                maxCode[17] = 0xFFFFFFFF;
+
+                ::memset(fast, 255, sizeof(fast));
+                for (UINT i = 0; i != k; ++i)
+                {
+                    UINT s = size[i];
+                    if (s <= FastBits)
+                    {
+                        UINT first = code[i] << (FastBits - s), n = 1u << (FastBits - s);
+                        for (UINT j = 0; j != n; ++j)
+                            fast[first + j] = (BYTE)i;
+                    }
+                }
+
+                return true;
+            }
+        };
+
+        struct JpegComponent
+        {
+            INT id;
+            INT h, v;               //! sampling factors
+            INT tq;                 //! quantization table
+            INT hd, ha;             //! dc and ac huffman tables of the current scan
+            INT dcPred;
+
+            INT x, y;               //! samples in the image
+            INT w2, h2;             //! samples in whole MCUs, the plane's stride and height
+            std::vector<BYTE> plane;
+
+            //! progressive: every block's coefficients until the last scan
+            INT coeffW, coeffH;
+            std::vector<short> coeff;
+        };
+
+        class JpegDecoder
+        {
+        private:
+            const BYTE *m_p;
+            const BYTE *m_end;
+
+            JpegHuffman m_dc[4];
+            JpegHuffman m_ac[4];
+            WORD m_dequant[4][64];  //! natural order
+
+            INT m_width, m_height;
+            INT m_mcuX, m_mcuY;     //! MCUs per row and column
+            INT m_hMax, m_vMax;
+            bool m_progressive;
+            INT m_componentCount;
+            JpegComponent m_components[4];
+
+            //! the current scan
+            INT m_scanCount;
+            INT m_scan[4];
+            INT m_specStart, m_specEnd, m_succHigh, m_succLow;
+            INT m_eobRun;
+            INT m_restartInterval;
+            INT m_todo;
+
+            //! entropy coded bits, msb first, the marker ending them is kept
+            UINT m_bits;
+            INT m_bitCount;
+            INT m_marker;
+            bool m_noMore;
+
+            INT m_transform;        //! Adobe APP14, -1 without one
+
+        public:
+            JpegDecoder(const BYTE *data, SIZE_T size)
+                : m_p(data)
+                , m_end(data + size)
+                , m_width(0)
+                , m_height(0)
+                , m_mcuX(0)
+                , m_mcuY(0)
+                , m_hMax(1)
+                , m_vMax(1)
+                , m_progressive(false)
+                , m_componentCount(0)
+                , m_scanCount(0)
+                , m_specStart(0)
+                , m_specEnd(63)
+                , m_succHigh(0)
+                , m_succLow(0)
+                , m_eobRun(0)
+                , m_restartInterval(0)
+                , m_todo(0)
+                , m_bits(0)
+                , m_bitCount(0)
+                , m_marker(0)
+                , m_noMore(false)
+                , m_transform(-1)
+            {
+                ::memset(m_dequant, 0, sizeof(m_dequant));
+            }
+
+            bool Decode(Image *nullImage);
+
+        private:
+            BYTE Get8()
+            {
+                return m_p < m_end ? *m_p++ : 0;
+            }
+
+            UINT Get16()
+            {
+                UINT high = Get8();
+                return (high << 8) | Get8();
+            }
+
+            //! the next marker code, 0 when the stream does not continue with one
+            INT GetMarker()
+            {
+                if (m_marker)
+                {
+                    INT marker = m_marker;
+                    m_marker = 0;
+                    return marker;
+                }
+
+                if (m_p >= m_end || 0xFF != Get8())
+                    return 0;
+
+                BYTE code = 0xFF;
+                while (0xFF == code && m_p < m_end)
+                    code = Get8();
+                return 0xFF == code ? 0 : code;
+            }
+
+            bool ReadFrame(INT marker);
+            bool ReadHuffman(UINT length);
+            bool ReadQuant(UINT length);
+            bool ReadScanHeader(UINT length);
+
+            //! fills at least 25 bits, zeros once a marker or the end is reached
+            void Fill()
+            {
+                do
+                {
+                    UINT b = 0;
+                    if (!m_noMore)
+                    {
+                        if (m_p >= m_end)
+                        {
+                            m_noMore = true;
+                        }
+                        else if (0xFF == (b = *m_p++))
+                        {
+                            UINT c = Get8();
+                            while (0xFF == c && m_p < m_end)
+                                c = Get8();
+                            if (c)
+                            {
+                                m_marker = 0xFF == c ? 0 : c;
+                                m_noMore = true;
+                                b = 0;
+                            }
+                        }
+                    }
+
+                    m_bits |= b << (24 - m_bitCount);
+                    m_bitCount += 8;
+                }
+                while (m_bitCount <= 24);
+            }
+
+            UINT GetBits(INT n)
+            {
+                if (!n)
+                    return 0;
+                if (m_bitCount < n)
+                    Fill();
+
+                UINT k = m_bits >> (32 - n);
+                m_bits <<= n;
+                m_bitCount -= n;
+                return k;
+            }
+
+            UINT GetBit()
+            {
+                return GetBits(1);
+            }
+
+            //! n magnitude bits, the top bit 0 means negative
+            INT Extend(INT n)
+            {
+                INT k = (INT)GetBits(n);
+                return k < (1 << (n - 1)) ? k - (1 << n) + 1 : k;
+            }
+
+            //! the next symbol, -1 for a code that is not in the table
+            INT DecodeSymbol(const JpegHuffman& h)
+            {
+                if (m_bitCount < 16)
+                    Fill();
+
+                UINT c = m_bits >> (32 - JpegHuffman::FastBits);
+                UINT k = h.fast[c];
+                if (k < 255)
+                {
+                    INT s = h.size[k];
+                    if (s > m_bitCount)
+                        return -1;
+
+                    m_bits <<= s;
+                    m_bitCount -= s;
+                    return h.values[k];
+                }
+
+                UINT top = m_bits >> 16;
+                for (k = JpegHuffman::FastBits + 1; top >= h.maxCode[k]; ++k);
+                if (17 == k || (INT)k > m_bitCount)
+                    return -1;
+
+                INT index = (INT)(m_bits >> (32 - k)) + h.delta[k];
+                if (index < 0 || index >= 256)
+                    return -1;
+
+                m_bits <<= k;
+                m_bitCount -= k;
+                return h.values[index];
+            }
+
+            void Reset()
+            {
+                m_bits = 0;
+                m_bitCount = 0;
+                m_noMore = false;
+                m_marker = 0;
+                m_eobRun = 0;
+                m_todo = m_restartInterval ? m_restartInterval : 0x7FFFFFFF;
+                for (INT i = 0; i != m_componentCount; ++i)
+                    m_components[i].dcPred = 0;
+            }
+
+            //! false at the end of the scan, otherwise past the restart marker when one is due
+            bool NextInterval()
+            {
+                if (--m_todo > 0)
+                    return true;
+
+                if (m_bitCount < 24)
+                    Fill();
+                if (m_marker < 0xD0 || m_marker > 0xD7)
+                    return false;
+
+                Reset();
+                return true;
+            }
+
+            bool DecodeBlock(short data[64], JpegComponent& c);
+            bool DecodeBlockDC(short data[64], JpegComponent& c);
+            bool DecodeBlockAC(short data[64], JpegComponent& c);
+            bool DecodeScan();
+            void FinishProgressive();
+            void Output(Image *nullImage);
+        };
+
+        //! stb_image's integer IDCT, 12 bit fixed-point constants
+        static inline INT F2F(double x) { return (INT)(x * 4096 + 0.5); }
+
+        //! unsigned so a corrupt block wraps instead of overflowing, valid data never gets near
+        struct Idct1D
+        {
+            UINT t0, t1, t2, t3, x0, x1, x2, x3;
+
+            Idct1D(UINT s0, UINT s1, UINT s2, UINT s3, UINT s4, UINT s5, UINT s6, UINT s7)
+            {
+                UINT p1 = (s2 + s6) * F2F(0.5411961);
+                t2 = p1 + s6 * F2F(-1.847759065);
+                t3 = p1 + s2 * F2F(0.765366865);
+                t0 = (s0 + s4) * 4096;
+                t1 = (s0 - s4) * 4096;
+                x0 = t0 + t3;
+                x3 = t0 - t3;
+                x1 = t1 + t2;
+                x2 = t1 - t2;
+
+                t0 = s7;
+                t1 = s5;
+                t2 = s3;
+                t3 = s1;
+                UINT p3 = t0 + t2, p4 = t1 + t3, p2 = t1 + t2;
+                p1 = t0 + t3;
+                UINT p5 = (p3 + p4) * F2F(1.175875602);
+                t0 = t0 * F2F(0.298631336);
+                t1 = t1 * F2F(2.053119869);
+                t2 = t2 * F2F(3.072711026);
+                t3 = t3 * F2F(1.501321110);
+                p1 = p5 + p1 * F2F(-0.899976223);
+                p2 = p5 + p2 * F2F(-2.562915447);
+                p3 = p3 * F2F(-1.961570560);
+                p4 = p4 * F2F(-0.390180644);
+                t3 += p1 + p4;
+                t2 += p2 + p3;
+                t1 += p2 + p4;
+                t0 += p1 + p3;
+            }
+        };
+
+        static inline BYTE Clamp8(INT x)
+        {
+            return (UINT)x > 255 ? (x < 0 ? 0 : 255) : (BYTE)x;
+        }
+
+        static void IdctBlock(PBYTE out, INT stride, const short data[64])
+        {
+            INT values[64];
+
+            for (INT i = 0; i != 8; ++i)
+            {
+                const short *d = data + i;
+                INT *v = values + i;
+
+                //! a column without ac terms is flat
+                if (!d[8] && !d[16] && !d[24] && !d[32] && !d[40] && !d[48] && !d[56])
+                {
+                    INT dc = d[0] * 4;
+                    v[0] = v[8] = v[16] = v[24] = v[32] = v[40] = v[48] = v[56] = dc;
+                    continue;
+                }
+
+                //! back down from 12 bits of scale, 2 bits of precision kept for the rows
+                Idct1D c(d[0], d[8], d[16], d[24], d[32], d[40], d[48], d[56]);
+                c.x0 += 512; c.x1 += 512; c.x2 += 512; c.x3 += 512;
+                v[0] = (INT)(c.x0 + c.t3) >> 10;
+                v[56] = (INT)(c.x0 - c.t3) >> 10;
+                v[8] = (INT)(c.x1 + c.t2) >> 10;
+                v[48] = (INT)(c.x1 - c.t2) >> 10;
+                v[16] = (INT)(c.x2 + c.t1) >> 10;
+                v[40] = (INT)(c.x2 - c.t1) >> 10;
+                v[24] = (INT)(c.x3 + c.t0) >> 10;
+                v[32] = (INT)(c.x3 - c.t0) >> 10;
+            }
+
+            for (INT i = 0; i != 8; ++i, out += stride)
+            {
+                const INT *v = values + i * 8;
+                Idct1D r(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7]);
+
+                //! rounding and the +128 level shift folded into the 17 bit scale
+                const UINT bias = 65536 + (128 << 17);
+                r.x0 += bias; r.x1 += bias; r.x2 += bias; r.x3 += bias;
+                out[0] = Clamp8((INT)(r.x0 + r.t3) >> 17);
+                out[7] = Clamp8((INT)(r.x0 - r.t3) >> 17);
+                out[1] = Clamp8((INT)(r.x1 + r.t2) >> 17);
+                out[6] = Clamp8((INT)(r.x1 - r.t2) >> 17);
+                out[2] = Clamp8((INT)(r.x2 + r.t1) >> 17);
+                out[5] = Clamp8((INT)(r.x2 - r.t1) >> 17);
+                out[3] = Clamp8((INT)(r.x3 + r.t0) >> 17);
+                out[4] = Clamp8((INT)(r.x3 - r.t0) >> 17);
+            }
+        }
+
+        bool JpegDecoder::ReadHuffman(UINT length)
+        {
+            if (length < 2)
+                return false;
+            length -= 2;
+
+            while (length >= 17)
+            {
+                BYTE q = Get8();
+                UINT tc = q >> 4, th = q & 15;
+                if (tc > 1 || th > 3)
+                    return false;
+
+                BYTE counts[16];
+                UINT n = 0;
+                for (UINT i = 0; i != 16; ++i)
+                    n += counts[i] = Get8();
+
+                if (n > 256 || length < 17 + n || (SIZE_T)(m_end - m_p) < n)
+                    return false;
+
+                JpegHuffman& h = tc ? m_ac[th] : m_dc[th];
+                if (!h.Build(counts))
+                    return false;
+
+                ::memcpy(h.values, m_p, n);
+                m_p += n;
+                length -= 17 + n;
+            }
+
+            return 0 == length;
+        }
+
+        bool JpegDecoder::ReadQuant(UINT length)
+        {
+            if (length < 2)
+                return false;
+            length -= 2;
+
+            while (length >= 65)
+            {
+                BYTE q = Get8();
+                UINT precision = q >> 4, t = q & 15;
+                if (precision > 1 || t > 3 || length < (precision ? 129u : 65u))
+                    return false;
+
+                for (UINT i = 0; i != 64; ++i)
+                    m_dequant[t][s_dezigzag[i]] = (WORD)(precision ? Get16() : Get8());
+
+                length -= precision ? 129 : 65;
+            }
+
+            return 0 == length;
+        }
+
+        bool JpegDecoder::ReadFrame(INT marker)
+        {
+            //! one frame per image
+            if (m_componentCount)
+                return false;
+
+            UINT length = Get16();
+            if (length < 11 || 8 != Get8())
+                return false;
+
+            m_progressive = 0xC2 == marker;
+            m_height = Get16();
+            m_width = Get16();
+            m_componentCount = Get8();
+
+            //! a height from a DNL marker is not supported
+            if (!m_width || !m_height)
+                return false;
+            if (1 != m_componentCount && 3 != m_componentCount && 4 != m_componentCount)
+                return false;
+            if (length != 8 + 3 * (UINT)m_componentCount)
+                return false;
+
+            for (INT i = 0; i != m_componentCount; ++i)
+            {
+                JpegComponent& c = m_components[i];
+                c.id = Get8();
+                BYTE sampling = Get8();
+                c.h = sampling >> 4;
+                c.v = sampling & 15;
+                c.tq = Get8();
+                if (c.h < 1 || c.h > 4 || c.v < 1 || c.v > 4 || c.tq > 3)
+                    return false;
+
+                m_hMax = max(m_hMax, c.h);
+                m_vMax = max(m_vMax, c.v);
+            }
+
+            //! samples only fill whole MCUs when every component divides into the largest factor
+            for (INT i = 0; i != m_componentCount; ++i)
+            {
+                if (m_hMax % m_components[i].h || m_vMax % m_components[i].v)
+                    return false;
+            }
+
+            INT mcuW = m_hMax * 8, mcuH = m_vMax * 8;
+            m_mcuX = (m_width + mcuW - 1) / mcuW;
+            m_mcuY = (m_height + mcuH - 1) / mcuH;
+
+            //! the planes are bounded by the image, which AllocateImage already capped
+            if ((ULONGLONG)m_width * m_height > (1u << 28))
+                return false;
+
+            for (INT i = 0; i != m_componentCount; ++i)
+            {
+                JpegComponent& c = m_components[i];
+                c.x = (m_width * c.h + m_hMax - 1) / m_hMax;
+                c.y = (m_height * c.v + m_vMax - 1) / m_vMax;
+                c.w2 = m_mcuX * c.h * 8;
+                c.h2 = m_mcuY * c.v * 8;
+                c.dcPred = 0;
+                c.hd = c.ha = 0;
+                c.plane.assign((SIZE_T)c.w2 * c.h2, 0);
+
+                if (m_progressive)
+                {
+                    c.coeffW = c.w2 / 8;
+                    c.coeffH = c.h2 / 8;
+                    c.coeff.assign((SIZE_T)c.w2 * c.h2, 0);
+                }
+            }
+
+            return true;
+        }
+
+        bool JpegDecoder::ReadScanHeader(UINT length)
+        {
+            m_scanCount = Get8();
+            if (m_scanCount < 1 || m_scanCount > 4 || m_scanCount > m_componentCount)
+                return false;
+            if (length != 6 + 2 * (UINT)m_scanCount)
+                return false;
+
+            for (INT i = 0; i != m_scanCount; ++i)
+            {
+                INT id = Get8(), tables = Get8(), which = 0;
+                while (which != m_componentCount && m_components[which].id != id)
+                    ++which;
+                if (which == m_componentCount)
+                    return false;
+
+                JpegComponent& c = m_components[which];
+                c.hd = tables >> 4;
+                c.ha = tables & 15;
+                if (c.hd > 3 || c.ha > 3)
+                    return false;
+
+                m_scan[i] = which;
+            }
+
+            m_specStart = Get8();
+            m_specEnd = Get8();
+            BYTE approx = Get8();
+            m_succHigh = approx >> 4;
+            m_succLow = approx & 15;
+
+            if (m_progressive)
+            {
+                if (m_specStart > 63 || m_specEnd > 63 || m_specStart > m_specEnd || m_succHigh > 13 || m_succLow > 13)
+                    return false;
+            }
+            else
+            {
+                if (m_specStart || m_succHigh || m_succLow)
+                    return false;
+                m_specEnd = 63;
+            }
+
+            return true;
+        }
+
+        bool JpegDecoder::DecodeBlock(short data[64], JpegComponent& c)
+        {
+            const WORD *dequant = m_dequant[c.tq];
+            ::memset(data, 0, 64 * sizeof(short));
+
+            INT t = DecodeSymbol(m_dc[c.hd]);
+            if (t < 0 || t > 15)
+                return false;
+
+            c.dcPred += t ? Extend(t) : 0;
+            data[0] = (short)(c.dcPred * dequant[0]);
+
+            for (INT k = 1; k < 64;)
+            {
+                INT rs = DecodeSymbol(m_ac[c.ha]);
+                if (rs < 0)
+                    return false;
+
+                INT s = rs & 15, r = rs >> 4;
+                if (!s)
+                {
+                    if (0xF0 != rs)
+                        break;
+                    k += 16;
+                }
+                else
+                {
+                    k += r;
+                    INT zig = s_dezigzag[k++];
+                    data[zig] = (short)(Extend(s) * dequant[zig]);
+                }
+            }
+
+            return true;
+        }
+
+        bool JpegDecoder::DecodeBlockDC(short data[64], JpegComponent& c)
+        {
+            if (m_specEnd)
+                return false;
+
+            if (!m_succHigh)
+            {
+                INT t = DecodeSymbol(m_dc[c.hd]);
+                if (t < 0 || t > 15)
+                    return false;
+
+                c.dcPred += t ? Extend(t) : 0;
+                data[0] = (short)(c.dcPred * (1 << m_succLow));
+            }
+            else if (GetBit())
+            {
+                data[0] = (short)(data[0] + (1 << m_succLow));
+            }
+
+            return true;
+        }
+
+        bool JpegDecoder::DecodeBlockAC(short data[64], JpegComponent& c)
+        {
+            if (!m_specStart)
+                return false;
+
+            if (!m_succHigh)
+            {
+                if (m_eobRun)
+                {
+                    --m_eobRun;
+                    return true;
+                }
+
+                for (INT k = m_specStart; k <= m_specEnd;)
+                {
+                    INT rs = DecodeSymbol(m_ac[c.ha]);
+                    if (rs < 0)
+                        return false;
+
+                    INT s = rs & 15, r = rs >> 4;
+                    if (!s)
+                    {
+                        if (r < 15)
+                        {
+                            m_eobRun = (1 << r) - 1 + (INT)GetBits(r);
+                            break;
+                        }
+                        k += 16;
+                    }
+                    else
+                    {
+                        k += r;
+                        INT zig = s_dezigzag[k++];
+                        data[zig] = (short)(Extend(s) * (1 << m_succLow));
+                    }
+                }
+
+                return true;
+            }
+
+            //! refinement: one more bit for every coefficient already nonzero, new ones are +-1
+            short bit = (short)(1 << m_succLow);
+
+            if (m_eobRun)
+            {
+                --m_eobRun;
+                for (INT k = m_specStart; k <= m_specEnd; ++k)
+                {
+                    short *p = &data[s_dezigzag[k]];
+                    if (*p && GetBit() && !(*p & bit))
+                        *p = (short)(*p > 0 ? *p + bit : *p - bit);
+                }
+                return true;
+            }
+
+            for (INT k = m_specStart; k <= m_specEnd;)
+            {
+                INT rs = DecodeSymbol(m_ac[c.ha]);
+                if (rs < 0)
+                    return false;
+
+                INT s = rs & 15, r = rs >> 4;
+                if (!s)
+                {
+                    //! r == 15 is a run of 16 zeros: 15 skipped, then a 0 written
+                    if (r < 15)
+                    {
+                        m_eobRun = (1 << r) - 1 + (INT)GetBits(r);
+                        r = 64;
+                    }
+                }
+                else
+                {
+                    if (1 != s)
+                        return false;
+                    s = GetBit() ? bit : -bit;
+                }
+
+                while (k <= m_specEnd)
+                {
+                    short *p = &data[s_dezigzag[k++]];
+                    if (*p)
+                    {
+                        if (GetBit() && !(*p & bit))
+                            *p = (short)(*p > 0 ? *p + bit : *p - bit);
+                    }
+                    else
+                    {
+                        if (!r)
+                        {
+                            *p = (short)s;
+                            break;
+                        }
+                        --r;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        bool JpegDecoder::DecodeScan()
+        {
+            Reset();
+
+            short block[64];
+
+            if (1 == m_scanCount)
+            {
+                //! a lone component is coded in its own block order, without the MCU padding
+                JpegComponent& c = m_components[m_scan[0]];
+                INT w = (c.x + 7) >> 3, h = (c.y + 7) >> 3;
+
+                for (INT j = 0; j != h; ++j)
+                {
+                    for (INT i = 0; i != w; ++i)
+                    {
+                        if (m_progressive)
+                        {
+                            short *data = &c.coeff[64 * ((SIZE_T)i + (SIZE_T)j * c.coeffW)];
+                            if (!(m_specStart ? DecodeBlockAC(data, c) : DecodeBlockDC(data, c)))
+                                return false;
+                        }
+                        else
+                        {
+                            if (!DecodeBlock(block, c))
+                                return false;
+                            IdctBlock(&c.plane[(SIZE_T)c.w2 * j * 8 + i * 8], c.w2, block);
+                        }
+
+                        if (!NextInterval())
+                            return true;
+                    }
+                }
+
+                return true;
+            }
+
+            for (INT j = 0; j != m_mcuY; ++j)
+            {
+                for (INT i = 0; i != m_mcuX; ++i)
+                {
+                    for (INT n = 0; n != m_scanCount; ++n)
+                    {
+                        JpegComponent& c = m_components[m_scan[n]];
+                        for (INT y = 0; y != c.v; ++y)
+                        {
+                            for (INT x = 0; x != c.h; ++x)
+                            {
+                                INT bx = i * c.h + x, by = j * c.v + y;
+                                if (m_progressive)
+                                {
+                                    //! only dc scans interleave
+                                    if (!DecodeBlockDC(&c.coeff[64 * ((SIZE_T)bx + (SIZE_T)by * c.coeffW)], c))
+                                        return false;
+                                }
+                                else
+                                {
+                                    if (!DecodeBlock(block, c))
+                                        return false;
+                                    IdctBlock(&c.plane[(SIZE_T)c.w2 * by * 8 + bx * 8], c.w2, block);
+                                }
+                            }
+                        }
+                    }
+
+                    if (!NextInterval())
+                        return true;
+                }
+            }
+
+            return true;
+        }
+
+        void JpegDecoder::FinishProgressive()
+        {
+            short block[64];
+
+            for (INT n = 0; n != m_componentCount; ++n)
+            {
+                JpegComponent& c = m_components[n];
+                const WORD *dequant = m_dequant[c.tq];
+                INT w = (c.x + 7) >> 3, h = (c.y + 7) >> 3;
+
+                for (INT j = 0; j != h; ++j)
+                {
+                    for (INT i = 0; i != w; ++i)
+                    {
+                        const short *data = &c.coeff[64 * ((SIZE_T)i + (SIZE_T)j * c.coeffW)];
+                        for (INT k = 0; k != 64; ++k)
+                            block[k] = (short)(data[k] * dequant[k]);
+                        IdctBlock(&c.plane[(SIZE_T)c.w2 * j * 8 + i * 8], c.w2, block);
+                    }
+                }
+            }
+        }
+
+        //! upsampling of one output row from the two nearest input rows, stb_image's "fancy" filters
+        typedef const BYTE *(*ResampleProc)(PBYTE out, const BYTE *near, const BYTE *far, INT w, INT hs);
+
+        static const BYTE *ResampleCopy(PBYTE, const BYTE *near, const BYTE *, INT, INT)
+        {
+            return near;
+        }
+
+        static const BYTE *ResampleV2(PBYTE out, const BYTE *near, const BYTE *far, INT w, INT)
+        {
+            for (INT i = 0; i != w; ++i)
+                out[i] = (BYTE)((3 * near[i] + far[i] + 2) >> 2);
+            return out;
+        }
+
+        static const BYTE *ResampleH2(PBYTE out, const BYTE *in, const BYTE *, INT w, INT)
+        {
+            if (1 == w)
+            {
+                out[0] = out[1] = in[0];
+                return out;
+            }
+
+            out[0] = in[0];
+            out[1] = (BYTE)((in[0] * 3 + in[1] + 2) >> 2);
+
+            INT i = 1;
+            for (; i < w - 1; ++i)
+            {
+                INT n = 3 * in[i] + 2;
+                out[i * 2] = (BYTE)((n + in[i - 1]) >> 2);
+                out[i * 2 + 1] = (BYTE)((n + in[i + 1]) >> 2);
+            }
+
+            out[i * 2] = (BYTE)((in[w - 2] * 3 + in[w - 1] + 2) >> 2);
+            out[i * 2 + 1] = in[w - 1];
+            return out;
+        }
+
+        static const BYTE *ResampleHV2(PBYTE out, const BYTE *near, const BYTE *far, INT w, INT)
+        {
+            if (1 == w)
+            {
+                out[0] = out[1] = (BYTE)((3 * near[0] + far[0] + 2) >> 2);
+                return out;
+            }
+
+            INT t1 = 3 * near[0] + far[0];
+            out[0] = (BYTE)((t1 + 2) >> 2);
+
+            for (INT i = 1; i != w; ++i)
+            {
+                INT t0 = t1;
+                t1 = 3 * near[i] + far[i];
+                out[i * 2 - 1] = (BYTE)((3 * t0 + t1 + 8) >> 4);
+                out[i * 2] = (BYTE)((3 * t1 + t0 + 8) >> 4);
+            }
+
+            out[w * 2 - 1] = (BYTE)((t1 + 2) >> 2);
+            return out;
+        }
+
+        static const BYTE *ResampleNearest(PBYTE out, const BYTE *near, const BYTE *, INT w, INT hs)
+        {
+            for (INT i = 0; i != w; ++i)
+            {
+                for (INT j = 0; j != hs; ++j)
+                    out[i * hs + j] = near[i];
+            }
+            return out;
+        }
+
+        //! Adobe CMYK is stored inverted, so this is x * (255 - ink) / 255
+        static inline BYTE Blinn(UINT x, UINT y)
+        {
+            UINT t = x * y + 128;
+            return (BYTE)((t + (t >> 8)) >> 8);
+        }
+
+        void JpegDecoder::Output(Image *nullImage)
+        {
+            struct Resampler
+            {
+                ResampleProc proc;
+                const BYTE *line0, *line1;
+                INT hs, vs, wLores, yStep, yPos;
+                std::vector<BYTE> buffer;
+            };
+
+            Resampler r[4];
+            const BYTE *rows[4];
+
+            for (INT n = 0; n != m_componentCount; ++n)
+            {
+                JpegComponent& c = m_components[n];
+                Resampler& s = r[n];
+
+                s.hs = m_hMax / c.h;
+                s.vs = m_vMax / c.v;
+                s.yStep = s.vs >> 1;
+                s.yPos = 0;
+                s.wLores = (m_width + s.hs - 1) / s.hs;
+                s.line0 = s.line1 = &c.plane[0];
+                s.buffer.resize(m_width + 3);
+
+                if (1 == s.hs && 1 == s.vs)
+                    s.proc = ResampleCopy;
+                else if (1 == s.hs && 2 == s.vs)
+                    s.proc = ResampleV2;
+                else if (2 == s.hs && 1 == s.vs)
+                    s.proc = ResampleH2;
+                else if (2 == s.hs && 2 == s.vs)
+                    s.proc = ResampleHV2;
+                else
+                    s.proc = ResampleNearest;
+            }
+
+            const Pixel::Kernels& kernels = Pixel::GetKernels();
+            bool rgb = 3 == m_componentCount && (0 == m_transform
+                || ('R' == m_components[0].id && 'G' == m_components[1].id && 'B' == m_components[2].id));
+
+            RowWriter writer(nullImage, false);
+
+            for (INT y = 0; y != m_height; ++y)
+            {
+                for (INT n = 0; n != m_componentCount; ++n)
+                {
+                    Resampler& s = r[n];
+                    bool bottom = s.yStep >= (s.vs >> 1);
+                    rows[n] = s.proc(&s.buffer[0], bottom ? s.line1 : s.line0, bottom ? s.line0 : s.line1, s.wLores, s.hs);
+
+                    if (++s.yStep >= s.vs)
+                    {
+                        s.yStep = 0;
+                        s.line0 = s.line1;
+                        if (++s.yPos < m_components[n].y)
+                            s.line1 += m_components[n].w2;
+                    }
+                }
+
+                DWORD *dst = writer.GetRow(y);
+                switch (m_componentCount)
+                {
+                case 1:
+                    for (INT x = 0; x != m_width; ++x)
+                        dst[x] = 0xFF000000 | (rows[0][x] * 0x010101);
+                    break;
+                case 3:
+                    if (rgb)
+                    {
+                        for (INT x = 0; x != m_width; ++x)
+                            dst[x] = 0xFF000000 | (rows[0][x] << 16) | (rows[1][x] << 8) | rows[2][x];
+                    }
+                    else
+                    {
+                        kernels.ycbcr(dst, rows[0], rows[1], rows[2], m_width);
+                    }
+                    break;
+                default:
+                    if (2 == m_transform)
+                    {
+                        //! YCCK: inverted YCbCr over the black channel
+                        kernels.ycbcr(dst, rows[0], rows[1], rows[2], m_width);
+                        for (INT x = 0; x != m_width; ++x)
+                        {
+                            DWORD p = dst[x];
+                            UINT k = rows[3][x];
+                            dst[x] = 0xFF000000 | (Blinn(255 - ((p >> 16) & 0xFF), k) << 16)
+                                | (Blinn(255 - ((p >> 8) & 0xFF), k) << 8) | Blinn(255 - (p & 0xFF), k);
+                        }
+                    }
+                    else
+                    {
+                        for (INT x = 0; x != m_width; ++x)
+                        {
+                            UINT k = rows[3][x];
+                            dst[x] = 0xFF000000 | (Blinn(rows[0][x], k) << 16) | (Blinn(rows[1][x], k) << 8) | Blinn(rows[2][x], k);
+                        }
+                    }
+                    break;
+                }
+
+                writer.Commit(y);
+            }
+
+            writer.Finish();
+        }
+
+        bool JpegDecoder::Decode(Image *nullImage)
+        {
+            //! SOI, checked by Sniff
+            m_p += 2;
+
+            bool scanned = false;
+
+            for (;;)
+            {
+                INT marker = GetMarker();
+
+                //! EOI, or a stream cut short
+                if (0xD9 == marker || !marker)
+                    break;
+
+                //! stray restart markers carry no segment
+                if (marker >= 0xD0 && marker <= 0xD7)
+                    continue;
+
+                if (0xC0 == marker || 0xC1 == marker || 0xC2 == marker)
+                {
+                    if (!ReadFrame(marker) || !AllocateImage(nullImage, m_width, m_height))
+                        return false;
+                    continue;
+                }
+
+                //! other frame types: lossless, hierarchical and arithmetic coded
+                if (marker >= 0xC3 && marker <= 0xCF && 0xC4 != marker && 0xC8 != marker && 0xCC != marker)
+                    return false;
+
+                UINT length = Get16();
+                if (length < 2 || (SIZE_T)(m_end - m_p) < length - 2)
+                {
+                    //! segments cut short end the image after the last whole scan
+                    break;
+                }
+
+                const BYTE *next = m_p + length - 2;
+
+                switch (marker)
+                {
+                case 0xC4:
+                    if (!ReadHuffman(length))
+                        return false;
+                    break;
+                case 0xDB:
+                    if (!ReadQuant(length))
+                        return false;
+                    break;
+                case 0xDD:
+                    if (4 != length)
+                        return false;
+                    m_restartInterval = Get16();
+                    break;
+                case 0xEE:
+                    if (length >= 14 && 0 == ::memcmp(m_p, "Adobe", 6))
+                        m_transform = m_p[11];
+                    break;
+                case 0xDA:
+                    if (!m_componentCount || !ReadScanHeader(length))
+                        return false;
+
+                    scanned = true;
+                    m_p = next;
+
+                    //! a corrupt scan keeps what it decoded, like a truncated one
+                    if (!DecodeScan())
+                        m_p = m_end;
+
+                    //! past any padding to the marker ending the scan
+                    if (!m_marker)
+                    {
+                        while (m_p < m_end)
+                        {
+                            if (0xFF == *m_p++ && m_p < m_end && *m_p && 0xFF != *m_p)
+                            {
+                                m_marker = *m_p++;
+                                break;
+                            }
+                        }
+                    }
+                    continue;
+                default:
+                    break;
+                }
+
+                m_p = next;
+            }
+
+            if (!scanned)
+                return false;
+
+            if (m_progressive)
+                FinishProgressive();
+
+            Output(nullImage);
+            return true;
+        }
+
+        bool DecodeJPEG(const BYTE *data, SIZE_T size, Image *nullImage)
+        {
+            JpegDecoder decoder(data, size);
+            return decoder.Decode(nullImage);
+        }
+    }
+}
\ No newline at end of file
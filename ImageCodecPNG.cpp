@@ -0,0 +1,718 @@
+#include "ImageCodecFormats.h"
+
+#include <string.h>
+
+namespace Render
+{
+    namespace Codec
+    {
+        //! canonical huffman code of a deflate block, 9 bit lookup with a per-length walk for the rest
+        class InflateTable
+        {
+        public:
+            enum { FastBits = 9, FastSize = 1 << FastBits, MaxSymbols = 288 };
+
+        private:
+            WORD m_fast[FastSize];      //! length << 9 | symbol, 0 when the code is longer
+            WORD m_firstCode[16];
+            WORD m_firstSymbol[16];
+            UINT m_maxCode[17];         //! first code of the next length, left aligned to 16 bits
+            BYTE m_size[MaxSymbols];
+            WORD m_value[MaxSymbols];
+
+        public:
+            static UINT Reverse(UINT code, UINT bits)
+            {
+                UINT r = 0;
+                for (UINT i = 0; i != bits; ++i, code >>= 1)
+                    r = (r << 1) | (code & 1);
+                return r;
+            }
+
+            bool Build(const BYTE *lengths, UINT count)
+            {
+                UINT sizes[17] = { 0 }, nextCode[16];
+                ::memset(m_fast, 0, sizeof(m_fast));
+
+                for (UINT i = 0; i != count; ++i)
+                    ++sizes[lengths[i]];
+                sizes[0] = 0;
+
+                UINT code = 0, k = 0;
+                for (UINT i = 1; i != 16; ++i)
+                {
+                    if (sizes[i] > (1u << i))
+                        return false;
+
+                    nextCode[i] = code;
+                    m_firstCode[i] = (WORD)code;
+                    m_firstSymbol[i] = (WORD)k;
+                    code += sizes[i];
+                    if (sizes[i] && code - 1 >= (1u << i))
+                        return false;
+
+                    m_maxCode[i] = code << (16 - i);
+                    code <<= 1;
+                    k += sizes[i];
+                }
+                m_maxCode[16] = 0x10000;
+
+                for (UINT i = 0; i != count; ++i)
+                {
+                    UINT s = lengths[i];
+                    if (!s)
+                        continue;
+
+                    UINT c = nextCode[s] - m_firstCode[s] + m_firstSymbol[s];
+                    m_size[c] = (BYTE)s;
+                    m_value[c] = (WORD)i;
+
+                    if (s <= FastBits)
+                    {
+                        for (UINT j = Reverse(nextCode[s], s); j < FastSize; j += 1u << s)
+                            m_fast[j] = (WORD)((s << 9) | i);
+                    }
+                    ++nextCode[s];
+                }
+
+                return true;
+            }
+
+            //! bits holds at least 16 valid bits lsb first, -1 for an invalid code
+            INT Decode(ULONGLONG bits, UINT *length) const
+            {
+                UINT fast = m_fast[bits & (FastSize - 1)];
+                if (fast)
+                {
+                    *length = fast >> 9;
+                    return fast & 511;
+                }
+
+                UINT k = Reverse((UINT)bits & 0xFFFF, 16);
+                UINT s = FastBits + 1;
+                while (s < 16 && k >= m_maxCode[s])
+                    ++s;
+                if (s >= 16)
+                    return -1;
+
+                UINT c = (k >> (16 - s)) - m_firstCode[s] + m_firstSymbol[s];
+                if (c >= MaxSymbols || m_size[c] != s)
+                    return -1;
+
+                *length = s;
+                return m_value[c];
+            }
+        };
+
+        //! zlib stream into a buffer of known size
+        class Inflater
+        {
+        private:
+            const BYTE *m_in;
+            const BYTE *m_end;
+            ULONGLONG m_bits;
+            UINT m_count;
+            UINT m_padding;         //! zero bytes fed past the end
+
+            PBYTE m_out;
+            SIZE_T m_pos;
+            SIZE_T m_size;
+
+            InflateTable m_literals;
+            InflateTable m_distances;
+
+        public:
+            Inflater(const BYTE *in, SIZE_T inSize, PBYTE out, SIZE_T outSize)
+                : m_in(in)
+                , m_end(in + inSize)
+                , m_bits(0)
+                , m_count(0)
+                , m_padding(0)
+                , m_out(out)
+                , m_pos(0)
+                , m_size(outSize)
+            {
+
+            }
+
+        public:
+            //! true once the final block ended, GetSize tells how much came out
+            bool Run()
+            {
+                if (m_end - m_in < 2)
+                    return false;
+
+                UINT cmf = m_in[0], flg = m_in[1];
+                if ((cmf * 256 + flg) % 31 || 8 != (cmf & 15) || (flg & 32))
+                    return false;
+                m_in += 2;
+
+                for (;;)
+                {
+                    UINT final = Bits(1);
+                    UINT type = Bits(2);
+
+                    bool ok = false;
+                    switch (type)
+                    {
+                    case 0: ok = Stored(); break;
+                    case 1: ok = FixedTables() && Codes(); break;
+                    case 2: ok = DynamicTables() && Codes(); break;
+                    default: break;
+                    }
+
+                    //! a block that read past the input was decoded from padding
+                    if (!ok || m_padding * 8 > m_count)
+                        return false;
+
+                    if (final)
+                        return true;
+                }
+            }
+
+            SIZE_T GetSize() const { return m_pos; }
+
+        private:
+            void Refill()
+            {
+                while (m_count <= 56)
+                {
+                    BYTE b = 0;
+                    if (m_in < m_end)
+                        b = *m_in++;
+                    else
+                        ++m_padding;
+
+                    m_bits |= (ULONGLONG)b << m_count;
+                    m_count += 8;
+                }
+            }
+
+            UINT Bits(UINT n)
+            {
+                if (m_count < n)
+                    Refill();
+
+                UINT v = (UINT)(m_bits & ((1ull << n) - 1));
+                m_bits >>= n;
+                m_count -= n;
+                return v;
+            }
+
+            INT Symbol(const InflateTable& table)
+            {
+                if (m_count < 16)
+                    Refill();
+
+                UINT length = 0;
+                INT s = table.Decode(m_bits, &length);
+                if (s >= 0)
+                {
+                    m_bits >>= length;
+                    m_count -= length;
+                }
+                return s;
+            }
+
+            bool Stored()
+            {
+                Bits(m_count & 7);
+
+                UINT len = Bits(16);
+                UINT nlen = Bits(16);
+                if ((len ^ 0xFFFF) != nlen || len > m_size - m_pos)
+                    return false;
+
+                //! the real bytes still in the bit buffer first, whole bytes by now
+                while (len && m_count / 8 > m_padding)
+                {
+                    m_out[m_pos++] = (BYTE)m_bits;
+                    m_bits >>= 8;
+                    m_count -= 8;
+                    --len;
+                }
+
+                if ((SIZE_T)(m_end - m_in) < len)
+                    return false;
+
+                ::memcpy(m_out + m_pos, m_in, len);
+                m_in += len;
+                m_pos += len;
+                return true;
+            }
+
+            bool FixedTables()
+            {
+                BYTE lengths[288];
+                ::memset(lengths, 8, 144);
+                ::memset(lengths + 144, 9, 112);
+                ::memset(lengths + 256, 7, 24);
+                ::memset(lengths + 280, 8, 8);
+                if (!m_literals.Build(lengths, 288))
+                    return false;
+
+                ::memset(lengths, 5, 30);
+                return m_distances.Build(lengths, 30);
+            }
+
+            bool DynamicTables()
+            {
+                static const BYTE order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+                UINT literals = Bits(5) + 257;
+                UINT distances = Bits(5) + 1;
+                UINT codes = Bits(4) + 4;
+                if (literals > 286 || distances > 30)
+                    return false;
+
+                BYTE codeLengths[19] = { 0 };
+                for (UINT i = 0; i != codes; ++i)
+                    codeLengths[order[i]] = (BYTE)Bits(3);
+
+                InflateTable codeTable;
+                if (!codeTable.Build(codeLengths, 19))
+                    return false;
+
+                BYTE lengths[286 + 30];
+                UINT n = 0, total = literals + distances;
+                while (n < total)
+                {
+                    INT s = Symbol(codeTable);
+                    if (s < 0)
+                        return false;
+
+                    if (s < 16)
+                    {
+                        lengths[n++] = (BYTE)s;
+                        continue;
+                    }
+
+                    BYTE fill = 0;
+                    UINT repeat = 0;
+                    if (16 == s)
+                    {
+                        if (!n)
+                            return false;
+                        fill = lengths[n - 1];
+                        repeat = 3 + Bits(2);
+                    }
+                    else if (17 == s)
+                    {
+                        repeat = 3 + Bits(3);
+                    }
+                    else
+                    {
+                        repeat = 11 + Bits(7);
+                    }
+
+                    if (repeat > total - n)
+                        return false;
+
+                    ::memset(lengths + n, fill, repeat);
+                    n += repeat;
+                }
+
+                if (!lengths[256])
+                    return false;
+
+                return m_literals.Build(lengths, literals) && m_distances.Build(lengths + literals, distances);
+            }
+
+            bool Codes()
+            {
+                static const WORD lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+                static const BYTE lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+                static const WORD distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+                static const BYTE distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+                for (;;)
+                {
+                    INT s = Symbol(m_literals);
+                    if (s < 0)
+                        return false;
+
+                    if (s < 256)
+                    {
+                        if (m_pos == m_size)
+                            return false;
+                        m_out[m_pos++] = (BYTE)s;
+                        continue;
+                    }
+
+                    if (256 == s)
+                        return true;
+
+                    s -= 257;
+                    if (s >= 29)
+                        return false;
+                    UINT length = lengthBase[s] + Bits(lengthExtra[s]);
+
+                    INT d = Symbol(m_distances);
+                    if (d < 0 || d >= 30)
+                        return false;
+                    UINT distance = distanceBase[d] + Bits(distanceExtra[d]);
+
+                    if (distance > m_pos || length > m_size - m_pos)
+                        return false;
+
+                    PBYTE out = m_out + m_pos;
+                    const BYTE *from = out - distance;
+                    if (1 == distance)
+                    {
+                        ::memset(out, *from, length);
+                    }
+                    else
+                    {
+                        //! overlapping runs repeat the pattern, byte by byte
+                        for (UINT i = 0; i != length; ++i)
+                            out[i] = from[i];
+                    }
+                    m_pos += length;
+                }
+            }
+        };
+
+        //! PNG: every colour type and bit depth, tRNS, Adam7; gamma and colour chunks are not applied, CRCs not checked
+
+        enum PngColor
+        {
+            PngGray = 0, PngRGB = 2, PngPalette = 3, PngGrayAlpha = 4, PngRGBA = 6,
+        };
+
+        struct PngHeader
+        {
+            UINT width;
+            UINT height;
+            UINT depth;
+            UINT color;
+            bool interlaced;
+
+            UINT channels;
+            UINT bytesPerPixel;     //! filter distance, at least 1
+
+            bool hasKey;            //! tRNS of gray or rgb images
+            UINT key[3];
+            DWORD palette[256];     //! straight BGRA, tRNS applied
+
+            SIZE_T RowBytes(UINT w) const { return ((SIZE_T)w * channels * depth + 7) / 8; }
+        };
+
+        static inline BYTE Paeth(INT a, INT b, INT c)
+        {
+            INT p = a + b - c;
+            INT pa = p > a ? p - a : a - p;
+            INT pb = p > b ? p - b : b - p;
+            INT pc = p > c ? p - c : c - p;
+
+            if (pa <= pb && pa <= pc)
+                return (BYTE)a;
+            return (BYTE)(pb <= pc ? b : c);
+        }
+
+        //! row starts with its filter byte, prior is the unfiltered row above (zeros for the first)
+        static bool Unfilter(PBYTE row, const BYTE *prior, SIZE_T bytes, UINT bpp)
+        {
+            BYTE filter = *row++;
+            switch (filter)
+            {
+            case 0:
+                break;
+            case 1:
+                for (SIZE_T i = bpp; i < bytes; ++i)
+                    row[i] = (BYTE)(row[i] + row[i - bpp]);
+                break;
+            case 2:
+                for (SIZE_T i = 0; i != bytes; ++i)
+                    row[i] = (BYTE)(row[i] + prior[i]);
+                break;
+            case 3:
+                for (SIZE_T i = 0; i != bytes; ++i)
+                    row[i] = (BYTE)(row[i] + (((i >= bpp ? row[i - bpp] : 0) + prior[i]) >> 1));
+                break;
+            case 4:
+                for (SIZE_T i = 0; i != bytes; ++i)
+                {
+                    INT a = i >= bpp ? row[i - bpp] : 0;
+                    INT c = i >= bpp ? prior[i - bpp] : 0;
+                    row[i] = (BYTE)(row[i] + Paeth(a, prior[i], c));
+                }
+                break;
+            default:
+                return false;
+            }
+
+            return true;
+        }
+
+        //! i-th sample of an unfiltered row, any depth
+        static inline UINT Sample(const BYTE *row, UINT depth, SIZE_T i)
+        {
+            switch (depth)
+            {
+            case 8: return row[i];
+            case 16: return Read16BE(row + i * 2);
+            default:
+                {
+                    SIZE_T bit = i * depth;
+                    return (row[bit >> 3] >> (8 - depth - (bit & 7))) & ((1u << depth) - 1);
+                }
+            }
+        }
+
+        //! one unfiltered row to straight BGRA
+        static void ConvertRow(const PngHeader& h, const Pixel::Kernels& kernels, const BYTE *row, DWORD *dst, UINT count)
+        {
+            if (PngRGBA == h.color && 8 == h.depth)
+            {
+                kernels.swizzle(dst, (const DWORD *)row, count);
+                return;
+            }
+
+            //! samples to 8 bits: low depths scale up, 16 keeps the high byte
+            UINT depth = h.depth;
+            UINT scale = 1 == depth ? 255 : 2 == depth ? 85 : 4 == depth ? 17 : 1;
+            UINT shift = 16 == depth ? 8 : 0;
+
+            switch (h.color)
+            {
+            case PngGray:
+                for (UINT x = 0; x != count; ++x)
+                {
+                    UINT s = Sample(row, depth, x);
+                    DWORD g = (s >> shift) * scale;
+                    DWORD a = h.hasKey && s == h.key[0] ? 0 : 0xFF000000;
+                    dst[x] = a | g << 16 | g << 8 | g;
+                }
+                break;
+            case PngRGB:
+                for (UINT x = 0; x != count; ++x)
+                {
+                    UINT r = Sample(row, depth, x * 3), g = Sample(row, depth, x * 3 + 1), b = Sample(row, depth, x * 3 + 2);
+                    DWORD a = h.hasKey && r == h.key[0] && g == h.key[1] && b == h.key[2] ? 0 : 0xFF000000;
+                    dst[x] = a | (r >> shift) << 16 | (g >> shift) << 8 | (b >> shift);
+                }
+                break;
+            case PngPalette:
+                for (UINT x = 0; x != count; ++x)
+                    dst[x] = h.palette[Sample(row, depth, x)];
+                break;
+            case PngGrayAlpha:
+                for (UINT x = 0; x != count; ++x)
+                {
+                    DWORD g = Sample(row, depth, x * 2) >> shift;
+                    DWORD a = Sample(row, depth, x * 2 + 1) >> shift;
+                    dst[x] = a << 24 | g << 16 | g << 8 | g;
+                }
+                break;
+            default:
+                for (UINT x = 0; x != count; ++x)
+                {
+                    DWORD r = Sample(row, depth, x * 4) >> shift, g = Sample(row, depth, x * 4 + 1) >> shift;
+                    DWORD b = Sample(row, depth, x * 4 + 2) >> shift, a = Sample(row, depth, x * 4 + 3) >> shift;
+                    dst[x] = a << 24 | r << 16 | g << 8 | b;
+                }
+                break;
+            }
+        }
+
+        static bool ValidDepth(UINT color, UINT depth)
+        {
+            switch (color)
+            {
+            case PngGray: return 1 == depth || 2 == depth || 4 == depth || 8 == depth || 16 == depth;
+            case PngPalette: return 1 == depth || 2 == depth || 4 == depth || 8 == depth;
+            case PngRGB:
+            case PngGrayAlpha:
+            case PngRGBA: return 8 == depth || 16 == depth;
+            default: return false;
+            }
+        }
+
+        bool DecodePNG(const BYTE *data, SIZE_T size, Image *nullImage)
+        {
+            PngHeader h;
+            ::memset(&h, 0, sizeof(h));
+            for (UINT i = 0; i != 256; ++i)
+                h.palette[i] = 0xFF000000;
+
+            //! the chunks, IDAT concatenated only when there is more than one
+            const BYTE *idat = NULL;
+            SIZE_T idatSize = 0;
+            std::vector<BYTE> joined;
+            bool header = false, paletteSeen = false, alpha = false;
+
+            const BYTE *p = data + 8, *end = data + size;
+            while (end - p >= 12)
+            {
+                UINT length = Read32BE(p);
+                const BYTE *type = p + 4, *chunk = p + 8;
+                if (length > (SIZE_T)(end - chunk) - 4)
+                    return false;
+                p = chunk + length + 4;
+
+                if (0 == ::memcmp(type, "IHDR", 4))
+                {
+                    if (13 != length)
+                        return false;
+
+                    h.width = Read32BE(chunk);
+                    h.height = Read32BE(chunk + 4);
+                    h.depth = chunk[8];
+                    h.color = chunk[9];
+                    h.interlaced = 1 == chunk[12];
+
+                    if (chunk[10] || chunk[11] || chunk[12] > 1 || !ValidDepth(h.color, h.depth))
+                        return false;
+
+                    h.channels = PngRGB == h.color ? 3 : PngGrayAlpha == h.color ? 2 : PngRGBA == h.color ? 4 : 1;
+                    h.bytesPerPixel = (h.channels * h.depth + 7) / 8;
+                    alpha = PngGrayAlpha == h.color || PngRGBA == h.color;
+                    header = true;
+                }
+                else if (!header)
+                {
+                    return false;
+                }
+                else if (0 == ::memcmp(type, "PLTE", 4))
+                {
+                    if (length % 3 || length > 768)
+                        return false;
+
+                    for (UINT i = 0; i != length / 3; ++i)
+                        h.palette[i] = 0xFF000000 | (chunk[i * 3] << 16) | (chunk[i * 3 + 1] << 8) | chunk[i * 3 + 2];
+                    paletteSeen = true;
+                }
+                else if (0 == ::memcmp(type, "tRNS", 4))
+                {
+                    if (PngPalette == h.color)
+                    {
+                        if (length > 256)
+                            return false;
+                        for (UINT i = 0; i != length; ++i)
+                            h.palette[i] = (h.palette[i] & 0x00FFFFFF) | ((DWORD)chunk[i] << 24);
+                    }
+                    else if (PngGray == h.color && 2 == length)
+                    {
+                        h.key[0] = Read16BE(chunk);
+                        h.hasKey = true;
+                    }
+                    else if (PngRGB == h.color && 6 == length)
+                    {
+                        h.key[0] = Read16BE(chunk);
+                        h.key[1] = Read16BE(chunk + 2);
+                        h.key[2] = Read16BE(chunk + 4);
+                        h.hasKey = true;
+                    }
+                    alpha = true;
+                }
+                else if (0 == ::memcmp(type, "IDAT", 4))
+                {
+                    if (!idat)
+                    {
+                        idat = chunk;
+                        idatSize = length;
+                    }
+                    else
+                    {
+                        if (joined.empty())
+                            joined.assign(idat, idat + idatSize);
+                        joined.insert(joined.end(), chunk, chunk + length);
+                    }
+                }
+                else if (0 == ::memcmp(type, "IEND", 4))
+                {
+                    break;
+                }
+                else if (!(type[0] & 0x20))
+                {
+                    //! unknown critical chunk
+                    return false;
+                }
+            }
+
+            if (!header || !idat || (PngPalette == h.color && !paletteSeen))
+                return false;
+
+            if (!joined.empty())
+            {
+                idat = &joined[0];
+                idatSize = joined.size();
+            }
+
+            if (h.width > (1u << 24) || h.height > (1u << 24))
+                return false;
+            if (!AllocateImage(nullImage, (LONG)h.width, (LONG)h.height))
+                return false;
+
+            //! the passes, one covering the image when not interlaced
+            static const BYTE adam7[7][4] = { { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+            static const BYTE whole[1][4] = { { 0, 0, 1, 1 } };
+            const BYTE (*passes)[4] = h.interlaced ? adam7 : whole;
+            UINT passCount = h.interlaced ? 7 : 1;
+
+            SIZE_T raw = 0;
+            for (UINT i = 0; i != passCount; ++i)
+            {
+                UINT pw = (h.width - passes[i][0] + passes[i][2] - 1) / passes[i][2];
+                UINT ph = (h.height - passes[i][1] + passes[i][3] - 1) / passes[i][3];
+                if (h.width > passes[i][0] && h.height > passes[i][1])
+                    raw += (SIZE_T)ph * (1 + h.RowBytes(pw));
+            }
+
+            std::vector<BYTE> pixels(raw);
+            Inflater inflater(idat, idatSize, &pixels[0], raw);
+            if (!inflater.Run() || inflater.GetSize() != raw)
+                return false;
+
+            const Pixel::Kernels& kernels = Pixel::GetKernels();
+            RowWriter writer(nullImage, alpha);
+            std::vector<BYTE> zeros(h.RowBytes(h.width));
+            std::vector<DWORD> scattered;
+
+            PBYTE row = &pixels[0];
+            for (UINT i = 0; i != passCount; ++i)
+            {
+                if (h.width <= passes[i][0] || h.height <= passes[i][1])
+                    continue;
+
+                UINT x0 = passes[i][0], y0 = passes[i][1], dx = passes[i][2], dy = passes[i][3];
+                UINT pw = (h.width - x0 + dx - 1) / dx;
+                UINT ph = (h.height - y0 + dy - 1) / dy;
+                SIZE_T bytes = h.RowBytes(pw);
+                const BYTE *prior = &zeros[0];
+
+                if (h.interlaced)
+                    scattered.resize(pw);
+
+                for (UINT y = 0; y != ph; ++y, row += 1 + bytes)
+                {
+                    if (!Unfilter(row, prior, bytes, h.bytesPerPixel))
+                        return false;
+                    prior = row + 1;
+
+                    if (!h.interlaced)
+                    {
+                        ConvertRow(h, kernels, row + 1, writer.GetRow(y), pw);
+                        writer.Commit(y);
+                        continue;
+                    }
+
+                    ConvertRow(h, kernels, row + 1, &scattered[0], pw);
+                    DWORD *dst = writer.GetRow(y0 + y * dy);
+                    for (UINT x = 0; x != pw; ++x)
+                        dst[x0 + x * dx] = scattered[x];
+                }
+            }
+
+            //! interlaced rows are complete only after the last pass
+            if (h.interlaced)
+            {
+                for (UINT y = 0; y != h.height; ++y)
+                    writer.Commit(y);
+            }
+
+            writer.Finish();
+            return true;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "PipelinedSurface.h"
+
+namespace Render
+{
+    PipelinedSurface::PipelinedSurface(UINT depth)
+        : m_slots()
+        , m_next(0)
+        , m_drawing(NULL)
+        , m_frame(0)
+        , m_flushed(NULL)
+        , m_param(NULL)
+        , m_lock()
+        , m_queued()
+        , m_freed()
+        , m_pending()
+        , m_stop(false)
+        , m_worker()
+    {
+        depth = min(max(depth, 1u), (UINT)MaxDepth);
+        for (UINT i = 0; i != depth; ++i)
+        {
+            Slot *slot = new Slot();
+            slot->out = NULL;
+            slot->frame = 0;
+            slot->attached = false;
+            slot->busy = false;
+            m_slots.push_back(slot);
+        }
+
+        m_worker = std::thread(&PipelinedSurface::WorkerLoop, this);
+    }
+
+    PipelinedSurface::~PipelinedSurface()
+    {
+        WaitIdle();
+
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_stop = true;
+        }
+        m_queued.notify_all();
+        m_worker.join();
+
+        for (size_t i = 0; i != m_slots.size(); ++i)
+        {
+            delete m_slots[i];
+        }
+    }
+
+    void PipelinedSurface::SetFlushedCallback(FlushedProc proc, void *param)
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        m_flushed = proc;
+        m_param = param;
+    }
+
+    Context& PipelinedSurface::BeginFrame(PBYTE pOut, LONG iStride, LONG iWidth, LONG iHeight, UINT iFormat)
+    {
+        //! a frame left open is queued as is
+        if (m_drawing)
+            EndFrame();
+
+        Slot *slot = m_slots[m_next];
+        {
+            //! back-pressure, the oldest buffer has to come back first
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_freed.wait(lock, [slot] { return !slot->busy; });
+        }
+
+        slot->surface.Bind(pOut, iStride, iWidth, iHeight, iFormat);
+        slot->out = pOut;
+        slot->frame = m_frame++;
+
+        //! Reset re-attaches and drops the old dc, binds may have replaced the mirror
+        if (slot->attached)
+        {
+            slot->context.Reset();
+        }
+        else
+        {
+            slot->surface.InitContext(slot->context);
+            slot->attached = true;
+        }
+        slot->context.ResetDamage();
+
+        m_drawing = slot;
+        m_next = (m_next + 1) % m_slots.size();
+
+        return slot->context;
+    }
+
+    void PipelinedSurface::EndFrame()
+    {
+        if (!m_drawing)
+            return;
+
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            m_drawing->busy = true;
+            m_pending.push_back(m_drawing);
+        }
+        m_queued.notify_one();
+
+        m_drawing = NULL;
+    }
+
+    void PipelinedSurface::WaitIdle()
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_freed.wait(lock, [this] {
+            for (size_t i = 0; i != m_slots.size(); ++i)
+            {
+                if (m_slots[i]->busy)
+                    return false;
+            }
+            return true;
+        });
+    }
+
+    void PipelinedSurface::WorkerLoop()
+    {
+        for (;;)
+        {
+            Slot *slot = NULL;
+            FlushedProc flushed = NULL;
+            void *param = NULL;
+
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_queued.wait(lock, [this] { return m_stop || !m_pending.empty(); });
+
+                if (m_pending.empty())
+                    return;
+
+                slot = m_pending.front();
+                m_pending.pop_front();
+
+                flushed = m_flushed;
+                param = m_param;
+            }
+
+            slot->surface.Flush();
+            if (flushed)
+                flushed(param, slot->out, slot->frame);
+
+            {
+                std::lock_guard<std::mutex> guard(m_lock);
+                slot->busy = false;
+            }
+            m_freed.notify_all();
+        }
+    }
+}
\ No newline at end of file
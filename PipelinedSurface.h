@@ -0,0 +1,78 @@
+#pragma once
+
+#include "Context.h"
+#include "Surface.h"
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+namespace Render
+{
+    //! N RenderSurfaces in flight: the caller draws frame N+1 while a worker thread
+    //! flushes frame N to its output; BeginFrame blocks while every buffer is busy
+    class PipelinedSurface
+    {
+    public:
+        enum { DefaultDepth = 2, MaxDepth = 8 };
+
+        //! on the worker after the frame reached pOut, e.g. hand it to the encoder
+        typedef void (*FlushedProc)(void *param, PBYTE pOut, ULONGLONG frame);
+
+    private:
+        struct Slot
+        {
+            RenderSurface surface;
+            Context context;
+            PBYTE out;
+            ULONGLONG frame;
+            bool attached;
+            bool busy;
+        };
+
+    private:
+        std::vector<Slot *> m_slots;
+        UINT m_next;            //! slot BeginFrame hands out next, round robin keeps frames in order
+        Slot *m_drawing;
+        ULONGLONG m_frame;
+
+        FlushedProc m_flushed;
+        void *m_param;
+
+        std::mutex m_lock;
+        std::condition_variable m_queued;
+        std::condition_variable m_freed;
+        std::deque<Slot *> m_pending;
+        bool m_stop;
+
+        std::thread m_worker;
+
+    public:
+        //! 2 is double buffering, 3 triple
+        explicit PipelinedSurface(UINT depth = DefaultDepth);
+        ~PipelinedSurface();
+
+    public:
+        //! set before the first frame
+        void SetFlushedCallback(FlushedProc proc, void *param);
+
+        //! waits for a free buffer and binds it to this frame's output, draw through the returned context
+        Context& BeginFrame(PBYTE pOut, LONG iStride, LONG iWidth, LONG iHeight, UINT iFormat);
+        //! queues the flush and returns at once
+        void EndFrame();
+        //! until every queued frame is flushed
+        void WaitIdle();
+
+    public:
+        UINT GetDepth() const { return (UINT)m_slots.size(); }
+
+    private:
+        void WorkerLoop();
+
+    private:
+        PipelinedSurface(const PipelinedSurface&);
+        PipelinedSurface& operator = (const PipelinedSurface&);
+    };
+}
\ No newline at end of file
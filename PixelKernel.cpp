@@ -0,0 +1,739 @@
+#include "PixelKernelISA.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <atomic>
+
+#if PIXEL_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace Render
+{
+    namespace Pixel
+    {
+        static inline DWORD BlendPixel(DWORD s, DWORD d, UINT k)
+        {
+            UINT ik = 255 - k;
+            s |= 0xFF000000;
+
+            return Div255((s & 0xFF) * k + (d & 0xFF) * ik)
+                | Div255(((s >> 8) & 0xFF) * k + ((d >> 8) & 0xFF) * ik) << 8
+                | Div255(((s >> 16) & 0xFF) * k + ((d >> 16) & 0xFF) * ik) << 16
+                | Div255((s >> 24) * k + (d >> 24) * ik) << 24;
+        }
+
+        static void BlendConstAlphaRow_Scalar(DWORD *dst, const DWORD *src, UINT count, BYTE alpha)
+        {
+            for (UINT i = 0; i != count; ++i)
+                dst[i] = BlendPixel(src[i], dst[i], alpha);
+        }
+
+        static void BlendPixelAlphaRow_Scalar(DWORD *dst, const DWORD *src, UINT count, BYTE)
+        {
+            for (UINT i = 0; i != count; ++i)
+            {
+                UINT k = src[i] >> 24;
+                if (255 == k)
+                    dst[i] = src[i];
+                else if (k)
+                    dst[i] = BlendPixel(src[i], dst[i], k);
+            }
+        }
+
+        static void BlendCombinedAlphaRow_Scalar(DWORD *dst, const DWORD *src, UINT count, BYTE alpha)
+        {
+            for (UINT i = 0; i != count; ++i)
+            {
+                UINT k = Div255((src[i] >> 24) * alpha);
+                if (k)
+                    dst[i] = BlendPixel(src[i], dst[i], k);
+            }
+        }
+
+        static void BlendPremultipliedRow_Scalar(DWORD *dst, const DWORD *src, UINT count, BYTE alpha)
+        {
+            for (UINT i = 0; i != count; ++i)
+            {
+                DWORD s = src[i], d = dst[i];
+                if (!s)
+                    continue;
+
+                UINT ik = 255 - Div255((s >> 24) * alpha);
+                DWORD r = 0;
+                for (UINT shift = 0; shift != 32; shift += 8)
+                    r |= min(255u, Div255(((s >> shift) & 0xFF) * alpha) + Div255(((d >> shift) & 0xFF) * ik)) << shift;
+
+                dst[i] = r;
+            }
+        }
+
+        static void FillRow_Scalar(DWORD *dst, UINT count, DWORD color)
+        {
+            for (UINT i = 0; i != count; ++i)
+                dst[i] = color;
+        }
+
+        static void CopyRow_Scalar(DWORD *dst, const DWORD *src, UINT count)
+        {
+            ::memmove(dst, src, count * sizeof(DWORD));
+        }
+
+        static void SwizzleRow_Scalar(DWORD *dst, const DWORD *src, UINT count)
+        {
+            for (UINT i = 0; i != count; ++i)
+            {
+                DWORD p = src[i];
+                dst[i] = (p & 0xFF00FF00) | ((p >> 16) & 0xFF) | ((p & 0xFF) << 16);
+            }
+        }
+
+        static void ScaleRow_Scalar(DWORD *dst, UINT count, const DWORD *src, UINT x, UINT dx)
+        {
+            for (UINT i = 0; i != count; ++i, x += dx)
+                dst[i] = src[x >> 16];
+        }
+
+        static void BlendMaskRow_Scalar(DWORD *dst, const BYTE *mask, UINT count, DWORD color, BYTE alpha)
+        {
+            for (UINT i = 0; i != count; ++i)
+            {
+                UINT k = Div255(mask[i] * alpha);
+                if (k)
+                    dst[i] = BlendPixel(color, dst[i], k);
+            }
+        }
+
+        static BYTE PremultiplyRow_Scalar(DWORD *dst, const DWORD *src, UINT count)
+        {
+            DWORD opaque = 0xFF;
+            for (UINT i = 0; i != count; ++i)
+            {
+                DWORD p = src[i];
+                UINT a = p >> 24;
+                opaque &= a;
+
+                dst[i] = Div255((p & 0xFF) * a) | Div255(((p >> 8) & 0xFF) * a) << 8 | Div255(((p >> 16) & 0xFF) * a) << 16 | (p & 0xFF000000);
+            }
+
+            return (BYTE)opaque;
+        }
+
+        //! y * (255 - a) / 255 plus the pixel's own luma, p is premultiplied
+        static inline UINT LumaOver(DWORD p, UINT y)
+        {
+            UINT a = p >> 24;
+            UINT t = (66 * ((p >> 16) & 0xFF) + 129 * ((p >> 8) & 0xFF) + 25 * (p & 0xFF) + 16 * a + 128) >> 8;
+
+            return min(255u, t + Div255(y * (255 - a)));
+        }
+
+        static void BlendLumaRow_Scalar(BYTE *y, UINT step, const DWORD *src, UINT count)
+        {
+            for (UINT i = 0; i != count; ++i, y += step)
+            {
+                if (src[i])
+                    *y = (BYTE)LumaOver(src[i], *y);
+            }
+        }
+
+        static void BlendChromaRow_Scalar(BYTE *u, BYTE *v, UINT step, const DWORD *src0, const DWORD *src1, UINT count)
+        {
+            for (UINT i = 0; i != count; ++i, u += step, v += step)
+            {
+                DWORD p[4] = { src0[2 * i], src0[2 * i + 1], src1[2 * i], src1[2 * i + 1] };
+                if (!(p[0] | p[1] | p[2] | p[3]))
+                    continue;
+
+                //! channel averages of the 2x2 block, rounded
+                INT c[4] = { 2, 2, 2, 2 };
+                for (int j = 0; j != 4; ++j)
+                {
+                    for (int n = 0; n != 4; ++n)
+                        c[n] += (p[j] >> (n * 8)) & 0xFF;
+                }
+                INT b = c[0] >> 2, g = c[1] >> 2, r = c[2] >> 2, a = c[3] >> 2;
+
+                INT tu = 112 * b - 74 * g - 38 * r + 128 * a + 128;
+                INT tv = -18 * b - 94 * g + 112 * r + 128 * a + 128;
+                UINT ia = 255 - a;
+
+                *u = (BYTE)min(255u, (tu > 0 ? (UINT)tu >> 8 : 0) + Div255(*u * ia));
+                *v = (BYTE)min(255u, (tv > 0 ? (UINT)tv >> 8 : 0) + Div255(*v * ia));
+            }
+        }
+
+        //! (c * 2^14 + 2^13) >> 14 with R = Y + 1.402 Cr, G = Y - 0.714 Cr - 0.344 Cb, B = Y + 1.772 Cb
+        static void YCbCrRow_Scalar(DWORD *dst, const BYTE *y, const BYTE *cb, const BYTE *cr, UINT count)
+        {
+            for (UINT i = 0; i != count; ++i)
+            {
+                INT base = (y[i] << 14) + 8192;
+                INT u = cb[i] - 128, v = cr[i] - 128;
+
+                INT r = (base + v * 22970) >> 14;
+                INT g = (base - v * 11700 - u * 5638) >> 14;
+                INT b = (base + u * 29032) >> 14;
+
+                r = r < 0 ? 0 : r > 255 ? 255 : r;
+                g = g < 0 ? 0 : g > 255 ? 255 : g;
+                b = b < 0 ? 0 : b > 255 ? 255 : b;
+
+                dst[i] = 0xFF000000 | (DWORD)r << 16 | (DWORD)g << 8 | (DWORD)b;
+            }
+        }
+
+        //! (sum + 2^13) >> 14 per channel, clamped
+        static inline DWORD PackResampled(const INT *c)
+        {
+            DWORD r = 0;
+            for (UINT n = 0; n != 4; ++n)
+            {
+                INT v = (c[n] + (1 << 13)) >> 14;
+                r |= (DWORD)(v < 0 ? 0 : v > 255 ? 255 : v) << (n * 8);
+            }
+
+            return r;
+        }
+
+        static void ResampleRow_Scalar(DWORD *dst, UINT count, const DWORD *src, const INT *start, const SHORT *weight, UINT taps)
+        {
+            for (UINT i = 0; i != count; ++i, weight += taps)
+            {
+                const DWORD *s = src + start[i];
+                INT c[4] = { 0, 0, 0, 0 };
+
+                for (UINT t = 0; t != taps; ++t)
+                {
+                    for (UINT n = 0; n != 4; ++n)
+                        c[n] += (INT)((s[t] >> (n * 8)) & 0xFF) * weight[t];
+                }
+
+                dst[i] = PackResampled(c);
+            }
+        }
+
+        static void ResampleColumn_Scalar(DWORD *dst, UINT count, const DWORD *src, INT srcStride, const SHORT *weight, UINT taps)
+        {
+            for (UINT i = 0; i != count; ++i)
+            {
+                const BYTE *row = (const BYTE *)(src + i);
+                INT c[4] = { 0, 0, 0, 0 };
+
+                for (UINT t = 0; t != taps; ++t, row += srcStride)
+                {
+                    DWORD p = *(const DWORD *)row;
+                    for (UINT n = 0; n != 4; ++n)
+                        c[n] += (INT)((p >> (n * 8)) & 0xFF) * weight[t];
+                }
+
+                dst[i] = PackResampled(c);
+            }
+        }
+
+        static inline DWORD SamplePixel(const DWORD *src, INT srcStride, INT srcWidth, INT srcHeight, INT x, INT y, DWORD alphaOr)
+        {
+            if ((UINT)x >= (UINT)srcWidth || (UINT)y >= (UINT)srcHeight)
+                return 0;
+
+            return *(const DWORD *)((const BYTE *)src + y * srcStride + x * 4) | alphaOr;
+        }
+
+        static void SampleBilinearRow_Scalar(DWORD *dst, UINT count, const DWORD *src, INT srcStride, INT srcWidth, INT srcHeight,
+            INT u, INT v, INT du, INT dv, DWORD alphaOr)
+        {
+            for (UINT i = 0; i != count; ++i, u += du, v += dv)
+            {
+                INT x = u >> 16, y = v >> 16;
+                UINT fx = (u >> 9) & 0x7F, fy = (v >> 9) & 0x7F;
+
+                DWORD p00 = SamplePixel(src, srcStride, srcWidth, srcHeight, x, y, alphaOr);
+                DWORD p01 = SamplePixel(src, srcStride, srcWidth, srcHeight, x + 1, y, alphaOr);
+                DWORD p10 = SamplePixel(src, srcStride, srcWidth, srcHeight, x, y + 1, alphaOr);
+                DWORD p11 = SamplePixel(src, srcStride, srcWidth, srcHeight, x + 1, y + 1, alphaOr);
+
+                //! rows first within 15 bits, then the two rows to 14 bits of fraction
+                DWORD r = 0;
+                for (UINT shift = 0; shift != 32; shift += 8)
+                {
+                    UINT top = ((p00 >> shift) & 0xFF) * (128 - fx) + ((p01 >> shift) & 0xFF) * fx;
+                    UINT bottom = ((p10 >> shift) & 0xFF) * (128 - fx) + ((p11 >> shift) & 0xFF) * fx;
+                    r |= ((top * (128 - fy) + bottom * fy + (1 << 13)) >> 14) << shift;
+                }
+
+                dst[i] = r;
+            }
+        }
+
+        void InitKernels_Scalar(Kernels& k)
+        {
+            k.blend[BlendConstAlpha] = BlendConstAlphaRow_Scalar;
+            k.blend[BlendPixelAlpha] = BlendPixelAlphaRow_Scalar;
+            k.blend[BlendCombinedAlpha] = BlendCombinedAlphaRow_Scalar;
+            k.blend[BlendPremultiplied] = BlendPremultipliedRow_Scalar;
+            k.fill = FillRow_Scalar;
+            k.copy = CopyRow_Scalar;
+            k.swizzle = SwizzleRow_Scalar;
+            k.scaleNearest = ScaleRow_Scalar;
+            k.blendMask = BlendMaskRow_Scalar;
+            k.premultiply = PremultiplyRow_Scalar;
+            k.blendLuma = BlendLumaRow_Scalar;
+            k.blendChroma = BlendChromaRow_Scalar;
+            k.ycbcr = YCbCrRow_Scalar;
+            k.resampleRow = ResampleRow_Scalar;
+            k.resampleColumn = ResampleColumn_Scalar;
+            k.sampleBilinear = SampleBilinearRow_Scalar;
+        }
+
+        CpuLevel DetectCpuLevel()
+        {
+#if PIXEL_X86
+            int regs[4] = { 0 };
+#if defined(_MSC_VER)
+            __cpuid(regs, 1);
+#else
+            __cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+            if (!(regs[3] & (1 << 26)))
+                return CpuScalar;
+
+            if (!(regs[2] & (1 << 9)))
+                return CpuSSE2;
+
+            //! wider levels need osxsave + avx, and the os must save the vector state
+            if (!(regs[2] & (1 << 27)) || !(regs[2] & (1 << 28)))
+                return CpuSSSE3;
+
+#if defined(_MSC_VER)
+            unsigned long long xcr0 = _xgetbv(0);
+#else
+            unsigned int eax, edx;
+            __asm__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+            unsigned long long xcr0 = ((unsigned long long)edx << 32) | eax;
+#endif
+            if (0x6 != (xcr0 & 0x6))
+                return CpuSSSE3;
+
+#if defined(_MSC_VER)
+            __cpuidex(regs, 7, 0);
+#else
+            __cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+            if (!(regs[1] & (1 << 5)))
+                return CpuSSSE3;
+
+            //! avx512f and avx512bw, opmask + zmm state enabled
+            if ((regs[1] & (1 << 16)) && (regs[1] & (1 << 30)) && 0xE6 == (xcr0 & 0xE6))
+                return CpuAVX512;
+
+            return CpuAVX2;
+#else
+            return CpuScalar;
+#endif
+        }
+
+        static const char *s_levelNames[CpuLevelCount] = { "scalar", "sse2", "ssse3", "avx2", "avx512" };
+
+        const char *GetCpuLevelName(CpuLevel level)
+        {
+            return (level >= 0 && level < CpuLevelCount) ? s_levelNames[level] : "unknown";
+        }
+
+        CpuLevel ParseCpuLevel(const char *name, CpuLevel fallback)
+        {
+            if (name)
+            {
+                for (int i = 0; i != CpuLevelCount; ++i)
+                {
+                    if (0 == ::strcmp(name, s_levelNames[i]))
+                        return (CpuLevel)i;
+                }
+            }
+
+            return fallback;
+        }
+
+        class Dispatcher
+        {
+        public:
+            Kernels tables[CpuLevelCount];
+            CpuLevel supported;
+            //! SetCpuLevel may swap it while other threads draw, the tables themselves never change
+            std::atomic<const Kernels *> active;
+
+        public:
+            Dispatcher()
+                : supported(DetectCpuLevel())
+                , active(NULL)
+            {
+                typedef void(*InitProc)(Kernels&);
+                static const InitProc inits[CpuLevelCount] =
+                {
+                    InitKernels_Scalar, InitKernels_SSE2, InitKernels_SSSE3, InitKernels_AVX2, InitKernels_AVX512
+                };
+
+                //! every level starts from the one below, so missing slots fall back
+                for (int i = 0; i != CpuLevelCount; ++i)
+                {
+                    if (i)
+                        tables[i] = tables[i - 1];
+                    tables[i].level = (CpuLevel)i;
+                    inits[i](tables[i]);
+                }
+
+                CpuLevel level = supported;
+
+                const char *pinned = ::getenv("SIMPLE_CANVAS_CPU");
+                if (pinned)
+                    level = min(level, ParseCpuLevel(pinned, level));
+
+                const char *selfTest = ::getenv("SIMPLE_CANVAS_SELFTEST");
+                if (selfTest && '1' == selfTest[0])
+                {
+                    while (level > CpuScalar && !SelfTestTable(tables[level], 1))
+                        level = (CpuLevel)(level - 1);
+                }
+
+                active = &tables[level];
+            }
+
+        public:
+            bool SelfTestTable(const Kernels& k, UINT seed) const;
+        };
+
+        static Dispatcher& GetDispatcher()
+        {
+            static Dispatcher dispatcher;
+            return dispatcher;
+        }
+
+        const Kernels *GetKernels(CpuLevel level)
+        {
+            Dispatcher& d = GetDispatcher();
+            if (level < 0 || level > d.supported)
+                return NULL;
+
+            return &d.tables[level];
+        }
+
+        const Kernels& GetKernels()
+        {
+            return *GetDispatcher().active.load();
+        }
+
+        bool SetCpuLevel(CpuLevel level)
+        {
+            Dispatcher& d = GetDispatcher();
+            if (level < 0 || level > d.supported)
+                return false;
+
+            d.active = &d.tables[level];
+            return true;
+        }
+
+        //! xorshift, deterministic per seed
+        class TestRandom
+        {
+        private:
+            UINT m_state;
+
+        public:
+            explicit TestRandom(UINT seed) : m_state(seed ? seed : 0x9E3779B9) {}
+
+        public:
+            UINT Next()
+            {
+                m_state ^= m_state << 13;
+                m_state ^= m_state >> 17;
+                m_state ^= m_state << 5;
+                return m_state;
+            }
+
+            //! pixels with a good share of fully transparent and fully opaque alpha
+            DWORD NextPixel()
+            {
+                DWORD p = Next();
+                switch (Next() & 3)
+                {
+                case 0: return p & 0x00FFFFFF;
+                case 1: return p | 0xFF000000;
+                default: return p;
+                }
+            }
+        };
+
+        bool Dispatcher::SelfTestTable(const Kernels& k, UINT seed) const
+        {
+            const Kernels& ref = tables[CpuScalar];
+            TestRandom rnd(seed);
+
+            const UINT maxCount = 300;
+            std::vector<DWORD> src(maxCount + 16), dst(maxCount + 16), expected(maxCount + 16);
+            std::vector<BYTE> mask(maxCount + 16);
+
+            for (UINT round = 0; round != 200; ++round)
+            {
+                UINT count = rnd.Next() % maxCount;
+                UINT offset = rnd.Next() % 16;     //! misaligned rows too
+
+                for (size_t i = 0; i != src.size(); ++i)
+                {
+                    src[i] = rnd.NextPixel();
+                    dst[i] = rnd.NextPixel();
+                    mask[i] = (BYTE)(rnd.NextPixel() >> 24);
+                }
+
+                BYTE alpha = (BYTE)rnd.Next();
+
+                for (int mode = 0; mode != BlendModeCount; ++mode)
+                {
+                    expected = dst;
+                    std::vector<DWORD> actual = dst;
+
+                    ref.blend[mode](&expected[offset], &src[offset], count, alpha);
+                    k.blend[mode](&actual[offset], &src[offset], count, alpha);
+
+                    if (actual != expected)
+                        return false;
+                }
+
+                DWORD color = rnd.NextPixel();
+                expected = dst;
+                std::vector<DWORD> actual = dst;
+                ref.fill(&expected[offset], count, color);
+                k.fill(&actual[offset], count, color);
+                if (actual != expected)
+                    return false;
+
+                expected = dst;
+                actual = dst;
+                ref.copy(&expected[offset], &src[offset], count);
+                k.copy(&actual[offset], &src[offset], count);
+                if (actual != expected)
+                    return false;
+
+                expected = dst;
+                actual = dst;
+                ref.blendMask(&expected[offset], &mask[offset], count, color, alpha);
+                k.blendMask(&actual[offset], &mask[offset], count, color, alpha);
+                if (actual != expected)
+                    return false;
+
+                expected = dst;
+                actual = dst;
+                if (ref.premultiply(&expected[offset], &src[offset], count) != k.premultiply(&actual[offset], &src[offset], count))
+                    return false;
+                if (actual != expected)
+                    return false;
+
+                expected = dst;
+                actual = dst;
+                ref.swizzle(&expected[offset], &src[offset], count);
+                k.swizzle(&actual[offset], &src[offset], count);
+                if (actual != expected)
+                    return false;
+
+                //! planar (I420), paired (NV12) and packed (YUY2) steps, the planes are the bytes of dst
+                for (UINT step = 1; step <= 4; step *= 2)
+                {
+                    UINT samples = count / step;
+                    std::vector<BYTE> expectedY(mask), actualY(mask);
+                    ref.blendLuma(&expectedY[0], step, &src[offset], samples);
+                    k.blendLuma(&actualY[0], step, &src[offset], samples);
+                    if (actualY != expectedY)
+                        return false;
+
+                    expected = dst;
+                    actual = dst;
+                    UINT vOffset = 1 == step ? maxCount : 1;
+                    PBYTE e = (PBYTE)&expected[0], a = (PBYTE)&actual[0];
+                    ref.blendChroma(e, e + vOffset, step, &src[offset], &src[0], samples / 2);
+                    k.blendChroma(a, a + vOffset, step, &src[offset], &src[0], samples / 2);
+                    if (actual != expected)
+                        return false;
+                }
+
+                //! the three planes are the bytes of src
+                expected = dst;
+                actual = dst;
+                const BYTE *planes = (const BYTE *)&src[0];
+                ref.ycbcr(&expected[offset], planes + offset, planes + maxCount, planes + 2 * maxCount, count);
+                k.ycbcr(&actual[offset], planes + offset, planes + maxCount, planes + 2 * maxCount, count);
+                if (actual != expected)
+                    return false;
+
+                //! windows of up to 13 taps inside src, weights over the whole signed range
+                {
+                    UINT taps = 1 + rnd.Next() % 13;
+                    UINT samples = count / 2;
+                    std::vector<INT> start(samples + 1);
+                    std::vector<SHORT> weight((samples + 1) * taps);
+                    for (UINT i = 0; i != samples; ++i)
+                        start[i] = rnd.Next() % (maxCount - taps);
+                    for (size_t i = 0; i != weight.size(); ++i)
+                        weight[i] = (SHORT)rnd.Next();
+
+                    expected = dst;
+                    actual = dst;
+                    ref.resampleRow(&expected[offset], samples, &src[0], &start[0], &weight[0], taps);
+                    k.resampleRow(&actual[offset], samples, &src[0], &start[0], &weight[0], taps);
+                    if (actual != expected)
+                        return false;
+
+                    //! rows of the column pass overlap inside src
+                    UINT width = min(count, maxCount / 2);
+                    INT stride = (INT)((maxCount - width) / taps) * 4;
+                    expected = dst;
+                    actual = dst;
+                    ref.resampleColumn(&expected[offset], width, &src[0], stride, &weight[0], taps);
+                    k.resampleColumn(&actual[offset], width, &src[0], stride, &weight[0], taps);
+                    if (actual != expected)
+                        return false;
+                }
+
+                //! a 16 x 16 source at the start of src, lines running in and out of it in any direction
+                {
+                    INT u = (INT)(rnd.Next() % (24 << 16)) - (4 << 16);
+                    INT v = (INT)(rnd.Next() % (24 << 16)) - (4 << 16);
+                    INT du = (INT)(rnd.Next() % (1 << 17)) - (1 << 16);
+                    INT dv = (INT)(rnd.Next() % (1 << 17)) - (1 << 16);
+                    DWORD alphaOr = (rnd.Next() & 1) ? 0xFF000000 : 0;
+                    UINT samples = min(count, 64u);
+
+                    expected = dst;
+                    actual = dst;
+                    ref.sampleBilinear(&expected[offset], samples, &src[0], 16 * 4, 16, 16, u, v, du, dv, alphaOr);
+                    k.sampleBilinear(&actual[offset], samples, &src[0], 16 * 4, 16, 16, u, v, du, dv, alphaOr);
+                    if (actual != expected)
+                        return false;
+                }
+
+                //! keep (x + (count - 1) * dx) >> 16 inside src
+                if (count)
+                {
+                    UINT dx = rnd.Next() % (((maxCount - 1) << 16) / count + 1);
+                    UINT x = rnd.Next() & 0xFFFF;
+                    if (((x + (count - 1) * dx) >> 16) >= maxCount)
+                        x = 0;
+
+                    expected = dst;
+                    actual = dst;
+                    ref.scaleNearest(&expected[0], count, &src[0], x, dx);
+                    k.scaleNearest(&actual[0], count, &src[0], x, dx);
+                    if (actual != expected)
+                        return false;
+                }
+            }
+
+            return true;
+        }
+
+        bool SelfTest(CpuLevel level, UINT seed)
+        {
+            const Kernels *k = GetKernels(level);
+            if (!k)
+                return false;
+
+            return GetDispatcher().SelfTestTable(*k, seed);
+        }
+
+        void Blend(BlendMode mode, PBYTE dst, INT dstStride, const BYTE *src, INT srcStride, INT width, INT height, BYTE alpha)
+        {
+            if (width <= 0 || height <= 0)
+                return;
+
+            BlendRowProc row = GetKernels().blend[mode];
+            for (INT y = 0; y != height; ++y, dst += dstStride, src += srcStride)
+            {
+                row((DWORD *)dst, (const DWORD *)src, width, alpha);
+            }
+        }
+
+        void Fill(PBYTE dst, INT dstStride, INT width, INT height, DWORD color)
+        {
+            if (width <= 0 || height <= 0)
+                return;
+
+            FillRowProc row = GetKernels().fill;
+            for (INT y = 0; y != height; ++y, dst += dstStride)
+            {
+                row((DWORD *)dst, width, color);
+            }
+        }
+
+        void Copy(PBYTE dst, INT dstStride, const BYTE *src, INT srcStride, INT width, INT height)
+        {
+            if (width <= 0 || height <= 0)
+                return;
+
+            CopyRowProc row = GetKernels().copy;
+            for (INT y = 0; y != height; ++y, dst += dstStride, src += srcStride)
+            {
+                row((DWORD *)dst, (const DWORD *)src, width);
+            }
+        }
+
+        void Swizzle(PBYTE dst, INT dstStride, const BYTE *src, INT srcStride, INT width, INT height)
+        {
+            if (width <= 0 || height <= 0)
+                return;
+
+            SwizzleRowProc row = GetKernels().swizzle;
+            for (INT y = 0; y != height; ++y, dst += dstStride, src += srcStride)
+            {
+                row((DWORD *)dst, (const DWORD *)src, width);
+            }
+        }
+
+        void BlendMask(PBYTE dst, INT dstStride, const BYTE *mask, INT maskStride, INT width, INT height, DWORD color, BYTE alpha)
+        {
+            if (width <= 0 || height <= 0 || !alpha)
+                return;
+
+            BlendMaskRowProc row = GetKernels().blendMask;
+            for (INT y = 0; y != height; ++y, dst += dstStride, mask += maskStride)
+            {
+                row((DWORD *)dst, mask, width, color, alpha);
+            }
+        }
+
+        bool Premultiply(PBYTE dst, INT dstStride, const BYTE *src, INT srcStride, INT width, INT height)
+        {
+            if (width <= 0 || height <= 0)
+                return true;
+
+            BYTE opaque = 0xFF;
+            PremultiplyRowProc row = GetKernels().premultiply;
+            for (INT y = 0; y != height; ++y, dst += dstStride, src += srcStride)
+            {
+                opaque &= row((DWORD *)dst, (const DWORD *)src, width);
+            }
+
+            return 0xFF == opaque;
+        }
+
+        void ScaleNearest(PBYTE dst, INT dstStride, INT dstWidth, INT dstHeight,
+            const BYTE *src, INT srcStride, INT srcWidth, INT srcHeight)
+        {
+            if (dstWidth <= 0 || dstHeight <= 0 || srcWidth <= 0 || srcHeight <= 0)
+                return;
+
+            //! sample pixel centres, 16.16 fixed point
+            UINT dx = (UINT)(((unsigned long long)srcWidth << 16) / dstWidth);
+            UINT dy = (UINT)(((unsigned long long)srcHeight << 16) / dstHeight);
+            UINT x0 = dx / 2;
+            UINT y = dy / 2;
+
+            ScaleRowProc row = GetKernels().scaleNearest;
+            for (INT i = 0; i != dstHeight; ++i, dst += dstStride, y += dy)
+            {
+                row((DWORD *)dst, dstWidth, (const DWORD *)(src + (y >> 16) * srcStride), x0, dx);
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "Win32Compat.h"
+
+namespace Render
+{
+    //! 32bpp BGRA pixels owned by someone else, stride in bytes
+    struct PixelBuffer
+    {
+        PBYTE data;
+        LONG stride;
+        LONG width;
+        LONG height;
+        //! the alpha channel is read back as coverage, e.g. an overlay composited later,
+        //! so opaque draws write 255 instead of copying the source alpha
+        bool coverage;
+    };
+
+    class ThreadPool;
+
+    namespace Pixel
+    {
+        //! x / 255 rounded, exact for x in [0, 255 * 255]
+        inline UINT Div255(UINT x)
+        {
+            x += 128;
+            return (x + (x >> 8)) >> 8;
+        }
+
+        //! source-over on 32bpp BGRA, source is straight alpha unless noted
+        //! dst = src * k + dst * (255 - k) per channel, alpha channel receives the coverage k
+        enum BlendMode
+        {
+            BlendConstAlpha = 0,    //! k = alpha
+            BlendPixelAlpha,        //! k = src.a
+            BlendCombinedAlpha,     //! k = src.a * alpha / 255
+            //! premultiplied source, every channel alpha included:
+            //! dst = src * alpha / 255 + dst * (255 - src.a * alpha / 255) / 255, saturated
+            BlendPremultiplied,
+
+            BlendModeCount
+        };
+
+        enum CpuLevel
+        {
+            CpuScalar = 0,
+            CpuSSE2,
+            CpuSSSE3,
+            CpuAVX2,
+            CpuAVX512,      //! avx512f + avx512bw
+
+            CpuLevelCount
+        };
+
+        //! how Resample weighs the source pixels under an output pixel
+        //! the filters are stretched over the source when shrinking, so every pixel under the output one counts
+        enum Filter
+        {
+            FilterNearest = 0,      //! the pixel under the centre, no weighing at all
+            FilterBilinear,         //! triangle, support 1
+            FilterBox,              //! area average, support 1/2
+            FilterLanczos3,         //! windowed sinc, support 3, sharpest, rings a little at hard edges
+
+            FilterCount
+        };
+
+        typedef void (*BlendRowProc)(DWORD *dst, const DWORD *src, UINT count, BYTE alpha);
+        typedef void (*FillRowProc)(DWORD *dst, UINT count, DWORD color);
+        typedef void (*CopyRowProc)(DWORD *dst, const DWORD *src, UINT count);
+        //! swaps the 1st and 3rd byte of every pixel, RGBA <-> BGRA
+        typedef void (*SwizzleRowProc)(DWORD *dst, const DWORD *src, UINT count);
+        //! nearest neighbour, dst[i] = src[(x + i * dx) >> 16]
+        typedef void (*ScaleRowProc)(DWORD *dst, UINT count, const DWORD *src, UINT x, UINT dx);
+        //! A8 coverage tinted with a solid colour, k = mask * alpha / 255, colour alpha is not used
+        typedef void (*BlendMaskRowProc)(DWORD *dst, const BYTE *mask, UINT count, DWORD color, BYTE alpha);
+        //! straight to premultiplied, alpha kept, returns the AND of all alphas (255 when opaque)
+        typedef BYTE (*PremultiplyRowProc)(DWORD *dst, const DWORD *src, UINT count);
+        //! premultiplied BGRA over 8 bit luma, BT.601 studio range, the i-th sample is y[i * step]
+        typedef void (*BlendLumaRowProc)(BYTE *y, UINT step, const DWORD *src, UINT count);
+        //! premultiplied BGRA over subsampled chroma, sample i averages src0[2i], src0[2i + 1], src1[2i], src1[2i + 1]
+        //! and lands in u[i * step], v[i * step]; 4:2:2 passes the same row twice
+        typedef void (*BlendChromaRowProc)(BYTE *u, BYTE *v, UINT step, const DWORD *src0, const DWORD *src1, UINT count);
+        //! full range (JFIF) YCbCr planes to opaque BGRA, 14 bit fixed-point coefficients
+        typedef void (*YCbCrRowProc)(DWORD *dst, const BYTE *y, const BYTE *cb, const BYTE *cr, UINT count);
+        //! horizontal resample pass, dst[i] = sum of src[start[i] + t] * weight[i * taps + t] over t < taps
+        //! 14 bit fixed-point weights, every channel rounded and clamped to [0, 255]
+        typedef void (*ResampleRowProc)(DWORD *dst, UINT count, const DWORD *src, const INT *start, const SHORT *weight, UINT taps);
+        //! vertical resample pass, dst[i] = sum of row t's i-th pixel * weight[t], row t at src + t * srcStride bytes
+        typedef void (*ResampleColumnProc)(DWORD *dst, UINT count, const DWORD *src, INT srcStride, const SHORT *weight, UINT taps);
+        //! bilinear samples of premultiplied src along a line, sample i at (u + i * du, v + i * dv)
+        //! 16.16 fixed point with pixel centres on whole numbers, 7 bit fractions; pixels outside the source are transparent
+        //! alphaOr is or-ed into every pixel read, 0xFF000000 for opaque sources whose alpha byte is not kept
+        typedef void (*SampleRowProc)(DWORD *dst, UINT count, const DWORD *src, INT srcStride, INT srcWidth, INT srcHeight,
+            INT u, INT v, INT du, INT dv, DWORD alphaOr);
+
+        //! one complete set of entry points, every slot is always valid
+        struct Kernels
+        {
+            CpuLevel level;
+
+            BlendRowProc blend[BlendModeCount];
+            FillRowProc fill;
+            CopyRowProc copy;
+            SwizzleRowProc swizzle;
+            ScaleRowProc scaleNearest;
+            BlendMaskRowProc blendMask;
+            PremultiplyRowProc premultiply;
+            BlendLumaRowProc blendLuma;
+            BlendChromaRowProc blendChroma;
+            YCbCrRowProc ycbcr;
+            ResampleRowProc resampleRow;
+            ResampleColumnProc resampleColumn;
+            SampleRowProc sampleBilinear;
+        };
+
+        //! highest level supported by cpu and os
+        CpuLevel DetectCpuLevel();
+
+        //! NULL when the level is not supported on this machine
+        const Kernels *GetKernels(CpuLevel level);
+
+        //! the active table, picked once from cpuid
+        //! SIMPLE_CANVAS_CPU=scalar|sse2|ssse3|avx2|avx512 caps the level
+        //! SIMPLE_CANVAS_SELFTEST=1 verifies every level at startup and drops the ones that fail
+        const Kernels& GetKernels();
+
+        //! pin the active table, false when the level is not supported
+        //! safe while other threads draw, a draw already running finishes on the table it picked
+        bool SetCpuLevel(CpuLevel level);
+
+        CpuLevel ParseCpuLevel(const char *name, CpuLevel fallback);
+        const char *GetCpuLevelName(CpuLevel level);
+
+        //! compare every kernel of the level against the scalar one on random inputs
+        bool SelfTest(CpuLevel level, UINT seed = 1);
+
+        //! block helpers on the active table, strides in bytes
+        void Blend(BlendMode mode, PBYTE dst, INT dstStride, const BYTE *src, INT srcStride, INT width, INT height, BYTE alpha);
+        void Fill(PBYTE dst, INT dstStride, INT width, INT height, DWORD color);
+        void Copy(PBYTE dst, INT dstStride, const BYTE *src, INT srcStride, INT width, INT height);
+        void Swizzle(PBYTE dst, INT dstStride, const BYTE *src, INT srcStride, INT width, INT height);
+        void ScaleNearest(PBYTE dst, INT dstStride, INT dstWidth, INT dstHeight,
+            const BYTE *src, INT srcStride, INT srcWidth, INT srcHeight);
+        void BlendMask(PBYTE dst, INT dstStride, const BYTE *mask, INT maskStride, INT width, INT height, DWORD color, BYTE alpha);
+        //! true when every alpha is 255
+        bool Premultiply(PBYTE dst, INT dstStride, const BYTE *src, INT srcStride, INT width, INT height);
+
+        //! src scaled to scaledWidth x scaledHeight, of which only part (right is width, bottom is height) is written to dst
+        //! separable: rows through per-column weights into scratch rows, then those through per-row weights
+        //! a part draws the same pixels as the whole; pool splits the rows of both passes across its threads
+        void Resample(Filter filter, PBYTE dst, INT dstStride, const RECT& part, INT scaledWidth, INT scaledHeight,
+            const BYTE *src, INT srcStride, INT srcWidth, INT srcHeight, ThreadPool *pool = NULL);
+    }
+}
\ No newline at end of file
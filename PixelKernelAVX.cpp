@@ -0,0 +1,525 @@
+#include "PixelKernelISA.h"
+
+namespace Render
+{
+    namespace Pixel
+    {
+#if PIXEL_X86
+
+        PIXEL_TARGET("avx2") static inline __m256i Div255_AVX2(__m256i t)
+        {
+            t = _mm256_add_epi16(t, _mm256_set1_epi16(128));
+            return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+        }
+
+        PIXEL_TARGET("avx2") static inline __m256i Lerp16_AVX2(__m256i s, __m256i d, __m256i k)
+        {
+            return Div255_AVX2(_mm256_add_epi16(_mm256_mullo_epi16(s, k), _mm256_mullo_epi16(d, _mm256_sub_epi16(_mm256_set1_epi16(255), k))));
+        }
+
+        PIXEL_TARGET("avx2") static inline __m256i AlphaOf16_AVX2(__m256i px16)
+        {
+            return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(px16, 0xFF), 0xFF);
+        }
+
+        //! 8 pixels, unpack/pack stay inside the 128 bit lanes so the order is preserved
+        template<BlendMode mode>
+        PIXEL_TARGET("avx2") static inline __m256i Blend8_AVX2(__m256i s, __m256i d, __m256i alpha16)
+        {
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i alphaLane = _mm256_set1_epi64x(0x00FF000000000000LL);
+
+            __m256i sLo = _mm256_unpacklo_epi8(s, zero);
+            __m256i sHi = _mm256_unpackhi_epi8(s, zero);
+            __m256i kLo = alpha16, kHi = alpha16;
+
+            if (BlendConstAlpha != mode)
+            {
+                kLo = AlphaOf16_AVX2(sLo);
+                kHi = AlphaOf16_AVX2(sHi);
+            }
+
+            if (BlendCombinedAlpha == mode)
+            {
+                kLo = Div255_AVX2(_mm256_mullo_epi16(kLo, alpha16));
+                kHi = Div255_AVX2(_mm256_mullo_epi16(kHi, alpha16));
+            }
+
+            __m256i lo = Lerp16_AVX2(_mm256_or_si256(sLo, alphaLane), _mm256_unpacklo_epi8(d, zero), kLo);
+            __m256i hi = Lerp16_AVX2(_mm256_or_si256(sHi, alphaLane), _mm256_unpackhi_epi8(d, zero), kHi);
+
+            return _mm256_packus_epi16(lo, hi);
+        }
+
+        template<BlendMode mode>
+        PIXEL_TARGET("avx2") static void BlendRow_AVX2(DWORD *dst, const DWORD *src, UINT count, BYTE alpha)
+        {
+            const __m256i alpha16 = _mm256_set1_epi16(alpha);
+            const __m256i alphaMask = _mm256_set1_epi32(0xFF000000);
+
+            UINT i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+
+                if (BlendConstAlpha != mode)
+                {
+                    //! fully transparent runs are skipped, fully opaque ones copied
+                    __m256i a = _mm256_and_si256(s, alphaMask);
+                    if (_mm256_testz_si256(a, a))
+                        continue;
+
+                    if (BlendPixelAlpha == mode && -1 == _mm256_movemask_epi8(_mm256_cmpeq_epi32(a, alphaMask)))
+                    {
+                        _mm256_storeu_si256((__m256i *)(dst + i), s);
+                        continue;
+                    }
+                }
+
+                __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+                _mm256_storeu_si256((__m256i *)(dst + i), Blend8_AVX2<mode>(s, d, alpha16));
+            }
+
+            if (i != count)
+            {
+                //! masked tail, lanes past the end read as zero and are never written
+                const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+                __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(count - i), lanes);
+
+                __m256i s = _mm256_maskload_epi32((const int *)(src + i), mask);
+                __m256i d = _mm256_maskload_epi32((const int *)(dst + i), mask);
+                _mm256_maskstore_epi32((int *)(dst + i), mask, Blend8_AVX2<mode>(s, d, alpha16));
+            }
+        }
+
+        PIXEL_TARGET("avx2") static void FillRow_AVX2(DWORD *dst, UINT count, DWORD color)
+        {
+            const __m256i c = _mm256_set1_epi32(color);
+
+            UINT i = 0;
+            for (; i + 8 <= count; i += 8)
+                _mm256_storeu_si256((__m256i *)(dst + i), c);
+            for (; i != count; ++i)
+                dst[i] = color;
+        }
+
+        PIXEL_TARGET("avx2") static void CopyRow_AVX2(DWORD *dst, const DWORD *src, UINT count)
+        {
+            UINT i = 0;
+            for (; i + 16 <= count; i += 16)
+            {
+                __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+                __m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 8));
+                _mm256_storeu_si256((__m256i *)(dst + i), a);
+                _mm256_storeu_si256((__m256i *)(dst + i + 8), b);
+            }
+            for (; i != count; ++i)
+                dst[i] = src[i];
+        }
+
+        PIXEL_TARGET("avx2") static void SwizzleRow_AVX2(DWORD *dst, const DWORD *src, UINT count)
+        {
+            const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+            UINT i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                __m256i p = _mm256_loadu_si256((const __m256i *)(src + i));
+                _mm256_storeu_si256((__m256i *)(dst + i), _mm256_shuffle_epi8(p, shuffle));
+            }
+            for (; i != count; ++i)
+            {
+                DWORD p = src[i];
+                dst[i] = (p & 0xFF00FF00) | ((p >> 16) & 0xFF) | ((p & 0xFF) << 16);
+            }
+        }
+
+        PIXEL_TARGET("avx2") static void ScaleRow_AVX2(DWORD *dst, UINT count, const DWORD *src, UINT x, UINT dx)
+        {
+            const __m256i steps = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(dx));
+
+            UINT i = 0;
+            for (; i + 8 <= count; i += 8, x += 8 * dx)
+            {
+                __m256i idx = _mm256_srli_epi32(_mm256_add_epi32(_mm256_set1_epi32(x), steps), 16);
+                _mm256_storeu_si256((__m256i *)(dst + i), _mm256_i32gather_epi32((const int *)src, idx, 4));
+            }
+            for (; i != count; ++i, x += dx)
+                dst[i] = src[x >> 16];
+        }
+
+        PIXEL_TARGET("avx2") static void BlendMaskRow_AVX2(DWORD *dst, const BYTE *mask, UINT count, DWORD color, BYTE alpha)
+        {
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i alpha16 = _mm256_set1_epi16(alpha);
+            const __m256i color16 = _mm256_unpacklo_epi8(_mm256_set1_epi32(color | 0xFF000000), zero);
+
+            UINT i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                __m128i bytes = _mm_loadl_epi64((const __m128i *)(mask + i));
+                if (!_mm_cvtsi128_si64(bytes))
+                    continue;
+
+                //! one dword per pixel holding the coverage twice, then spread like unpacklo/hi spread dst
+                __m256i m = _mm256_cvtepu8_epi32(bytes);
+                m = _mm256_or_si256(m, _mm256_slli_epi32(m, 16));
+
+                __m256i kLo = Div255_AVX2(_mm256_mullo_epi16(_mm256_unpacklo_epi32(m, m), alpha16));
+                __m256i kHi = Div255_AVX2(_mm256_mullo_epi16(_mm256_unpackhi_epi32(m, m), alpha16));
+
+                __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+                __m256i lo = Lerp16_AVX2(color16, _mm256_unpacklo_epi8(d, zero), kLo);
+                __m256i hi = Lerp16_AVX2(color16, _mm256_unpackhi_epi8(d, zero), kHi);
+                _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(lo, hi));
+            }
+
+            if (i != count)
+            {
+                Kernels sse;
+                InitKernels_SSE2(sse);
+                sse.blendMask(dst + i, mask + i, count - i, color, alpha);
+            }
+        }
+
+        PIXEL_TARGET("avx2") static void ResampleRow_AVX2(DWORD *dst, UINT count, const DWORD *src, const INT *start, const SHORT *weight, UINT taps)
+        {
+            //! 16 bit channels of two pixels regrouped into (first, second) pairs, each madd gives the 4 channel sums
+            const __m256i pairs = _mm256_setr_epi8(0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15,
+                0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+            //! weights 0, 1 over the low lane, 2, 3 over the high one
+            const __m256i spread = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+            const __m128i round = _mm_set1_epi32(1 << 13);
+
+            for (UINT i = 0; i != count; ++i, weight += taps)
+            {
+                const DWORD *s = src + start[i];
+                __m256i acc = _mm256_setzero_si256();
+
+                UINT t = 0;
+                for (; t + 4 <= taps; t += 4)
+                {
+                    __m256i px = _mm256_shuffle_epi8(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(s + t))), pairs);
+                    __m256i w = _mm256_permutevar8x32_epi32(_mm256_castsi128_si256(_mm_loadl_epi64((const __m128i *)(weight + t))), spread);
+                    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(px, w));
+                }
+
+                __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+                if (t + 2 <= taps)
+                {
+                    __m128i px = _mm_shuffle_epi8(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)(s + t))), _mm256_castsi256_si128(pairs));
+                    __m128i w = _mm_set1_epi32((INT)((UINT)(WORD)weight[t] | (UINT)(WORD)weight[t + 1] << 16));
+                    sum = _mm_add_epi32(sum, _mm_madd_epi16(px, w));
+                    t += 2;
+                }
+                if (t != taps)
+                {
+                    __m128i px = _mm_cvtepu8_epi32(_mm_cvtsi32_si128((INT)s[t]));
+                    sum = _mm_add_epi32(sum, _mm_mullo_epi32(px, _mm_set1_epi32(weight[t])));
+                }
+
+                sum = _mm_srai_epi32(_mm_add_epi32(sum, round), 14);
+                sum = _mm_packus_epi16(_mm_packs_epi32(sum, sum), sum);
+                dst[i] = (DWORD)_mm_cvtsi128_si32(sum);
+            }
+        }
+
+        PIXEL_TARGET("avx2") static void ResampleColumn_AVX2(DWORD *dst, UINT count, const DWORD *src, INT srcStride, const SHORT *weight, UINT taps)
+        {
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i round = _mm256_set1_epi32(1 << 13);
+
+            UINT i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                //! pixels 0 and 4, 1 and 5, 2 and 6, 3 and 7, the unpacks stay inside the 128 bit lanes
+                __m256i acc0 = round, acc1 = round, acc2 = round, acc3 = round;
+                const BYTE *row = (const BYTE *)(src + i);
+
+                for (UINT t = 0; t < taps; t += 2, row += 2 * srcStride)
+                {
+                    //! rows interleaved byte by byte, a lone last row pairs with zero
+                    __m256i r0 = _mm256_loadu_si256((const __m256i *)row);
+                    __m256i r1 = zero;
+                    UINT pair = (WORD)weight[t];
+                    if (t + 1 != taps)
+                    {
+                        r1 = _mm256_loadu_si256((const __m256i *)(row + srcStride));
+                        pair |= (UINT)(WORD)weight[t + 1] << 16;
+                    }
+
+                    __m256i w = _mm256_set1_epi32((INT)pair);
+                    __m256i lo = _mm256_unpacklo_epi8(r0, r1);
+                    __m256i hi = _mm256_unpackhi_epi8(r0, r1);
+
+                    acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi8(lo, zero), w));
+                    acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi8(lo, zero), w));
+                    acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_unpacklo_epi8(hi, zero), w));
+                    acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_unpackhi_epi8(hi, zero), w));
+                }
+
+                __m256i p01 = _mm256_packs_epi32(_mm256_srai_epi32(acc0, 14), _mm256_srai_epi32(acc1, 14));
+                __m256i p23 = _mm256_packs_epi32(_mm256_srai_epi32(acc2, 14), _mm256_srai_epi32(acc3, 14));
+                _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(p01, p23));
+            }
+
+            if (i != count)
+            {
+                Kernels scalar;
+                InitKernels_Scalar(scalar);
+                scalar.resampleColumn(dst + i, count - i, src + i, srcStride, weight, taps);
+            }
+        }
+
+        PIXEL_TARGET("avx2") static void SampleBilinearRow_AVX2(DWORD *dst, UINT count, const DWORD *src, INT srcStride, INT srcWidth, INT srcHeight,
+            INT u, INT v, INT du, INT dv, DWORD alphaOr)
+        {
+            const __m256i zero = _mm256_setzero_si256();
+            const __m256i minusOne = _mm256_set1_epi32(-1);
+            const __m256i width = _mm256_set1_epi32(srcWidth);
+            const __m256i height = _mm256_set1_epi32(srcHeight);
+            const __m256i pitch = _mm256_set1_epi32(srcStride / 4);
+            const __m256i alpha = _mm256_set1_epi32((INT)alphaOr);
+            const __m256i fraction = _mm256_set1_epi32(0x7F);
+            const __m256i full = _mm256_set1_epi16(128);
+            const __m256i round = _mm256_set1_epi32(1 << 13);
+
+            const __m256i steps = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+            const __m256i uSteps = _mm256_mullo_epi32(steps, _mm256_set1_epi32(du));
+            const __m256i vSteps = _mm256_mullo_epi32(steps, _mm256_set1_epi32(dv));
+
+            //! the row weights of pixel n (low lane) and n + 4 (high lane), as the 16 bit unpacks leave them
+            const __m256i spread0 = _mm256_setr_epi32(0, 0, 0, 0, 4, 4, 4, 4);
+            const __m256i spread1 = _mm256_setr_epi32(1, 1, 1, 1, 5, 5, 5, 5);
+            const __m256i spread2 = _mm256_setr_epi32(2, 2, 2, 2, 6, 6, 6, 6);
+            const __m256i spread3 = _mm256_setr_epi32(3, 3, 3, 3, 7, 7, 7, 7);
+
+            UINT i = 0;
+            for (; i + 8 <= count; i += 8, u += 8 * du, v += 8 * dv)
+            {
+                __m256i uu = _mm256_add_epi32(_mm256_set1_epi32(u), uSteps);
+                __m256i vv = _mm256_add_epi32(_mm256_set1_epi32(v), vSteps);
+                __m256i x0 = _mm256_srai_epi32(uu, 16), x1 = _mm256_sub_epi32(x0, minusOne);
+                __m256i y0 = _mm256_srai_epi32(vv, 16), y1 = _mm256_sub_epi32(y0, minusOne);
+
+                //! masked lanes read nothing, so indices of pixels outside the source never touch memory
+                __m256i inX0 = _mm256_and_si256(_mm256_cmpgt_epi32(x0, minusOne), _mm256_cmpgt_epi32(width, x0));
+                __m256i inX1 = _mm256_and_si256(_mm256_cmpgt_epi32(x1, minusOne), _mm256_cmpgt_epi32(width, x1));
+                __m256i inY0 = _mm256_and_si256(_mm256_cmpgt_epi32(y0, minusOne), _mm256_cmpgt_epi32(height, y0));
+                __m256i inY1 = _mm256_and_si256(_mm256_cmpgt_epi32(y1, minusOne), _mm256_cmpgt_epi32(height, y1));
+
+                __m256i index = _mm256_add_epi32(_mm256_mullo_epi32(y0, pitch), x0);
+                __m256i below = _mm256_add_epi32(index, pitch);
+
+                __m256i m00 = _mm256_and_si256(inX0, inY0), m01 = _mm256_and_si256(inX1, inY0);
+                __m256i m10 = _mm256_and_si256(inX0, inY1), m11 = _mm256_and_si256(inX1, inY1);
+
+                __m256i p00 = _mm256_mask_i32gather_epi32(zero, (const int *)src, index, m00, 4);
+                __m256i p01 = _mm256_mask_i32gather_epi32(zero, (const int *)src, _mm256_sub_epi32(index, minusOne), m01, 4);
+                __m256i p10 = _mm256_mask_i32gather_epi32(zero, (const int *)src, below, m10, 4);
+                __m256i p11 = _mm256_mask_i32gather_epi32(zero, (const int *)src, _mm256_sub_epi32(below, minusOne), m11, 4);
+
+                p00 = _mm256_or_si256(p00, _mm256_and_si256(alpha, m00));
+                p01 = _mm256_or_si256(p01, _mm256_and_si256(alpha, m01));
+                p10 = _mm256_or_si256(p10, _mm256_and_si256(alpha, m10));
+                p11 = _mm256_or_si256(p11, _mm256_and_si256(alpha, m11));
+
+                //! column weights spread over the channels like unpacklo/hi spread the pixels
+                __m256i fx = _mm256_and_si256(_mm256_srli_epi32(uu, 9), fraction);
+                fx = _mm256_or_si256(fx, _mm256_slli_epi32(fx, 16));
+                __m256i kLo = _mm256_unpacklo_epi32(fx, fx), kHi = _mm256_unpackhi_epi32(fx, fx);
+                __m256i ikLo = _mm256_sub_epi16(full, kLo), ikHi = _mm256_sub_epi16(full, kHi);
+
+                __m256i topLo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(p00, zero), ikLo), _mm256_mullo_epi16(_mm256_unpacklo_epi8(p01, zero), kLo));
+                __m256i topHi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(p00, zero), ikHi), _mm256_mullo_epi16(_mm256_unpackhi_epi8(p01, zero), kHi));
+                __m256i bottomLo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(p10, zero), ikLo), _mm256_mullo_epi16(_mm256_unpacklo_epi8(p11, zero), kLo));
+                __m256i bottomHi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(p10, zero), ikHi), _mm256_mullo_epi16(_mm256_unpackhi_epi8(p11, zero), kHi));
+
+                //! (128 - fy, fy) pairs against (top, bottom) pairs, one madd per pixel pair
+                __m256i fy = _mm256_and_si256(_mm256_srli_epi32(vv, 9), fraction);
+                __m256i wy = _mm256_or_si256(_mm256_sub_epi32(_mm256_set1_epi32(128), fy), _mm256_slli_epi32(fy, 16));
+
+                __m256i r0 = _mm256_madd_epi16(_mm256_unpacklo_epi16(topLo, bottomLo), _mm256_permutevar8x32_epi32(wy, spread0));
+                __m256i r1 = _mm256_madd_epi16(_mm256_unpackhi_epi16(topLo, bottomLo), _mm256_permutevar8x32_epi32(wy, spread1));
+                __m256i r2 = _mm256_madd_epi16(_mm256_unpacklo_epi16(topHi, bottomHi), _mm256_permutevar8x32_epi32(wy, spread2));
+                __m256i r3 = _mm256_madd_epi16(_mm256_unpackhi_epi16(topHi, bottomHi), _mm256_permutevar8x32_epi32(wy, spread3));
+
+                r0 = _mm256_srli_epi32(_mm256_add_epi32(r0, round), 14);
+                r1 = _mm256_srli_epi32(_mm256_add_epi32(r1, round), 14);
+                r2 = _mm256_srli_epi32(_mm256_add_epi32(r2, round), 14);
+                r3 = _mm256_srli_epi32(_mm256_add_epi32(r3, round), 14);
+
+                _mm256_storeu_si256((__m256i *)(dst + i), _mm256_packus_epi16(_mm256_packs_epi32(r0, r1), _mm256_packs_epi32(r2, r3)));
+            }
+
+            if (i != count)
+            {
+                Kernels scalar;
+                InitKernels_Scalar(scalar);
+                scalar.sampleBilinear(dst + i, count - i, src, srcStride, srcWidth, srcHeight, u, v, du, dv, alphaOr);
+            }
+        }
+
+        void InitKernels_AVX2(Kernels& k)
+        {
+            k.blend[BlendConstAlpha] = BlendRow_AVX2<BlendConstAlpha>;
+            k.blend[BlendPixelAlpha] = BlendRow_AVX2<BlendPixelAlpha>;
+            k.blend[BlendCombinedAlpha] = BlendRow_AVX2<BlendCombinedAlpha>;
+            k.fill = FillRow_AVX2;
+            k.copy = CopyRow_AVX2;
+            k.swizzle = SwizzleRow_AVX2;
+            k.scaleNearest = ScaleRow_AVX2;
+            k.blendMask = BlendMaskRow_AVX2;
+            k.resampleRow = ResampleRow_AVX2;
+            k.resampleColumn = ResampleColumn_AVX2;
+            k.sampleBilinear = SampleBilinearRow_AVX2;
+        }
+
+#define PIXEL_AVX512 "avx512f,avx512bw"
+
+        PIXEL_TARGET(PIXEL_AVX512) static inline __m512i Div255_AVX512(__m512i t)
+        {
+            t = _mm512_add_epi16(t, _mm512_set1_epi16(128));
+            return _mm512_srli_epi16(_mm512_add_epi16(t, _mm512_srli_epi16(t, 8)), 8);
+        }
+
+        PIXEL_TARGET(PIXEL_AVX512) static inline __m512i Lerp16_AVX512(__m512i s, __m512i d, __m512i k)
+        {
+            return Div255_AVX512(_mm512_add_epi16(_mm512_mullo_epi16(s, k), _mm512_mullo_epi16(d, _mm512_sub_epi16(_mm512_set1_epi16(255), k))));
+        }
+
+        PIXEL_TARGET(PIXEL_AVX512) static inline __m512i AlphaOf16_AVX512(__m512i px16)
+        {
+            return _mm512_shufflehi_epi16(_mm512_shufflelo_epi16(px16, 0xFF), 0xFF);
+        }
+
+        template<BlendMode mode>
+        PIXEL_TARGET(PIXEL_AVX512) static inline __m512i Blend16_AVX512(__m512i s, __m512i d, __m512i alpha16)
+        {
+            const __m512i zero = _mm512_setzero_si512();
+            const __m512i alphaLane = _mm512_set1_epi64(0x00FF000000000000LL);
+
+            __m512i sLo = _mm512_unpacklo_epi8(s, zero);
+            __m512i sHi = _mm512_unpackhi_epi8(s, zero);
+            __m512i kLo = alpha16, kHi = alpha16;
+
+            if (BlendConstAlpha != mode)
+            {
+                kLo = AlphaOf16_AVX512(sLo);
+                kHi = AlphaOf16_AVX512(sHi);
+            }
+
+            if (BlendCombinedAlpha == mode)
+            {
+                kLo = Div255_AVX512(_mm512_mullo_epi16(kLo, alpha16));
+                kHi = Div255_AVX512(_mm512_mullo_epi16(kHi, alpha16));
+            }
+
+            __m512i lo = Lerp16_AVX512(_mm512_or_si512(sLo, alphaLane), _mm512_unpacklo_epi8(d, zero), kLo);
+            __m512i hi = Lerp16_AVX512(_mm512_or_si512(sHi, alphaLane), _mm512_unpackhi_epi8(d, zero), kHi);
+
+            return _mm512_packus_epi16(lo, hi);
+        }
+
+        PIXEL_TARGET(PIXEL_AVX512) static inline __mmask16 TailMask(UINT rest)
+        {
+            return (__mmask16)((1u << rest) - 1);
+        }
+
+        template<BlendMode mode>
+        PIXEL_TARGET(PIXEL_AVX512) static void BlendRow_AVX512(DWORD *dst, const DWORD *src, UINT count, BYTE alpha)
+        {
+            const __m512i alpha16 = _mm512_set1_epi16(alpha);
+            const __m512i alphaMask = _mm512_set1_epi32(0xFF000000);
+
+            for (UINT i = 0; i < count; i += 16)
+            {
+                __mmask16 lanes = count - i >= 16 ? (__mmask16)0xFFFF : TailMask(count - i);
+                __m512i s = _mm512_maskz_loadu_epi32(lanes, src + i);
+
+                if (BlendConstAlpha != mode)
+                {
+                    __mmask16 visible = _mm512_test_epi32_mask(s, alphaMask);
+                    if (!visible)
+                        continue;
+
+                    if (BlendPixelAlpha == mode && lanes == _mm512_cmpeq_epi32_mask(_mm512_and_si512(s, alphaMask), alphaMask))
+                    {
+                        _mm512_mask_storeu_epi32(dst + i, lanes, s);
+                        continue;
+                    }
+                }
+
+                __m512i d = _mm512_maskz_loadu_epi32(lanes, dst + i);
+                _mm512_mask_storeu_epi32(dst + i, lanes, Blend16_AVX512<mode>(s, d, alpha16));
+            }
+        }
+
+        PIXEL_TARGET(PIXEL_AVX512) static void FillRow_AVX512(DWORD *dst, UINT count, DWORD color)
+        {
+            const __m512i c = _mm512_set1_epi32(color);
+
+            UINT i = 0;
+            for (; i + 16 <= count; i += 16)
+                _mm512_storeu_si512(dst + i, c);
+            if (i != count)
+                _mm512_mask_storeu_epi32(dst + i, TailMask(count - i), c);
+        }
+
+        PIXEL_TARGET(PIXEL_AVX512) static void CopyRow_AVX512(DWORD *dst, const DWORD *src, UINT count)
+        {
+            UINT i = 0;
+            for (; i + 16 <= count; i += 16)
+                _mm512_storeu_si512(dst + i, _mm512_loadu_si512(src + i));
+            if (i != count)
+            {
+                __mmask16 lanes = TailMask(count - i);
+                _mm512_mask_storeu_epi32(dst + i, lanes, _mm512_maskz_loadu_epi32(lanes, src + i));
+            }
+        }
+
+        PIXEL_TARGET(PIXEL_AVX512) static void SwizzleRow_AVX512(DWORD *dst, const DWORD *src, UINT count)
+        {
+            const __m512i shuffle = _mm512_broadcast_i32x4(_mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15));
+
+            for (UINT i = 0; i < count; i += 16)
+            {
+                __mmask16 lanes = count - i >= 16 ? (__mmask16)0xFFFF : TailMask(count - i);
+                __m512i p = _mm512_maskz_loadu_epi32(lanes, src + i);
+                _mm512_mask_storeu_epi32(dst + i, lanes, _mm512_shuffle_epi8(p, shuffle));
+            }
+        }
+
+        PIXEL_TARGET(PIXEL_AVX512) static void ScaleRow_AVX512(DWORD *dst, UINT count, const DWORD *src, UINT x, UINT dx)
+        {
+            const __m512i steps = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(dx));
+
+            for (UINT i = 0; i < count; i += 16, x += 16 * dx)
+            {
+                __mmask16 lanes = count - i >= 16 ? (__mmask16)0xFFFF : TailMask(count - i);
+                __m512i idx = _mm512_srli_epi32(_mm512_add_epi32(_mm512_set1_epi32(x), steps), 16);
+                __m512i p = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), lanes, idx, (const int *)src, 4);
+                _mm512_mask_storeu_epi32(dst + i, lanes, p);
+            }
+        }
+
+        void InitKernels_AVX512(Kernels& k)
+        {
+            k.blend[BlendConstAlpha] = BlendRow_AVX512<BlendConstAlpha>;
+            k.blend[BlendPixelAlpha] = BlendRow_AVX512<BlendPixelAlpha>;
+            k.blend[BlendCombinedAlpha] = BlendRow_AVX512<BlendCombinedAlpha>;
+            k.fill = FillRow_AVX512;
+            k.copy = CopyRow_AVX512;
+            k.swizzle = SwizzleRow_AVX512;
+            k.scaleNearest = ScaleRow_AVX512;
+        }
+
+#else
+
+        void InitKernels_AVX2(Kernels&) {}
+        void InitKernels_AVX512(Kernels&) {}
+
+#endif
+    }
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#pragma once
+
+//! private to the PixelKernel*.cpp units
+
+#include "PixelKernel.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define PIXEL_X86 1
+#include <immintrin.h>
+#endif
+
+//! msvc emits any intrinsic without /arch, gcc and clang need the target per function
+#if defined(_MSC_VER)
+#define PIXEL_TARGET(isa)
+#else
+#define PIXEL_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace Render
+{
+    namespace Pixel
+    {
+        //! each fills the slots it implements and leaves the rest untouched
+        void InitKernels_Scalar(Kernels& k);
+        void InitKernels_SSE2(Kernels& k);
+        void InitKernels_SSSE3(Kernels& k);
+        void InitKernels_AVX2(Kernels& k);
+        void InitKernels_AVX512(Kernels& k);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,526 @@
+#include "PixelKernelISA.h"
+
+#include <string.h>
+
+namespace Render
+{
+    namespace Pixel
+    {
+#if PIXEL_X86
+
+        //! 16 bit lanes: (s * k + d * (255 - k)) / 255
+        PIXEL_TARGET("sse2") static inline __m128i Lerp16_SSE2(__m128i s, __m128i d, __m128i k)
+        {
+            __m128i t = _mm_add_epi16(_mm_mullo_epi16(s, k), _mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), k)));
+            t = _mm_add_epi16(t, _mm_set1_epi16(128));
+            return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        }
+
+        PIXEL_TARGET("sse2") static inline __m128i Div255_SSE2(__m128i t)
+        {
+            t = _mm_add_epi16(t, _mm_set1_epi16(128));
+            return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        }
+
+        PIXEL_TARGET("sse2") static inline __m128i AlphaOf16_SSE2(__m128i px16)
+        {
+            return _mm_shufflehi_epi16(_mm_shufflelo_epi16(px16, 0xFF), 0xFF);
+        }
+
+        //! 4 pixels, mode as template parameter so the inner loop has no branches
+        template<BlendMode mode>
+        PIXEL_TARGET("sse2") static inline __m128i Blend4_SSE2(__m128i s, __m128i d, __m128i alpha16)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i alphaLane = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+
+            __m128i sLo = _mm_unpacklo_epi8(s, zero);
+            __m128i sHi = _mm_unpackhi_epi8(s, zero);
+            __m128i kLo = alpha16, kHi = alpha16;
+
+            if (BlendConstAlpha != mode)
+            {
+                kLo = AlphaOf16_SSE2(sLo);
+                kHi = AlphaOf16_SSE2(sHi);
+            }
+
+            if (BlendCombinedAlpha == mode)
+            {
+                kLo = Div255_SSE2(_mm_mullo_epi16(kLo, alpha16));
+                kHi = Div255_SSE2(_mm_mullo_epi16(kHi, alpha16));
+            }
+
+            __m128i lo = Lerp16_SSE2(_mm_or_si128(sLo, alphaLane), _mm_unpacklo_epi8(d, zero), kLo);
+            __m128i hi = Lerp16_SSE2(_mm_or_si128(sHi, alphaLane), _mm_unpackhi_epi8(d, zero), kHi);
+
+            return _mm_packus_epi16(lo, hi);
+        }
+
+        template<BlendMode mode>
+        PIXEL_TARGET("sse2") static void BlendRow_SSE2(DWORD *dst, const DWORD *src, UINT count, BYTE alpha)
+        {
+            const __m128i alpha16 = _mm_set1_epi16(alpha);
+            const __m128i alphaMask = _mm_set1_epi32(0xFF000000);
+
+            UINT i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+
+                if (BlendConstAlpha != mode)
+                {
+                    //! fully transparent runs are skipped, fully opaque ones copied
+                    __m128i a = _mm_and_si128(s, alphaMask);
+                    if (0xFFFF == _mm_movemask_epi8(_mm_cmpeq_epi32(a, _mm_setzero_si128())))
+                        continue;
+
+                    if (BlendPixelAlpha == mode && 0xFFFF == _mm_movemask_epi8(_mm_cmpeq_epi32(a, alphaMask)))
+                    {
+                        _mm_storeu_si128((__m128i *)(dst + i), s);
+                        continue;
+                    }
+                }
+
+                __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+                _mm_storeu_si128((__m128i *)(dst + i), Blend4_SSE2<mode>(s, d, alpha16));
+            }
+
+            //! tail through a zero padded vector, keeps the rounding identical
+            if (i != count)
+            {
+                DWORD s[4] = { 0 }, d[4] = { 0 };
+                UINT rest = count - i;
+                for (UINT j = 0; j != rest; ++j)
+                {
+                    s[j] = src[i + j];
+                    d[j] = dst[i + j];
+                }
+
+                __m128i r = Blend4_SSE2<mode>(_mm_loadu_si128((const __m128i *)s), _mm_loadu_si128((const __m128i *)d), alpha16);
+                _mm_storeu_si128((__m128i *)d, r);
+
+                for (UINT j = 0; j != rest; ++j)
+                    dst[i + j] = d[j];
+            }
+        }
+
+        //! 4 premultiplied pixels, src * alpha + dst * (255 - k) with each product rounded on its own
+        PIXEL_TARGET("sse2") static inline __m128i Premultiplied4_SSE2(__m128i s, __m128i d, __m128i alpha16)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i full = _mm_set1_epi16(255);
+
+            __m128i sLo = _mm_unpacklo_epi8(s, zero);
+            __m128i sHi = _mm_unpackhi_epi8(s, zero);
+            __m128i ikLo = _mm_sub_epi16(full, Div255_SSE2(_mm_mullo_epi16(AlphaOf16_SSE2(sLo), alpha16)));
+            __m128i ikHi = _mm_sub_epi16(full, Div255_SSE2(_mm_mullo_epi16(AlphaOf16_SSE2(sHi), alpha16)));
+
+            __m128i lo = _mm_add_epi16(Div255_SSE2(_mm_mullo_epi16(sLo, alpha16)), Div255_SSE2(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), ikLo)));
+            __m128i hi = _mm_add_epi16(Div255_SSE2(_mm_mullo_epi16(sHi, alpha16)), Div255_SSE2(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), ikHi)));
+
+            return _mm_packus_epi16(lo, hi);
+        }
+
+        PIXEL_TARGET("sse2") static void BlendPremultipliedRow_SSE2(DWORD *dst, const DWORD *src, UINT count, BYTE alpha)
+        {
+            const __m128i alpha16 = _mm_set1_epi16(alpha);
+            const __m128i alphaMask = _mm_set1_epi32(0xFF000000);
+
+            UINT i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+
+                //! clear runs are skipped, opaque ones at full opacity copied
+                if (0xFFFF == _mm_movemask_epi8(_mm_cmpeq_epi32(s, _mm_setzero_si128())))
+                    continue;
+
+                if (255 == alpha && 0xFFFF == _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, alphaMask), alphaMask)))
+                {
+                    _mm_storeu_si128((__m128i *)(dst + i), s);
+                    continue;
+                }
+
+                __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+                _mm_storeu_si128((__m128i *)(dst + i), Premultiplied4_SSE2(s, d, alpha16));
+            }
+
+            if (i != count)
+            {
+                DWORD s[4] = { 0 }, d[4] = { 0 };
+                UINT rest = count - i;
+                for (UINT j = 0; j != rest; ++j)
+                {
+                    s[j] = src[i + j];
+                    d[j] = dst[i + j];
+                }
+
+                _mm_storeu_si128((__m128i *)d, Premultiplied4_SSE2(_mm_loadu_si128((const __m128i *)s), _mm_loadu_si128((const __m128i *)d), alpha16));
+
+                for (UINT j = 0; j != rest; ++j)
+                    dst[i + j] = d[j];
+            }
+        }
+
+        PIXEL_TARGET("sse2") static BYTE PremultiplyRow_SSE2(DWORD *dst, const DWORD *src, UINT count)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i alphaLane = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+            const __m128i colorLanes = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+            __m128i opaque = _mm_set1_epi32(-1);
+
+            UINT i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+                opaque = _mm_and_si128(opaque, p);
+
+                //! alpha times itself would not be alpha, its lane is multiplied by 255 instead
+                __m128i lo = _mm_unpacklo_epi8(p, zero);
+                __m128i hi = _mm_unpackhi_epi8(p, zero);
+                __m128i kLo = _mm_or_si128(_mm_and_si128(AlphaOf16_SSE2(lo), colorLanes), alphaLane);
+                __m128i kHi = _mm_or_si128(_mm_and_si128(AlphaOf16_SSE2(hi), colorLanes), alphaLane);
+
+                lo = Div255_SSE2(_mm_mullo_epi16(lo, kLo));
+                hi = Div255_SSE2(_mm_mullo_epi16(hi, kHi));
+                _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+            }
+
+            DWORD lanes[4];
+            _mm_storeu_si128((__m128i *)lanes, opaque);
+            BYTE result = (BYTE)((lanes[0] & lanes[1] & lanes[2] & lanes[3]) >> 24);
+
+            if (i != count)
+            {
+                Kernels scalar;
+                InitKernels_Scalar(scalar);
+                result &= scalar.premultiply(dst + i, src + i, count - i);
+            }
+
+            return result;
+        }
+
+        PIXEL_TARGET("sse2") static void FillRow_SSE2(DWORD *dst, UINT count, DWORD color)
+        {
+            const __m128i c = _mm_set1_epi32(color);
+
+            UINT i = 0;
+            for (; i + 4 <= count; i += 4)
+                _mm_storeu_si128((__m128i *)(dst + i), c);
+            for (; i != count; ++i)
+                dst[i] = color;
+        }
+
+        PIXEL_TARGET("sse2") static void CopyRow_SSE2(DWORD *dst, const DWORD *src, UINT count)
+        {
+            UINT i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+                __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 4));
+                _mm_storeu_si128((__m128i *)(dst + i), a);
+                _mm_storeu_si128((__m128i *)(dst + i + 4), b);
+            }
+            for (; i != count; ++i)
+                dst[i] = src[i];
+        }
+
+        PIXEL_TARGET("sse2") static void SwizzleRow_SSE2(DWORD *dst, const DWORD *src, UINT count)
+        {
+            const __m128i keep = _mm_set1_epi32(0xFF00FF00);
+            const __m128i low = _mm_set1_epi32(0x000000FF);
+
+            UINT i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+                __m128i r = _mm_or_si128(_mm_and_si128(p, keep),
+                    _mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 16), low), _mm_slli_epi32(_mm_and_si128(p, low), 16)));
+                _mm_storeu_si128((__m128i *)(dst + i), r);
+            }
+            for (; i != count; ++i)
+            {
+                DWORD p = src[i];
+                dst[i] = (p & 0xFF00FF00) | ((p >> 16) & 0xFF) | ((p & 0xFF) << 16);
+            }
+        }
+
+        PIXEL_TARGET("sse2") static void ScaleRow_SSE2(DWORD *dst, UINT count, const DWORD *src, UINT x, UINT dx)
+        {
+            //! no gather before avx2, the win is the 4-wide store
+            UINT i = 0;
+            for (; i + 4 <= count; i += 4, x += 4 * dx)
+            {
+                __m128i p = _mm_set_epi32(src[(x + 3 * dx) >> 16], src[(x + 2 * dx) >> 16], src[(x + dx) >> 16], src[x >> 16]);
+                _mm_storeu_si128((__m128i *)(dst + i), p);
+            }
+            for (; i != count; ++i, x += dx)
+                dst[i] = src[x >> 16];
+        }
+
+        //! 4 coverage bytes widened to one 16 bit lane per channel, pixels 0-1 and 2-3
+        PIXEL_TARGET("sse2") static inline void Coverage16_SSE2(int bytes, __m128i *lo, __m128i *hi)
+        {
+            __m128i m = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), _mm_setzero_si128()), _mm_setzero_si128());
+            m = _mm_or_si128(m, _mm_slli_epi32(m, 16));
+
+            *lo = _mm_unpacklo_epi32(m, m);
+            *hi = _mm_unpackhi_epi32(m, m);
+        }
+
+        PIXEL_TARGET("sse2") static void BlendMaskRow_SSE2(DWORD *dst, const BYTE *mask, UINT count, DWORD color, BYTE alpha)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i alpha16 = _mm_set1_epi16(alpha);
+            const __m128i color16 = _mm_unpacklo_epi8(_mm_set1_epi32(color | 0xFF000000), zero);
+
+            UINT i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                int bytes;
+                ::memcpy(&bytes, mask + i, 4);
+                if (!bytes)
+                    continue;
+
+                __m128i kLo, kHi;
+                Coverage16_SSE2(bytes, &kLo, &kHi);
+                kLo = Div255_SSE2(_mm_mullo_epi16(kLo, alpha16));
+                kHi = Div255_SSE2(_mm_mullo_epi16(kHi, alpha16));
+
+                __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+                __m128i lo = Lerp16_SSE2(color16, _mm_unpacklo_epi8(d, zero), kLo);
+                __m128i hi = Lerp16_SSE2(color16, _mm_unpackhi_epi8(d, zero), kHi);
+                _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+            }
+
+            for (; i != count; ++i)
+            {
+                UINT k = Div255(mask[i] * alpha);
+                if (!k)
+                    continue;
+
+                //! same formula as the vector body, one pixel at a time
+                __m128i d16 = _mm_unpacklo_epi8(_mm_cvtsi32_si128(dst[i]), zero);
+                __m128i r = Lerp16_SSE2(color16, d16, _mm_set1_epi16((short)k));
+                dst[i] = _mm_cvtsi128_si32(_mm_packus_epi16(r, r));
+            }
+        }
+
+        //! per pixel dot product of the four 16 bit channels with coeffs, lo and hi hold two pixels each
+        PIXEL_TARGET("sse2") static inline __m128i Dot4_SSE2(__m128i lo, __m128i hi, __m128i coeffs)
+        {
+            __m128 a = _mm_castsi128_ps(_mm_madd_epi16(lo, coeffs));
+            __m128 b = _mm_castsi128_ps(_mm_madd_epi16(hi, coeffs));
+
+            return _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0))),
+                _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))));
+        }
+
+        //! base + sample * (255 - a) / 255 on 16 bit lanes, saturated to bytes in the low half
+        PIXEL_TARGET("sse2") static inline __m128i Over16_SSE2(__m128i base, __m128i sample, __m128i a)
+        {
+            __m128i keep = Div255_SSE2(_mm_mullo_epi16(sample, _mm_sub_epi16(_mm_set1_epi16(255), a)));
+            return _mm_packus_epi16(_mm_add_epi16(base, keep), _mm_setzero_si128());
+        }
+
+        PIXEL_TARGET("sse2") static void BlendLumaRow_SSE2(BYTE *y, UINT step, const DWORD *src, UINT count)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i coeffs = _mm_set_epi16(16, 66, 129, 25, 16, 66, 129, 25);
+            const __m128i bias = _mm_set1_epi32(128);
+
+            UINT i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                __m128i p0 = _mm_loadu_si128((const __m128i *)(src + i));
+                __m128i p1 = _mm_loadu_si128((const __m128i *)(src + i + 4));
+                if (0xFFFF == _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(p0, p1), zero)))
+                    continue;
+
+                __m128i t0 = _mm_srli_epi32(_mm_add_epi32(Dot4_SSE2(_mm_unpacklo_epi8(p0, zero), _mm_unpackhi_epi8(p0, zero), coeffs), bias), 8);
+                __m128i t1 = _mm_srli_epi32(_mm_add_epi32(Dot4_SSE2(_mm_unpacklo_epi8(p1, zero), _mm_unpackhi_epi8(p1, zero), coeffs), bias), 8);
+                __m128i a = _mm_packs_epi32(_mm_srli_epi32(p0, 24), _mm_srli_epi32(p1, 24));
+
+                BYTE *row = y + i * step;
+                __m128i samples;
+                if (1 == step)
+                {
+                    samples = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)row), zero);
+                }
+                else
+                {
+                    samples = _mm_set_epi16(row[7 * step], row[6 * step], row[5 * step], row[4 * step],
+                        row[3 * step], row[2 * step], row[step], row[0]);
+                }
+
+                __m128i r = Over16_SSE2(_mm_packs_epi32(t0, t1), samples, a);
+
+                if (1 == step)
+                {
+                    _mm_storel_epi64((__m128i *)row, r);
+                }
+                else
+                {
+                    BYTE out[16];
+                    _mm_storeu_si128((__m128i *)out, r);
+                    for (UINT j = 0; j != 8; ++j)
+                        row[j * step] = out[j];
+                }
+            }
+
+            if (i != count)
+            {
+                Kernels scalar;
+                InitKernels_Scalar(scalar);
+                scalar.blendLuma(y + i * step, step, src + i, count - i);
+            }
+        }
+
+        //! 4 chroma samples per pass, the averaged 2x2 blocks stay in 16 bit lanes
+        PIXEL_TARGET("sse2") static void BlendChromaRow_SSE2(BYTE *u, BYTE *v, UINT step, const DWORD *src0, const DWORD *src1, UINT count)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i two = _mm_set1_epi16(2);
+            const __m128i uCoeffs = _mm_set_epi16(128, -38, -74, 112, 128, -38, -74, 112);
+            const __m128i vCoeffs = _mm_set_epi16(128, 112, -94, -18, 128, 112, -94, -18);
+            const __m128i aCoeffs = _mm_set_epi16(1, 0, 0, 0, 1, 0, 0, 0);
+            const __m128i bias = _mm_set1_epi32(128);
+
+            UINT i = 0;
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128i a0 = _mm_loadu_si128((const __m128i *)(src0 + 2 * i));
+                __m128i a1 = _mm_loadu_si128((const __m128i *)(src0 + 2 * i + 4));
+                __m128i b0 = _mm_loadu_si128((const __m128i *)(src1 + 2 * i));
+                __m128i b1 = _mm_loadu_si128((const __m128i *)(src1 + 2 * i + 4));
+                if (0xFFFF == _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(_mm_or_si128(a0, a1), _mm_or_si128(b0, b1)), zero)))
+                    continue;
+
+                //! vertical sums, pixel pairs in the 64 bit halves
+                __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+                __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+                __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+                __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+                __m128i lo = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+                __m128i hi = _mm_add_epi16(_mm_unpacklo_epi64(s2, s3), _mm_unpackhi_epi64(s2, s3));
+                lo = _mm_srli_epi16(_mm_add_epi16(lo, two), 2);
+                hi = _mm_srli_epi16(_mm_add_epi16(hi, two), 2);
+
+                __m128i tu = _mm_srai_epi32(_mm_add_epi32(Dot4_SSE2(lo, hi, uCoeffs), bias), 8);
+                __m128i tv = _mm_srai_epi32(_mm_add_epi32(Dot4_SSE2(lo, hi, vCoeffs), bias), 8);
+                __m128i a = Dot4_SSE2(lo, hi, aCoeffs);
+
+                //! u in the low four lanes, v in the high four
+                BYTE *pu = u + i * step, *pv = v + i * step;
+                __m128i base = _mm_max_epi16(_mm_packs_epi32(tu, tv), zero);
+                __m128i samples = _mm_set_epi16(pv[3 * step], pv[2 * step], pv[step], pv[0], pu[3 * step], pu[2 * step], pu[step], pu[0]);
+                a = _mm_packs_epi32(a, a);
+
+                BYTE out[16];
+                _mm_storeu_si128((__m128i *)out, Over16_SSE2(base, samples, a));
+                for (UINT j = 0; j != 4; ++j)
+                {
+                    pu[j * step] = out[j];
+                    pv[j * step] = out[4 + j];
+                }
+            }
+
+            if (i != count)
+            {
+                Kernels scalar;
+                InitKernels_Scalar(scalar);
+                scalar.blendChroma(u + i * step, v + i * step, step, src0 + 2 * i, src1 + 2 * i, count - i);
+            }
+        }
+
+        PIXEL_TARGET("ssse3") static void SwizzleRow_SSSE3(DWORD *dst, const DWORD *src, UINT count)
+        {
+            const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+
+            UINT i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+                __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 4));
+                _mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(a, shuffle));
+                _mm_storeu_si128((__m128i *)(dst + i + 4), _mm_shuffle_epi8(b, shuffle));
+            }
+            SwizzleRow_SSE2(dst + i, src + i, count - i);
+        }
+
+        //! 8 pixels per round, pmaddwd on (cr, cb) pairs keeps the 32 bit products of the scalar kernel
+        PIXEL_TARGET("sse2") static void YCbCrRow_SSE2(DWORD *dst, const BYTE *y, const BYTE *cb, const BYTE *cr, UINT count)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i bias = _mm_set1_epi16(128);
+            const __m128i round = _mm_set1_epi32(8192);
+            const __m128i kr = _mm_set_epi16(0, 22970, 0, 22970, 0, 22970, 0, 22970);
+            const __m128i kg = _mm_set_epi16(-5638, -11700, -5638, -11700, -5638, -11700, -5638, -11700);
+            const __m128i kb = _mm_set_epi16(29032, 0, 29032, 0, 29032, 0, 29032, 0);
+            const __m128i opaque = _mm_set1_epi8((char)0xFF);
+
+            UINT i = 0;
+            for (; i + 8 <= count; i += 8)
+            {
+                __m128i y16 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(y + i)), zero);
+                __m128i u16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(cb + i)), zero), bias);
+                __m128i v16 = _mm_sub_epi16(_mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(cr + i)), zero), bias);
+
+                __m128i vuLo = _mm_unpacklo_epi16(v16, u16);
+                __m128i vuHi = _mm_unpackhi_epi16(v16, u16);
+                __m128i baseLo = _mm_add_epi32(_mm_slli_epi32(_mm_unpacklo_epi16(y16, zero), 14), round);
+                __m128i baseHi = _mm_add_epi32(_mm_slli_epi32(_mm_unpackhi_epi16(y16, zero), 14), round);
+
+                __m128i r = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(baseLo, _mm_madd_epi16(vuLo, kr)), 14),
+                    _mm_srai_epi32(_mm_add_epi32(baseHi, _mm_madd_epi16(vuHi, kr)), 14));
+                __m128i g = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(baseLo, _mm_madd_epi16(vuLo, kg)), 14),
+                    _mm_srai_epi32(_mm_add_epi32(baseHi, _mm_madd_epi16(vuHi, kg)), 14));
+                __m128i b = _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(baseLo, _mm_madd_epi16(vuLo, kb)), 14),
+                    _mm_srai_epi32(_mm_add_epi32(baseHi, _mm_madd_epi16(vuHi, kb)), 14));
+
+                __m128i bg = _mm_unpacklo_epi8(_mm_packus_epi16(b, b), _mm_packus_epi16(g, g));
+                __m128i ra = _mm_unpacklo_epi8(_mm_packus_epi16(r, r), opaque);
+
+                _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi16(bg, ra));
+                _mm_storeu_si128((__m128i *)(dst + i + 4), _mm_unpackhi_epi16(bg, ra));
+            }
+
+            if (i != count)
+            {
+                Kernels scalar;
+                InitKernels_Scalar(scalar);
+                scalar.ycbcr(dst + i, y + i, cb + i, cr + i, count - i);
+            }
+        }
+
+        void InitKernels_SSE2(Kernels& k)
+        {
+            k.blend[BlendConstAlpha] = BlendRow_SSE2<BlendConstAlpha>;
+            k.blend[BlendPixelAlpha] = BlendRow_SSE2<BlendPixelAlpha>;
+            k.blend[BlendCombinedAlpha] = BlendRow_SSE2<BlendCombinedAlpha>;
+            k.blend[BlendPremultiplied] = BlendPremultipliedRow_SSE2;
+            k.fill = FillRow_SSE2;
+            k.copy = CopyRow_SSE2;
+            k.swizzle = SwizzleRow_SSE2;
+            k.scaleNearest = ScaleRow_SSE2;
+            k.blendMask = BlendMaskRow_SSE2;
+            k.premultiply = PremultiplyRow_SSE2;
+            k.blendLuma = BlendLumaRow_SSE2;
+            k.blendChroma = BlendChromaRow_SSE2;
+            k.ycbcr = YCbCrRow_SSE2;
+        }
+
+        void InitKernels_SSSE3(Kernels& k)
+        {
+            k.swizzle = SwizzleRow_SSSE3;
+        }
+
+#else
+
+        void InitKernels_SSE2(Kernels&) {}
+        void InitKernels_SSSE3(Kernels&) {}
+
+#endif
+    }
+}
\ No newline at end of file
@@ -0,0 +1,263 @@
+#include "PixelKernel.h"
+#include "ThreadPool.h"
+
+#include <math.h>
+#include <vector>
+
+namespace Render
+{
+    namespace Pixel
+    {
+        //! weights for one axis, the same number of taps for every output pixel
+        struct ResampleTable
+        {
+            std::vector<INT> start;
+            std::vector<SHORT> weight;      //! taps per output pixel, summing to 1 << 14
+            std::vector<double> work;
+            UINT taps;
+        };
+
+        //! kept per thread, so a steady stream of scaled draws allocates nothing
+        struct ResampleScratch
+        {
+            ResampleTable columns;
+            ResampleTable rows;
+            std::vector<DWORD> pixels;      //! source rows after the horizontal pass
+        };
+
+        static ResampleScratch& GetScratch()
+        {
+            static thread_local ResampleScratch scratch;
+            return scratch;
+        }
+
+        static double FilterSupport(Filter filter)
+        {
+            switch (filter)
+            {
+            case FilterBox: return 0.5;
+            case FilterLanczos3: return 3.0;
+            default: return 1.0;
+            }
+        }
+
+        static inline double Sinc(double x)
+        {
+            if (0.0 == x)
+                return 1.0;
+
+            x *= 3.14159265358979323846;
+            return ::sin(x) / x;
+        }
+
+        static double FilterWeight(Filter filter, double x)
+        {
+            switch (filter)
+            {
+            case FilterBox:
+                return x > -0.5 && x <= 0.5 ? 1.0 : 0.0;
+            case FilterLanczos3:
+                return x >= -3.0 && x < 3.0 ? Sinc(x) * Sinc(x / 3.0) : 0.0;
+            default:
+                x = x < 0.0 ? -x : x;
+                return x < 1.0 ? 1.0 - x : 0.0;
+            }
+        }
+
+        //! output pixels [first, first + count) of srcSize scaled to dstSize
+        //! a window running past the end is moved back inside, so no tap reads out of the source
+        static void BuildTable(Filter filter, INT srcSize, INT dstSize, INT first, INT count, ResampleTable& table)
+        {
+            double scale = (double)srcSize / dstSize;
+            double filterScale = max(scale, 1.0);
+            double support = FilterSupport(filter) * filterScale;
+
+            UINT taps = min((UINT)::ceil(support) * 2 + 1, (UINT)srcSize);
+            table.taps = taps;
+            table.start.resize(count);
+            table.weight.resize((size_t)count * taps);
+            table.work.resize(taps);
+
+            for (INT i = 0; i != count; ++i)
+            {
+                double center = (first + i + 0.5) * scale;
+                INT lo = max((INT)(center - support + 0.5), 0);
+                INT hi = min((INT)(center + support + 0.5), srcSize);
+                INT start = min(lo, srcSize - (INT)taps);
+
+                double sum = 0.0;
+                for (UINT t = 0; t != taps; ++t)
+                {
+                    INT x = start + (INT)t;
+                    double w = x >= lo && x < hi ? FilterWeight(filter, (x - center + 0.5) / filterScale) : 0.0;
+                    table.work[t] = w;
+                    sum += w;
+                }
+
+                //! rounded to 14 bits, the largest weight takes the rounding error so flat areas stay exact
+                SHORT *weight = &table.weight[(size_t)i * taps];
+                INT total = 0;
+                UINT largest = 0;
+                for (UINT t = 0; t != taps; ++t)
+                {
+                    weight[t] = (SHORT)::floor((0.0 != sum ? table.work[t] / sum : 0.0) * (1 << 14) + 0.5);
+                    total += weight[t];
+                    if (weight[t] > weight[largest])
+                        largest = t;
+                }
+                weight[largest] = (SHORT)(weight[largest] + (1 << 14) - total);
+
+                table.start[i] = start;
+            }
+        }
+
+        struct ResampleJob
+        {
+            const Kernels *kernels;
+            const ResampleTable *columns;
+            const ResampleTable *rows;
+
+            PBYTE dst;
+            INT dstStride;
+            INT width;
+
+            //! source rows, already moved to the part's first column when the width is not scaled
+            const BYTE *src;
+            INT srcStride;
+            INT firstRow;
+
+            //! what the vertical pass reads: pixels after the horizontal one, or src itself
+            const BYTE *rowsBase;
+            INT rowsStride;
+
+            void (*pass)(const ResampleJob& job, INT begin, INT end);
+            UINT count;
+            UINT chunks;
+        };
+
+        //! source rows [firstRow + begin, firstRow + end) through the column weights into the scratch rows
+        static void HorizontalPass(const ResampleJob& job, INT begin, INT end)
+        {
+            for (INT y = begin; y != end; ++y)
+            {
+                job.kernels->resampleRow((DWORD *)(job.rowsBase + y * job.rowsStride), job.width,
+                    (const DWORD *)(job.src + (job.firstRow + y) * job.srcStride), &job.columns->start[0], &job.columns->weight[0], job.columns->taps);
+            }
+        }
+
+        //! output rows [begin, end) through the row weights
+        static void VerticalPass(const ResampleJob& job, INT begin, INT end)
+        {
+            UINT taps = job.rows->taps;
+            for (INT y = begin; y != end; ++y)
+            {
+                job.kernels->resampleColumn((DWORD *)(job.dst + y * job.dstStride), job.width,
+                    (const DWORD *)(job.rowsBase + (job.rows->start[y] - job.firstRow) * job.rowsStride), job.rowsStride,
+                    &job.rows->weight[(size_t)y * taps], taps);
+            }
+        }
+
+        //! the height is not scaled, output row y is source row firstRow + y
+        static void RowPass(const ResampleJob& job, INT begin, INT end)
+        {
+            for (INT y = begin; y != end; ++y)
+            {
+                job.kernels->resampleRow((DWORD *)(job.dst + y * job.dstStride), job.width,
+                    (const DWORD *)(job.src + (job.firstRow + y) * job.srcStride), &job.columns->start[0], &job.columns->weight[0], job.columns->taps);
+            }
+        }
+
+        static void RunChunk(void *param, UINT index)
+        {
+            const ResampleJob& job = *(const ResampleJob *)param;
+            job.pass(job, (INT)((ULONGLONG)job.count * index / job.chunks), (INT)((ULONGLONG)job.count * (index + 1) / job.chunks));
+        }
+
+        static void RunPass(ResampleJob& job, void (*pass)(const ResampleJob&, INT, INT), UINT count, ThreadPool *pool)
+        {
+            job.pass = pass;
+            job.count = count;
+            job.chunks = pool ? min(count, pool->GetConcurrency() * 4) : 1;
+
+            if (job.chunks > 1)
+                pool->Run(job.chunks, RunChunk, &job);
+            else
+                pass(job, 0, (INT)count);
+        }
+
+        void Resample(Filter filter, PBYTE dst, INT dstStride, const RECT& part, INT scaledWidth, INT scaledHeight,
+            const BYTE *src, INT srcStride, INT srcWidth, INT srcHeight, ThreadPool *pool)
+        {
+            if (part.right <= 0 || part.bottom <= 0 || scaledWidth <= 0 || scaledHeight <= 0 || srcWidth <= 0 || srcHeight <= 0)
+                return;
+
+            const Kernels& kernels = GetKernels();
+
+            if (FilterNearest == filter)
+            {
+                //! sample pixel centres, 16.16 fixed point, as ScaleNearest does
+                UINT dx = (UINT)(((unsigned long long)srcWidth << 16) / scaledWidth);
+                UINT dy = (UINT)(((unsigned long long)srcHeight << 16) / scaledHeight);
+                UINT x0 = dx / 2 + part.left * dx;
+                UINT y = dy / 2 + part.top * dy;
+
+                for (INT i = 0; i != part.bottom; ++i, dst += dstStride, y += dy)
+                {
+                    kernels.scaleNearest((DWORD *)dst, part.right, (const DWORD *)(src + (y >> 16) * srcStride), x0, dx);
+                }
+
+                return;
+            }
+
+            ResampleScratch& scratch = GetScratch();
+            bool scaleWidth = scaledWidth != srcWidth;
+            bool scaleHeight = scaledHeight != srcHeight;
+
+            ResampleJob job = { &kernels, &scratch.columns, &scratch.rows, dst, dstStride, part.right, src, srcStride, 0, NULL, 0, NULL, 0, 0 };
+
+            if (scaleWidth)
+                BuildTable(filter, srcWidth, scaledWidth, part.left, part.right, scratch.columns);
+            else
+                job.src += part.left * 4;
+
+            if (!scaleHeight)
+            {
+                job.firstRow = part.top;
+                if (scaleWidth)
+                {
+                    RunPass(job, RowPass, part.bottom, pool);
+                }
+                else
+                {
+                    for (INT y = 0; y != part.bottom; ++y)
+                        kernels.copy((DWORD *)(dst + y * dstStride), (const DWORD *)(job.src + (part.top + y) * srcStride), part.right);
+                }
+
+                return;
+            }
+
+            BuildTable(filter, srcHeight, scaledHeight, part.top, part.bottom, scratch.rows);
+
+            //! the source rows some output row reads, the starts only grow
+            INT firstRow = scratch.rows.start[0];
+            INT lastRow = scratch.rows.start[part.bottom - 1] + (INT)scratch.rows.taps;
+            job.firstRow = firstRow;
+
+            if (scaleWidth)
+            {
+                scratch.pixels.resize((size_t)(lastRow - firstRow) * part.right);
+                job.rowsBase = (const BYTE *)&scratch.pixels[0];
+                job.rowsStride = part.right * 4;
+
+                RunPass(job, HorizontalPass, lastRow - firstRow, pool);
+            }
+            else
+            {
+                job.rowsBase = job.src + firstRow * srcStride;
+                job.rowsStride = srcStride;
+            }
+
+            RunPass(job, VerticalPass, part.bottom, pool);
+        }
+    }
+}
\ No newline at end of file
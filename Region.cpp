@@ -0,0 +1,470 @@
+#include "Region.h"
+
+#include <limits.h>
+
+namespace Render
+{
+    static inline ULONG AreaOf(const RECT& r)
+    {
+        return (ULONG)r.right * (ULONG)r.bottom;
+    }
+
+    static inline RECT BoundsOf(const RECT& a, const RECT& b)
+    {
+        LONG left = min(a.left, b.left);
+        LONG top = min(a.top, b.top);
+        LONG right = max(a.left + a.right, b.left + b.right);
+        LONG bottom = max(a.top + a.bottom, b.top + b.bottom);
+
+        RECT r = { left, top, right - left, bottom - top };
+        return r;
+    }
+
+    static inline bool Contains(const RECT& outer, const RECT& inner)
+    {
+        return inner.left >= outer.left && inner.top >= outer.top &&
+            inner.left + inner.right <= outer.left + outer.right &&
+            inner.top + inner.bottom <= outer.top + outer.bottom;
+    }
+
+    DamageRegion::DamageRegion()
+        : m_rects()
+    {
+        m_rects.reserve(MaxRects + 1);
+    }
+
+    DamageRegion::~DamageRegion()
+    {
+
+    }
+
+    void DamageRegion::Add(const RECT& rect)
+    {
+        if (rect.right <= 0 || rect.bottom <= 0)
+            return;
+
+        RECT merged = rect;
+
+        //! swallow whatever the new rect covers, or merge when the bounding box wastes nothing
+        for (size_t i = 0; i < m_rects.size();)
+        {
+            const RECT& current = m_rects[i];
+
+            if (Contains(current, merged))
+                return;
+
+            RECT bounds = BoundsOf(current, merged);
+            if (Contains(merged, current) || AreaOf(bounds) <= AreaOf(current) + AreaOf(merged))
+            {
+                merged = bounds;
+                m_rects.erase(m_rects.begin() + i);
+                i = 0;
+                continue;
+            }
+
+            ++i;
+        }
+
+        if (m_rects.size() < MaxRects)
+        {
+            m_rects.push_back(merged);
+            return;
+        }
+
+        //! full, grow the rect that costs the fewest extra pixels
+        size_t best = 0;
+        ULONG bestGrowth = (ULONG)~0;
+        for (size_t i = 0; i != m_rects.size(); ++i)
+        {
+            ULONG growth = AreaOf(BoundsOf(m_rects[i], merged)) - AreaOf(m_rects[i]);
+            if (growth < bestGrowth)
+            {
+                bestGrowth = growth;
+                best = i;
+            }
+        }
+
+        RECT grown = BoundsOf(m_rects[best], merged);
+        m_rects.erase(m_rects.begin() + best);
+        Add(grown);
+    }
+
+    void DamageRegion::Add(const DamageRegion& other)
+    {
+        for (size_t i = 0; i != other.m_rects.size(); ++i)
+        {
+            Add(other.m_rects[i]);
+        }
+    }
+
+    void DamageRegion::Clear()
+    {
+        m_rects.clear();
+    }
+
+    void DamageRegion::ClipTo(const SIZE& size)
+    {
+        for (size_t i = 0; i < m_rects.size();)
+        {
+            RECT& r = m_rects[i];
+
+            LONG left = max(0, r.left);
+            LONG top = max(0, r.top);
+            LONG right = min(size.cx, r.left + r.right);
+            LONG bottom = min(size.cy, r.top + r.bottom);
+
+            if (right <= left || bottom <= top)
+            {
+                m_rects.erase(m_rects.begin() + i);
+                continue;
+            }
+
+            r.left = left;
+            r.top = top;
+            r.right = right - left;
+            r.bottom = bottom - top;
+            ++i;
+        }
+    }
+
+    RECT DamageRegion::GetBounds() const
+    {
+        if (m_rects.empty())
+        {
+            RECT empty = { 0 };
+            return empty;
+        }
+
+        RECT bounds = m_rects[0];
+        for (size_t i = 1; i != m_rects.size(); ++i)
+        {
+            bounds = BoundsOf(bounds, m_rects[i]);
+        }
+
+        return bounds;
+    }
+
+    ULONG DamageRegion::GetArea() const
+    {
+        ULONG area = 0;
+        for (size_t i = 0; i != m_rects.size(); ++i)
+        {
+            area += AreaOf(m_rects[i]);
+        }
+
+        return area;
+    }
+
+    static inline LONG RightOf(const RECT& r)
+    {
+        return r.left + r.right;
+    }
+
+    static inline LONG BottomOf(const RECT& r)
+    {
+        return r.top + r.bottom;
+    }
+
+    //! one past the last rect of the band first starts
+    static inline const RECT *BandEnd(const RECT *first, const RECT *end)
+    {
+        const RECT *p = first;
+        while (p != end && p->top == first->top)
+            ++p;
+
+        return p;
+    }
+
+    static inline bool Keeps(ClipOp op, bool inA, bool inB)
+    {
+        switch (op)
+        {
+        case ClipIntersect: return inA && inB;
+        case ClipUnion: return inA || inB;
+        case ClipExclude: return inA && !inB;
+        default: return inB;
+        }
+    }
+
+    //! the spans of two bands combined by op, appended as one band of [top, top + height)
+    //! spans touching sideways come out as one
+    static void CombineSpans(ClipOp op, const RECT *a, const RECT *aEnd, const RECT *b, const RECT *bEnd,
+        LONG top, LONG height, std::vector<RECT>& out)
+    {
+        size_t start = out.size();
+        LONG x = INT_MIN;
+
+        for (;;)
+        {
+            while (a != aEnd && RightOf(*a) <= x)
+                ++a;
+            while (b != bEnd && RightOf(*b) <= x)
+                ++b;
+
+            if ((a == aEnd && b == bEnd) || (ClipIntersect == op && (a == aEnd || b == bEnd)) || (ClipExclude == op && a == aEnd))
+                break;
+
+            LONG aLeft = a != aEnd ? a->left : INT_MAX;
+            LONG bLeft = b != bEnd ? b->left : INT_MAX;
+
+            //! [x, next) is inside or outside each side as a whole
+            x = max(x, min(aLeft, bLeft));
+            bool inA = aLeft <= x, inB = bLeft <= x;
+
+            LONG next = INT_MAX;
+            if (a != aEnd)
+                next = min(next, inA ? RightOf(*a) : aLeft);
+            if (b != bEnd)
+                next = min(next, inB ? RightOf(*b) : bLeft);
+
+            if (Keeps(op, inA, inB))
+            {
+                if (out.size() != start && RightOf(out.back()) == x)
+                {
+                    out.back().right = next - out.back().left;
+                }
+                else
+                {
+                    RECT span = { x, top, next - x, height };
+                    out.push_back(span);
+                }
+            }
+
+            x = next;
+        }
+    }
+
+    ClipRegion::ClipRegion()
+        : m_rects()
+        , m_bounds()
+        , m_scratch()
+    {
+
+    }
+
+    ClipRegion::ClipRegion(const ClipRegion& other)
+        : m_rects(other.m_rects)
+        , m_bounds(other.m_bounds)
+        , m_scratch()
+    {
+
+    }
+
+    ClipRegion::~ClipRegion()
+    {
+
+    }
+
+    ClipRegion& ClipRegion::operator = (const ClipRegion& other)
+    {
+        if (this != &other)
+        {
+            m_rects.assign(other.m_rects.begin(), other.m_rects.end());
+            m_bounds = other.m_bounds;
+        }
+
+        return *this;
+    }
+
+    void ClipRegion::SetEmpty()
+    {
+        m_rects.clear();
+        UpdateBounds();
+    }
+
+    void ClipRegion::SetRect(const RECT& rect)
+    {
+        m_rects.clear();
+        if (rect.right > 0 && rect.bottom > 0)
+            m_rects.push_back(rect);
+
+        UpdateBounds();
+    }
+
+    void ClipRegion::Intersect(const RECT& rect)
+    {
+        if (rect.right <= 0 || rect.bottom <= 0)
+        {
+            SetEmpty();
+            return;
+        }
+
+        if (IsRect())
+        {
+            //! the common case, one rect stays one rect
+            RECT& r = m_rects[0];
+            LONG left = max(r.left, rect.left), top = max(r.top, rect.top);
+            LONG right = min(RightOf(r), RightOf(rect)), bottom = min(BottomOf(r), BottomOf(rect));
+
+            RECT both = { left, top, right - left, bottom - top };
+            SetRect(both);
+            return;
+        }
+
+        Combine(ClipIntersect, &rect, 1);
+    }
+
+    void ClipRegion::Intersect(const ClipRegion& other)
+    {
+        Combine(ClipIntersect, other.m_rects.data(), other.m_rects.size());
+    }
+
+    void ClipRegion::Union(const RECT& rect)
+    {
+        if (rect.right > 0 && rect.bottom > 0)
+            Combine(ClipUnion, &rect, 1);
+    }
+
+    void ClipRegion::Union(const ClipRegion& other)
+    {
+        Combine(ClipUnion, other.m_rects.data(), other.m_rects.size());
+    }
+
+    void ClipRegion::Subtract(const RECT& rect)
+    {
+        if (rect.right > 0 && rect.bottom > 0 && Intersects(rect))
+            Combine(ClipExclude, &rect, 1);
+    }
+
+    void ClipRegion::Subtract(const ClipRegion& other)
+    {
+        Combine(ClipExclude, other.m_rects.data(), other.m_rects.size());
+    }
+
+    void ClipRegion::Combine(ClipOp op, const RECT& rect)
+    {
+        switch (op)
+        {
+        case ClipReplace: SetRect(rect); break;
+        case ClipIntersect: Intersect(rect); break;
+        case ClipUnion: Union(rect); break;
+        case ClipExclude: Subtract(rect); break;
+        }
+    }
+
+    void ClipRegion::Offset(LONG dx, LONG dy)
+    {
+        for (size_t i = 0; i != m_rects.size(); ++i)
+        {
+            m_rects[i].left += dx;
+            m_rects[i].top += dy;
+        }
+
+        UpdateBounds();
+    }
+
+    bool ClipRegion::Intersects(const RECT& rect) const
+    {
+        if (rect.right <= 0 || rect.bottom <= 0 || m_rects.empty())
+            return false;
+
+        if (rect.left >= RightOf(m_bounds) || RightOf(rect) <= m_bounds.left || rect.top >= BottomOf(m_bounds) || BottomOf(rect) <= m_bounds.top)
+            return false;
+
+        for (size_t i = 0; i != m_rects.size(); ++i)
+        {
+            const RECT& r = m_rects[i];
+            if (r.top >= BottomOf(rect))
+                break;
+
+            if (BottomOf(r) > rect.top && r.left < RightOf(rect) && RightOf(r) > rect.left)
+                return true;
+        }
+
+        return false;
+    }
+
+    bool ClipRegion::Contains(LONG x, LONG y) const
+    {
+        RECT pixel = { x, y, 1, 1 };
+        return Intersects(pixel);
+    }
+
+    void ClipRegion::Combine(ClipOp op, const RECT *other, size_t count)
+    {
+        const RECT *a = m_rects.data(), *aEnd = a + m_rects.size();
+        const RECT *b = other, *bEnd = other + count;
+
+        m_scratch.clear();
+
+        //! the last band put out, a band with the same spans right below it only makes it taller
+        size_t previous = 0;
+        LONG y = INT_MIN;
+
+        for (;;)
+        {
+            while (a != aEnd && BottomOf(*a) <= y)
+                a = BandEnd(a, aEnd);
+            while (b != bEnd && BottomOf(*b) <= y)
+                b = BandEnd(b, bEnd);
+
+            if ((a == aEnd && b == bEnd) || (ClipIntersect == op && (a == aEnd || b == bEnd)) || (ClipExclude == op && a == aEnd))
+                break;
+
+            LONG aTop = a != aEnd ? a->top : INT_MAX;
+            LONG bTop = b != bEnd ? b->top : INT_MAX;
+
+            //! [y, next) crosses no band edge of either side
+            y = max(y, min(aTop, bTop));
+            bool inA = aTop <= y, inB = bTop <= y;
+
+            LONG next = INT_MAX;
+            if (a != aEnd)
+                next = min(next, inA ? BottomOf(*a) : aTop);
+            if (b != bEnd)
+                next = min(next, inB ? BottomOf(*b) : bTop);
+
+            size_t start = m_scratch.size();
+            CombineSpans(op, inA ? a : aEnd, inA ? BandEnd(a, aEnd) : aEnd, inB ? b : bEnd, inB ? BandEnd(b, bEnd) : bEnd,
+                y, next - y, m_scratch);
+
+            if (m_scratch.size() != start)
+            {
+                bool same = start - previous == m_scratch.size() - start && BottomOf(m_scratch[previous]) == y;
+                for (size_t i = 0; same && i != start - previous; ++i)
+                {
+                    same = m_scratch[previous + i].left == m_scratch[start + i].left && m_scratch[previous + i].right == m_scratch[start + i].right;
+                }
+
+                if (same)
+                {
+                    for (size_t i = previous; i != start; ++i)
+                    {
+                        m_scratch[i].bottom += next - y;
+                    }
+                    m_scratch.resize(start);
+                }
+                else
+                {
+                    previous = start;
+                }
+            }
+
+            y = next;
+        }
+
+        m_rects.swap(m_scratch);
+        UpdateBounds();
+    }
+
+    void ClipRegion::UpdateBounds()
+    {
+        if (m_rects.empty())
+        {
+            RECT empty = { 0 };
+            m_bounds = empty;
+            return;
+        }
+
+        //! banded, the first rect has the top and the last the bottom
+        LONG left = m_rects[0].left, right = RightOf(m_rects[0]);
+        for (size_t i = 1; i != m_rects.size(); ++i)
+        {
+            left = min(left, m_rects[i].left);
+            right = max(right, RightOf(m_rects[i]));
+        }
+
+        RECT bounds = { left, m_rects[0].top, right - left, BottomOf(m_rects.back()) - m_rects[0].top };
+        m_bounds = bounds;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Win32Compat.h"
+
+#include <vector>
+
+namespace Render
+{
+    //! rects touched since the last reset
+    //! every rect is left / top / width / height, like GetSurfaceRect
+    class DamageRegion
+    {
+    public:
+        //! past this the closest rects are merged, so flushes stay a handful of copies
+        enum { MaxRects = 16 };
+
+    private:
+        typedef std::vector<RECT> Rects;
+        Rects m_rects;
+
+    public:
+        DamageRegion();
+        ~DamageRegion();
+
+    public:
+        void Add(const RECT& rect);
+        void Add(const DamageRegion& other);
+        void Clear();
+
+        //! drop everything outside [0, size)
+        void ClipTo(const SIZE& size);
+
+    public:
+        bool IsEmpty() const { return m_rects.empty(); }
+        UINT GetCount() const { return (UINT)m_rects.size(); }
+        const RECT& GetRect(UINT index) const { return m_rects[index]; }
+
+        RECT GetBounds() const;
+        //! pixels covered, overlaps counted once per rect
+        ULONG GetArea() const;
+    };
+
+    //! how a rect changes a clip
+    enum ClipOp
+    {
+        ClipReplace = 0, ClipIntersect, ClipUnion, ClipExclude,
+    };
+
+    //! a set of pixels as y-x banded rects: sorted top to bottom, then left to right,
+    //! the rects of a band share top and height, never overlap or touch sideways,
+    //! and a band the same as the one right above it is merged into it
+    //! every rect is left / top / width / height, like DamageRegion
+    class ClipRegion
+    {
+    private:
+        typedef std::vector<RECT> Rects;
+        Rects m_rects;
+        RECT m_bounds;
+        //! the result of the last operation is built here and swapped in, both keep their capacity
+        Rects m_scratch;
+
+    public:
+        ClipRegion();
+        ClipRegion(const ClipRegion& other);
+        ~ClipRegion();
+
+        //! copies the rects only, into the capacity already there
+        ClipRegion& operator = (const ClipRegion& other);
+
+    public:
+        void SetEmpty();
+        void SetRect(const RECT& rect);
+
+        void Intersect(const RECT& rect);
+        void Intersect(const ClipRegion& other);
+        void Union(const RECT& rect);
+        void Union(const ClipRegion& other);
+        void Subtract(const RECT& rect);
+        void Subtract(const ClipRegion& other);
+
+        void Combine(ClipOp op, const RECT& rect);
+        void Offset(LONG dx, LONG dy);
+
+    public:
+        bool IsEmpty() const { return m_rects.empty(); }
+        UINT GetCount() const { return (UINT)m_rects.size(); }
+        const RECT& GetRect(UINT index) const { return m_rects[index]; }
+
+        //! zero sized when empty
+        const RECT& GetBounds() const { return m_bounds; }
+        bool IsRect() const { return 1 == m_rects.size(); }
+
+        //! whether any pixel of rect is inside
+        bool Intersects(const RECT& rect) const;
+        bool Contains(LONG x, LONG y) const;
+
+    private:
+        void Combine(ClipOp op, const RECT *other, size_t count);
+        void UpdateBounds();
+    };
+}
\ No newline at end of file
@@ -0,0 +1,226 @@
+#include "ScaledImageCache.h"
+
+#include "Image.h"
+
+namespace Render
+{
+    ScaledImageCache& ScaledImageCache::Instance()
+    {
+        //! never destroyed: images cleaned by other statics at exit, such as ImageCache's, still call Drop
+        static ScaledImageCache *cache = new ScaledImageCache();
+        return *cache;
+    }
+
+    ScaledImageCache::ScaledImageCache()
+        : m_lock()
+        , m_entries()
+        , m_index()
+        , m_dropped()
+        , m_bytes(0)
+        , m_budget(DefaultBudget)
+        , m_hits(0)
+        , m_misses(0)
+        , m_evictions(0)
+    {
+
+    }
+
+    ScaledImageCache::~ScaledImageCache()
+    {
+        Clear();
+    }
+
+    RefImageResource *ScaledImageCache::Acquire(Image *image, const SIZE& size, Pixel::Filter filter)
+    {
+        if (image->IsNull() || !image->GetId() || size.cx <= 0 || size.cy <= 0)
+            return NULL;
+
+        Key key = { image->GetId(), image->GetGeneration(), size.cx, size.cy, filter };
+        SIZE_T bytes = (SIZE_T)size.cx * 4 * size.cy;
+
+        bool seen;
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+
+            EntryIndex::iterator found = m_index.find(key);
+            if (found != m_index.end() && found->second->image)
+            {
+                ++m_hits;
+                m_entries.splice(m_entries.begin(), m_entries, found->second);
+
+                found->second->image->AddRef();
+                return found->second->image;
+            }
+
+            ++m_misses;
+            if (bytes > m_budget)
+                return NULL;
+
+            seen = found != m_index.end();
+            if (!seen)
+            {
+                //! seen once, remember the size without scaling it
+                Entry entry = { key, NULL, 0 };
+                m_entries.push_front(entry);
+                m_index[key] = m_entries.begin();
+                image->m_scaleCached = true;
+
+                Trim(m_budget);
+            }
+            else
+                m_entries.splice(m_entries.begin(), m_entries, found->second);
+        }
+
+        if (!seen)
+        {
+            ReleaseDropped();
+            return NULL;
+        }
+
+        //! scaled outside the lock, draws of other images go on meanwhile
+        Image *source = Pixel::FilterNearest == filter ? image : image->GetMipmap(size);
+
+        RefImageResource *scaled = RefImageResource::Create(size);
+        if (!scaled)
+            return NULL;
+
+        scaled->AddRef();
+
+        RECT whole = { 0, 0, size.cx, size.cy };
+        Pixel::Resample(filter, scaled->GetOffset(0, 0), scaled->GetStride(), whole, size.cx, size.cy,
+            source->GetOffset(0, 0), source->GetStride(), source->GetWidth(), source->GetHeight());
+        scaled->SetAlphaMode(image->GetAlphaMode(), image->IsOpaque());
+
+        RefImageResource *drawn = scaled;
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+
+            EntryIndex::iterator found = m_index.find(key);
+            if (found == m_index.end())
+            {
+                //! trimmed meanwhile
+                Entry entry = { key, NULL, 0 };
+                m_entries.push_front(entry);
+                found = m_index.insert(std::make_pair(key, m_entries.begin())).first;
+                image->m_scaleCached = true;
+            }
+
+            EntryList::iterator entry = found->second;
+            if (entry->image)
+            {
+                //! another thread scaled the same size first
+                drawn = entry->image;
+                drawn->AddRef();
+            }
+            else
+            {
+                entry->image = scaled;
+                entry->bytes = (SIZE_T)scaled->GetStride() * scaled->GetHeight();
+                m_bytes += entry->bytes;
+
+                //! the caller's reference, the first one is the cache's
+                scaled->AddRef();
+                Trim(m_budget);
+            }
+        }
+
+        if (drawn != scaled)
+            scaled->Release();
+        ReleaseDropped();
+
+        return drawn;
+    }
+
+    void ScaledImageCache::Drop(ULONGLONG id)
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+
+            for (EntryList::iterator it = m_entries.begin(); it != m_entries.end();)
+            {
+                EntryList::iterator entry = it++;
+                if (id == entry->key.id)
+                    Drop(entry);
+            }
+        }
+
+        ReleaseDropped();
+    }
+
+    void ScaledImageCache::SetBudget(SIZE_T bytes)
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+
+            m_budget = bytes;
+            Trim(m_budget);
+        }
+
+        ReleaseDropped();
+    }
+
+    void ScaledImageCache::Clear()
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+
+            while (!m_entries.empty())
+                Drop(m_entries.begin());
+        }
+
+        ReleaseDropped();
+    }
+
+    ScaledImageCacheStats ScaledImageCache::GetStats()
+    {
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        ScaledImageCacheStats stats = { m_hits, m_misses, m_evictions, m_bytes, (UINT)m_entries.size() };
+        return stats;
+    }
+
+    void ScaledImageCache::Trim(SIZE_T budget)
+    {
+        //! oldest first, an image being drawn would not free anything
+        for (EntryList::iterator it = m_entries.end(); it != m_entries.begin() && (m_bytes > budget || m_entries.size() > MaxEntries);)
+        {
+            --it;
+            if (it->image && 1 != it->image->GetRefCount())
+                continue;
+
+            EntryList::iterator victim = it++;
+            if (victim->image)
+                ++m_evictions;
+            Drop(victim);
+        }
+    }
+
+    void ScaledImageCache::Drop(EntryList::iterator entry)
+    {
+        m_index.erase(entry->key);
+        m_bytes -= entry->bytes;
+
+        if (entry->image)
+            m_dropped.push_back(entry->image);
+        m_entries.erase(entry);
+    }
+
+    void ScaledImageCache::ReleaseDropped()
+    {
+        //! one at a time outside the lock, a scaled image freed drops its own id through Image::Clean
+        for (;;)
+        {
+            RefImageResource *image;
+            {
+                std::lock_guard<std::mutex> guard(m_lock);
+
+                if (m_dropped.empty())
+                    return;
+                image = m_dropped.back();
+                m_dropped.pop_back();
+            }
+
+            image->Release();
+        }
+    }
+}
\ No newline at end of file
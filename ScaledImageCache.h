@@ -0,0 +1,120 @@
+#pragma once
+
+#include "Win32Compat.h"
+#include "PixelKernel.h"
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace Render
+{
+    class Image;
+    class RefImageResource;
+
+    struct ScaledImageCacheStats
+    {
+        ULONGLONG hits;
+        ULONGLONG misses;
+        ULONGLONG evictions;
+        SIZE_T bytes;
+        UINT count;
+    };
+
+    //! images resampled to the sizes they are drawn at, keyed by (image id, generation, size, filter)
+    //! a size is scaled and kept from its second draw on, so one-off sizes and changing frames cost nothing extra
+    //! an image's entries go when its pixels are written (Invalidate) or freed (Clean)
+    class ScaledImageCache
+    {
+    public:
+        enum
+        {
+            DefaultBudget = 32 * 1024 * 1024,
+            MaxEntries = 1024,      //! seen once sizes included, they hold no pixels
+        };
+
+    private:
+        struct Key
+        {
+            ULONGLONG id;
+            UINT generation;
+            LONG width;
+            LONG height;
+            Pixel::Filter filter;
+
+            bool operator == (const Key& other) const
+            {
+                return id == other.id && generation == other.generation && width == other.width
+                    && height == other.height && filter == other.filter;
+            }
+        };
+
+        struct KeyHash
+        {
+            size_t operator () (const Key& key) const
+            {
+                ULONGLONG h = key.id * 0x9E3779B97F4A7C15ull;
+                h ^= ((ULONGLONG)key.generation << 32) | ((ULONGLONG)(DWORD)key.filter << 28);
+                h ^= ((ULONGLONG)(DWORD)key.width << 16) ^ (DWORD)key.height;
+                return (size_t)(h ^ (h >> 29));
+            }
+        };
+
+        struct Entry
+        {
+            Key key;
+            RefImageResource *image;    //! one reference is the cache's, NULL while seen only once
+            SIZE_T bytes;
+        };
+
+        //! front is the most recent
+        typedef std::list<Entry> EntryList;
+        typedef std::unordered_map<Key, EntryList::iterator, KeyHash> EntryIndex;
+
+    private:
+        std::mutex m_lock;
+
+        EntryList m_entries;
+        EntryIndex m_index;
+        std::vector<RefImageResource *> m_dropped;  //! the cache's references of dropped entries, released once unlocked
+        SIZE_T m_bytes;
+        SIZE_T m_budget;
+
+        ULONGLONG m_hits;
+        ULONGLONG m_misses;
+        ULONGLONG m_evictions;
+
+    public:
+        static ScaledImageCache& Instance();
+
+    public:
+        ScaledImageCache();
+        ~ScaledImageCache();
+
+    public:
+        //! image scaled to size with filter, one reference the caller's to Release
+        //! NULL the first time a size is asked for, or when it would not fit the budget; draw it directly then
+        RefImageResource *Acquire(Image *image, const SIZE& size, Pixel::Filter filter);
+
+        //! every size of the image with this id, any generation; Image::Invalidate and Clean call it
+        void Drop(ULONGLONG id);
+
+        //! bytes of scaled pixels kept, entries still being drawn stay even over it
+        void SetBudget(SIZE_T bytes);
+        //! drops the cache's references, images being drawn live on until released
+        void Clear();
+
+        ScaledImageCacheStats GetStats();
+
+    private:
+        void Trim(SIZE_T budget);
+        //! under the lock, the image's reference goes to m_dropped
+        void Drop(EntryList::iterator entry);
+        void ReleaseDropped();
+
+    private:
+        ScaledImageCache(const ScaledImageCache&);
+        ScaledImageCache& operator = (const ScaledImageCache&);
+    };
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Win32Compat.h"
+
+#include <vector>
+
+namespace Render
+{
+    //! stack whose first N levels live inline, deeper levels spill into a vector
+    //! popped slots keep their contents and their storage, Push hands a slot back
+    //! as it was left, the caller resets what it needs
+    template<class T, UINT N>
+    class SmallStack
+    {
+    private:
+        T m_inline[N];
+        std::vector<T> m_spill;     //! never shrinks, levels N and deeper
+        UINT m_size;
+
+    public:
+        SmallStack() : m_spill(), m_size(0) {}
+
+    public:
+        T& Push()
+        {
+            if (m_size < N)
+                return m_inline[m_size++];
+
+            if (m_spill.size() <= m_size - N)
+                m_spill.push_back(T());
+
+            return m_spill[m_size++ - N];
+        }
+
+        void Pop() { --m_size; }
+        void Clear() { m_size = 0; }
+
+    public:
+        T& Top() { return (*this)[m_size - 1]; }
+        const T& Top() const { return (*this)[m_size - 1]; }
+
+        T& operator [] (UINT level) { return level < N ? m_inline[level] : m_spill[level - N]; }
+        const T& operator [] (UINT level) const { return level < N ? m_inline[level] : m_spill[level - N]; }
+
+        UINT GetSize() const { return m_size; }
+        bool IsEmpty() const { return 0 == m_size; }
+
+    private:
+        SmallStack(const SmallStack&);
+        SmallStack& operator = (const SmallStack&);
+    };
+}
\ No newline at end of file
@@ -1,8 +1,11 @@
 #include "Surface.h"
 
+#if defined(_WIN32)
 #include <Amvideo.h>
+#endif
 
 #include "Context.h"
+#include "PixelKernel.h"
 
 #if USE_CAIRO
 #include "cairo.h"
@@ -18,6 +21,7 @@ namespace Render
         , m_mirrorBitmap(NULL)
         , m_mirrorBitmapInfo()
         , m_pOutData(NULL)
+        , m_outStride(0)
     {
     }
 
@@ -28,6 +32,11 @@ namespace Render
     }
 
     void RenderSurface::SetSource(PBYTE pData, ULONG uLen, LONG iWidth, LONG iHeight, UINT iFormat)
+    {
+        Bind(pData, WIDTHBYTES(iWidth * iFormat), iWidth, iHeight, iFormat);
+    }
+
+    void RenderSurface::Bind(PBYTE pData, LONG iStride, LONG iWidth, LONG iHeight, UINT iFormat)
     {
         if (m_mirrorBitmapInfo.bmiHeader.biWidth != iWidth ||
             -m_mirrorBitmapInfo.bmiHeader.biHeight != iHeight ||
@@ -57,6 +66,7 @@ namespace Render
         }
 
         m_pOutData = pData;
+        m_outStride = iStride;
     }
 
     void RenderSurface::InitContext(Context& context)
@@ -72,9 +82,74 @@ namespace Render
 
     void RenderSurface::Flush()
     {
+        ++m_flushCount;
+
         if (m_pOutData)
         {
-            ::memcpy(m_pOutData, m_pMirrorData, DIBSIZE(m_mirrorBitmapInfo.bmiHeader));
+            LONG stride = DIBWIDTHBYTES(m_mirrorBitmapInfo.bmiHeader);
+
+            if (stride == m_outStride)
+            {
+                ::memcpy(m_pOutData, m_pMirrorData, DIBSIZE(m_mirrorBitmapInfo.bmiHeader));
+            }
+            else
+            {
+                LONG rowBytes = m_mirrorBitmapInfo.bmiHeader.biWidth * m_mirrorBitmapInfo.bmiHeader.biBitCount / 8;
+                LONG height = -m_mirrorBitmapInfo.bmiHeader.biHeight;
+
+                for (LONG y = 0; y != height; ++y)
+                {
+                    ::memcpy(m_pOutData + y * m_outStride, m_pMirrorData + y * stride, rowBytes);
+                }
+            }
+        }
+    }
+
+    void RenderSurface::Flush(const DamageRegion& damage)
+    {
+        ++m_flushCount;
+
+        if (m_pOutData && m_pMirrorData)
+        {
+            ::GdiFlush();
+
+            //! both top-down, the output may be padded differently
+            LONG stride = DIBWIDTHBYTES(m_mirrorBitmapInfo.bmiHeader);
+            LONG depth = m_mirrorBitmapInfo.bmiHeader.biBitCount / 8;
+
+            for (UINT i = 0; i != damage.GetCount(); ++i)
+            {
+                const RECT& r = damage.GetRect(i);
+                PBYTE src = m_pMirrorData + r.top * stride + r.left * depth;
+                PBYTE dst = m_pOutData + r.top * m_outStride + r.left * depth;
+
+                for (LONG y = 0; y != r.bottom; ++y, src += stride, dst += m_outStride)
+                {
+                    ::memcpy(dst, src, r.right * depth);
+                }
+            }
+        }
+    }
+
+    void RenderSurface::Clear(const DamageRegion& damage)
+    {
+        if (m_pMirrorData)
+        {
+            ::GdiFlush();
+
+            LONG stride = DIBWIDTHBYTES(m_mirrorBitmapInfo.bmiHeader);
+            LONG depth = m_mirrorBitmapInfo.bmiHeader.biBitCount / 8;
+
+            for (UINT i = 0; i != damage.GetCount(); ++i)
+            {
+                const RECT& r = damage.GetRect(i);
+                LONG offset = r.top * stride + r.left * depth;
+
+                for (LONG y = 0; y != r.bottom; ++y, offset += stride)
+                {
+                    ::memset(m_pMirrorData + offset, 0, r.right * depth);
+                }
+            }
         }
     }
 
@@ -102,22 +177,29 @@ namespace Render
 
     void RenderSurface::SetSource(PBYTE pData, ULONG uLen, LONG iWidth, LONG iHeight, UINT iFormat)
     {
-        //! must be 32bit
-        if (32 != iFormat)
+        Bind(pData, ::cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, iWidth), iWidth, iHeight, iFormat);
+    }
+
+    void RenderSurface::Bind(PBYTE pData, LONG iStride, LONG iWidth, LONG iHeight, UINT iFormat)
+    {
+        //! must be 32bit, cairo has no bottom-up strides
+        if (32 != iFormat || iStride < iWidth * 4)
             throw 0;
 
         if (m_cairo_surface)
         {
-            int w = cairo_image_surface_get_width(m_cairo_surface);
-            int h = cairo_image_surface_get_height(m_cairo_surface);
-
-            if (w != iWidth || h != iHeight)
+            if (::cairo_image_surface_get_data(m_cairo_surface) == pData &&
+                ::cairo_image_surface_get_stride(m_cairo_surface) == iStride &&
+                ::cairo_image_surface_get_width(m_cairo_surface) == iWidth &&
+                ::cairo_image_surface_get_height(m_cairo_surface) == iHeight)
             {
-                ::cairo_surface_destroy(m_cairo_surface);
+                return;
             }
+
+            ::cairo_surface_destroy(m_cairo_surface);
         }
 
-        m_cairo_surface = ::cairo_image_surface_create_for_data(pData, CAIRO_FORMAT_ARGB32, iWidth, iHeight, ::cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, iWidth));
+        m_cairo_surface = ::cairo_image_surface_create_for_data(pData, CAIRO_FORMAT_ARGB32, iWidth, iHeight, iStride);
     }
 
     void RenderSurface::InitContext(Context& context)
@@ -125,18 +207,45 @@ namespace Render
         if (m_cairo_surface)
         {
             cairo_t *dc = ::cairo_create(m_cairo_surface);
-            context.OnAttached(dc, this);
+            context.OnAttached(dc, &m_cairo_surface, this);
         }
     }
 
     void RenderSurface::Flush()
     {
+        ++m_flushCount;
+
         if (m_cairo_surface)
         {
             cairo_surface_flush(m_cairo_surface);
         }
     }
 
+    void RenderSurface::Flush(const DamageRegion& /*damage*/)
+    {
+        //! cairo already draws into the output
+        Flush();
+    }
+
+    void RenderSurface::Clear(const DamageRegion& damage)
+    {
+        if (m_cairo_surface)
+        {
+            ::cairo_surface_flush(m_cairo_surface);
+
+            PBYTE data = ::cairo_image_surface_get_data(m_cairo_surface);
+            int stride = ::cairo_image_surface_get_stride(m_cairo_surface);
+
+            for (UINT i = 0; i != damage.GetCount(); ++i)
+            {
+                const RECT& r = damage.GetRect(i);
+                Pixel::Fill(data + r.top * stride + r.left * 4, stride, r.right, r.bottom, 0);
+
+                ::cairo_surface_mark_dirty_rectangle(m_cairo_surface, r.left, r.top, r.right, r.bottom);
+            }
+        }
+    }
+
     void RenderSurface::GetSurfaceRect(PRECT pRect) const
     {
         if (m_cairo_surface)
@@ -151,6 +260,80 @@ namespace Render
         }
     }
 
+#elif USE_SOFTWARE
+
+    RenderSurface::RenderSurface()
+        : m_buffer()
+    {
+
+    }
+
+    RenderSurface::~RenderSurface()
+    {
+
+    }
+
+    void RenderSurface::SetSource(PBYTE pData, ULONG uLen, LONG iWidth, LONG iHeight, UINT iFormat)
+    {
+        //! must be 32bit, top-down and packed
+        if (32 != iFormat || iWidth <= 0 || iHeight <= 0)
+            throw 0;
+
+        if (uLen < (ULONG)iWidth * 4 * iHeight)
+            throw 0;
+
+        Bind(pData, iWidth * 4, iWidth, iHeight, iFormat);
+    }
+
+    void RenderSurface::Bind(PBYTE pData, LONG iStride, LONG iWidth, LONG iHeight, UINT iFormat)
+    {
+        //! negative strides walk a bottom-up buffer from its top row
+        if (32 != iFormat || iWidth <= 0 || iHeight <= 0 || (iStride < 0 ? -iStride : iStride) < iWidth * 4)
+            throw 0;
+
+        m_buffer.data = pData;
+        m_buffer.stride = iStride;
+        m_buffer.width = iWidth;
+        m_buffer.height = iHeight;
+    }
+
+    void RenderSurface::InitContext(Context& context)
+    {
+        if (m_buffer.data)
+        {
+            context.OnAttached(&m_buffer, this);
+        }
+    }
+
+    void RenderSurface::Flush()
+    {
+        ++m_flushCount;
+
+        //! nothing is buffered
+    }
+
+    void RenderSurface::Flush(const DamageRegion& /*damage*/)
+    {
+        ++m_flushCount;
+
+        //! nothing is buffered
+    }
+
+    void RenderSurface::Clear(const DamageRegion& damage)
+    {
+        for (UINT i = 0; i != damage.GetCount(); ++i)
+        {
+            const RECT& r = damage.GetRect(i);
+            Pixel::Fill(m_buffer.data + r.top * m_buffer.stride + r.left * 4, m_buffer.stride, r.right, r.bottom, 0);
+        }
+    }
+
+    void RenderSurface::GetSurfaceRect(PRECT pRect) const
+    {
+        RECT tmp = { 0, 0, m_buffer.width, m_buffer.height };
+        *pRect = tmp;
+    }
+
 #endif
 
 }
\ No newline at end of file
@@ -1,7 +1,12 @@
 #pragma once
 
+#include "Win32Compat.h"
+#include "Region.h"
+
 #if USE_CAIRO
 struct _cairo_surface;
+#elif USE_SOFTWARE
+#include "PixelKernel.h"
 #endif
 
 namespace Render
@@ -10,15 +15,31 @@ namespace Render
 
     class Surface
     {
+    protected:
+        ULONG m_flushCount;
+
     public:
+        Surface() : m_flushCount(0) {}
         virtual ~Surface() {}
 
     public:
         virtual void SetSource(PBYTE pData, ULONG uLen, LONG iWidth, LONG iHeight, UINT iFormat) = 0;
+        //! use the caller's buffer as is, pData is the top row and iStride may exceed the packed width
+        //! rebinding the same geometry to another address is O(1) for software and gdi, whose mirror is
+        //! only copied out at Flush; cairo recreates its surface and the attached contexts their cairo_t
+        virtual void Bind(PBYTE pData, LONG iStride, LONG iWidth, LONG iHeight, UINT iFormat) = 0;
         virtual void InitContext(Context& context) = 0;
         virtual void Flush() = 0;
+        //! only the damaged rects reach the output, they must lie inside the surface
+        virtual void Flush(const DamageRegion& damage) = 0;
+        //! zero the damaged rects, typically what the previous frame drew
+        virtual void Clear(const DamageRegion& damage) = 0;
         //! pRect right/ bottom means width and height
         virtual void GetSurfaceRect(PRECT pRect) const = 0;
+
+    public:
+        //! bumped by every Flush, contexts rewind their frame arena when it moves
+        ULONG GetFlushCount() const { return m_flushCount; }
     };
 
 #if USE_GDI
@@ -31,7 +52,9 @@ namespace Render
         HBITMAP m_mirrorBitmap;
         BITMAPINFO m_mirrorBitmapInfo;
 
+        //! a dib cannot wrap foreign memory, so the output stays a copy target
         PBYTE m_pOutData;
+        LONG m_outStride;
 
     public:
         RenderSurface();
@@ -39,13 +62,18 @@ namespace Render
 
     public:
         virtual void SetSource(PBYTE pData, ULONG uLen, LONG iWidth, LONG iHeight, UINT iFormat);
+        virtual void Bind(PBYTE pData, LONG iStride, LONG iWidth, LONG iHeight, UINT iFormat);
         virtual void InitContext(Context& context);
         virtual void Flush();
+        virtual void Flush(const DamageRegion& damage);
+        virtual void Clear(const DamageRegion& damage);
         virtual void GetSurfaceRect(PRECT pRect) const;
     };
 
 #elif USE_CAIRO
 
+    //! cairo wraps the buffer directly, but a cairo surface cannot be re-pointed: binding another
+    //! address recreates it, attached contexts see that and recreate their cairo_t before drawing
     class RenderSurface : public Surface
     {
     private:
@@ -57,9 +85,37 @@ namespace Render
 
     public:
         virtual void SetSource(PBYTE pData, ULONG uLen, LONG iWidth, LONG iHeight, UINT iFormat);
+        virtual void Bind(PBYTE pData, LONG iStride, LONG iWidth, LONG iHeight, UINT iFormat);
+        virtual void InitContext(Context& context);
+        virtual void Flush();
+        virtual void Flush(const DamageRegion& damage);
+        virtual void Clear(const DamageRegion& damage);
+        virtual void GetSurfaceRect(PRECT pRect) const;
+    };
+
+#elif USE_SOFTWARE
+
+    //! no mirror, the context draws into the caller's buffer directly and follows every Bind
+    class RenderSurface : public Surface
+    {
+    private:
+        PixelBuffer m_buffer;
+
+    public:
+        RenderSurface();
+        virtual ~RenderSurface();
+
+    public:
+        virtual void SetSource(PBYTE pData, ULONG uLen, LONG iWidth, LONG iHeight, UINT iFormat);
+        virtual void Bind(PBYTE pData, LONG iStride, LONG iWidth, LONG iHeight, UINT iFormat);
         virtual void InitContext(Context& context);
         virtual void Flush();
+        virtual void Flush(const DamageRegion& damage);
+        virtual void Clear(const DamageRegion& damage);
         virtual void GetSurfaceRect(PRECT pRect) const;
+
+    public:
+        const PixelBuffer& GetBuffer() const { return m_buffer; }
     };
 
 #endif
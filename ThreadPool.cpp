@@ -0,0 +1,151 @@
+#include "ThreadPool.h"
+
+namespace Render
+{
+    ThreadPool::ThreadPool(UINT threads)
+        : m_threads()
+        , m_queues()
+        , m_runLock()
+        , m_wakeLock()
+        , m_wake()
+        , m_done()
+        , m_queued(0)
+        , m_pending(0)
+        , m_stop(false)
+        , m_proc(NULL)
+        , m_param(NULL)
+    {
+        if (!threads)
+            threads = max(std::thread::hardware_concurrency(), 1u);
+
+        for (UINT i = 0; i != threads; ++i)
+        {
+            m_queues.push_back(new Queue());
+        }
+
+        for (UINT i = 0; i + 1 < threads; ++i)
+        {
+            m_threads.push_back(std::thread(&ThreadPool::WorkerLoop, this, i));
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(m_wakeLock);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+
+        for (size_t i = 0; i != m_threads.size(); ++i)
+        {
+            m_threads[i].join();
+        }
+
+        for (size_t i = 0; i != m_queues.size(); ++i)
+        {
+            delete m_queues[i];
+        }
+    }
+
+    void ThreadPool::Run(UINT count, TaskProc proc, void *param)
+    {
+        if (!count)
+            return;
+
+        std::lock_guard<std::mutex> running(m_runLock);
+
+        m_proc = proc;
+        m_param = param;
+        m_pending = count;
+        m_queued = count;
+
+        //! dealt round robin, neighbouring tasks land on different workers
+        UINT queues = (UINT)m_queues.size();
+        for (UINT q = 0; q != queues; ++q)
+        {
+            Queue& queue = *m_queues[q];
+            std::lock_guard<std::mutex> guard(queue.lock);
+
+            //! the last run drained it, so it starts over at 0
+            UINT dealt = q < count ? (count - q + queues - 1) / queues : 0;
+            if (queue.tasks.size() < dealt)
+                queue.tasks.resize(dealt);
+
+            queue.head = queue.tail = 0;
+            for (UINT i = q; i < count; i += queues)
+            {
+                queue.tasks[queue.tail++] = i;
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> guard(m_wakeLock);
+        }
+        m_wake.notify_all();
+
+        UINT task = 0;
+        while (Take(queues - 1, &task))
+        {
+            Execute(task);
+        }
+
+        std::unique_lock<std::mutex> lock(m_wakeLock);
+        m_done.wait(lock, [this] { return 0 == m_pending; });
+    }
+
+    bool ThreadPool::Take(UINT self, UINT *task)
+    {
+        UINT queues = (UINT)m_queues.size();
+
+        //! own queue from the back, the others from the front
+        for (UINT k = 0; k != queues; ++k)
+        {
+            Queue& queue = *m_queues[(self + k) % queues];
+            std::lock_guard<std::mutex> guard(queue.lock);
+
+            if (queue.head == queue.tail)
+                continue;
+
+            if (0 == k)
+                *task = queue.tasks[--queue.tail];
+            else
+                *task = queue.tasks[queue.head++];
+
+            --m_queued;
+            return true;
+        }
+
+        return false;
+    }
+
+    void ThreadPool::Execute(UINT task)
+    {
+        m_proc(m_param, task);
+
+        if (1 == m_pending.fetch_sub(1))
+        {
+            std::lock_guard<std::mutex> guard(m_wakeLock);
+            m_done.notify_all();
+        }
+    }
+
+    void ThreadPool::WorkerLoop(UINT self)
+    {
+        for (;;)
+        {
+            UINT task = 0;
+            if (Take(self, &task))
+            {
+                Execute(task);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_wakeLock);
+            m_wake.wait(lock, [this] { return m_stop || m_queued > 0; });
+
+            if (m_stop)
+                return;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Win32Compat.h"
+
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+
+namespace Render
+{
+    //! fixed set of workers, each with its own queue, idle workers steal from the others
+    //! one parallel loop at a time, the calling thread takes part in it
+    class ThreadPool
+    {
+    public:
+        typedef void (*TaskProc)(void *param, UINT index);
+
+    private:
+        //! tasks[head, tail) are left; the storage is kept across runs, grown only when a run deals more
+        struct Queue
+        {
+            std::mutex lock;
+            std::vector<UINT> tasks;
+            UINT head;      //! stolen from here
+            UINT tail;      //! the owner takes from here down
+
+            Queue() : lock(), tasks(), head(0), tail(0) {}
+        };
+
+    private:
+        std::vector<std::thread> m_threads;
+        std::vector<Queue *> m_queues;     //! one per worker, the last one is the caller's
+
+        std::mutex m_runLock;
+        std::mutex m_wakeLock;
+        std::condition_variable m_wake;
+        std::condition_variable m_done;
+
+        std::atomic<UINT> m_queued;
+        std::atomic<UINT> m_pending;
+        bool m_stop;
+
+        TaskProc m_proc;
+        void *m_param;
+
+    public:
+        //! 0 picks one thread per hardware thread
+        explicit ThreadPool(UINT threads = 0);
+        ~ThreadPool();
+
+    public:
+        //! proc(param, i) for every i in [0, count), returns once all are done
+        void Run(UINT count, TaskProc proc, void *param);
+
+        //! workers plus the calling thread
+        UINT GetConcurrency() const { return (UINT)m_queues.size(); }
+
+    private:
+        bool Take(UINT self, UINT *task);
+        void Execute(UINT task);
+        void WorkerLoop(UINT self);
+
+    private:
+        ThreadPool(const ThreadPool&);
+        ThreadPool& operator = (const ThreadPool&);
+    };
+}
\ No newline at end of file
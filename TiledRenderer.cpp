@@ -0,0 +1,127 @@
+#include "TiledRenderer.h"
+
+#include "DisplayList.h"
+#include "ThreadPool.h"
+
+#if USE_SOFTWARE
+
+namespace Render
+{
+    TiledRenderer::TiledRenderer(ThreadPool& pool, LONG tileSize)
+        : m_pool(pool)
+        , m_tileSize(max(tileSize, 16))
+        , m_tiles()
+        , m_tileCount(0)
+        , m_list(NULL)
+        , m_damage()
+    {
+
+    }
+
+    TiledRenderer::~TiledRenderer()
+    {
+        for (size_t i = 0; i != m_tiles.size(); ++i)
+        {
+            delete m_tiles[i];
+        }
+    }
+
+    void TiledRenderer::Render(const DisplayList& list, RenderSurface& surface)
+    {
+        m_damage.Clear();
+
+        const PixelBuffer& target = surface.GetBuffer();
+        if (!target.data || list.IsEmpty())
+            return;
+
+        LONG columns = (target.width + m_tileSize - 1) / m_tileSize;
+        LONG rows = (target.height + m_tileSize - 1) / m_tileSize;
+
+        m_tileCount = columns * rows;
+        while (m_tiles.size() < m_tileCount)
+        {
+            m_tiles.push_back(new Tile());
+        }
+
+        for (LONG row = 0; row != rows; ++row)
+        {
+            for (LONG column = 0; column != columns; ++column)
+            {
+                Tile& tile = *m_tiles[row * columns + column];
+                LONG x = column * m_tileSize, y = row * m_tileSize;
+
+                tile.origin.x = x;
+                tile.origin.y = y;
+                tile.commands.clear();
+                tile.hasDraws = false;
+
+                tile.surface.Bind(target.data + y * target.stride + x * 4, target.stride,
+                    min(m_tileSize, target.width - x), min(m_tileSize, target.height - y), 32);
+                tile.surface.InitContext(tile.context);
+                tile.context.ResetDamage();
+            }
+        }
+
+        //! state goes to every tile so each replays the same Save / Restore nesting
+        for (UINT i = 0; i != list.GetCount(); ++i)
+        {
+            const DisplayList::Command& command = list.GetCommand(i);
+
+            if (!DisplayList::IsDraw(command.op))
+            {
+                for (UINT t = 0; t != m_tileCount; ++t)
+                {
+                    m_tiles[t]->commands.push_back(i);
+                }
+                continue;
+            }
+
+            const RECT& b = command.bounds;
+            LONG left = max(b.left, 0), top = max(b.top, 0);
+            LONG right = min(b.left + b.right, target.width), bottom = min(b.top + b.bottom, target.height);
+            if (right <= left || bottom <= top)
+                continue;
+
+            for (LONG row = top / m_tileSize; row <= (bottom - 1) / m_tileSize; ++row)
+            {
+                for (LONG column = left / m_tileSize; column <= (right - 1) / m_tileSize; ++column)
+                {
+                    Tile& tile = *m_tiles[row * columns + column];
+                    tile.commands.push_back(i);
+                    tile.hasDraws = true;
+                }
+            }
+        }
+
+        m_list = &list;
+        m_pool.Run(m_tileCount, RenderTile, this);
+        m_list = NULL;
+
+        for (UINT t = 0; t != m_tileCount; ++t)
+        {
+            const Tile& tile = *m_tiles[t];
+            const DamageRegion& damage = tile.context.GetDamage();
+
+            for (UINT i = 0; i != damage.GetCount(); ++i)
+            {
+                RECT r = damage.GetRect(i);
+                r.left += tile.origin.x;
+                r.top += tile.origin.y;
+                m_damage.Add(r);
+            }
+        }
+    }
+
+    void TiledRenderer::RenderTile(void *param, UINT index)
+    {
+        TiledRenderer *self = (TiledRenderer *)param;
+        Tile& tile = *self->m_tiles[index];
+
+        if (tile.hasDraws)
+        {
+            self->m_list->Replay(tile.context, tile.origin, tile.commands);
+        }
+    }
+}
+
+#endif
\ No newline at end of file
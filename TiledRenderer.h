@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Context.h"
+#include "Surface.h"
+#include "Region.h"
+
+#include <vector>
+
+#if USE_SOFTWARE
+
+namespace Render
+{
+    class DisplayList;
+    class ThreadPool;
+
+    //! splits the surface into tiles, bins every draw of a list into the tiles it overlaps
+    //! and replays the tiles on a thread pool; each tile clips to itself, so the pixels
+    //! match a single-threaded Replay exactly
+    class TiledRenderer
+    {
+    public:
+        enum { DefaultTileSize = 128 };
+
+    private:
+        struct Tile
+        {
+            RenderSurface surface;      //! bound to the tile's rows of the target
+            Context context;
+            POINT origin;
+            std::vector<UINT> commands;
+            bool hasDraws;
+        };
+
+    private:
+        ThreadPool& m_pool;
+        LONG m_tileSize;
+
+        std::vector<Tile *> m_tiles;    //! kept across frames with their bins
+        UINT m_tileCount;
+        const DisplayList *m_list;
+
+        DamageRegion m_damage;
+
+    public:
+        explicit TiledRenderer(ThreadPool& pool, LONG tileSize = DefaultTileSize);
+        ~TiledRenderer();
+
+    public:
+        void Render(const DisplayList& list, RenderSurface& surface);
+
+        //! what the last Render touched, in surface coordinates
+        const DamageRegion& GetDamage() const { return m_damage; }
+
+    private:
+        static void RenderTile(void *param, UINT index);
+
+    private:
+        TiledRenderer(const TiledRenderer&);
+        TiledRenderer& operator = (const TiledRenderer&);
+    };
+}
+
+#endif
\ No newline at end of file
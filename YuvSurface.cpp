@@ -0,0 +1,210 @@
+#include "YuvSurface.h"
+
+#include "Context.h"
+
+#if USE_SOFTWARE
+
+namespace Render
+{
+    YuvSurface::YuvSurface()
+        : m_format(0)
+        , m_width(0)
+        , m_height(0)
+        , m_overlayData()
+        , m_overlay()
+    {
+        for (int i = 0; i != 3; ++i)
+        {
+            m_planes[i] = NULL;
+            m_strides[i] = 0;
+        }
+    }
+
+    YuvSurface::~YuvSurface()
+    {
+
+    }
+
+    void YuvSurface::SetSource(PBYTE pData, ULONG uLen, LONG iWidth, LONG iHeight, UINT iFormat)
+    {
+        if (iWidth <= 0 || iHeight <= 0)
+            throw 0;
+
+        //! 12 bits per pixel for the 4:2:0 formats, 16 for YUY2
+        LONG stride = FormatYUY2 == iFormat ? iWidth * 2 : iWidth;
+        ULONG size = FormatYUY2 == iFormat ? (ULONG)stride * iHeight : (ULONG)iWidth * iHeight * 3 / 2;
+
+        if (uLen < size)
+            throw 0;
+
+        Bind(pData, stride, iWidth, iHeight, iFormat);
+    }
+
+    void YuvSurface::Bind(PBYTE pData, LONG iStride, LONG iWidth, LONG iHeight, UINT iFormat)
+    {
+        PBYTE planes[3] = { pData, NULL, NULL };
+        LONG strides[3] = { iStride, 0, 0 };
+
+        if (FormatNV12 == iFormat)
+        {
+            planes[1] = pData + iStride * iHeight;
+            strides[1] = iStride;
+        }
+        else if (FormatI420 == iFormat)
+        {
+            strides[1] = strides[2] = iStride / 2;
+            planes[1] = pData + iStride * iHeight;
+            planes[2] = planes[1] + strides[1] * (iHeight / 2);
+        }
+
+        BindPlanes(planes, strides, iWidth, iHeight, iFormat);
+    }
+
+    void YuvSurface::BindPlanes(const PBYTE planes[3], const LONG strides[3], LONG iWidth, LONG iHeight, UINT iFormat)
+    {
+        //! chroma comes in whole 2x2 (2x1 for YUY2) blocks
+        if (iWidth <= 0 || iHeight <= 0 || (iWidth & 1))
+            throw 0;
+
+        switch (iFormat)
+        {
+        case FormatNV12:
+            if ((iHeight & 1) || strides[0] < iWidth || strides[1] < iWidth)
+                throw 0;
+            break;
+        case FormatI420:
+            if ((iHeight & 1) || strides[0] < iWidth || strides[1] < iWidth / 2 || strides[2] < iWidth / 2)
+                throw 0;
+            break;
+        case FormatYUY2:
+            if (strides[0] < iWidth * 2)
+                throw 0;
+            break;
+        default:
+            throw 0;
+        }
+
+        m_format = iFormat;
+        for (int i = 0; i != 3; ++i)
+        {
+            m_planes[i] = planes[i];
+            m_strides[i] = strides[i];
+        }
+
+        //! the overlay only follows the geometry, rebinding the next frame costs nothing
+        if (iWidth != m_width || iHeight != m_height)
+        {
+            m_width = iWidth;
+            m_height = iHeight;
+
+            m_overlayData.assign((size_t)iWidth * iHeight, 0);
+            m_overlay.data = (PBYTE)&m_overlayData[0];
+            m_overlay.stride = iWidth * 4;
+            m_overlay.width = iWidth;
+            m_overlay.height = iHeight;
+            m_overlay.coverage = true;
+        }
+    }
+
+    void YuvSurface::InitContext(Context& context)
+    {
+        if (m_overlay.data)
+        {
+            context.OnAttached(&m_overlay, this);
+        }
+    }
+
+    void YuvSurface::Flush()
+    {
+        ++m_flushCount;
+
+        RECT whole = { 0, 0, m_width, m_height };
+        Composite(whole);
+    }
+
+    void YuvSurface::Flush(const DamageRegion& damage)
+    {
+        ++m_flushCount;
+
+        //! overlapping rects are fine, a composited pixel is cleared before the next rect reaches it
+        for (UINT i = 0; i != damage.GetCount(); ++i)
+        {
+            Composite(damage.GetRect(i));
+        }
+    }
+
+    void YuvSurface::Clear(const DamageRegion& damage)
+    {
+        for (UINT i = 0; i != damage.GetCount(); ++i)
+        {
+            const RECT& r = damage.GetRect(i);
+            Pixel::Fill(m_overlay.data + r.top * m_overlay.stride + r.left * 4, m_overlay.stride, r.right, r.bottom, 0);
+        }
+    }
+
+    void YuvSurface::GetSurfaceRect(PRECT pRect) const
+    {
+        RECT tmp = { 0, 0, m_width, m_height };
+        *pRect = tmp;
+    }
+
+    void YuvSurface::Composite(const RECT& rect)
+    {
+        if (!m_overlay.data)
+            return;
+
+        //! grown to whole chroma blocks, the overlay next to the damage is clear and blends as nothing
+        bool halfHeight = FormatYUY2 != m_format;
+        LONG left = max(0, rect.left) & ~1;
+        LONG right = min(m_width, (rect.left + rect.right + 1) & ~1);
+        LONG top = max(0, rect.top), bottom = min(m_height, rect.top + rect.bottom);
+        if (halfHeight)
+        {
+            top &= ~1;
+            bottom = min(m_height, (bottom + 1) & ~1);
+        }
+
+        if (right <= left || bottom <= top)
+            return;
+
+        const Pixel::Kernels& kernels = Pixel::GetKernels();
+        LONG width = right - left;
+
+        for (LONG y = top; y != bottom; ++y)
+        {
+            const DWORD *src = (const DWORD *)(m_overlay.data + y * m_overlay.stride) + left;
+
+            if (FormatYUY2 == m_format)
+            {
+                PBYTE row = m_planes[0] + y * m_strides[0] + left * 2;
+                kernels.blendLuma(row, 2, src, width);
+                kernels.blendChroma(row + 1, row + 3, 4, src, src, width / 2);
+                continue;
+            }
+
+            kernels.blendLuma(m_planes[0] + y * m_strides[0] + left, 1, src, width);
+
+            //! chroma once both rows of the block are there
+            if (y & 1)
+            {
+                const DWORD *above = (const DWORD *)((const BYTE *)src - m_overlay.stride);
+                LONG row = y / 2;
+
+                if (FormatNV12 == m_format)
+                {
+                    PBYTE uv = m_planes[1] + row * m_strides[1] + left;
+                    kernels.blendChroma(uv, uv + 1, 2, above, src, width / 2);
+                }
+                else
+                {
+                    kernels.blendChroma(m_planes[1] + row * m_strides[1] + left / 2, m_planes[2] + row * m_strides[2] + left / 2, 1,
+                        above, src, width / 2);
+                }
+            }
+        }
+
+        Pixel::Fill(m_overlay.data + top * m_overlay.stride + left * 4, m_overlay.stride, width, bottom - top, 0);
+    }
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Surface.h"
+
+#include <vector>
+
+#if USE_SOFTWARE
+
+namespace Render
+{
+    //! a decoder's NV12 / I420 / YUY2 frame as the render target, without converting the frame
+    //! contexts draw into a premultiplied BGRA overlay; Flush converts only the damaged overlay
+    //! pixels to YUV, blends them into the planes and clears them for the next frame
+    class YuvSurface : public Surface
+    {
+    public:
+        //! iFormat of SetSource / Bind, little endian FOURCC
+        enum Format
+        {
+            FormatNV12 = 0x3231564E,    //! Y plane, then interleaved UV at half resolution
+            FormatI420 = 0x30323449,    //! Y plane, U plane, V plane, chroma at half resolution
+            FormatYUY2 = 0x32595559,    //! packed Y0 U Y1 V, chroma at half width
+        };
+
+    private:
+        UINT m_format;
+        PBYTE m_planes[3];
+        LONG m_strides[3];
+        LONG m_width;
+        LONG m_height;
+
+        std::vector<DWORD> m_overlayData;
+        PixelBuffer m_overlay;
+
+    public:
+        YuvSurface();
+        virtual ~YuvSurface();
+
+    public:
+        //! the planes packed one after another, as most decoders hand them out
+        virtual void SetSource(PBYTE pData, ULONG uLen, LONG iWidth, LONG iHeight, UINT iFormat);
+        //! iStride is the luma stride (the row stride for YUY2), chroma planes follow the luma rows
+        //! with the stride the format implies
+        virtual void Bind(PBYTE pData, LONG iStride, LONG iWidth, LONG iHeight, UINT iFormat);
+        //! planes anywhere, planes[2] / strides[2] only for I420, planes[1] unused for YUY2
+        void BindPlanes(const PBYTE planes[3], const LONG strides[3], LONG iWidth, LONG iHeight, UINT iFormat);
+
+        virtual void InitContext(Context& context);
+        virtual void Flush();
+        virtual void Flush(const DamageRegion& damage);
+        //! drops what was drawn into the damaged rects since the last Flush, the frame is untouched
+        virtual void Clear(const DamageRegion& damage);
+        virtual void GetSurfaceRect(PRECT pRect) const;
+
+    public:
+        UINT GetFormat() const { return m_format; }
+        const PixelBuffer& GetOverlay() const { return m_overlay; }
+
+    private:
+        void Composite(const RECT& rect);
+    };
+}
+
+#endif
\ No newline at end of file
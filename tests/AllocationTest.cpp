@@ -0,0 +1,150 @@
+//! USE_SOFTWARE: once warmed up, frames of clipped, scaled, transformed and text draws, direct, recorded and tiled, do no heap allocation
+//! exits non-zero on the first failure
+
+#include "TestSupport.h"
+#include "../DisplayList.h"
+#include "../TiledRenderer.h"
+#include "../ThreadPool.h"
+
+#include <new>
+#include <atomic>
+
+using namespace Render;
+using namespace Test;
+
+namespace
+{
+    //! the pool's workers allocate too
+    std::atomic<bool> counting(false);
+    std::atomic<size_t> allocations(0);
+
+    void *Allocate(size_t size)
+    {
+        if (counting)
+            ++allocations;
+
+        void *p = ::malloc(size ? size : 1);
+        if (!p)
+            throw std::bad_alloc();
+        return p;
+    }
+}
+
+void *operator new(size_t size) { return Allocate(size); }
+void *operator new[](size_t size) { return Allocate(size); }
+void operator delete(void *p) noexcept { ::free(p); }
+void operator delete[](void *p) noexcept { ::free(p); }
+void operator delete(void *p, size_t) noexcept { ::free(p); }
+void operator delete[](void *p, size_t) noexcept { ::free(p); }
+
+namespace
+{
+    const LONG Width = 320;
+    const LONG Height = 240;
+    const int WarmFrames = 3;
+    const int CountedFrames = 20;
+
+    //! built once as a caller keeps its strings, a wide literal past a few characters allocates on its own
+    struct Texts
+    {
+        String lines;
+        String turned;
+        Font font;
+    };
+
+    //! frames cycle through WarmFrames shapes, so every scratch size has been seen once counting starts
+    void DrawFrame(Context& context, Image *image, const Texts& texts, int frame)
+    {
+        context.Save();
+
+        RECT keep = { 10, 10, 280, 200 }, hole = { 100, 60, 40, 40 };
+        context.IntersectClip(keep);
+        context.ExcludeClip(hole);
+
+        POINT at = { 5 + frame % WarmFrames, 5 };
+        context.DrawImageAt(image, at);
+
+        RECT larger = { 40, 40, 150, 110 }, smaller = { 200, 30, 30, 22 };
+        context.DrawScaledImage(image, larger);
+        context.DrawScaledImage(image, smaller, Pixel::FilterLanczos3);
+        context.DrawScaledImage(image, smaller, Pixel::FilterNearest);
+
+        context.SetFont(texts.font);
+        context.SetBrush(Brush(Brush::Solid, 0x336699));
+        POINT where = { 20, 160 };
+        context.DrawTextAt(where, texts.lines);
+
+        AffineMaxtrix rotate;
+        rotate.Translate(160.f, 120.f);
+        rotate.Rotate(20.f + (float)(frame % WarmFrames));
+        context.SetTransform(rotate);
+        context.DrawImage(image);
+        context.DrawTextAt(where, texts.turned);
+
+        AffineMaxtrix scale;
+        scale.Scale(1.5f, 0.75f);
+        context.SetTransform(scale);
+        context.DrawImage(image);
+
+        context.Restore();
+    }
+
+    void Run()
+    {
+        Canvas canvas(Width, Height), tiledCanvas(Width, Height);
+        Context& context = canvas.context;
+
+        //! small tiles over many workers, so plenty are stolen every frame
+        ThreadPool pool(8);
+        TiledRenderer renderer(pool, 32);
+
+        RefImageResource *image = CreateImage(96, 72, false);
+        image->EnableMipmaps();
+        DisplayList list;
+        Texts texts = { L"no allocation\nper frame", L"turned", Font(L"box", 13) };
+
+        size_t direct = 0, recorded = 0, tiled = 0;
+        for (int frame = 0; frame != WarmFrames + CountedFrames; ++frame)
+        {
+            counting = frame >= WarmFrames;
+
+            context.ResetDamage();
+            DrawFrame(context, image, texts, frame);
+
+            size_t before = allocations;
+            list.Reset();
+            context.BeginRecording(&list);
+            DrawFrame(context, image, texts, frame);
+            context.EndRecording();
+            list.Replay(context);
+            recorded += allocations - before;
+
+            before = allocations;
+            renderer.Render(list, tiledCanvas.surface);
+            tiledCanvas.surface.Flush(renderer.GetDamage());
+            tiled += allocations - before;
+
+            canvas.surface.Flush(context.GetDamage());
+        }
+
+        counting = false;
+        direct = allocations - recorded - tiled;
+
+        if (direct)
+            Fail("%u heap allocations over %d drawn frames", (UINT)direct, CountedFrames);
+        if (recorded)
+            Fail("%u heap allocations over %d recorded and replayed frames", (UINT)recorded, CountedFrames);
+        if (tiled)
+            Fail("%u heap allocations over %d frames through TiledRenderer", (UINT)tiled, CountedFrames);
+
+        image->Release();
+    }
+}
+
+int main()
+{
+    GlyphCache::Instance().SetRasterizer(new BoxRasterizer());
+
+    Run();
+    return Finish();
+}
\ No newline at end of file
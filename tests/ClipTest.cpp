@@ -0,0 +1,162 @@
+//! USE_SOFTWARE: clipped draws against unclipped ones, and a context whose surface is rebound under it
+//! exits non-zero on the first failure
+
+#include "TestSupport.h"
+
+using namespace Render;
+using namespace Test;
+
+namespace
+{
+    const DWORD Background = 0xFF202020;
+    const DWORD Guard = 0x5A5A5A5A;
+
+    void DrawAll(Context& context, Image *opaque, Image *alpha, LONG offset)
+    {
+        POINT at = { offset + 10, offset + 5 };
+        context.DrawImageAt(alpha, at);
+
+        RECT scaled = { offset - 20, offset - 10, 150, 120 };
+        context.DrawScaledImage(opaque, scaled);
+
+        context.SetFont(Font(L"box", 14));
+        context.SetBrush(Brush(Brush::Solid, 0x334455));
+        POINT where = { offset, offset + 30 };
+        context.DrawTextAt(where, L"rebound\ntext");
+
+        AffineMaxtrix rotate;
+        rotate.Translate((float)offset + 40.f, (float)offset + 40.f);
+        rotate.Rotate(33.f);
+        context.Save();
+        context.SetTransform(rotate);
+        context.DrawImage(opaque);
+        context.DrawTextAt(where, L"turned");
+        context.Restore();
+    }
+
+    //! a clip inside the surface: outside it nothing changes, inside it the pixels are the unclipped ones
+    void TestClipMatchesUnclipped(Image *opaque, Image *alpha)
+    {
+        Canvas plain(200, 150, Background), clipped(200, 150, Background);
+
+        RECT keep = { 30, 20, 120, 90 }, hole = { 60, 40, 30, 30 }, extra = { 170, 0, 20, 150 };
+        clipped.context.ClipRect(keep);
+        clipped.context.ExcludeClip(hole);
+        clipped.context.UnionClip(extra);
+
+        DrawAll(plain.context, opaque, alpha, 0);
+        DrawAll(clipped.context, opaque, alpha, 0);
+
+        size_t outside = 0, inside = 0;
+        for (LONG y = 0; y != 150; ++y)
+        {
+            for (LONG x = 0; x != 200; ++x)
+            {
+                DWORD a = plain.pixels[y * 200 + x], b = clipped.pixels[y * 200 + x];
+                if (!clipped.context.GetClip().Contains(x, y))
+                {
+                    outside += Background != b;
+                    continue;
+                }
+
+                inside += a != b;
+            }
+        }
+
+        Expect(0 == outside, "clipped draws stay inside the clip");
+        Expect(0 == inside, "clipped draws match the unclipped ones inside the clip");
+    }
+
+    //! a smaller buffer bound under an attached context, the draws must stay inside it
+    void TestRebindSmaller(Image *opaque, Image *alpha)
+    {
+        std::vector<DWORD> large(200 * 200, Background);
+        RenderSurface surface;
+        Context context;
+
+        surface.Bind((PBYTE)&large[0], 200 * 4, 200, 200, 32);
+        surface.InitContext(context);
+
+        //! the 50 x 50 view sits in a wider buffer, the guard around it shows any write past it
+        const LONG stride = 80;
+        std::vector<DWORD> small(stride * 60, Guard);
+        for (LONG y = 0; y != 50; ++y)
+        {
+            for (LONG x = 0; x != 50; ++x)
+                small[y * stride + x] = Background;
+        }
+
+        surface.Bind((PBYTE)&small[0], stride * 4, 50, 50, 32);
+        DrawAll(context, opaque, alpha, 0);
+
+        size_t touched = 0, drawn = 0;
+        for (LONG y = 0; y != 60; ++y)
+        {
+            for (LONG x = 0; x != stride; ++x)
+            {
+                if (x < 50 && y < 50)
+                    drawn += Background != small[y * stride + x];
+                else
+                    touched += Guard != small[y * stride + x];
+            }
+        }
+
+        RECT bounds = context.GetClip().GetBounds();
+        Expect(0 == touched, "nothing is drawn past a smaller rebound buffer");
+        Expect(drawn > 0, "the smaller rebound buffer is drawn");
+        Expect(50 == bounds.right && 50 == bounds.bottom, "the whole surface clip follows the rebind");
+    }
+
+    //! a larger buffer bound under an attached context is drawn to its far corner
+    void TestRebindLarger(Image *opaque, Image *alpha)
+    {
+        std::vector<DWORD> small(50 * 50, Background), large(300 * 300, Background);
+        RenderSurface surface;
+        Context context;
+
+        surface.Bind((PBYTE)&small[0], 50 * 4, 50, 50, 32);
+        surface.InitContext(context);
+
+        surface.Bind((PBYTE)&large[0], 300 * 4, 300, 300, 32);
+        DrawAll(context, opaque, alpha, 240);
+
+        RECT bounds = context.GetClip().GetBounds();
+        Expect(Background != large[299 * 300 + 299], "a larger rebound buffer is drawn to its corner");
+        Expect(300 == bounds.right && 300 == bounds.bottom, "the whole surface clip grows with the rebind");
+    }
+
+    void TestEmptyClip(Image *opaque, Image *alpha)
+    {
+        Canvas canvas(200, 150, Background);
+
+        RECT nothing = { 0, 0, 0, 0 };
+        canvas.context.ClipRect(nothing);
+        DrawAll(canvas.context, opaque, alpha, 0);
+
+        size_t changed = 0;
+        for (size_t i = 0; i != canvas.pixels.size(); ++i)
+            changed += Background != canvas.pixels[i];
+
+        Expect(0 == changed, "an empty clip draws nothing");
+        Expect(0 == canvas.context.GetDamage().GetCount(), "an empty clip adds no damage");
+    }
+}
+
+int main()
+{
+    GlyphCache::Instance().SetRasterizer(new BoxRasterizer());
+    ::srand(7);
+
+    RefImageResource *opaque = CreateImage(100, 100, true);
+    RefImageResource *alpha = CreateImage(64, 48, false);
+
+    TestClipMatchesUnclipped(opaque, alpha);
+    TestRebindSmaller(opaque, alpha);
+    TestRebindLarger(opaque, alpha);
+    TestEmptyClip(opaque, alpha);
+
+    opaque->Release();
+    alpha->Release();
+
+    return Finish();
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+//! USE_SOFTWARE: sizes kept by ScaledImageCache go with the pixels they were scaled from
+//! exits non-zero on the first failure
+
+#include "TestSupport.h"
+#include "../ScaledImageCache.h"
+
+using namespace Render;
+using namespace Test;
+
+namespace
+{
+    UINT CachedCount()
+    {
+        return ScaledImageCache::Instance().GetStats().count;
+    }
+
+    //! a copy handed out, as AnimationImageSet::GetFrameAt does, is drawn; the original's pixels are freed
+    void TestCopyDrawnOriginalFreed(Context& context)
+    {
+        RefImageResource *image = CreateImage(64, 48, true);
+        Image copy = *image;
+
+        RECT region = { 0, 0, 100, 70 };
+        context.DrawScaledImage(&copy, region);
+        context.DrawScaledImage(&copy, region);
+        Expect(1 == CachedCount(), "a size drawn twice is cached");
+
+        image->Release();
+        Expect(0 == CachedCount(), "freeing the pixels drops the sizes a copy cached");
+    }
+
+    //! the one drawn is written, its sizes go at once
+    void TestDrawnInvalidated(Context& context)
+    {
+        RefImageResource *image = CreateImage(64, 48, true);
+
+        RECT region = { 0, 0, 90, 40 };
+        context.DrawScaledImage(image, region);
+        context.DrawScaledImage(image, region);
+        Expect(1 == CachedCount(), "a size drawn twice is cached");
+
+        image->Invalidate();
+        Expect(0 == CachedCount(), "writing the pixels drops their sizes");
+
+        image->Release();
+    }
+}
+
+int main()
+{
+    Canvas canvas(120, 80);
+
+    TestCopyDrawnOriginalFreed(canvas.context);
+    TestDrawnInvalidated(canvas.context);
+
+    return Finish();
+}
\ No newline at end of file
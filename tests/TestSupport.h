@@ -0,0 +1,119 @@
+#pragma once
+
+//! what the programs under tests/ share, each of them is a single translation unit
+
+#include "../Context.h"
+#include "../Surface.h"
+#include "../Image.h"
+#include "../GlyphCache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <vector>
+
+namespace Test
+{
+    using namespace Render;
+
+    //! boxes of made up coverage, no font files needed
+    class BoxRasterizer : public GlyphRasterizer
+    {
+    public:
+        virtual bool GetLineMetrics(const Font& font, LONG *ascent, LONG *height)
+        {
+            *ascent = font.GetPixelSize();
+            *height = font.GetPixelSize() + 4;
+            return true;
+        }
+
+        virtual UINT MapCharacter(const Font&, WCHAR ch) { return ch; }
+
+        virtual bool Rasterize(const Font& font, UINT glyph, GlyphMetrics *metrics, std::vector<BYTE> *coverage)
+        {
+            LONG size = font.GetPixelSize();
+            GlyphMetrics box = { -2, -size, size / 2 + 3, size + 2, size / 2 };
+            *metrics = box;
+
+            coverage->resize(box.width * box.height);
+            for (size_t i = 0; i != coverage->size(); ++i)
+                (*coverage)[i] = (BYTE)(i * 37 + glyph);
+            return true;
+        }
+    };
+
+    //! the higher bits of rand, its low bits are poor on some platforms
+    inline int Random(int range)
+    {
+        return (::rand() >> 4) % range;
+    }
+
+    //! random premultiplied pixels, one reference the caller's
+    inline RefImageResource *CreateImage(LONG width, LONG height, bool opaque)
+    {
+        SIZE size = { width, height };
+        RefImageResource *image = RefImageResource::Create(size);
+        image->AddRef();
+
+        for (LONG y = 0; y != height; ++y)
+        {
+            for (LONG x = 0; x != width; ++x)
+            {
+                DWORD alpha = opaque ? 255 : (DWORD)Random(256), colour = (DWORD)::rand();
+                DWORD r = ((colour >> 16) & 0xFF) * alpha / 255, g = ((colour >> 8) & 0xFF) * alpha / 255, b = (colour & 0xFF) * alpha / 255;
+                *(DWORD *)image->GetOffset(x, y) = (alpha << 24) | (r << 16) | (g << 8) | b;
+            }
+        }
+
+        image->SetAlphaMode(opaque ? Image::AlphaIgnored : Image::AlphaPremultiplied, opaque);
+        return image;
+    }
+
+    //! packed pixels filled with one colour, a surface bound to them and a context on it
+    struct Canvas
+    {
+        std::vector<DWORD> pixels;
+        RenderSurface surface;
+        Context context;
+
+        Canvas(LONG width, LONG height, DWORD fill = 0) : pixels(width * height, fill)
+        {
+            surface.Bind((PBYTE)&pixels[0], width * 4, width, height, 32);
+            surface.InitContext(context);
+        }
+    };
+
+    inline int& Failures()
+    {
+        static int failures = 0;
+        return failures;
+    }
+
+    inline void Fail(const char *format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        ::fprintf(stderr, "FAILED: ");
+        ::vfprintf(stderr, format, args);
+        ::fprintf(stderr, "\n");
+        va_end(args);
+
+        ++Failures();
+    }
+
+    inline void Expect(bool condition, const char *what)
+    {
+        if (!condition)
+            Fail("%s", what);
+    }
+
+    //! what main returns, non-zero after any failure
+    inline int Finish()
+    {
+        if (Failures())
+            return 1;
+
+        ::printf("ok\n");
+        return 0;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,192 @@
+//! USE_SOFTWARE: random display lists rendered by TiledRenderer at several tile sizes against a single Replay
+//! clips, Save / Restore, transforms, scaled images and text; the pixels must be identical
+//! exits non-zero on the first failure
+
+#include "TestSupport.h"
+#include "../DisplayList.h"
+#include "../TiledRenderer.h"
+#include "../ThreadPool.h"
+
+using namespace Render;
+using namespace Test;
+
+namespace
+{
+    const LONG Width = 333;
+    const LONG Height = 277;
+    const DWORD Background = 0xFF112233;
+    const int Lists = 200;
+    const int DrawsPerList = 30;
+
+    RECT RandomRect(LONG maxSize)
+    {
+        RECT rect = { Random(Width + 40) - 40, Random(Height + 40) - 40, Random(maxSize) + 1, Random(maxSize) + 1 };
+        return rect;
+    }
+
+    POINT RandomPoint()
+    {
+        POINT point = { Random(Width + 60) - 60, Random(Height + 60) - 60 };
+        return point;
+    }
+
+    AffineMaxtrix RandomTransform()
+    {
+        AffineMaxtrix matrix;
+        switch (Random(4))
+        {
+        case 0:
+            matrix.Translate((float)(Random(60) - 30), (float)(Random(60) - 30));
+            break;
+        case 1:
+            matrix.Translate((float)(Random(8000) - 4000) / 100.f, (float)(Random(8000) - 4000) / 100.f);
+            break;
+        case 2:
+            matrix.Translate((float)Random(Width / 2), (float)Random(Height / 2));
+            matrix.Scale(0.3f + (float)Random(300) / 100.f, 0.3f + (float)Random(300) / 100.f);
+            break;
+        default:
+            matrix.Translate((float)Random(Width), (float)Random(Height));
+            matrix.Rotate((float)Random(360));
+            if (Random(2))
+                matrix.Scale(0.5f + (float)Random(150) / 100.f, 0.5f + (float)Random(150) / 100.f);
+            break;
+        }
+        return matrix;
+    }
+
+    void Record(Context& context, const std::vector<RefImageResource *>& images, const std::vector<String>& texts)
+    {
+        int depth = 0;
+        for (int i = 0; i != DrawsPerList; ++i)
+        {
+            Image *image = images[Random((int)images.size())];
+            switch (Random(13))
+            {
+            case 0:
+                context.DrawImageAt(image, RandomPoint());
+                break;
+            case 1:
+                context.DrawScaledImage(image, RandomRect(220), (Pixel::Filter)Random(Pixel::FilterCount));
+                break;
+            case 2:
+            {
+                SIZE size = image->GetSize();
+                RECT part = { Random(size.cx), Random(size.cy), Random(size.cx) + 1, Random(size.cy) + 1 };
+                context.DrawClippedImageAt(image, part, RandomPoint());
+                break;
+            }
+            case 3:
+                context.DrawImage(image);
+                break;
+            case 4:
+                if (depth < 4)
+                {
+                    context.Save();
+                    ++depth;
+                }
+                break;
+            case 5:
+                if (depth > 0)
+                {
+                    context.Restore();
+                    --depth;
+                }
+                break;
+            case 6:
+            {
+                RECT rect = RandomRect(200);
+                switch (Random(4))
+                {
+                case 0: context.ClipRect(rect); break;
+                case 1: context.IntersectClip(rect); break;
+                case 2: context.UnionClip(rect); break;
+                default: context.ExcludeClip(rect); break;
+                }
+                break;
+            }
+            case 7:
+                context.SetTransform(RandomTransform());
+                break;
+            case 8:
+                context.SetTransform(AffineMaxtrix());
+                break;
+            case 9:
+                context.SetOpaque((BYTE)Random(256));
+                break;
+            case 10:
+                context.SetFont(Font(L"box", 8 + Random(20)));
+                context.SetBrush(Brush(Brush::Solid, (COLORREF)::rand()));
+                break;
+            default:
+                context.DrawTextAt(RandomPoint(), texts[Random((int)texts.size())]);
+                break;
+            }
+        }
+
+        while (depth--)
+            context.Restore();
+    }
+}
+
+int main()
+{
+    GlyphCache::Instance().SetRasterizer(new BoxRasterizer());
+    ::srand(9);
+
+    std::vector<RefImageResource *> images;
+    images.push_back(CreateImage(40, 30, true));
+    images.push_back(CreateImage(70, 90, false));
+    images.push_back(CreateImage(300, 200, false));
+    images.push_back(CreateImage(17, 5, false));
+    images[2]->EnableMipmaps();
+
+    std::vector<String> texts;
+    texts.push_back(L"tile");
+    texts.push_back(L"across\nthe tiles");
+    texts.push_back(L"a longer line of text that runs past a tile or two");
+
+    ThreadPool pool(4);
+    const LONG tileSizes[] = { 32, 57, 64, 128 };
+    std::vector<TiledRenderer *> renderers;
+    for (size_t i = 0; i != sizeof(tileSizes) / sizeof(tileSizes[0]); ++i)
+        renderers.push_back(new TiledRenderer(pool, tileSizes[i]));
+
+    Canvas single(Width, Height), tiled(Width, Height);
+    DisplayList list;
+
+    for (int i = 0; i != Lists; ++i)
+    {
+        //! each list starts from a fresh state, as every tile's context does
+        Context context;
+        single.surface.InitContext(context);
+
+        list.Reset();
+        context.BeginRecording(&list);
+        Record(context, images, texts);
+        context.EndRecording();
+
+        single.pixels.assign(single.pixels.size(), Background);
+        list.Replay(context);
+
+        for (size_t r = 0; r != renderers.size(); ++r)
+        {
+            tiled.pixels.assign(tiled.pixels.size(), Background);
+            renderers[r]->Render(list, tiled.surface);
+
+            size_t differ = 0;
+            for (size_t p = 0; p != single.pixels.size(); ++p)
+                differ += single.pixels[p] != tiled.pixels[p];
+
+            if (differ)
+                Fail("list %d, %d pixel tiles: %u pixels differ from a single replay", i, (int)tileSizes[r], (UINT)differ);
+        }
+    }
+
+    for (size_t r = 0; r != renderers.size(); ++r)
+        delete renderers[r];
+    for (size_t i = 0; i != images.size(); ++i)
+        images[i]->Release();
+
+    return Finish();
+}
\ No newline at end of file
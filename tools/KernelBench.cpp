@@ -0,0 +1,145 @@
+//! pixel kernel throughput: KernelBench [width height]
+//! every blend mode, fill, copy and text mask at every cpu level this machine supports, in MPix/s
+//! the default 256 x 256 block stays in cache, a 1920 x 1080 one measures memory bandwidth as well
+
+#include "../PixelKernel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+using namespace Render;
+
+namespace
+{
+    //! long enough for the clock and the cpu's frequency to settle
+    const double MinSeconds = 0.25;
+
+    struct Buffers
+    {
+        INT width;
+        INT height;
+        INT stride;
+        std::vector<DWORD> dst;
+        std::vector<DWORD> src;
+        std::vector<BYTE> mask;
+    };
+
+    //! premultiplied pixels, channels never above alpha, so every blend mode takes its usual path
+    void FillRandom(Buffers& buffers)
+    {
+        ::srand(1);
+        for (size_t i = 0; i != buffers.src.size(); ++i)
+        {
+            DWORD alpha = (DWORD)(::rand() >> 4) & 0xFF;
+            DWORD r = ((DWORD)::rand() & 0xFF) * alpha / 255, g = ((DWORD)::rand() & 0xFF) * alpha / 255, b = ((DWORD)::rand() & 0xFF) * alpha / 255;
+            buffers.src[i] = (alpha << 24) | (r << 16) | (g << 8) | b;
+            buffers.dst[i] = 0xFF000000 | ((DWORD)::rand() << 8) | ((DWORD)::rand() & 0xFF);
+        }
+
+        for (size_t i = 0; i != buffers.mask.size(); ++i)
+            buffers.mask[i] = (BYTE)(::rand() >> 4);
+    }
+
+    enum Operation
+    {
+        OperationFill = Pixel::BlendModeCount,
+        OperationCopy,
+        OperationMask,
+
+        OperationCount
+    };
+
+    const char *GetOperationName(int operation)
+    {
+        static const char *names[OperationCount] = { "const alpha", "pixel alpha", "combined alpha", "premultiplied", "fill", "copy", "text mask" };
+        return names[operation];
+    }
+
+    void Run(Buffers& buffers, int operation)
+    {
+        PBYTE dst = (PBYTE)&buffers.dst[0];
+        const BYTE *src = (const BYTE *)&buffers.src[0];
+
+        switch (operation)
+        {
+        case OperationFill:
+            Pixel::Fill(dst, buffers.stride, buffers.width, buffers.height, 0x80336699);
+            break;
+        case OperationCopy:
+            Pixel::Copy(dst, buffers.stride, src, buffers.stride, buffers.width, buffers.height);
+            break;
+        case OperationMask:
+            Pixel::BlendMask(dst, buffers.stride, &buffers.mask[0], buffers.width, buffers.width, buffers.height, 0x336699, 200);
+            break;
+        default:
+            Pixel::Blend((Pixel::BlendMode)operation, dst, buffers.stride, src, buffers.stride, buffers.width, buffers.height, 200);
+            break;
+        }
+    }
+
+    double Measure(Buffers& buffers, int operation)
+    {
+        typedef std::chrono::steady_clock Clock;
+
+        Run(buffers, operation);
+
+        ULONGLONG pixels = 0;
+        Clock::time_point start = Clock::now();
+        double seconds = 0;
+        do
+        {
+            Run(buffers, operation);
+            pixels += (ULONGLONG)buffers.width * buffers.height;
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (seconds < MinSeconds);
+
+        return (double)pixels / seconds / 1e6;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Buffers buffers;
+    buffers.width = argc > 2 ? ::atoi(argv[1]) : 256;
+    buffers.height = argc > 2 ? ::atoi(argv[2]) : 256;
+    if (buffers.width <= 0 || buffers.height <= 0)
+    {
+        ::fprintf(stderr, "usage: KernelBench [width height]\n");
+        return 2;
+    }
+
+    buffers.stride = buffers.width * 4;
+    buffers.dst.resize((size_t)buffers.width * buffers.height);
+    buffers.src.resize(buffers.dst.size());
+    buffers.mask.resize(buffers.dst.size());
+    FillRandom(buffers);
+
+    std::vector<Pixel::CpuLevel> levels;
+    for (int level = 0; level != Pixel::CpuLevelCount; ++level)
+    {
+        if (Pixel::GetKernels((Pixel::CpuLevel)level))
+            levels.push_back((Pixel::CpuLevel)level);
+    }
+
+    ::printf("%d x %d, MPix/s\n%-16s", buffers.width, buffers.height, "");
+    for (size_t i = 0; i != levels.size(); ++i)
+        ::printf("%10s", Pixel::GetCpuLevelName(levels[i]));
+    ::printf("\n");
+
+    for (int operation = 0; operation != OperationCount; ++operation)
+    {
+        ::printf("%-16s", GetOperationName(operation));
+        for (size_t i = 0; i != levels.size(); ++i)
+        {
+            Pixel::SetCpuLevel(levels[i]);
+            ::printf("%10.0f", Measure(buffers, operation));
+            ::fflush(stdout);
+        }
+        ::printf("\n");
+    }
+
+    Pixel::SetCpuLevel(Pixel::DetectCpuLevel());
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+//! offline packer: PackBundle out.bundle name=image [name=image ...]
+//! decodes every image with the canvas codecs and writes them pre-decoded for AssetBundle::Open
+
+#include "../AssetBundle.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <locale.h>
+
+using namespace Render;
+
+#if defined(_WIN32)
+int wmain(int argc, wchar_t **argv)
+{
+    std::vector<String> args(argv, argv + argc);
+#else
+int main(int argc, char **argv)
+{
+    ::setlocale(LC_ALL, "");
+
+    std::vector<String> args;
+    for (int i = 0; i != argc; ++i)
+    {
+        String arg(::mbstowcs(NULL, argv[i], 0) + 1, L'\0');
+        arg.resize(::mbstowcs(&arg[0], argv[i], arg.size()));
+        args.push_back(arg);
+    }
+#endif
+
+    if (args.size() < 3)
+    {
+        ::fprintf(stderr, "usage: PackBundle out.bundle name=image [name=image ...]\n");
+        return 2;
+    }
+
+    AssetBundleWriter writer;
+    for (size_t i = 2; i != args.size(); ++i)
+    {
+        size_t split = args[i].find(L'=');
+        if (String::npos == split)
+        {
+            ::fprintf(stderr, "expected name=image: %ls\n", args[i].c_str());
+            return 2;
+        }
+
+        if (!writer.Add(args[i].substr(0, split), args[i].substr(split + 1)))
+        {
+            ::fprintf(stderr, "cannot decode %ls\n", args[i].c_str() + split + 1);
+            return 1;
+        }
+    }
+
+    if (!writer.Write(args[1]))
+    {
+        ::fprintf(stderr, "cannot write %ls\n", args[1].c_str());
+        return 1;
+    }
+
+    return 0;
+}
\ No newline at end of file